@@ -4,6 +4,9 @@
 }
 -keepnames class io.requery.android.database.** { *; }
 -keep public class io.requery.android.database.sqlite.SQLiteFunction { *; }
+-keep class io.requery.android.database.sqlite.SQLiteFunction$Invocation { *; }
+-keep class io.requery.android.database.sqlite.SQLiteAggregateFunction { *; }
+-keep class io.requery.android.database.sqlite.SQLiteAggregateFunction$Invocation { *; }
 -keep public class io.requery.android.database.sqlite.SQLiteCustomFunction { *; }
 -keep public class io.requery.android.database.sqlite.SQLiteCursor { *; }
 -keep public class io.requery.android.database.sqlite.SQLiteDebug** { *; }
@@ -11,4 +14,6 @@
 -keep public class io.requery.android.database.sqlite.SQLiteOpenHelper { *; }
 -keep public class io.requery.android.database.sqlite.SQLiteStatement { *; }
 -keep public class io.requery.android.database.CursorWindow { *; }
+-keep public class io.requery.android.database.CursorWindow$BlobReference { *; }
+-keep class io.requery.android.database.sqlite.SQLiteConnection$PreparedStatement { *; }
 -keepattributes Exceptions,InnerClasses
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2007 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// modified from original source see README at the top level of this project
+
+package io.requery.android.database;
+
+import android.content.Context;
+import android.database.sqlite.SQLiteConstraintException;
+import android.database.sqlite.SQLiteException;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+import androidx.test.filters.MediumTest;
+import io.requery.android.database.sqlite.SQLiteCheckpointer;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDatabaseConfiguration;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+import io.requery.android.database.sqlite.SQLiteGroupCommit;
+import io.requery.android.database.sqlite.SQLiteSnapshot;
+
+import java.io.File;
+import java.util.Locale;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+import static org.junit.Assert.fail;
+
+@SuppressWarnings("ResultOfMethodCallIgnored")
+@RunWith(AndroidJUnit4.class)
+public class DatabaseConcurrencyTest {
+
+    private static final int CURRENT_DATABASE_VERSION = 42;
+    private SQLiteDatabase mDatabase;
+    private File mDatabaseFile;
+
+    @Before
+    public void setUp() {
+        File dbDir = ApplicationProvider.getApplicationContext().getDir("tests", Context.MODE_PRIVATE);
+        mDatabaseFile = new File(dbDir, "database_test.db");
+
+        if (mDatabaseFile.exists()) {
+            mDatabaseFile.delete();
+        }
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+        assertNotNull(mDatabase);
+        mDatabase.setVersion(CURRENT_DATABASE_VERSION);
+    }
+
+    @After
+    public void tearDown() {
+        mDatabase.close();
+        mDatabaseFile.delete();
+    }
+
+    @MediumTest
+    @Test
+    public void testGroupCommit() throws Exception {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER UNIQUE, data TEXT);");
+
+        final int threads = 4;
+        final int count = 50;
+        final SQLiteGroupCommit groupCommit = mDatabase.openGroupCommit(16, 1000);
+        try {
+            Thread[] writers = new Thread[threads];
+            final Throwable[] errors = new Throwable[threads];
+            for (int t = 0; t < threads; t++) {
+                final int thread = t;
+                writers[t] = new Thread(new Runnable() {
+                    @Override
+                    public void run() {
+                        try {
+                            for (int i = 0; i < count; i++) {
+                                int num = thread * count + i;
+                                assertTrue(groupCommit.executeInsert(
+                                        "INSERT INTO test VALUES (?, ?);", num, "row" + num) > 0);
+                            }
+                        } catch (Throwable ex) {
+                            errors[thread] = ex;
+                        }
+                    }
+                });
+                writers[t].start();
+            }
+            for (int t = 0; t < threads; t++) {
+                writers[t].join();
+                if (errors[t] != null) {
+                    throw new AssertionError(errors[t]);
+                }
+            }
+
+            // A failing statement is rolled back on its own.
+            try {
+                groupCommit.executeInsert("INSERT INTO test VALUES (?, ?);", 0, "duplicate");
+                fail("expected the unique constraint to fail");
+            } catch (SQLiteConstraintException expected) {
+            }
+            // Only one statement is run, so more are refused.
+            try {
+                groupCommit.executeUpdateDelete("DELETE FROM test; DELETE FROM test;");
+                fail("expected the second statement to be refused");
+            } catch (SQLiteException expected) {
+            }
+            assertEquals(threads * count,
+                    groupCommit.executeUpdateDelete("UPDATE test SET data = upper(data);"));
+
+            SQLiteGroupCommit.Stats stats = groupCommit.getStats();
+            assertEquals(threads * count + 3, stats.operations);
+            assertEquals(2, stats.failedOperations);
+            assertEquals(0, stats.failedBatches);
+            assertTrue(stats.batches <= stats.operations);
+            assertTrue(stats.maxBatchSize <= 16);
+        } finally {
+            groupCommit.close();
+        }
+
+        assertEquals(threads * count,
+                mDatabase.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+        assertEquals("ROW0", mDatabase.compileStatement(
+                "SELECT data FROM test WHERE num = 0;").simpleQueryForString());
+        try {
+            groupCommit.executeInsert("INSERT INTO test VALUES (?, ?);", -1, "closed");
+            fail("expected the group commit to be closed");
+        } catch (IllegalStateException expected) {
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testBackgroundCheckpoint() throws Exception {
+        File file = new File(mDatabaseFile.getParentFile(), "checkpoint_test.db");
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabaseConfiguration configuration = new SQLiteDatabaseConfiguration(
+                file.getPath(), SQLiteDatabase.CREATE_IF_NECESSARY
+                        | SQLiteDatabase.ENABLE_WRITE_AHEAD_LOGGING);
+        configuration.backgroundCheckpoint = true;
+
+        SQLiteDatabase db = SQLiteDatabase.openDatabase(configuration, null, null);
+        try {
+            assertEquals(0, db.getCheckpointStats().checkpoints);
+            db.execSQL("CREATE TABLE test (_id INTEGER PRIMARY KEY, data BLOB);");
+            final int count = SQLiteGlobal.getWALAutoCheckpoint() * 2;
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < count; i++) {
+                    db.execSQL("INSERT INTO test (data) VALUES (randomblob(4000));");
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+            }
+
+            // The commit returns without checkpointing; the checkpointer catches up.
+            SQLiteCheckpointer.Stats stats = db.getCheckpointStats();
+            for (int i = 0; i < 100 && stats.checkpoints == 0; i++) {
+                Thread.sleep(50);
+                stats = db.getCheckpointStats();
+            }
+            assertTrue(stats.checkpoints > 0);
+            assertTrue(stats.maxWalFrames >= SQLiteGlobal.getWALAutoCheckpoint());
+            assertTrue(stats.framesCheckpointed > 0);
+            assertEquals(0, stats.failedCheckpoints);
+            assertEquals(count,
+                    db.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+
+            // The checkpoint connection is closed between checkpoints, so WAL can be disabled.
+            db.disableWriteAheadLogging();
+            assertFalse(db.isWriteAheadLoggingEnabled());
+            assertEquals(SQLiteGlobal.getDefaultJournalMode().toLowerCase(Locale.US),
+                    db.compileStatement("PRAGMA journal_mode;").simpleQueryForString());
+            assertFalse(new File(file.getPath() + "-wal").exists());
+        } finally {
+            db.close();
+            SQLiteDatabase.deleteDatabase(file);
+        }
+
+        // Without the flag, writers checkpoint the WAL themselves.
+        assertNull(mDatabase.getCheckpointStats());
+    }
+
+    @MediumTest
+    @Test
+    public void testSnapshot() throws Exception {
+        assertTrue(mDatabase.enableWriteAheadLogging());
+        mDatabase.execSQL("CREATE TABLE test (_id INTEGER PRIMARY KEY, data TEXT);");
+        for (int i = 0; i < 10; i++) {
+            mDatabase.execSQL("INSERT INTO test (data) VALUES (?);", new Object[] { "row " + i });
+        }
+
+        final SQLiteSnapshot snapshot = mDatabase.getSnapshot();
+        try {
+            mDatabase.execSQL("INSERT INTO test (data) VALUES ('later');");
+            assertEquals(11,
+                    mDatabase.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+
+            // Transactions at the snapshot read the same rows, on any connection.
+            final long[] counts = new long[2];
+            Thread reader = new Thread(new Runnable() {
+                @Override
+                public void run() {
+                    mDatabase.beginTransactionAtSnapshot(snapshot);
+                    try {
+                        counts[1] = mDatabase.compileStatement(
+                                "SELECT count(*) FROM test;").simpleQueryForLong();
+                    } finally {
+                        mDatabase.endTransaction();
+                    }
+                }
+            });
+            reader.start();
+            mDatabase.beginTransactionAtSnapshot(snapshot);
+            try {
+                counts[0] = mDatabase.compileStatement(
+                        "SELECT count(*) FROM test;").simpleQueryForLong();
+            } finally {
+                mDatabase.endTransaction();
+            }
+            reader.join();
+            assertEquals(10, counts[0]);
+            assertEquals(10, counts[1]);
+
+            SQLiteSnapshot latest = mDatabase.getSnapshot();
+            try {
+                assertTrue(snapshot.compareTo(latest) < 0);
+                assertTrue(latest.compareTo(snapshot) > 0);
+            } finally {
+                latest.close();
+            }
+
+            mDatabase.beginTransaction();
+            try {
+                mDatabase.beginTransactionAtSnapshot(snapshot);
+                fail("Expected the nested transaction to be refused");
+            } catch (IllegalStateException e) {
+                // expected
+            } finally {
+                mDatabase.endTransaction();
+            }
+        } finally {
+            snapshot.close();
+        }
+
+        try {
+            mDatabase.beginTransactionAtSnapshot(snapshot);
+            fail("Expected the closed snapshot to be refused");
+        } catch (IllegalStateException e) {
+            // expected
+        }
+        assertFalse(mDatabase.inTransaction());
+    }
+}
@@ -38,6 +38,7 @@ import io.requery.android.database.sqlite.SQLiteCursor;
 import io.requery.android.database.sqlite.SQLiteCursorDriver;
 import io.requery.android.database.sqlite.SQLiteDatabase;
 import io.requery.android.database.sqlite.SQLiteQuery;
+import io.requery.android.database.sqlite.SQLiteStatement;
 
 import java.io.File;
 import java.util.ArrayList;
@@ -507,4 +508,79 @@ public class DatabaseCursorTest {
             c.close();
         }
     }
+
+    @MediumTest
+    @Test
+    public void testLazyBlobs() {
+        mDatabase.setLazyBlobThreshold(1024);
+        mDatabase.execSQL("CREATE TABLE test (_id INTEGER PRIMARY KEY, data BLOB);");
+        byte[] large = new byte[100000];
+        for (int i = 0; i < large.length; i++) {
+            large[i] = (byte) i;
+        }
+        byte[] small = new byte[] {1, 2, 3};
+        SQLiteStatement statement = mDatabase.compileStatement("INSERT INTO test (data) VALUES (?)");
+        statement.bindBlob(1, large);
+        statement.executeInsert();
+        statement.bindBlob(1, small);
+        statement.executeInsert();
+        statement.close();
+
+        Cursor c = mDatabase.rawQuery("SELECT _id, data FROM test ORDER BY _id", null);
+        assertTrue(c.moveToFirst());
+        assertEquals(Cursor.FIELD_TYPE_BLOB, c.getType(1));
+        assertTrue(Arrays.equals(large, c.getBlob(1)));
+        assertTrue(c.moveToNext());
+        assertTrue(Arrays.equals(small, c.getBlob(1)));
+        c.close();
+
+        // Expressions have no table to read from and are copied as before.
+        c = mDatabase.rawQuery("SELECT data || x'00' FROM test ORDER BY _id", null);
+        assertTrue(c.moveToFirst());
+        assertEquals(large.length + 1, c.getBlob(0).length);
+        c.close();
+
+        // A table joined with itself reports the same origin for the columns of both of
+        // its rows, the blob of one row must not be read with the rowid of the other.
+        c = mDatabase.rawQuery("SELECT a.data, b._id FROM test a JOIN test b ON b._id = a._id + 1",
+                null);
+        assertTrue(c.moveToFirst());
+        assertEquals(2, c.getInt(1));
+        assertTrue(Arrays.equals(large, c.getBlob(0)));
+        c.close();
+
+        byte[] other = new byte[large.length];
+        for (int i = 0; i < other.length; i++) {
+            other[i] = (byte) ~i;
+        }
+        mDatabase.execSQL("CREATE TABLE test2 (_id INTEGER PRIMARY KEY, data BLOB);");
+        mDatabase.execSQL("INSERT INTO test2 (data) VALUES (?);", new Object[] { other });
+
+        // Other tables may be joined with the one the blobs are read from.
+        c = mDatabase.rawQuery("SELECT test.data, test._id FROM test2 JOIN test ON test._id = test2._id",
+                null);
+        assertTrue(c.moveToFirst());
+        assertEquals(1, c.getInt(1));
+        assertTrue(Arrays.equals(large, c.getBlob(0)));
+        c.close();
+
+        mDatabase.execSQL("CREATE VIEW test_view AS SELECT _id, data FROM test;");
+        c = mDatabase.rawQuery("SELECT data, _id FROM test_view ORDER BY _id", null);
+        assertTrue(c.moveToFirst());
+        assertTrue(Arrays.equals(large, c.getBlob(0)));
+        assertTrue(c.moveToNext());
+        assertTrue(Arrays.equals(small, c.getBlob(0)));
+        c.close();
+
+        // Rows of a view over a compound SELECT come from several tables, although SQLite
+        // reports the first one as their origin.
+        mDatabase.execSQL("CREATE VIEW both_tests AS SELECT _id, data, 1 AS source FROM test "
+                + "UNION ALL SELECT _id, data, 2 FROM test2;");
+        c = mDatabase.rawQuery("SELECT _id, data, source FROM both_tests WHERE _id = 1", null);
+        assertEquals(2, c.getCount());
+        while (c.moveToNext()) {
+            assertTrue(Arrays.equals(c.getInt(2) == 1 ? large : other, c.getBlob(1)));
+        }
+        c.close();
+    }
 }
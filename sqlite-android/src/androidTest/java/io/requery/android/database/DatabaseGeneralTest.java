@@ -47,11 +47,13 @@ import androidx.test.filters.MediumTest;
 import androidx.test.filters.SmallTest;
 import androidx.test.filters.Suppress;
 import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteFunction;
 import io.requery.android.database.sqlite.SQLiteStatement;
 
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
 import static org.junit.Assert.assertSame;
 import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
@@ -133,6 +135,293 @@ public class DatabaseGeneralTest {
         assertSame(3, result);
     }
 
+    @MediumTest
+    @Test
+    public void testNewFunctionTypedArgs() {
+        mDatabase.addFunction("describe", -1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                StringBuilder sb = new StringBuilder();
+                for (int i = 0; i < 10; i++) {
+                    switch (args.getType(i)) {
+                        case Cursor.FIELD_TYPE_NULL:
+                            assertNull(args.getString(i));
+                            sb.append('N');
+                            break;
+                        case Cursor.FIELD_TYPE_INTEGER:
+                            sb.append('I').append(args.getLong(i));
+                            break;
+                        case Cursor.FIELD_TYPE_FLOAT:
+                            sb.append('F').append(args.getDouble(i));
+                            break;
+                        case Cursor.FIELD_TYPE_STRING:
+                            sb.append('S').append(args.getString(i));
+                            break;
+                        case Cursor.FIELD_TYPE_BLOB:
+                            sb.append('B').append(args.getBlob(i).length);
+                            break;
+                    }
+                }
+                result.set(sb.toString());
+            }
+        });
+        mDatabase.addFunction("twice", 1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                if (args.getType(0) == Cursor.FIELD_TYPE_FLOAT) {
+                    result.set(args.getDouble(0) * 2);
+                } else {
+                    result.set(args.getLong(0) * 2);
+                }
+            }
+        });
+
+        // More arguments than are preallocated for variadic functions.
+        Cursor cursor = mDatabase.rawQuery("SELECT describe(NULL, 1, 2.5, 'a', x'0102', "
+            + "9223372036854775807, -1, NULL, '\ud83d\ude00', 0)", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals("NI1F2.5SaB2I9223372036854775807I-1NS\ud83d\ude00I0",
+            cursor.getString(0));
+        cursor.close();
+
+        cursor = mDatabase.rawQuery("SELECT twice(21), twice(1.25), twice('4')", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals(Cursor.FIELD_TYPE_INTEGER, cursor.getType(0));
+        assertEquals(42, cursor.getLong(0));
+        assertEquals(Cursor.FIELD_TYPE_FLOAT, cursor.getType(1));
+        assertEquals(2.5, cursor.getDouble(1), 0);
+        assertEquals(8, cursor.getLong(2));
+        cursor.close();
+    }
+
+    @MediumTest
+    @Test
+    public void testMemoizedFunction() {
+        final int[] calls = new int[1];
+        mDatabase.addFunction("label", 1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                calls[0]++;
+                if (args.getType(0) == Cursor.FIELD_TYPE_NULL) {
+                    result.setNull();
+                } else {
+                    result.set("item " + args.getLong(0));
+                }
+            }
+        }, SQLiteDatabase.Function.FLAG_DETERMINISTIC, 64 * 1024);
+
+        mDatabase.execSQL("CREATE TABLE t (a INTEGER);");
+        for (int i = 0; i < 100; i++) {
+            mDatabase.execSQL("INSERT INTO t VALUES (?)", new Object[] {
+                i % 3 == 0 ? null : i % 3
+            });
+        }
+
+        Cursor cursor = mDatabase.rawQuery("SELECT a, label(a) FROM t", null);
+        assertEquals(100, cursor.getCount());
+        while (cursor.moveToNext()) {
+            if (cursor.isNull(0)) {
+                assertTrue(cursor.isNull(1));
+            } else {
+                assertEquals("item " + cursor.getLong(0), cursor.getString(1));
+            }
+        }
+        cursor.close();
+
+        assertEquals(3, calls[0]);
+        SQLiteFunction.CacheStats stats = mDatabase.getFunctionCacheStats("label");
+        assertNotNull(stats);
+        assertEquals(3, stats.misses);
+        assertEquals(97, stats.hits);
+        assertEquals(0, stats.evictions);
+        assertTrue(stats.size > 0);
+        assertNull(mDatabase.getFunctionCacheStats("missing"));
+
+        try {
+            mDatabase.addFunction("random_label", 1, new SQLiteDatabase.Function() {
+                @Override
+                public void callback(Args args, Result result) {
+                    result.set(Math.random());
+                }
+            }, 0, 1024);
+            fail("Expected IllegalArgumentException for a non-deterministic function");
+        } catch (IllegalArgumentException expected) {
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testNativeFunctions() {
+        try {
+            mDatabase.addNativeFunctions("no_such_group");
+            fail("Expected IllegalArgumentException for an unknown group");
+        } catch (IllegalArgumentException expected) {
+        }
+
+        mDatabase.addNativeFunctions(SQLiteDatabase.NATIVE_FUNCTIONS_REGEXP,
+            SQLiteDatabase.NATIVE_FUNCTIONS_UNICODE, SQLiteDatabase.NATIVE_FUNCTIONS_UNACCENT,
+            SQLiteDatabase.NATIVE_FUNCTIONS_HAVERSINE, SQLiteDatabase.NATIVE_FUNCTIONS_BITOPS);
+
+        Cursor cursor = mDatabase.rawQuery("SELECT 'hello world' REGEXP 'wor.d', "
+            + "'hello' REGEXP '^w', unicode_lower('\u00c9T\u00c9 \u0416'), "
+            + "unicode_upper('stra\u00dfe'), unicode_casefold('Stra\u00dfe'), "
+            + "unaccent('Cr\u00e8me Br\u00fbl\u00e9e'), "
+            + "round(haversine(52.52, 13.405, 48.8566, 2.3522) / 1000), "
+            + "hex(bit_and(x'F0F0', x'FF')), hex(bit_xor(x'FF', x'0F')), "
+            + "hex(bit_not(x'00FF')), bit_count(x'FF01'), unaccent(NULL)", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals(1, cursor.getInt(0));
+        assertEquals(0, cursor.getInt(1));
+        assertEquals("\u00e9t\u00e9 \u0436", cursor.getString(2));
+        assertEquals("STRASSE", cursor.getString(3));
+        assertEquals("strasse", cursor.getString(4));
+        assertEquals("Creme Brulee", cursor.getString(5));
+        assertEquals(877, cursor.getLong(6));
+        assertEquals("F000", cursor.getString(7));
+        assertEquals("F0", cursor.getString(8));
+        assertEquals("FF00", cursor.getString(9));
+        assertEquals(9, cursor.getInt(10));
+        assertTrue(cursor.isNull(11));
+        cursor.close();
+
+        cursor = mDatabase.rawQuery("SELECT 'x' REGEXP 'a('", null);
+        try {
+            cursor.moveToFirst();
+            fail("Expected an error for an invalid pattern");
+        } catch (SQLiteException expected) {
+        } finally {
+            cursor.close();
+        }
+    }
+
+    private static class SumAggregate implements SQLiteDatabase.WindowFunction.WindowAggregate {
+        long sum;
+        int rows;
+
+        @Override
+        public void step(SQLiteDatabase.AggregateFunction.Rows rows) {
+            while (rows.moveToNext()) {
+                sum += rows.getLong(0);
+                this.rows++;
+            }
+        }
+
+        @Override
+        public void inverse(SQLiteDatabase.AggregateFunction.Rows rows) {
+            while (rows.moveToNext()) {
+                sum -= rows.getLong(0);
+                this.rows--;
+            }
+        }
+
+        @Override
+        public void value(SQLiteDatabase.Function.Result result) {
+            result.set(sum);
+        }
+
+        @Override
+        public void finish(SQLiteDatabase.Function.Result result) {
+            if (rows == 0) {
+                result.setNull();
+            } else {
+                result.set(sum);
+            }
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testAggregateFunction() {
+        mDatabase.addAggregateFunction("java_sum", 1, new SQLiteDatabase.AggregateFunction() {
+            @Override
+            public Aggregate newAggregate() {
+                return new SumAggregate();
+            }
+        });
+        mDatabase.addAggregateFunction("java_concat", 1, new SQLiteDatabase.AggregateFunction() {
+            @Override
+            public Aggregate newAggregate() {
+                return new Aggregate() {
+                    final StringBuilder sb = new StringBuilder();
+
+                    @Override
+                    public void step(Rows rows) {
+                        while (rows.moveToNext()) {
+                            sb.append(rows.getString(0));
+                        }
+                    }
+
+                    @Override
+                    public void finish(SQLiteDatabase.Function.Result result) {
+                        result.set(sb.toString());
+                    }
+                };
+            }
+        });
+        mDatabase.execSQL("CREATE TABLE test (grp INTEGER, num INTEGER, name TEXT);");
+        mDatabase.beginTransaction();
+        try {
+            // Enough rows for several batches.
+            for (int i = 0; i < 1000; i++) {
+                mDatabase.execSQL("INSERT INTO test VALUES (?, ?, ?)",
+                    new Object[] {i % 2, i, i < 3 ? "n" + i : null});
+            }
+            mDatabase.setTransactionSuccessful();
+        } finally {
+            mDatabase.endTransaction();
+        }
+
+        Cursor cursor = mDatabase.rawQuery("SELECT java_sum(num), sum(num), java_concat(name) "
+            + "FROM test", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals(cursor.getLong(1), cursor.getLong(0));
+        assertEquals("n0n1n2", cursor.getString(2));
+        cursor.close();
+
+        cursor = mDatabase.rawQuery("SELECT grp, java_sum(num), sum(num) FROM test "
+            + "GROUP BY grp ORDER BY grp", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals(cursor.getLong(2), cursor.getLong(1));
+        assertTrue(cursor.moveToNext());
+        assertEquals(cursor.getLong(2), cursor.getLong(1));
+        cursor.close();
+
+        // The aggregate of no rows still produces a value.
+        cursor = mDatabase.rawQuery("SELECT java_sum(num) FROM test WHERE num < 0", null);
+        assertTrue(cursor.moveToFirst());
+        assertTrue(cursor.isNull(0));
+        cursor.close();
+    }
+
+    @MediumTest
+    @Test
+    public void testWindowFunction() {
+        mDatabase.addWindowFunction("java_sum", 1, new SQLiteDatabase.WindowFunction() {
+            @Override
+            public WindowAggregate newAggregate() {
+                return new SumAggregate();
+            }
+        });
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER);");
+        for (int i = 1; i <= 5; i++) {
+            mDatabase.execSQL("INSERT INTO test VALUES (?)", new Object[] {i});
+        }
+
+        Cursor cursor = mDatabase.rawQuery("SELECT java_sum(num) OVER "
+            + "(ORDER BY num ROWS BETWEEN 1 PRECEDING AND CURRENT ROW) FROM test", null);
+        long[] expected = {1, 3, 5, 7, 9};
+        for (long value : expected) {
+            assertTrue(cursor.moveToNext());
+            assertEquals(value, cursor.getLong(0));
+        }
+        cursor.close();
+
+        cursor = mDatabase.rawQuery("SELECT java_sum(num) FROM test", null);
+        assertTrue(cursor.moveToFirst());
+        assertEquals(15, cursor.getLong(0));
+        cursor.close();
+    }
+
     @MediumTest
     @Test
     public void testCustomFunctionNoReturn() {
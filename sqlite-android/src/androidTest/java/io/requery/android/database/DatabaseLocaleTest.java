@@ -23,7 +23,6 @@ import android.util.Log;
 import androidx.test.ext.junit.runners.AndroidJUnit4;
 import androidx.test.filters.MediumTest;
 import androidx.test.filters.SmallTest;
-import androidx.test.filters.Suppress;
 import io.requery.android.database.sqlite.SQLiteDatabase;
 
 import org.junit.After;
@@ -95,7 +94,6 @@ public class DatabaseLocaleTest {
         assertEquals(STRINGS, results);
     }
 
-    @Suppress // not supporting localized collators
     @MediumTest
     @Test
     public void testLocaleenUS() {
@@ -105,20 +103,58 @@ public class DatabaseLocaleTest {
         String[] results;
         results = query("SELECT data FROM test ORDER BY data COLLATE LOCALIZED ASC");
 
-        // The database code currently uses PRIMARY collation strength,
-        // meaning that all versions of a character compare equal (regardless
-        // of case or accents), leaving the "cote" flavors in database order.
+        // Letters compare by their base letter first, then by accents and then by case.
         assertEquals(results, new String[] {
                 STRINGS[4],  // "boy"
-                STRINGS[0],  // sundry forms of "cote"
-                STRINGS[1],
-                STRINGS[2],
-                STRINGS[3],
+                STRINGS[1],  // "cote"
                 STRINGS[6],  // "COTE"
+                STRINGS[3],  // "cot\u00e9"
+                STRINGS[2],  // "c\u00f4te"
+                STRINGS[0],  // "c\u00f4t\u00e9"
                 STRINGS[5],  // "dog"
         });
     }
 
+    @MediumTest
+    @Test
+    public void testLocalesvSE() {
+        String[] strings = {
+            "\u00f6l", "zebra", "\u00c4rlig", "apa", "\u00e5ka", "ost", "Bo",
+        };
+        for (String s : strings) {
+            mDatabase.execSQL("INSERT INTO test (data) VALUES('" + s + "');");
+        }
+        mDatabase.setLocale(new Locale("sv", "SE"));
+        String[] results = query("SELECT data FROM test ORDER BY data COLLATE LOCALIZED ASC");
+
+        // In Swedish the letters \u00e5, \u00e4 and \u00f6 sort after z.
+        assertEquals(results, new String[] {
+                strings[3],  // "apa"
+                strings[6],  // "Bo"
+                strings[5],  // "ost"
+                strings[1],  // "zebra"
+                strings[4],  // "\u00e5ka"
+                strings[2],  // "\u00c4rlig"
+                strings[0],  // "\u00f6l"
+        });
+    }
+
+    @MediumTest
+    @Test
+    public void testLocaleStoresCollationVersion() {
+        mDatabase.setLocale(new Locale("en", "US"));
+        Cursor c = mDatabase.rawQuery(
+                "SELECT locale, collation_version FROM android_metadata", null);
+        try {
+            assertTrue(c.moveToFirst());
+            assertEquals("en_US", c.getString(0));
+            assertTrue(c.getInt(1) > 0);
+            assertEquals(1, c.getCount());
+        } finally {
+            c.close();
+        }
+    }
+
     @SmallTest
     @Test
     public void testHoge() throws Exception {
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2007 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// modified from original source see README at the top level of this project
+
+package io.requery.android.database;
+
+import android.content.ComponentCallbacks2;
+import android.content.Context;
+import android.database.sqlite.SQLiteOutOfMemoryException;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+import androidx.test.filters.MediumTest;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+
+import java.io.File;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertTrue;
+import static org.junit.Assert.fail;
+
+@SuppressWarnings("ResultOfMethodCallIgnored")
+@RunWith(AndroidJUnit4.class)
+public class DatabaseMemoryTest {
+
+    private static final int CURRENT_DATABASE_VERSION = 42;
+    private SQLiteDatabase mDatabase;
+    private File mDatabaseFile;
+
+    @Before
+    public void setUp() {
+        File dbDir = ApplicationProvider.getApplicationContext().getDir("tests", Context.MODE_PRIVATE);
+        mDatabaseFile = new File(dbDir, "database_test.db");
+
+        if (mDatabaseFile.exists()) {
+            mDatabaseFile.delete();
+        }
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+        assertNotNull(mDatabase);
+        mDatabase.setVersion(CURRENT_DATABASE_VERSION);
+    }
+
+    @After
+    public void tearDown() {
+        mDatabase.close();
+        mDatabaseFile.delete();
+    }
+
+    @MediumTest
+    @Test
+    public void testLookasideStats() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER);");
+        for (int i = 0; i < 10; i++) {
+            mDatabase.execSQL("INSERT INTO test (num) VALUES (" + i + ");");
+        }
+        SQLiteDebug.DbStats stats = getMainDbStats();
+        assertTrue(stats.lookasideHits > 0);
+        assertTrue(stats.lookasideMissesSize >= 0);
+        assertTrue(stats.lookasideMissesFull >= 0);
+
+        // The memory can no longer be configured once a database is open.
+        try {
+            SQLiteGlobal.configureMemory(4096, 64, -1, -1);
+            fail("expected IllegalStateException");
+        } catch (IllegalStateException expected) {
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testPoolAllocator() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, str TEXT);");
+        long pooledBefore = sum(SQLiteDebug.getAllocatorStats().sizeClassAllocations);
+        SQLiteGlobal.setPoolAllocatorEnabled(true);
+        try {
+            for (int i = 0; i < 10; i++) {
+                mDatabase.execSQL("INSERT INTO test (num, str) VALUES (?, ?);",
+                        new Object[] { i, "row " + i });
+            }
+        } finally {
+            SQLiteGlobal.setPoolAllocatorEnabled(false);
+        }
+        SQLiteDebug.AllocatorStats stats = SQLiteDebug.getAllocatorStats();
+        assertTrue(sum(stats.sizeClassAllocations) > pooledBefore);
+        assertTrue(stats.bytesInUse > 0);
+        assertTrue(stats.highWater >= stats.bytesInUse);
+    }
+
+    @MediumTest
+    @Test
+    public void testMemoryPolicy() {
+        SQLiteGlobal.setMemoryPolicy(4 * 1024 * 1024, 0, 1000, 100);
+        try {
+            SQLiteDebug.MemoryGovernorStats stats = SQLiteDebug.getMemoryGovernorStats();
+            assertEquals(4 * 1024 * 1024, stats.policySoftHeapLimit);
+            assertEquals(1000, stats.policyMaxCacheSizeKiB);
+            assertEquals(100, stats.policyMinCacheSizeKiB);
+            assertTrue(stats.softHeapLimit <= stats.policySoftHeapLimit);
+
+            // Idle connections adopt the cache size of the current pressure.
+            assertTrue(SQLiteDatabase.onTrimMemory(ComponentCallbacks2.TRIM_MEMORY_UI_HIDDEN) >= 0);
+            stats = SQLiteDebug.getMemoryGovernorStats();
+            assertEquals(-stats.cacheSizeKiB,
+                    mDatabase.compileStatement("PRAGMA cache_size").simpleQueryForLong());
+        } finally {
+            SQLiteGlobal.setMemoryPolicy(8 * 1024 * 1024, 0, 2000, 128);
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testHardHeapLimit() {
+        // The result is a string of 20 MB, well past the hard heap limit.
+        String sql = "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c "
+                + "WHERE i < 20000) SELECT length(group_concat(hex(randomblob(500)))) FROM c";
+        long bytesInUse = SQLiteDebug.getMemoryGovernorStats().bytesInUse;
+        SQLiteGlobal.setMemoryPolicy(8 * 1024 * 1024, bytesInUse + 1024 * 1024, 2000, 128);
+        try {
+            mDatabase.compileStatement(sql).simpleQueryForLong();
+            fail("expected SQLiteOutOfMemoryException");
+        } catch (SQLiteOutOfMemoryException expected) {
+        } finally {
+            SQLiteGlobal.setMemoryPolicy(8 * 1024 * 1024, 0, 2000, 128);
+        }
+        assertEquals(20000 * 1000 + 19999, mDatabase.compileStatement(sql).simpleQueryForLong());
+    }
+
+    private static long sum(long[] values) {
+        long sum = 0;
+        for (long value : values) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    private SQLiteDebug.DbStats getMainDbStats() {
+        for (SQLiteDebug.DbStats stats : SQLiteDebug.getDatabaseInfo().dbStats) {
+            if (stats.dbName.equals(mDatabaseFile.getPath())) {
+                return stats;
+            }
+        }
+        throw new AssertionError("no stats for " + mDatabaseFile);
+    }
+}
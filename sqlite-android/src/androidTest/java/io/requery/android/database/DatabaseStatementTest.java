@@ -21,6 +21,7 @@ import android.content.Context;
 import android.database.Cursor;
 import android.database.sqlite.SQLiteConstraintException;
 import android.database.sqlite.SQLiteDoneException;
+import android.database.sqlite.SQLiteException;
 
 import org.junit.After;
 import org.junit.Before;
@@ -30,10 +31,14 @@ import org.junit.runner.RunWith;
 import androidx.test.core.app.ApplicationProvider;
 import androidx.test.ext.junit.runners.AndroidJUnit4;
 import androidx.test.filters.MediumTest;
+import io.requery.android.database.sqlite.SQLiteBlob;
 import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDebug;
 import io.requery.android.database.sqlite.SQLiteStatement;
 
 import java.io.File;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
 
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertNotNull;
@@ -335,4 +340,107 @@ public class DatabaseStatementTest {
         assertEquals(1, num);
         c.close();
     }
+
+    @MediumTest
+    @Test
+    public void testStatementBufferBinding() {
+        mDatabase.execSQL("CREATE TABLE test (data BLOB);");
+        SQLiteStatement statement = mDatabase.compileStatement("INSERT INTO test (data) VALUES (?)");
+
+        ByteBuffer direct = ByteBuffer.allocateDirect(4);
+        direct.put(new byte[] {1, 2, 3, 4}).flip();
+        direct.position(1);
+        statement.bindBlob(1, direct);
+        statement.execute();
+
+        statement.bindBlob(1, ByteBuffer.wrap(new byte[] {5, 6}));
+        statement.execute();
+        statement.close();
+
+        Cursor c = mDatabase.rawQuery("SELECT data FROM test ORDER BY rowid", null);
+        assertTrue(c.moveToFirst());
+        assertTrue(Arrays.equals(new byte[] {2, 3, 4}, c.getBlob(0)));
+        assertTrue(c.moveToNext());
+        assertTrue(Arrays.equals(new byte[] {5, 6}, c.getBlob(0)));
+        c.close();
+    }
+
+    @MediumTest
+    @Test
+    public void testIncrementalBlobIO() {
+        mDatabase.execSQL("CREATE TABLE test (_id INTEGER PRIMARY KEY, data BLOB);");
+        SQLiteStatement statement = mDatabase.compileStatement("INSERT INTO test (data) VALUES (?)");
+        statement.bindZeroBlob(1, 1024);
+        long rowId = statement.executeInsert();
+        statement.close();
+
+        SQLiteBlob blob = mDatabase.openBlob("test", "data", rowId, true);
+        try {
+            assertEquals(1024, blob.getLength());
+            ByteBuffer buffer = ByteBuffer.allocateDirect(16);
+            for (int i = 0; i < 16; i++) {
+                buffer.put((byte) i);
+            }
+            buffer.flip();
+            blob.write(buffer, 1000);
+            assertEquals(0, buffer.remaining());
+
+            buffer.clear();
+            blob.read(buffer, 1000);
+            for (int i = 0; i < 16; i++) {
+                assertEquals(i, buffer.get(i));
+            }
+
+            try {
+                blob.write(ByteBuffer.allocateDirect(32), 1000);
+                fail("expected exception not thrown");
+            } catch (SQLiteException e) {
+                // expected, blobs can't grow
+            }
+        } finally {
+            blob.close();
+        }
+
+        Cursor c = mDatabase.rawQuery("SELECT data FROM test", null);
+        assertTrue(c.moveToFirst());
+        byte[] data = c.getBlob(0);
+        c.close();
+        assertEquals(1024, data.length);
+        assertEquals(15, data[1015]);
+    }
+
+    @MediumTest
+    @Test
+    public void testStatementCache() {
+        mDatabase.setMaxSqlCacheSize(2);
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER);");
+        for (int i = 0; i < 10; i++) {
+            SQLiteStatement statement =
+                mDatabase.compileStatement("SELECT count(*) FROM test WHERE num = ?");
+            statement.bindLong(1, i);
+            assertEquals(0, statement.simpleQueryForLong());
+            statement.close();
+        }
+        SQLiteDebug.DbStats stats = getMainDbStats();
+        String[] cache = stats.cache.split("/");
+        assertTrue(Integer.parseInt(cache[0]) >= 9);
+        assertTrue(Integer.parseInt(cache[2]) <= 2);
+
+        // Statements used once are evicted before the one used repeatedly.
+        mDatabase.compileStatement("SELECT max(num) FROM test").close();
+        mDatabase.compileStatement("SELECT min(num) FROM test").close();
+        mDatabase.compileStatement("SELECT sum(num) FROM test").close();
+        stats = getMainDbStats();
+        assertTrue(stats.cacheEvictions > 0);
+        assertTrue(Integer.parseInt(stats.cache.split("/")[2]) <= 2);
+    }
+
+    private SQLiteDebug.DbStats getMainDbStats() {
+        for (SQLiteDebug.DbStats stats : SQLiteDebug.getDatabaseInfo().dbStats) {
+            if (stats.dbName.equals(mDatabaseFile.getPath())) {
+                return stats;
+            }
+        }
+        throw new AssertionError("no stats for " + mDatabaseFile);
+    }
 }
@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2007 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// modified from original source see README at the top level of this project
+
+package io.requery.android.database;
+
+import android.content.Context;
+import android.database.sqlite.SQLiteException;
+import android.database.sqlite.SQLiteReadOnlyDatabaseException;
+import android.os.ParcelFileDescriptor;
+
+import org.junit.After;
+import org.junit.Assume;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import androidx.core.os.CancellationSignal;
+import androidx.core.os.OperationCanceledException;
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+import androidx.test.filters.MediumTest;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDatabaseConfiguration;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.nio.ByteBuffer;
+import java.util.zip.CRC32;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertTrue;
+import static org.junit.Assert.fail;
+
+@SuppressWarnings("ResultOfMethodCallIgnored")
+@RunWith(AndroidJUnit4.class)
+public class DatabaseStorageTest {
+
+    private static final String sString3 = "this string is a little longer, but still a test";
+
+    private static final int CURRENT_DATABASE_VERSION = 42;
+    private SQLiteDatabase mDatabase;
+    private File mDatabaseFile;
+
+    @Before
+    public void setUp() {
+        File dbDir = ApplicationProvider.getApplicationContext().getDir("tests", Context.MODE_PRIVATE);
+        mDatabaseFile = new File(dbDir, "database_test.db");
+
+        if (mDatabaseFile.exists()) {
+            mDatabaseFile.delete();
+        }
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+        assertNotNull(mDatabase);
+        mDatabase.setVersion(CURRENT_DATABASE_VERSION);
+    }
+
+    @After
+    public void tearDown() {
+        mDatabase.close();
+        mDatabaseFile.delete();
+    }
+
+    @MediumTest
+    @Test
+    public void testMmapSize() {
+        mDatabase.execSQL("CREATE TABLE test (data TEXT);");
+        mDatabase.beginTransaction();
+        try {
+            for (int i = 0; i < 1000; i++) {
+                mDatabase.execSQL("INSERT INTO test (data) VALUES (hex(randomblob(100)));");
+            }
+            mDatabase.setTransactionSuccessful();
+        } finally {
+            mDatabase.endTransaction();
+        }
+
+        mDatabase.setMmapSize(1024 * 1024);
+        assertEquals(1024 * 1024,
+                mDatabase.compileStatement("PRAGMA mmap_size").simpleQueryForLong());
+        long mappedReads = SQLiteDebug.getMmapStats().mappedReads;
+        assertEquals(1000,
+                mDatabase.compileStatement("SELECT count(*) FROM test").simpleQueryForLong());
+        SQLiteDebug.MmapStats stats = SQLiteDebug.getMmapStats();
+        assertTrue(stats.mappedReads > mappedReads);
+        assertTrue(stats.reserved >= 1024 * 1024);
+
+        // A connection is granted no more than the budget leaves.
+        SQLiteGlobal.setMmapBudget(stats.reserved - 1024 * 1024 + 4096);
+        try {
+            mDatabase.setMmapSize(2 * 1024 * 1024);
+            assertEquals(4096,
+                    mDatabase.compileStatement("PRAGMA mmap_size").simpleQueryForLong());
+        } finally {
+            SQLiteGlobal.setMmapBudget(stats.budget);
+        }
+
+        mDatabase.setMmapSize(0);
+        assertEquals(0, mDatabase.compileStatement("PRAGMA mmap_size").simpleQueryForLong());
+    }
+
+    @MediumTest
+    @Test
+    public void testIoStats() {
+        SQLiteGlobal.setIoStatsEnabled(true);
+        try {
+            SQLiteDebug.resetIoStats();
+            mDatabase.execSQL("CREATE TABLE test (data TEXT);");
+            for (int i = 0; i < 10; i++) {
+                mDatabase.execSQL("INSERT INTO test (data) VALUES (hex(randomblob(100)));");
+            }
+
+            // The path is resolved by SQLite, which may follow symbolic links.
+            SQLiteDebug.IoStats stats = null;
+            for (SQLiteDebug.IoStats s : SQLiteDebug.getIoStats()) {
+                if (s.path.endsWith("/" + mDatabaseFile.getName())) {
+                    stats = s;
+                }
+            }
+            assertNotNull(stats);
+            assertTrue(stats.database.writes > 0);
+            assertTrue(stats.database.bytesWritten > 0);
+            assertTrue(stats.database.locks > 0);
+            assertTrue(stats.journal.writes > 0);
+            assertTrue(stats.database.syncs + stats.journal.syncs > 0);
+            assertEquals(stats.database.writes, sum(stats.database.writeLatency));
+            assertEquals(stats.journal.syncs, sum(stats.journal.syncLatency));
+        } finally {
+            SQLiteGlobal.setIoStatsEnabled(false);
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testReadahead() throws Exception {
+        insertRows(mDatabase, 2000);
+        String sql = "SELECT sum(length(data)) FROM test;";
+
+        try {
+            SQLiteGlobal.setReadaheadSize(0);
+            mDatabase.close();
+            mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+            long expected = mDatabase.compileStatement(sql).simpleQueryForLong();
+
+            SQLiteGlobal.setReadaheadSize(64 * 1024);
+            mDatabase.close();
+            mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+            long batchedReads = SQLiteDebug.getReadaheadStats().batchedReads;
+            assertEquals(expected, mDatabase.compileStatement(sql).simpleQueryForLong());
+            assertTrue(SQLiteDebug.getReadaheadStats().batchedReads > batchedReads);
+
+            // Pages read ahead are not served once the database has changed.
+            mDatabase.execSQL("UPDATE test SET data = data || 'x';");
+            assertEquals(expected + 2000, mDatabase.compileStatement(sql).simpleQueryForLong());
+        } finally {
+            SQLiteGlobal.setReadaheadSize(128 * 1024);
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testIoUring() {
+        insertRows(mDatabase, 2000);
+        String sumSql = "SELECT sum(length(data)) FROM test;";
+        String rowSql = "SELECT data FROM test WHERE _id = 1500;";
+        long expectedSum = mDatabase.compileStatement(sumSql).simpleQueryForLong();
+        String expectedRow = mDatabase.compileStatement(rowSql).simpleQueryForString();
+
+        try {
+            Assume.assumeTrue(SQLiteGlobal.setIoUringEnabled(true));
+
+            // Only files opened while io_uring is enabled read through it.
+            mDatabase.close();
+            mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFile.getPath(), null);
+            long ringReads = SQLiteDebug.getIoUringStats().ringReads;
+            assertEquals(expectedSum, mDatabase.compileStatement(sumSql).simpleQueryForLong());
+            assertEquals(expectedRow, mDatabase.compileStatement(rowSql).simpleQueryForString());
+            SQLiteDebug.IoUringStats stats = SQLiteDebug.getIoUringStats();
+            assertTrue(stats.enabled);
+            assertTrue(stats.ringReads > ringReads);
+        } finally {
+            SQLiteGlobal.setIoUringEnabled(false);
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testCompressedVfs() throws Exception {
+        File file = new File(mDatabaseFile.getParentFile(), "compressed_test.db");
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabaseConfiguration configuration = new SQLiteDatabaseConfiguration(
+                file.getPath(), SQLiteDatabase.CREATE_IF_NECESSARY);
+        configuration.vfsName = SQLiteDatabase.VFS_COMPRESSED;
+
+        final int count = 1000;
+        SQLiteDatabase db = SQLiteDatabase.openDatabase(configuration, null, null);
+        try {
+            insertRows(db, count);
+        } finally {
+            db.close();
+        }
+
+        db = SQLiteDatabase.openDatabase(configuration, null, null);
+        try {
+            assertEquals(count,
+                    db.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+            assertEquals(sString3 + " 7", db.compileStatement(
+                    "SELECT data FROM test WHERE _id = 8;").simpleQueryForString());
+            assertEquals("ok",
+                    db.compileStatement("PRAGMA integrity_check;").simpleQueryForString());
+            long pageCount = db.compileStatement("PRAGMA page_count;").simpleQueryForLong();
+            assertTrue(file.length() < pageCount * db.getPageSize());
+        } finally {
+            db.close();
+            SQLiteDatabase.deleteDatabase(file);
+        }
+
+        SQLiteDebug.CompressedVfsStats stats = SQLiteDebug.getCompressedVfsStats();
+        assertTrue(stats.pagesWritten > 0);
+        assertTrue(stats.bytesStored > 0);
+    }
+
+    @MediumTest
+    @Test
+    public void testZipVfs() throws Exception {
+        final int count = 1000;
+        insertRows(mDatabase, count);
+
+        byte[] content = new byte[(int) mDatabaseFile.length()];
+        FileInputStream in = new FileInputStream(mDatabaseFile);
+        try {
+            int read = 0;
+            while (read < content.length) {
+                read += in.read(content, read, content.length - read);
+            }
+        } finally {
+            in.close();
+        }
+        CRC32 crc = new CRC32();
+        crc.update(content);
+
+        File archive = new File(mDatabaseFile.getParentFile(), "zip_test.zip");
+        ZipOutputStream out = new ZipOutputStream(new FileOutputStream(archive));
+        try {
+            ZipEntry other = new ZipEntry("other.txt");
+            out.putNextEntry(other);
+            out.write(sString3.getBytes("UTF-8"));
+            out.closeEntry();
+
+            ZipEntry entry = new ZipEntry("assets/test.db");
+            entry.setMethod(ZipEntry.STORED);
+            entry.setSize(content.length);
+            entry.setCompressedSize(content.length);
+            entry.setCrc(crc.getValue());
+            out.putNextEntry(entry);
+            out.write(content);
+            out.closeEntry();
+        } finally {
+            out.close();
+        }
+
+        SQLiteDatabase db = SQLiteDatabase.openZipDatabase(
+                archive.getPath(), "assets/test.db", null);
+        try {
+            assertTrue(db.isReadOnly());
+            assertEquals(count,
+                    db.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+            assertEquals(sString3 + " 7", db.compileStatement(
+                    "SELECT data FROM test WHERE _id = 8;").simpleQueryForString());
+            try {
+                db.execSQL("DELETE FROM test;");
+                fail("Expected the database to be read-only");
+            } catch (SQLiteReadOnlyDatabaseException e) {
+                // expected
+            }
+        } finally {
+            db.close();
+        }
+
+        try {
+            SQLiteDatabase.openZipDatabase(archive.getPath(), "other.txt", null).close();
+            fail("Expected a compressed entry to be refused");
+        } catch (SQLiteException e) {
+            // expected
+        } finally {
+            assertTrue(archive.delete());
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testSerializeDeserialize() throws Exception {
+        final int count = 100;
+        insertRows(mDatabase, count);
+        byte[] image = mDatabase.serialize("main");
+        assertEquals(mDatabaseFile.length(), image.length);
+
+        SQLiteDatabase memory = SQLiteDatabase.create(null);
+        try {
+            ByteBuffer buffer = ByteBuffer.allocateDirect(image.length);
+            buffer.put(image);
+            buffer.flip();
+            memory.deserialize("main", buffer, true);
+            assertEquals(count,
+                    memory.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+            try {
+                memory.execSQL("DELETE FROM test;");
+                fail("Expected the database to be read-only");
+            } catch (SQLiteReadOnlyDatabaseException e) {
+                // expected
+            }
+
+            memory.deserialize("main", buffer, false);
+            memory.execSQL("INSERT INTO test (data) VALUES ('more');");
+            assertEquals(count + 1,
+                    memory.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+            assertEquals("ok",
+                    memory.compileStatement("PRAGMA integrity_check;").simpleQueryForString());
+
+            File copy = new File(mDatabaseFile.getParentFile(), "serialized_test.db");
+            ParcelFileDescriptor fd = ParcelFileDescriptor.open(copy,
+                    ParcelFileDescriptor.MODE_CREATE | ParcelFileDescriptor.MODE_TRUNCATE
+                            | ParcelFileDescriptor.MODE_WRITE_ONLY);
+            try {
+                assertEquals(memory.serialize("main").length, memory.serialize("main", fd));
+            } finally {
+                fd.close();
+            }
+            SQLiteDatabase loaded = SQLiteDatabase.openInMemory(copy, true, null);
+            try {
+                assertEquals(count + 1, loaded.compileStatement(
+                        "SELECT count(*) FROM test;").simpleQueryForLong());
+            } finally {
+                loaded.close();
+                SQLiteDatabase.deleteDatabase(copy);
+            }
+        } finally {
+            memory.close();
+        }
+
+        try {
+            mDatabase.deserialize("main", mDatabaseFile, false);
+            fail("Expected only in-memory databases to be deserialized into");
+        } catch (IllegalStateException e) {
+            // expected
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testDeserializeWal() throws Exception {
+        assertTrue(mDatabase.enableWriteAheadLogging());
+        final int count = 100;
+        insertRows(mDatabase, count);
+        File wal = new File(mDatabaseFile.getPath() + "-wal");
+        assertTrue(wal.length() > 0);
+
+        // The rows are only in the WAL file, which deserializing does not read.
+        try {
+            SQLiteDatabase.openInMemory(mDatabaseFile, false, null).close();
+            fail("Expected a database with commits in its WAL file to be refused");
+        } catch (SQLiteException e) {
+            // expected
+        }
+
+        assertEquals(0, mDatabase.compileStatement(
+                "PRAGMA wal_checkpoint(TRUNCATE);").simpleQueryForLong());
+        assertEquals(0, wal.length());
+        for (boolean readOnly : new boolean[] { true, false }) {
+            SQLiteDatabase loaded = SQLiteDatabase.openInMemory(mDatabaseFile, readOnly, null);
+            try {
+                assertEquals(count, loaded.compileStatement(
+                        "SELECT count(*) FROM test;").simpleQueryForLong());
+            } finally {
+                loaded.close();
+            }
+        }
+    }
+
+    @MediumTest
+    @Test
+    public void testBackup() throws Exception {
+        final int count = 1000;
+        insertRows(mDatabase, count);
+
+        // Rows written while the backup is in progress are copied as well.
+        final int[] steps = new int[1];
+        SQLiteDatabase memory = SQLiteDatabase.create(null);
+        try {
+            mDatabase.backup(memory, 4, 0, new SQLiteDatabase.BackupProgressListener() {
+                @Override
+                public void onProgress(int remainingPages, int pageCount) {
+                    assertTrue(remainingPages <= pageCount);
+                    if (steps[0]++ == 1) {
+                        mDatabase.execSQL("INSERT INTO test (data) VALUES ('during');");
+                    }
+                }
+            }, null);
+            assertTrue(steps[0] > 2);
+            assertEquals(count + 1,
+                    memory.compileStatement("SELECT count(*) FROM test;").simpleQueryForLong());
+            assertEquals("ok",
+                    memory.compileStatement("PRAGMA integrity_check;").simpleQueryForString());
+        } finally {
+            memory.close();
+        }
+
+        File file = new File(mDatabaseFile.getParentFile(), "backup_test.db");
+        SQLiteDatabase.deleteDatabase(file);
+        CancellationSignal signal = new CancellationSignal();
+        signal.cancel();
+        try {
+            mDatabase.backup(file, 4, 0, null, signal);
+            fail("Expected the backup to be canceled");
+        } catch (OperationCanceledException e) {
+            // expected
+        }
+        try {
+            mDatabase.backup(file, -1, 0, null, null);
+            SQLiteDatabase copy = SQLiteDatabase.openDatabase(file.getPath(), null,
+                    SQLiteDatabase.OPEN_READONLY);
+            try {
+                assertEquals(count + 1, copy.compileStatement(
+                        "SELECT count(*) FROM test;").simpleQueryForLong());
+            } finally {
+                copy.close();
+            }
+        } finally {
+            SQLiteDatabase.deleteDatabase(file);
+        }
+    }
+
+    private static void insertRows(SQLiteDatabase db, int count) {
+        db.execSQL("CREATE TABLE test (_id INTEGER PRIMARY KEY, data TEXT);");
+        db.beginTransaction();
+        try {
+            for (int i = 0; i < count; i++) {
+                db.execSQL("INSERT INTO test (data) VALUES (?);",
+                        new Object[] { sString3 + " " + i });
+            }
+            db.setTransactionSuccessful();
+        } finally {
+            db.endTransaction();
+        }
+    }
+
+    private static long sum(long[] values) {
+        long sum = 0;
+        for (long value : values) {
+            sum += value;
+        }
+        return sum;
+    }
+}
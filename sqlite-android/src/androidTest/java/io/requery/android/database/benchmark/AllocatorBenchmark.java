@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.database.Cursor;
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.Arrays;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures inserts and scans with the pooling allocator against plain malloc.
+ */
+@RunWith(AndroidJUnit4.class)
+public class AllocatorBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int RUNS = 5;
+
+    @Test
+    public void runBenchmark() {
+        try {
+            long[] malloc = run(false);
+            long[] pooled = run(true);
+            Log.i(TAG, "malloc insert: AVG " + malloc[0] / RUNS + "ms, scan: AVG "
+                + malloc[1] / RUNS + "ms");
+            Log.i(TAG, "pooled insert: AVG " + pooled[0] / RUNS + "ms, scan: AVG "
+                + pooled[1] / RUNS + "ms");
+
+            SQLiteDebug.AllocatorStats stats = SQLiteDebug.getAllocatorStats();
+            Log.i(TAG, "allocator high water " + stats.highWater + " bytes, size classes "
+                + Arrays.toString(stats.sizeClassAllocations) + ", large "
+                + stats.largeAllocations);
+        } finally {
+            SQLiteGlobal.setPoolAllocatorEnabled(false);
+        }
+    }
+
+    private static long[] run(boolean pooled) {
+        SQLiteGlobal.setPoolAllocatorEnabled(pooled);
+        Context context = ApplicationProvider.getApplicationContext();
+        File file = context.getDatabasePath("allocator.db");
+        long[] times = new long[2];
+        for (int i = 0; i < RUNS; i++) {
+            SQLiteDatabase.deleteDatabase(file);
+            SQLiteDatabase db = SQLiteDatabase.openOrCreateDatabase(file, null);
+            try {
+                db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, content TEXT, "
+                    + "created INTEGER)");
+                times[0] += insert(db);
+                times[1] += scan(db);
+            } finally {
+                db.close();
+            }
+        }
+        SQLiteDatabase.deleteDatabase(file);
+        return times;
+    }
+
+    private static long insert(SQLiteDatabase db) {
+        long start = System.nanoTime();
+        SQLiteStatement statement = db.compileStatement(
+            "INSERT INTO record (content, created) VALUES (?, ?)");
+        db.beginTransaction();
+        try {
+            for (int i = 0; i < COUNT; i++) {
+                statement.bindString(1, "position" + i);
+                statement.bindLong(2, start + i);
+                statement.executeInsert();
+            }
+            db.setTransactionSuccessful();
+        } finally {
+            db.endTransaction();
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+
+    private static long scan(SQLiteDatabase db) {
+        long start = System.nanoTime();
+        Cursor cursor = db.rawQuery(
+            "SELECT _id, content, created FROM record ORDER BY content", null);
+        try {
+            while (cursor.moveToNext()) {
+                cursor.getLong(0);
+                cursor.getString(1);
+                cursor.getLong(2);
+            }
+        } finally {
+            cursor.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.util.Log;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures binding of string parameters, which are transcoded to UTF-8 once in native code,
+ * against the platform SQLite which binds them as UTF-16.
+ */
+@RunWith(AndroidJUnit4.class)
+public class BindStringBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 10000;
+    private static final int RUNS = 5;
+
+    private static final String CREATE_TABLE =
+        "CREATE TABLE record (_id INTEGER PRIMARY KEY, content TEXT)";
+    private static final String INSERT = "INSERT INTO record (content) VALUES (?)";
+    private static final String SELECT = "SELECT count(*) FROM record WHERE content = ?";
+
+    @Test
+    public void runAsciiBenchmark() {
+        runBenchmark("ASCII", createStrings("The quick brown fox jumps over the lazy dog "));
+    }
+
+    @Test
+    public void runCjkBenchmark() {
+        // Tokyo Shibuya database, in kanji and katakana
+        runBenchmark("CJK", createStrings("\u6771\u4eac\u90fd\u6e0b\u8c37\u533a\u306e"
+            + "\u30c7\u30fc\u30bf\u30d9\u30fc\u30b9 "));
+    }
+
+    private static String[] createStrings(String base) {
+        String[] values = new String[COUNT];
+        StringBuilder sb = new StringBuilder();
+        for (int i = 0; i < COUNT; i++) {
+            sb.setLength(0);
+            for (int j = 0; j < 4; j++) {
+                sb.append(base);
+            }
+            sb.append(i);
+            values[i] = sb.toString();
+        }
+        return values;
+    }
+
+    private void runBenchmark(String name, String[] values) {
+        Context context = ApplicationProvider.getApplicationContext();
+        long androidBind = 0;
+        long requeryBind = 0;
+        long androidLookup = 0;
+        long requeryLookup = 0;
+        for (int i = 0; i < RUNS; i++) {
+            File file = context.getDatabasePath("bindAndroid.db");
+            context.deleteDatabase(file.getName());
+            android.database.sqlite.SQLiteDatabase platform =
+                android.database.sqlite.SQLiteDatabase.openOrCreateDatabase(file, null);
+            try {
+                platform.execSQL(CREATE_TABLE);
+                long start = System.nanoTime();
+                android.database.sqlite.SQLiteStatement insert = platform.compileStatement(INSERT);
+                platform.beginTransaction();
+                try {
+                    for (String value : values) {
+                        insert.bindString(1, value);
+                        insert.executeInsert();
+                    }
+                    platform.setTransactionSuccessful();
+                } finally {
+                    platform.endTransaction();
+                    insert.close();
+                }
+                androidBind += elapsed(start);
+
+                start = System.nanoTime();
+                android.database.sqlite.SQLiteStatement select = platform.compileStatement(SELECT);
+                for (String value : values) {
+                    select.bindString(1, value);
+                    select.simpleQueryForLong();
+                }
+                select.close();
+                androidLookup += elapsed(start);
+            } finally {
+                platform.close();
+            }
+
+            file = context.getDatabasePath("bindRequery.db");
+            context.deleteDatabase(file.getName());
+            io.requery.android.database.sqlite.SQLiteDatabase requery =
+                io.requery.android.database.sqlite.SQLiteDatabase.openOrCreateDatabase(file, null);
+            try {
+                requery.execSQL(CREATE_TABLE);
+                long start = System.nanoTime();
+                io.requery.android.database.sqlite.SQLiteStatement insert =
+                    requery.compileStatement(INSERT);
+                requery.beginTransaction();
+                try {
+                    for (String value : values) {
+                        insert.bindString(1, value);
+                        insert.executeInsert();
+                    }
+                    requery.setTransactionSuccessful();
+                } finally {
+                    requery.endTransaction();
+                    insert.close();
+                }
+                requeryBind += elapsed(start);
+
+                start = System.nanoTime();
+                io.requery.android.database.sqlite.SQLiteStatement select =
+                    requery.compileStatement(SELECT);
+                for (String value : values) {
+                    select.bindString(1, value);
+                    select.simpleQueryForLong();
+                }
+                select.close();
+                requeryLookup += elapsed(start);
+            } finally {
+                requery.close();
+            }
+        }
+        Log.i(TAG, name + " Android: insert AVG " + androidBind / RUNS + "ms"
+            + " lookup AVG " + androidLookup / RUNS + "ms");
+        Log.i(TAG, name + " requery: insert AVG " + requeryBind / RUNS + "ms"
+            + " lookup AVG " + requeryLookup / RUNS + "ms");
+    }
+
+    private static long elapsed(long start) {
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.database.Cursor;
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDatabaseConfiguration;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Compares the size and the read speed of a database stored by the compressed VFS with
+ * the same database stored as a plain file. The corpus is text generated from a fixed
+ * seed, so every run stores the same rows.
+ */
+@RunWith(AndroidJUnit4.class)
+public class CompressionBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 20000;
+    private static final int LOOKUPS = 2000;
+    private static final int RUNS = 5;
+    private static final long SEED = 42;
+
+    @Test
+    public void runBenchmark() {
+        Context context = ApplicationProvider.getApplicationContext();
+        File plainFile = context.getDatabasePath("plain.db");
+        File compressedFile = context.getDatabasePath("compressed.db");
+        try {
+            create(plainFile, null);
+            create(compressedFile, SQLiteDatabase.VFS_COMPRESSED);
+            long plainSize = plainFile.length();
+            long compressedSize = compressedFile.length();
+            Log.i(TAG, "plain size " + plainSize + " bytes, compressed size "
+                + compressedSize + " bytes, ratio "
+                + String.format("%.2f", (double) plainSize / compressedSize));
+
+            long[] plain = read(plainFile, null);
+            long[] compressed = read(compressedFile, SQLiteDatabase.VFS_COMPRESSED);
+            Log.i(TAG, "plain scan: AVG " + plain[0] / RUNS + "ms, lookups: AVG "
+                + plain[1] / RUNS + "ms");
+            Log.i(TAG, "compressed scan: AVG " + compressed[0] / RUNS + "ms, lookups: AVG "
+                + compressed[1] / RUNS + "ms");
+
+            SQLiteDebug.CompressedVfsStats stats = SQLiteDebug.getCompressedVfsStats();
+            Log.i(TAG, "compressed cache hits " + stats.cacheHits + ", misses "
+                + stats.cacheMisses + ", pages written " + stats.pagesWritten);
+        } finally {
+            SQLiteDatabase.deleteDatabase(plainFile);
+            SQLiteDatabase.deleteDatabase(compressedFile);
+        }
+    }
+
+    private static SQLiteDatabase open(File file, String vfsName) {
+        SQLiteDatabaseConfiguration configuration = new SQLiteDatabaseConfiguration(
+            file.getPath(), SQLiteDatabase.CREATE_IF_NECESSARY);
+        configuration.vfsName = vfsName;
+        return SQLiteDatabase.openDatabase(configuration, null, null);
+    }
+
+    private static void create(File file, String vfsName) {
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabase db = open(file, vfsName);
+        try {
+            db.execSQL("CREATE TABLE article (_id INTEGER PRIMARY KEY, title TEXT, body TEXT)");
+            SQLiteStatement statement = db.compileStatement(
+                "INSERT INTO article (title, body) VALUES (?, ?)");
+            Random random = new Random(SEED);
+            String[] words = words(random);
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < COUNT; i++) {
+                    statement.bindString(1, text(random, words, 4 + random.nextInt(8)));
+                    statement.bindString(2, text(random, words, 50 + random.nextInt(250)));
+                    statement.executeInsert();
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                statement.close();
+            }
+        } finally {
+            db.close();
+        }
+    }
+
+    // Each run opens the database again, so pages are read from the file rather than
+    // from the page cache of a previous run.
+    private static long[] read(File file, String vfsName) {
+        long[] times = new long[2];
+        for (int i = 0; i < RUNS; i++) {
+            SQLiteDatabase db = open(file, vfsName);
+            try {
+                times[0] += scan(db);
+                times[1] += lookup(db);
+            } finally {
+                db.close();
+            }
+        }
+        return times;
+    }
+
+    private static long scan(SQLiteDatabase db) {
+        long start = System.nanoTime();
+        Cursor cursor = db.rawQuery("SELECT _id, title, body FROM article", null);
+        try {
+            while (cursor.moveToNext()) {
+                cursor.getLong(0);
+                cursor.getString(1);
+                cursor.getString(2);
+            }
+        } finally {
+            cursor.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+
+    private static long lookup(SQLiteDatabase db) {
+        Random random = new Random(SEED);
+        long start = System.nanoTime();
+        SQLiteStatement statement = db.compileStatement(
+            "SELECT length(body) FROM article WHERE _id = ?");
+        try {
+            for (int i = 0; i < LOOKUPS; i++) {
+                statement.bindLong(1, 1 + random.nextInt(COUNT));
+                statement.simpleQueryForLong();
+            }
+        } finally {
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+
+    // A vocabulary of made-up words of two to four syllables.
+    private static String[] words(Random random) {
+        String[] syllables = {
+            "ka", "lo", "mi", "ren", "to", "sa", "vel", "an", "dor", "is", "qua", "ne",
+            "tri", "po", "lu", "es", "gra", "fin", "or", "ba"
+        };
+        String[] words = new String[2000];
+        for (int i = 0; i < words.length; i++) {
+            StringBuilder word = new StringBuilder();
+            int count = 2 + random.nextInt(3);
+            for (int j = 0; j < count; j++) {
+                word.append(syllables[random.nextInt(syllables.length)]);
+            }
+            words[i] = word.toString();
+        }
+        return words;
+    }
+
+    // Picks words with a skewed distribution, so common words repeat as in real text.
+    private static String text(Random random, String[] words, int count) {
+        StringBuilder text = new StringBuilder();
+        for (int i = 0; i < count; i++) {
+            if (i > 0) {
+                text.append(i % 12 == 11 ? ". " : " ");
+            }
+            int index = (int) (words.length * Math.pow(random.nextDouble(), 3));
+            text.append(words[index]);
+        }
+        return text.toString();
+    }
+}
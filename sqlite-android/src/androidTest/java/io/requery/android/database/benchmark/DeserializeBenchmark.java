@@ -0,0 +1,139 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures loading a reference database into an in-memory database by copying its rows,
+ * by deserializing a copy of it and by deserializing a mapping of it, each followed by
+ * random lookups.
+ */
+@RunWith(AndroidJUnit4.class)
+public class DeserializeBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int LOOKUPS = 2000;
+    private static final int RUNS = 5;
+
+    @Test
+    public void runBenchmark() {
+        Context context = ApplicationProvider.getApplicationContext();
+        File file = context.getDatabasePath("reference.db");
+        try {
+            create(file);
+            long[] rows = new long[2];
+            long[] copy = new long[2];
+            long[] mapped = new long[2];
+            for (int i = 0; i < RUNS; i++) {
+                long start = System.nanoTime();
+                SQLiteDatabase db = SQLiteDatabase.create(null);
+                try {
+                    db.execSQL("ATTACH DATABASE ? AS reference", new Object[] { file.getPath() });
+                    db.execSQL("CREATE TABLE record AS SELECT * FROM reference.record");
+                    db.execSQL("CREATE INDEX record_name ON record (name)");
+                    db.execSQL("DETACH DATABASE reference");
+                    measure(db, start, rows);
+                } finally {
+                    db.close();
+                }
+
+                start = System.nanoTime();
+                db = SQLiteDatabase.openInMemory(file, false, null);
+                try {
+                    measure(db, start, copy);
+                } finally {
+                    db.close();
+                }
+
+                start = System.nanoTime();
+                db = SQLiteDatabase.openInMemory(file, true, null);
+                try {
+                    measure(db, start, mapped);
+                } finally {
+                    db.close();
+                }
+            }
+            Log.i(TAG, "copy rows load: AVG " + rows[0] / RUNS + "ms, lookups: AVG "
+                + rows[1] / RUNS + "ms");
+            Log.i(TAG, "deserialize copy load: AVG " + copy[0] / RUNS + "ms, lookups: AVG "
+                + copy[1] / RUNS + "ms");
+            Log.i(TAG, "deserialize mapped load: AVG " + mapped[0] / RUNS
+                + "ms, lookups: AVG " + mapped[1] / RUNS + "ms");
+        } finally {
+            SQLiteDatabase.deleteDatabase(file);
+        }
+    }
+
+    private static void create(File file) {
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabase db = SQLiteDatabase.openOrCreateDatabase(file, null);
+        try {
+            db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, name TEXT, content TEXT)");
+            db.execSQL("CREATE INDEX record_name ON record (name)");
+            SQLiteStatement statement = db.compileStatement(
+                "INSERT INTO record (name, content) VALUES (?, ?)");
+            Random random = new Random(42);
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < COUNT; i++) {
+                    statement.bindString(1, "name " + i);
+                    statement.bindString(2, Long.toHexString(random.nextLong())
+                        + Long.toHexString(random.nextLong()) + " record " + i);
+                    statement.executeInsert();
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                statement.close();
+            }
+        } finally {
+            db.close();
+        }
+    }
+
+    // Adds the time since start to times[0], and the time of the lookups to times[1].
+    private static void measure(SQLiteDatabase db, long start, long[] times) {
+        times[0] += TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+        start = System.nanoTime();
+        Random random = new Random(7);
+        SQLiteStatement statement = db.compileStatement(
+            "SELECT length(content) FROM record WHERE name = ?");
+        try {
+            for (int i = 0; i < LOOKUPS; i++) {
+                statement.bindString(1, "name " + random.nextInt(COUNT));
+                statement.simpleQueryForLong();
+            }
+        } finally {
+            statement.close();
+        }
+        times[1] += TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures a numeric Java function evaluated over a table scan, through the typed
+ * {@link SQLiteDatabase.Function} interface and the string based
+ * {@link SQLiteDatabase.CustomFunction} interface.
+ */
+@RunWith(AndroidJUnit4.class)
+public class FunctionBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int RUNS = 5;
+
+    @Test
+    @SuppressWarnings("deprecation")
+    public void runBenchmark() {
+        SQLiteDatabase db = SQLiteDatabase.create(null);
+        try {
+            db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, a INTEGER, b REAL)");
+            SQLiteStatement insert = db.compileStatement("INSERT INTO record (a, b) VALUES (?, ?)");
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < COUNT; i++) {
+                    insert.bindLong(1, i);
+                    insert.bindDouble(2, i * 0.5);
+                    insert.executeInsert();
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                insert.close();
+            }
+
+            db.addFunction("typed_mix", 2, new SQLiteDatabase.Function() {
+                @Override
+                public void callback(Args args, Result result) {
+                    result.set(args.getLong(0) * 31 + (long) args.getDouble(1));
+                }
+            });
+            db.addCustomFunction("string_mix", 2, new SQLiteDatabase.CustomFunction() {
+                @Override
+                public String callback(String[] args) {
+                    return String.valueOf(Long.parseLong(args[0]) * 31
+                        + (long) Double.parseDouble(args[1]));
+                }
+            });
+
+            long typed = 0;
+            long string = 0;
+            for (int i = 0; i < RUNS; i++) {
+                typed += scan(db, "typed_mix");
+                string += scan(db, "string_mix");
+            }
+            Log.i(TAG, "Function: AVG " + typed / RUNS + "ms");
+            Log.i(TAG, "CustomFunction: AVG " + string / RUNS + "ms");
+        } finally {
+            db.close();
+        }
+    }
+
+    private static long scan(SQLiteDatabase db, String function) {
+        long start = System.nanoTime();
+        SQLiteStatement statement =
+            db.compileStatement("SELECT sum(" + function + "(a, b)) FROM record");
+        try {
+            statement.simpleQueryForLong();
+        } finally {
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
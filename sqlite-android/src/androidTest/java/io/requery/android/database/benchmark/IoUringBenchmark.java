@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Assume;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+import androidx.test.platform.app.InstrumentationRegistry;
+
+/**
+ * Measures random lookups of several threads sharing the connection pool of a database in
+ * WAL mode, with reads through read calls and through io_uring, starting each run with
+ * the database out of the page cache of the kernel.
+ *
+ * Since the seccomp policy of apps may end the process when io_uring is used, the
+ * benchmark only runs when the instrumentation argument ioUring is true.
+ */
+@RunWith(AndroidJUnit4.class)
+public class IoUringBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int LOOKUPS = 1000;
+    private static final int RUNS = 5;
+    private static final int[] THREADS = { 1, 4, 8 };
+
+    @Test
+    public void runBenchmark() throws Exception {
+        Assume.assumeTrue(Boolean.parseBoolean(
+            InstrumentationRegistry.getArguments().getString("ioUring")));
+
+        Context context = ApplicationProvider.getApplicationContext();
+        File file = context.getDatabasePath("io_uring.db");
+        try {
+            create(file);
+            for (int threads : THREADS) {
+                SQLiteGlobal.setIoUringEnabled(false);
+                long plain = run(file, threads);
+                if (!SQLiteGlobal.setIoUringEnabled(true)) {
+                    Log.i(TAG, "io_uring is not available");
+                    return;
+                }
+                long ring = run(file, threads);
+                Log.i(TAG, threads + " threads read calls: AVG " + plain / RUNS
+                    + "ms, io_uring: AVG " + ring / RUNS + "ms");
+            }
+            Log.i(TAG, "io_uring " + SQLiteDebug.getIoUringStats());
+        } finally {
+            SQLiteGlobal.setIoUringEnabled(false);
+            SQLiteDatabase.deleteDatabase(file);
+        }
+    }
+
+    private static void create(File file) {
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabase db = SQLiteDatabase.openOrCreateDatabase(file, null);
+        try {
+            db.enableWriteAheadLogging();
+            db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, content TEXT)");
+            SQLiteStatement statement = db.compileStatement(
+                "INSERT INTO record (content) VALUES (?)");
+            Random random = new Random(42);
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < COUNT; i++) {
+                    statement.bindString(1, Long.toHexString(random.nextLong())
+                        + Long.toHexString(random.nextLong()) + " record " + i);
+                    statement.executeInsert();
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                statement.close();
+            }
+            db.execSQL("PRAGMA wal_checkpoint(TRUNCATE)");
+        } finally {
+            db.close();
+        }
+    }
+
+    private static long run(File file, int threads) throws Exception {
+        long time = 0;
+        for (int i = 0; i < RUNS; i++) {
+            SQLiteDebug.evictFileCache(file);
+            final SQLiteDatabase db = SQLiteDatabase.openOrCreateDatabase(file, null);
+            db.enableWriteAheadLogging();
+            try {
+                Thread[] readers = new Thread[threads];
+                for (int t = 0; t < threads; t++) {
+                    final long seed = t;
+                    readers[t] = new Thread(new Runnable() {
+                        @Override
+                        public void run() {
+                            lookup(db, seed);
+                        }
+                    });
+                }
+                long start = System.nanoTime();
+                for (Thread reader : readers) {
+                    reader.start();
+                }
+                for (Thread reader : readers) {
+                    reader.join();
+                }
+                time += TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+            } finally {
+                db.close();
+            }
+        }
+        return time;
+    }
+
+    private static void lookup(SQLiteDatabase db, long seed) {
+        Random random = new Random(seed);
+        SQLiteStatement statement = db.compileStatement(
+            "SELECT length(content) FROM record WHERE _id = ?");
+        try {
+            for (int i = 0; i < LOOKUPS; i++) {
+                statement.bindLong(1, 1 + random.nextInt(COUNT));
+                statement.simpleQueryForLong();
+            }
+        } finally {
+            statement.close();
+        }
+    }
+}
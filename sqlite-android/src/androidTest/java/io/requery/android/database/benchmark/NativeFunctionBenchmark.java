@@ -0,0 +1,174 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.text.Normalizer;
+import java.util.Locale;
+import java.util.concurrent.TimeUnit;
+import java.util.regex.Pattern;
+
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures the built-in native functions over a table scan against Java
+ * {@link SQLiteDatabase.Function}s computing the same results.
+ */
+@RunWith(AndroidJUnit4.class)
+public class NativeFunctionBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int RUNS = 5;
+
+    private static final Pattern COMBINING_MARKS = Pattern.compile("\\p{M}+");
+
+    @Test
+    public void runBenchmark() {
+        SQLiteDatabase db = SQLiteDatabase.create(null);
+        try {
+            db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, name TEXT, "
+                + "lat REAL, lon REAL, bits BLOB)");
+            SQLiteStatement insert = db.compileStatement(
+                "INSERT INTO record (name, lat, lon, bits) VALUES (?, ?, ?, ?)");
+            db.beginTransaction();
+            try {
+                byte[] bits = new byte[32];
+                for (int i = 0; i < COUNT; i++) {
+                    bits[i % bits.length] = (byte) i;
+                    insert.bindString(1, "Crème Brûlée n°" + i);
+                    insert.bindDouble(2, (i % 180) - 90);
+                    insert.bindDouble(3, (i % 360) - 180);
+                    insert.bindBlob(4, bits);
+                    insert.executeInsert();
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                insert.close();
+            }
+
+            db.addNativeFunctions(SQLiteDatabase.NATIVE_FUNCTIONS_REGEXP,
+                SQLiteDatabase.NATIVE_FUNCTIONS_UNICODE,
+                SQLiteDatabase.NATIVE_FUNCTIONS_UNACCENT,
+                SQLiteDatabase.NATIVE_FUNCTIONS_HAVERSINE,
+                SQLiteDatabase.NATIVE_FUNCTIONS_BITOPS);
+            addJavaFunctions(db);
+
+            compare(db, "regexp",
+                "SELECT count(*) FROM record WHERE name REGEXP '9[0-9]*$'",
+                "SELECT count(*) FROM record WHERE java_regexp('9[0-9]*$', name)");
+            compare(db, "unicode_upper",
+                "SELECT count(DISTINCT unicode_upper(name)) FROM record",
+                "SELECT count(DISTINCT java_upper(name)) FROM record");
+            compare(db, "unaccent",
+                "SELECT count(DISTINCT unaccent(name)) FROM record",
+                "SELECT count(DISTINCT java_unaccent(name)) FROM record");
+            compare(db, "haversine",
+                "SELECT sum(haversine(lat, lon, 48.8566, 2.3522)) FROM record",
+                "SELECT sum(java_haversine(lat, lon, 48.8566, 2.3522)) FROM record");
+            compare(db, "bit_count",
+                "SELECT sum(bit_count(bits)) FROM record",
+                "SELECT sum(java_bit_count(bits)) FROM record");
+        } finally {
+            db.close();
+        }
+    }
+
+    private static void addJavaFunctions(SQLiteDatabase db) {
+        int flags = SQLiteDatabase.Function.FLAG_DETERMINISTIC;
+        db.addFunction("java_regexp", 2, new SQLiteDatabase.Function() {
+            private String source;
+            private Pattern pattern;
+
+            @Override
+            public void callback(Args args, Result result) {
+                String regex = args.getString(0);
+                if (!regex.equals(source)) {
+                    source = regex;
+                    pattern = Pattern.compile(regex);
+                }
+                result.set(pattern.matcher(args.getString(1)).find() ? 1 : 0);
+            }
+        }, flags);
+        db.addFunction("java_upper", 1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                result.set(args.getString(0).toUpperCase(Locale.ROOT));
+            }
+        }, flags);
+        db.addFunction("java_unaccent", 1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                String decomposed = Normalizer.normalize(args.getString(0), Normalizer.Form.NFD);
+                result.set(COMBINING_MARKS.matcher(decomposed).replaceAll(""));
+            }
+        }, flags);
+        db.addFunction("java_haversine", 4, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                double lat1 = Math.toRadians(args.getDouble(0));
+                double lon1 = Math.toRadians(args.getDouble(1));
+                double lat2 = Math.toRadians(args.getDouble(2));
+                double lon2 = Math.toRadians(args.getDouble(3));
+                double sinLat = Math.sin((lat2 - lat1) / 2);
+                double sinLon = Math.sin((lon2 - lon1) / 2);
+                double a = sinLat * sinLat
+                    + Math.cos(lat1) * Math.cos(lat2) * sinLon * sinLon;
+                result.set(2 * 6371008.8 * Math.asin(Math.min(1.0, Math.sqrt(a))));
+            }
+        }, flags);
+        db.addFunction("java_bit_count", 1, new SQLiteDatabase.Function() {
+            @Override
+            public void callback(Args args, Result result) {
+                long count = 0;
+                for (byte b : args.getBlob(0)) {
+                    count += Integer.bitCount(b & 0xff);
+                }
+                result.set(count);
+            }
+        }, flags);
+    }
+
+    private static void compare(SQLiteDatabase db, String name, String nativeSql,
+                                String javaSql) {
+        long nativeTime = 0;
+        long javaTime = 0;
+        for (int i = 0; i < RUNS; i++) {
+            nativeTime += scan(db, nativeSql);
+            javaTime += scan(db, javaSql);
+        }
+        Log.i(TAG, name + " native: AVG " + nativeTime / RUNS + "ms");
+        Log.i(TAG, name + " Java: AVG " + javaTime / RUNS + "ms");
+    }
+
+    private static long scan(SQLiteDatabase db, String sql) {
+        long start = System.nanoTime();
+        SQLiteStatement statement = db.compileStatement(sql);
+        try {
+            statement.simpleQueryForString();
+        } finally {
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
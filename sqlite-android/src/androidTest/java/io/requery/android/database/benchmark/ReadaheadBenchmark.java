@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.benchmark;
+
+import android.content.Context;
+import android.util.Log;
+import io.requery.android.database.sqlite.SQLiteDatabase;
+import io.requery.android.database.sqlite.SQLiteDebug;
+import io.requery.android.database.sqlite.SQLiteGlobal;
+import io.requery.android.database.sqlite.SQLiteStatement;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+
+import androidx.test.core.app.ApplicationProvider;
+import androidx.test.ext.junit.runners.AndroidJUnit4;
+
+/**
+ * Measures full table scans and random lookups of a database that is not in the page
+ * cache of the kernel, with and without reading ahead.
+ */
+@RunWith(AndroidJUnit4.class)
+public class ReadaheadBenchmark {
+
+    private static final String TAG = "SQLite";
+    private static final int COUNT = 100000;
+    private static final int LOOKUPS = 2000;
+    private static final int RUNS = 5;
+    private static final int DEFAULT_READAHEAD_SIZE = 128 * 1024;
+
+    @Test
+    public void runBenchmark() {
+        Context context = ApplicationProvider.getApplicationContext();
+        File file = context.getDatabasePath("readahead.db");
+        try {
+            create(file);
+            long[] plain = run(file, 0);
+            long[] readahead = run(file, DEFAULT_READAHEAD_SIZE);
+            Log.i(TAG, "no readahead cold scan: AVG " + plain[0] / RUNS + "ms, lookups: AVG "
+                + plain[1] / RUNS + "ms");
+            Log.i(TAG, "readahead cold scan: AVG " + readahead[0] / RUNS + "ms, lookups: AVG "
+                + readahead[1] / RUNS + "ms");
+            Log.i(TAG, "readahead " + SQLiteDebug.getReadaheadStats());
+        } finally {
+            SQLiteGlobal.setReadaheadSize(DEFAULT_READAHEAD_SIZE);
+            SQLiteDatabase.deleteDatabase(file);
+        }
+    }
+
+    // Rows of two tables are inserted in turns, so the pages of each table are not
+    // contiguous, as in a database that grew over time.
+    private static void create(File file) {
+        SQLiteDatabase.deleteDatabase(file);
+        SQLiteDatabase db = SQLiteDatabase.openOrCreateDatabase(file, null);
+        try {
+            db.execSQL("CREATE TABLE record (_id INTEGER PRIMARY KEY, content TEXT, "
+                + "created INTEGER)");
+            db.execSQL("CREATE TABLE event (_id INTEGER PRIMARY KEY, content TEXT)");
+            SQLiteStatement record = db.compileStatement(
+                "INSERT INTO record (content, created) VALUES (?, ?)");
+            SQLiteStatement event = db.compileStatement(
+                "INSERT INTO event (content) VALUES (?)");
+            Random random = new Random(42);
+            db.beginTransaction();
+            try {
+                for (int i = 0; i < COUNT; i++) {
+                    record.bindString(1, Long.toHexString(random.nextLong())
+                        + Long.toHexString(random.nextLong()) + " record " + i);
+                    record.bindLong(2, i);
+                    record.executeInsert();
+                    if (i % 4 == 0) {
+                        event.bindString(1, "event " + i);
+                        event.executeInsert();
+                    }
+                }
+                db.setTransactionSuccessful();
+            } finally {
+                db.endTransaction();
+                record.close();
+                event.close();
+            }
+        } finally {
+            db.close();
+        }
+    }
+
+    private static long[] run(File file, int readaheadSize) {
+        SQLiteGlobal.setReadaheadSize(readaheadSize);
+        long[] times = new long[2];
+        for (int i = 0; i < RUNS; i++) {
+            SQLiteDebug.evictFileCache(file);
+            SQLiteDatabase db = SQLiteDatabase.openDatabase(file.getPath(), null,
+                SQLiteDatabase.OPEN_READONLY);
+            try {
+                times[0] += scan(db);
+            } finally {
+                db.close();
+            }
+
+            SQLiteDebug.evictFileCache(file);
+            db = SQLiteDatabase.openDatabase(file.getPath(), null,
+                SQLiteDatabase.OPEN_READONLY);
+            try {
+                times[1] += lookup(db);
+            } finally {
+                db.close();
+            }
+        }
+        return times;
+    }
+
+    private static long scan(SQLiteDatabase db) {
+        long start = System.nanoTime();
+        SQLiteStatement statement = db.compileStatement(
+            "SELECT sum(length(content)) FROM record");
+        try {
+            statement.simpleQueryForLong();
+        } finally {
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+
+    private static long lookup(SQLiteDatabase db) {
+        Random random = new Random(7);
+        long start = System.nanoTime();
+        SQLiteStatement statement = db.compileStatement(
+            "SELECT length(content) FROM record WHERE _id = ?");
+        try {
+            for (int i = 0; i < LOOKUPS; i++) {
+                statement.bindLong(1, 1 + random.nextInt(COUNT));
+                statement.simpleQueryForLong();
+            }
+        } finally {
+            statement.close();
+        }
+        return TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - start);
+    }
+}
@@ -57,6 +57,8 @@ public class CursorWindow extends SQLiteClosable {
 
     private static native int nativeGetType(long windowPtr, int row, int column);
     private static native byte[] nativeGetBlob(long windowPtr, int row, int column);
+    private static native BlobReference nativeGetBlobReference(long windowPtr, int row,
+            int column);
     private static native String nativeGetString(long windowPtr, int row, int column);
     private static native long nativeGetLong(long windowPtr, int row, int column);
     private static native double nativeGetDouble(long windowPtr, int row, int column);
@@ -243,7 +245,8 @@ public class CursorWindow extends SQLiteClosable {
      * <li>If the field is of type {@link Cursor#FIELD_TYPE_NULL}, then the result
      * is <code>null</code>.</li>
      * <li>If the field is of type {@link Cursor#FIELD_TYPE_BLOB}, then the result
-     * is the blob value.</li>
+     * is the blob value, or <code>null</code> if the window only holds a
+     * {@link #getBlobReference reference} to it.</li>
      * <li>If the field is of type {@link Cursor#FIELD_TYPE_STRING}, then the result
      * is the array of bytes that make up the internal representation of the
      * string value.</li>
@@ -260,6 +263,18 @@ public class CursorWindow extends SQLiteClosable {
         return nativeGetBlob(mWindowPtr, row - mStartPos, column);
     }
 
+    /**
+     * Gets the location of a large blob which was left in the database instead of
+     * being copied into the window.
+     *
+     * @param row The zero-based row index.
+     * @param column The zero-based column index.
+     * @return The location of the blob, or <code>null</code> if the field holds a value.
+     */
+    public BlobReference getBlobReference(int row, int column) {
+        return nativeGetBlobReference(mWindowPtr, row - mStartPos, column);
+    }
+
     /**
      * Gets the value of the field at the specified row and column index as a string.
      * <p>
@@ -504,4 +519,38 @@ public class CursorWindow extends SQLiteClosable {
     public int getWindowSizeBytes() {
         return mWindowSizeBytes;
     }
+
+    /**
+     * The location of a blob which a query left in the database, see
+     * {@link io.requery.android.database.sqlite.SQLiteDatabase#setLazyBlobThreshold}.
+     * The value can be read with
+     * {@link io.requery.android.database.sqlite.SQLiteDatabase#openBlob(String, String, String,
+     * long, boolean)}.
+     */
+    public static final class BlobReference {
+        /** The schema name of the database containing the blob, e.g. "main". */
+        public final String database;
+        /** The table containing the blob. */
+        public final String table;
+        /** The column containing the blob. */
+        public final String column;
+        /** The row id of the row containing the blob. */
+        public final long rowId;
+        /** The size of the blob in bytes at the time the window was filled. */
+        public final int length;
+
+        BlobReference(String database, String table, String column, long rowId, int length) {
+            this.database = database;
+            this.table = table;
+            this.column = column;
+            this.rowId = rowId;
+            this.length = length;
+        }
+
+        @Override
+        public String toString() {
+            return database + "." + table + "." + column + "[" + rowId + "] (" + length
+                    + " bytes)";
+        }
+    }
 }
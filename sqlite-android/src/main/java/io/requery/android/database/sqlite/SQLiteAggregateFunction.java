@@ -0,0 +1,217 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.sqlite;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Describes an aggregate or window function implemented by a
+ * {@link SQLiteDatabase.AggregateFunction} or {@link SQLiteDatabase.WindowFunction}.
+ */
+public final class SQLiteAggregateFunction {
+    public final String name;
+    public final int numArgs;
+    private final SQLiteDatabase.AggregateFunction aggregateCallback;
+    private final SQLiteDatabase.WindowFunction windowCallback;
+
+    // accessed from native code
+    final int flags;
+    final boolean window;
+
+    /**
+     * Create an aggregate function.
+     *
+     * @param name The name of the sqlite3 function.
+     * @param numArgs The number of arguments for the function, or -1 to
+     * support any number of arguments.
+     * @param callback The callback creating the state of each aggregate.
+     * @param flags Extra SQLITE flags to pass when creating the function
+     * in native code.
+     */
+    public SQLiteAggregateFunction(String name, int numArgs,
+            SQLiteDatabase.AggregateFunction callback, int flags) {
+        this(name, numArgs, callback, null, flags);
+    }
+
+    /**
+     * Create an aggregate function which can also be used as a window function.
+     *
+     * @param name The name of the sqlite3 function.
+     * @param numArgs The number of arguments for the function, or -1 to
+     * support any number of arguments.
+     * @param callback The callback creating the state of each aggregate.
+     * @param flags Extra SQLITE flags to pass when creating the function
+     * in native code.
+     */
+    public SQLiteAggregateFunction(String name, int numArgs,
+            SQLiteDatabase.WindowFunction callback, int flags) {
+        this(name, numArgs, null, callback, flags);
+    }
+
+    private SQLiteAggregateFunction(String name, int numArgs,
+            SQLiteDatabase.AggregateFunction aggregateCallback,
+            SQLiteDatabase.WindowFunction windowCallback, int flags) {
+        if (name == null) {
+            throw new IllegalArgumentException("name must not be null.");
+        }
+        if (aggregateCallback == null && windowCallback == null) {
+            throw new IllegalArgumentException("callback must not be null.");
+        }
+
+        this.name = name;
+        this.numArgs = numArgs;
+        this.aggregateCallback = aggregateCallback;
+        this.windowCallback = windowCallback;
+        this.flags = flags;
+        this.window = windowCallback != null;
+    }
+
+    // Called from native when the function is registered on a connection.
+    @SuppressWarnings("unused")
+    private Invocation newInvocation() {
+        return new Invocation(this);
+    }
+
+    private SQLiteDatabase.AggregateFunction.Aggregate newAggregate() {
+        SQLiteDatabase.AggregateFunction.Aggregate aggregate = window
+                ? windowCallback.newAggregate()
+                : aggregateCallback.newAggregate();
+        if (aggregate == null) {
+            throw new IllegalStateException("newAggregate() returned null for " + name);
+        }
+        return aggregate;
+    }
+
+    /**
+     * Delivers the batches and results of the aggregates running on one connection,
+     * reusing the same row and result views for every call.
+     */
+    static final class Invocation {
+        private final SQLiteAggregateFunction function;
+        private final MyRows rows = new MyRows();
+        private final SQLiteFunction.MyResult result = new SQLiteFunction.MyResult();
+        private boolean active;
+
+        Invocation(SQLiteAggregateFunction function) {
+            this.function = function;
+        }
+
+        // Called from native.
+        @SuppressWarnings("unused")
+        private Object newAggregate() {
+            return function.newAggregate();
+        }
+
+        // Called from native.
+        @SuppressWarnings("unused")
+        private void step(Object aggregate, boolean inverse, ByteBuffer values, long argsPtr,
+                int argsCount, int rowCount) {
+            if (active) {
+                // The callback ran a query which uses the function again.
+                new Invocation(function).step(aggregate, inverse, values, argsPtr, argsCount,
+                        rowCount);
+                return;
+            }
+
+            values.order(ByteOrder.nativeOrder());
+            active = true;
+            rows.values = values;
+            rows.argsPtr = argsPtr;
+            rows.argsCount = argsCount;
+            rows.rowCount = rowCount;
+            rows.row = -1;
+            rows.base = -argsCount;
+
+            try {
+                if (inverse) {
+                    ((SQLiteDatabase.WindowFunction.WindowAggregate) aggregate).inverse(rows);
+                } else {
+                    ((SQLiteDatabase.AggregateFunction.Aggregate) aggregate).step(rows);
+                }
+            } finally {
+                rows.values = null;
+                rows.argsPtr = 0;
+                rows.argsCount = 0;
+                rows.rowCount = 0;
+                active = false;
+            }
+        }
+
+        // Called from native.
+        @SuppressWarnings("unused")
+        private void result(Object aggregate, boolean isFinal, long contextPtr,
+                ByteBuffer values) {
+            if (active) {
+                new Invocation(function).result(aggregate, isFinal, contextPtr, values);
+                return;
+            }
+
+            values.order(ByteOrder.nativeOrder());
+            active = true;
+            result.contextPtr = contextPtr;
+            result.values = values;
+
+            try {
+                if (isFinal) {
+                    ((SQLiteDatabase.AggregateFunction.Aggregate) aggregate).finish(result);
+                } else {
+                    ((SQLiteDatabase.WindowFunction.WindowAggregate) aggregate).value(result);
+                }
+
+                if (!result.isSet) {
+                    result.setNull();
+                }
+
+            } finally {
+                result.contextPtr = 0;
+                result.values = null;
+                result.isSet = false;
+                active = false;
+            }
+        }
+    }
+
+    private static class MyRows extends SQLiteFunction.MyArgs
+            implements SQLiteDatabase.AggregateFunction.Rows {
+        int rowCount;
+        int row;
+
+        @Override
+        public int getCount() {
+            return rowCount;
+        }
+
+        @Override
+        public boolean moveToNext() {
+            if (row + 1 >= rowCount) {
+                return false;
+            }
+            row += 1;
+            base += argsCount;
+            return true;
+        }
+
+        @Override
+        void checkRow() {
+            if (row < 0 || row >= rowCount) {
+                throw new IllegalStateException("Rows are not positioned on a row, row "
+                    + row + " of " + rowCount);
+            }
+        }
+    }
+}
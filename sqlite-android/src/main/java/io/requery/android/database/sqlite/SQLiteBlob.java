@@ -0,0 +1,264 @@
+/*
+ * Copyright 2016 requery.io
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.sqlite;
+
+import android.database.sqlite.SQLiteException;
+import android.os.ParcelFileDescriptor;
+
+import java.io.Closeable;
+import java.nio.ByteBuffer;
+
+/**
+ * A handle for incremental I/O on a single blob value, obtained from
+ * {@link SQLiteDatabase#openBlob}.
+ * <p>
+ * Reads and writes go directly between SQLite's pages and the caller's direct
+ * {@link ByteBuffer} or file descriptor, so large values never need to be held in a
+ * byte array. The size of a blob cannot be changed through the handle; reserve space
+ * with {@link SQLiteProgram#bindZeroBlob} and then fill it in.
+ * </p><p>
+ * The handle holds on to a database connection until it is closed. It is not thread-safe
+ * and must be used and closed on the thread that opened it.
+ * </p><p>
+ * If the row the handle refers to is modified or deleted by another statement, the handle
+ * expires and subsequent reads and writes fail with an abort error.
+ * </p>
+ */
+public final class SQLiteBlob implements Closeable {
+
+    private final CloseGuard mCloseGuard = CloseGuard.get();
+
+    private final SQLiteSession mSession;
+    private long mBlobPtr;
+
+    private static native void nativeClose(long blobPtr);
+    private static native void nativeReopen(long blobPtr, long rowId);
+    private static native int nativeGetLength(long blobPtr);
+    private static native void nativeRead(long blobPtr, ByteBuffer buffer, int bufferOffset,
+            int count, int blobOffset);
+    private static native void nativeWrite(long blobPtr, ByteBuffer buffer, int bufferOffset,
+            int count, int blobOffset);
+    private static native void nativeReadArray(long blobPtr, byte[] buffer, int bufferOffset,
+            int count, int blobOffset);
+    private static native void nativeWriteArray(long blobPtr, byte[] buffer, int bufferOffset,
+            int count, int blobOffset);
+    private static native int nativeReadToFileDescriptor(long blobPtr, int fd, int blobOffset,
+            int count);
+    private static native int nativeWriteFromFileDescriptor(long blobPtr, int fd, int blobOffset,
+            int count);
+
+    SQLiteBlob(SQLiteSession session, long blobPtr) {
+        mSession = session;
+        mBlobPtr = blobPtr;
+        mCloseGuard.open("close");
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            // The connection is owned by another thread's session, so it is not safe to
+            // close the handle from here.
+            if (mCloseGuard != null) {
+                mCloseGuard.warnIfOpen();
+            }
+        } finally {
+            super.finalize();
+        }
+    }
+
+    /**
+     * @return The size of the blob in bytes.
+     */
+    public int getLength() {
+        throwIfClosed();
+        return nativeGetLength(mBlobPtr);
+    }
+
+    /**
+     * Moves the handle to the same column of another row, which is cheaper than opening
+     * a new handle.
+     *
+     * @param rowId The row id of the row containing the blob.
+     *
+     * @throws SQLiteException if the row does not exist or does not contain a blob, in which
+     * case the handle can no longer be used for reading or writing.
+     */
+    public void reopen(long rowId) {
+        throwIfClosed();
+        nativeReopen(mBlobPtr, rowId);
+    }
+
+    /**
+     * Reads {@code buffer.remaining()} bytes of the blob into a direct buffer, advancing
+     * its position.
+     *
+     * @param buffer A direct buffer to read into.
+     * @param blobOffset The offset within the blob to start reading at.
+     *
+     * @throws SQLiteException if the range is outside the blob or the handle has expired.
+     */
+    public void read(ByteBuffer buffer, int blobOffset) {
+        throwIfClosed();
+        throwIfNotDirect(buffer);
+        final int count = buffer.remaining();
+        nativeRead(mBlobPtr, buffer, buffer.position(), count, blobOffset);
+        buffer.position(buffer.position() + count);
+    }
+
+    /**
+     * Writes the remaining bytes of a direct buffer into the blob, advancing its position.
+     *
+     * @param buffer A direct buffer to write from.
+     * @param blobOffset The offset within the blob to start writing at.
+     *
+     * @throws SQLiteException if the range is outside the blob, the handle is read-only
+     * or the handle has expired.
+     */
+    public void write(ByteBuffer buffer, int blobOffset) {
+        throwIfClosed();
+        throwIfNotDirect(buffer);
+        final int count = buffer.remaining();
+        nativeWrite(mBlobPtr, buffer, buffer.position(), count, blobOffset);
+        buffer.position(buffer.position() + count);
+    }
+
+    /**
+     * Reads a range of the blob into a byte array.
+     *
+     * @param buffer The array to read into.
+     * @param offset The offset within the array to start storing at.
+     * @param count The number of bytes to read.
+     * @param blobOffset The offset within the blob to start reading at.
+     *
+     * @throws SQLiteException if the range is outside the blob or the handle has expired.
+     */
+    public void read(byte[] buffer, int offset, int count, int blobOffset) {
+        throwIfClosed();
+        throwIfOutOfBounds(buffer, offset, count);
+        nativeReadArray(mBlobPtr, buffer, offset, count, blobOffset);
+    }
+
+    /**
+     * Writes a range of a byte array into the blob.
+     *
+     * @param buffer The array to write from.
+     * @param offset The offset within the array to start writing from.
+     * @param count The number of bytes to write.
+     * @param blobOffset The offset within the blob to start writing at.
+     *
+     * @throws SQLiteException if the range is outside the blob, the handle is read-only
+     * or the handle has expired.
+     */
+    public void write(byte[] buffer, int offset, int count, int blobOffset) {
+        throwIfClosed();
+        throwIfOutOfBounds(buffer, offset, count);
+        nativeWriteArray(mBlobPtr, buffer, offset, count, blobOffset);
+    }
+
+    /**
+     * Copies a range of the blob to a file descriptor, starting at its current offset.
+     *
+     * @param fd The file descriptor to write to.
+     * @param blobOffset The offset within the blob to start reading at.
+     * @param count The number of bytes to copy.
+     * @return The number of bytes copied.
+     *
+     * @throws SQLiteException if the range is outside the blob or the handle has expired,
+     * or {@link android.database.sqlite.SQLiteDiskIOException} if writing to fd fails.
+     */
+    public int readTo(ParcelFileDescriptor fd, int blobOffset, int count) {
+        throwIfClosed();
+        return nativeReadToFileDescriptor(mBlobPtr, fd.getFd(), blobOffset, count);
+    }
+
+    /**
+     * Copies up to {@code count} bytes from a file descriptor into the blob, stopping early
+     * at the end of the file.
+     *
+     * @param fd The file descriptor to read from.
+     * @param blobOffset The offset within the blob to start writing at.
+     * @param count The maximum number of bytes to copy.
+     * @return The number of bytes copied.
+     *
+     * @throws SQLiteException if the range is outside the blob, the handle is read-only
+     * or the handle has expired, or {@link android.database.sqlite.SQLiteDiskIOException}
+     * if reading from fd fails.
+     */
+    public int writeFrom(ParcelFileDescriptor fd, int blobOffset, int count) {
+        throwIfClosed();
+        return nativeWriteFromFileDescriptor(mBlobPtr, fd.getFd(), blobOffset, count);
+    }
+
+    /**
+     * Closes the handle and releases its database connection. If the handle was opened for
+     * writing outside of a transaction, this commits the changes.
+     */
+    @Override
+    public void close() {
+        if (mBlobPtr == 0) {
+            return;
+        }
+        final long blobPtr = mBlobPtr;
+        mBlobPtr = 0;
+        mCloseGuard.close();
+        try {
+            nativeClose(blobPtr);
+        } finally {
+            mSession.closeBlob();
+        }
+    }
+
+    private void throwIfClosed() {
+        if (mBlobPtr == 0) {
+            throw new IllegalStateException("Cannot perform this operation because "
+                    + "the blob has been closed.");
+        }
+    }
+
+    private static void throwIfOutOfBounds(byte[] buffer, int offset, int count) {
+        if (offset < 0 || count < 0 || offset > buffer.length - count) {
+            throw new IndexOutOfBoundsException("offset " + offset + " count " + count
+                    + " length " + buffer.length);
+        }
+    }
+
+    private static void throwIfNotDirect(ByteBuffer buffer) {
+        if (!buffer.isDirect()) {
+            throw new IllegalArgumentException("Blob I/O requires a direct buffer.");
+        }
+    }
+
+    /**
+     * Bind argument describing a blob of the given length filled with zeroes, bound with
+     * {@link SQLiteProgram#bindZeroBlob} or passed in bind argument arrays.
+     */
+    public static final class ZeroBlob {
+        final long length;
+
+        public ZeroBlob(long length) {
+            if (length < 0) {
+                throw new IllegalArgumentException("length must not be negative.");
+            }
+            this.length = length;
+        }
+
+        @Override
+        public String toString() {
+            return "zeroblob(" + length + ")";
+        }
+    }
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.sqlite;
+
+/**
+ * Checkpoints the WAL of a database on a native thread of its own, enabled with
+ * {@link SQLiteDatabaseConfiguration#backgroundCheckpoint}.
+ * <p>
+ * Without it, the writer whose commit makes the WAL reach
+ * {@link SQLiteGlobal#getWALAutoCheckpoint()} pages runs the checkpoint before its commit
+ * returns. With it, the writable connections of the pool report the size of the WAL after
+ * each commit instead, and the checkpoint thread runs a PASSIVE checkpoint once that size
+ * is reached and no commit has happened for a short while. When long readers keep the WAL
+ * from being reset, it runs a RESTART checkpoint past four times that size, and a TRUNCATE
+ * checkpoint past sixteen times, which briefly keep writers out while they wait for the
+ * readers.
+ * </p><p>
+ * The checkpointer is created and released by the connection pool, and stays alive until
+ * the last connection that reports to it is closed.
+ * </p>
+ */
+public final class SQLiteCheckpointer {
+
+    // How long writers must pause before a PASSIVE checkpoint runs.
+    private static final int IDLE_MILLIS = 100;
+
+    private final long mCheckpointerPtr;
+    private boolean mReleased;
+
+    private static native long nativeOpen(String path, String vfsName, int passiveFrames,
+            int restartFrames, int truncateFrames, int idleMillis);
+    private static native void nativeRelease(long checkpointerPtr);
+    private static native void nativeGetStats(long checkpointerPtr, long[] stats);
+
+    // Indices of the counters filled in by nativeGetStats.
+    private static final int STAT_CHECKPOINTS = 0;
+    private static final int STAT_PASSIVE_CHECKPOINTS = 1;
+    private static final int STAT_RESTART_CHECKPOINTS = 2;
+    private static final int STAT_TRUNCATE_CHECKPOINTS = 3;
+    private static final int STAT_FAILED_CHECKPOINTS = 4;
+    private static final int STAT_BUSY_RETRIES = 5;
+    private static final int STAT_FRAMES_CHECKPOINTED = 6;
+    private static final int STAT_LAST_FRAMES_CHECKPOINTED = 7;
+    private static final int STAT_MAX_WAL_FRAMES = 8;
+    private static final int STAT_LAST_DURATION_MICROS = 9;
+    private static final int STAT_MAX_DURATION_MICROS = 10;
+    private static final int STAT_TOTAL_DURATION_MICROS = 11;
+    private static final int STAT_COUNT = 12;
+
+    /**
+     * Contains the counters of the checkpoints run in the background.
+     */
+    public static class Stats {
+        /** the number of checkpoints run, including the failed ones */
+        public long checkpoints;
+
+        /** the number of PASSIVE checkpoints run */
+        public long passiveCheckpoints;
+
+        /** the number of RESTART checkpoints run */
+        public long restartCheckpoints;
+
+        /** the number of TRUNCATE checkpoints run */
+        public long truncateCheckpoints;
+
+        /** the number of checkpoints that readers or writers kept from completing */
+        public long failedCheckpoints;
+
+        /** the number of times checkpoints waited for readers or writers */
+        public long busyRetries;
+
+        /**
+         * the number of WAL frames copied into the database, as reported by SQLite, which
+         * reports none for a TRUNCATE checkpoint that completes
+         */
+        public long framesCheckpointed;
+
+        /** the number of WAL frames copied into the database by the last checkpoint */
+        public long lastFramesCheckpointed;
+
+        /** the largest number of frames the WAL held after a commit */
+        public long maxWalFrames;
+
+        /** how long the last checkpoint took */
+        public long lastDurationMicros;
+
+        /** how long the longest checkpoint took */
+        public long maxDurationMicros;
+
+        /** how long all checkpoints took */
+        public long totalDurationMicros;
+
+        @Override
+        public String toString() {
+            return "checkpoints=" + checkpoints + ", passiveCheckpoints=" + passiveCheckpoints
+                + ", restartCheckpoints=" + restartCheckpoints + ", truncateCheckpoints="
+                + truncateCheckpoints + ", failedCheckpoints=" + failedCheckpoints
+                + ", busyRetries=" + busyRetries + ", framesCheckpointed=" + framesCheckpointed
+                + ", maxWalFrames=" + maxWalFrames + ", lastDurationMicros="
+                + lastDurationMicros + ", maxDurationMicros=" + maxDurationMicros;
+        }
+    }
+
+    SQLiteCheckpointer(SQLiteDatabaseConfiguration configuration) {
+        final int passiveFrames = SQLiteGlobal.getWALAutoCheckpoint();
+        mCheckpointerPtr = nativeOpen(configuration.path, configuration.vfsName,
+                passiveFrames, passiveFrames * 4, passiveFrames * 16, IDLE_MILLIS);
+    }
+
+    // Called by SQLiteConnection only, which releases its own reference once closed.
+    long getNativePtr() {
+        return mCheckpointerPtr;
+    }
+
+    /**
+     * Returns the counters of the checkpoints run so far.
+     */
+    public Stats getStats() {
+        long[] values = new long[STAT_COUNT];
+        synchronized (this) {
+            if (mReleased) {
+                throw new IllegalStateException("The checkpointer has been released.");
+            }
+            nativeGetStats(mCheckpointerPtr, values);
+        }
+
+        Stats stats = new Stats();
+        stats.checkpoints = values[STAT_CHECKPOINTS];
+        stats.passiveCheckpoints = values[STAT_PASSIVE_CHECKPOINTS];
+        stats.restartCheckpoints = values[STAT_RESTART_CHECKPOINTS];
+        stats.truncateCheckpoints = values[STAT_TRUNCATE_CHECKPOINTS];
+        stats.failedCheckpoints = values[STAT_FAILED_CHECKPOINTS];
+        stats.busyRetries = values[STAT_BUSY_RETRIES];
+        stats.framesCheckpointed = values[STAT_FRAMES_CHECKPOINTED];
+        stats.lastFramesCheckpointed = values[STAT_LAST_FRAMES_CHECKPOINTED];
+        stats.maxWalFrames = values[STAT_MAX_WAL_FRAMES];
+        stats.lastDurationMicros = values[STAT_LAST_DURATION_MICROS];
+        stats.maxDurationMicros = values[STAT_MAX_DURATION_MICROS];
+        stats.totalDurationMicros = values[STAT_TOTAL_DURATION_MICROS];
+        return stats;
+    }
+
+    // Called by SQLiteConnectionPool only, once it is disposed.
+    void release() {
+        synchronized (this) {
+            if (mReleased) {
+                return;
+            }
+            mReleased = true;
+        }
+        nativeRelease(mCheckpointerPtr);
+    }
+}
@@ -32,15 +32,14 @@ import android.os.Looper;
 import android.os.ParcelFileDescriptor;
 import android.util.Log;
 import android.util.Printer;
-import androidx.collection.LruCache;
 import androidx.core.os.CancellationSignal;
 import androidx.core.os.OperationCanceledException;
 import io.requery.android.database.CursorWindow;
 
+import java.nio.ByteBuffer;
 import java.text.SimpleDateFormat;
 import java.util.ArrayList;
 import java.util.Date;
-import java.util.Map;
 import java.util.regex.Pattern;
 
 /**
@@ -101,6 +100,17 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
 
     private static final Pattern TRIM_SQL_PATTERN = Pattern.compile("[\\s]*\\n+[\\s]*");
 
+    // Indices of the counters filled in by nativeGetStatementCacheStats.
+    private static final int STATEMENT_CACHE_HITS = 0;
+    private static final int STATEMENT_CACHE_MISSES = 1;
+    private static final int STATEMENT_CACHE_EVICTIONS = 2;
+    private static final int STATEMENT_CACHE_SIZE = 3;
+
+    // Indices of the counters filled in by nativeGetDbLookaside.
+    private static final int LOOKASIDE_HITS = 0;
+    private static final int LOOKASIDE_MISSES_SIZE = 1;
+    private static final int LOOKASIDE_MISSES_FULL = 2;
+
     private final CloseGuard mCloseGuard = CloseGuard.get();
 
     private final SQLiteConnectionPool mPool;
@@ -108,7 +118,6 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     private final int mConnectionId;
     private final boolean mIsPrimaryConnection;
     private final boolean mIsReadOnlyConnection;
-    private final PreparedStatementCache mPreparedStatementCache;
     private PreparedStatement mPreparedStatementPool;
 
     // The recent operations log.
@@ -126,14 +135,29 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     private int mCancellationSignalAttachCount;
 
     private static native long nativeOpen(String path, int openFlags, String label,
-            boolean enableTrace, boolean enableProfile);
+            String vfsName, boolean enableTrace, boolean enableProfile, String[] nativeFunctions,
+            int lookasideSlotSize, int lookasideSlotCount);
     private static native void nativeClose(long connectionPtr);
     private static native void nativeRegisterCustomFunction(long connectionPtr,
             SQLiteCustomFunction function);
     private static native void nativeRegisterFunction(long connectionPtr,
         SQLiteFunction function);
+    private static native void nativeRegisterAggregateFunction(long connectionPtr,
+            SQLiteAggregateFunction function);
+    private static native void nativeRegisterNativeFunctions(long connectionPtr,
+            String[] nativeFunctions);
     private static native void nativeRegisterLocalizedCollators(long connectionPtr, String locale);
-    private static native long nativePrepareStatement(long connectionPtr, String sql);
+    private static native int nativeGetLocalizedCollatorVersion();
+    private static native long nativePrepareStatement(long connectionPtr, String sql,
+            boolean persistent);
+    private static native boolean nativeAcquireCachedStatement(long connectionPtr, String sql,
+            PreparedStatement statement);
+    private static native boolean nativeCacheStatement(long connectionPtr, String sql,
+            long statementPtr, int type);
+    private static native void nativeReleaseCachedStatement(long connectionPtr, long statementPtr);
+    private static native boolean nativeHasCachedStatement(long connectionPtr, String sql);
+    private static native void nativeResizeStatementCache(long connectionPtr, int size);
+    private static native void nativeGetStatementCacheStats(long connectionPtr, int[] stats);
     private static native void nativeFinalizeStatement(long connectionPtr, long statementPtr);
     private static native int nativeGetParameterCount(long connectionPtr, long statementPtr);
     private static native boolean nativeIsReadOnly(long connectionPtr, long statementPtr);
@@ -150,8 +174,10 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             int index, String value);
     private static native void nativeBindBlob(long connectionPtr, long statementPtr,
             int index, byte[] value);
-    private static native void nativeResetStatementAndClearBindings(
-            long connectionPtr, long statementPtr);
+    private static native void nativeBindBlobBuffer(long connectionPtr, long statementPtr,
+            int index, ByteBuffer value, int offset, int length);
+    private static native void nativeBindZeroBlob(long connectionPtr, long statementPtr,
+            int index, long length);
     private static native void nativeExecute(long connectionPtr, long statementPtr);
     private static native long nativeExecuteForLong(long connectionPtr, long statementPtr);
     private static native String nativeExecuteForString(long connectionPtr, long statementPtr);
@@ -162,13 +188,37 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             long connectionPtr, long statementPtr);
     private static native long nativeExecuteForCursorWindow(
             long connectionPtr, long statementPtr, long winPtr,
-            int startPos, int requiredPos, boolean countAllRows);
-    private static native int nativeGetDbLookaside(long connectionPtr);
+            int startPos, int requiredPos, boolean countAllRows, int lazyBlobThreshold);
+    private static native int nativeGetDbLookaside(long connectionPtr, int[] stats);
+    private static native void nativeApplyMemoryPolicy(long connectionPtr);
     private static native void nativeCancel(long connectionPtr);
     private static native void nativeResetCancel(long connectionPtr, boolean cancelable);
 
     private static native boolean nativeHasCodec();
     private static native void nativeLoadExtension(long connectionPtr, String file, String proc);
+    private static native long nativeOpenBlob(long connectionPtr, String database, String table,
+            String column, long rowId, boolean writable);
+    private static native byte[] nativeSerialize(long connectionPtr, String schema);
+    private static native long nativeSerializeToFileDescriptor(long connectionPtr, String schema,
+            int fd);
+    private static native void nativeDeserialize(long connectionPtr, String schema,
+            ByteBuffer buffer, int offset, int length, boolean readOnly);
+    private static native void nativeDeserializeFile(long connectionPtr, String schema,
+            String path, boolean readOnly);
+    private static native long nativeBackupOpen(long connectionPtr, long destinationPtr);
+    private static native int nativeBackupStep(long backupPtr, int pages, int[] progress);
+    private static native void nativeBackupFinish(long backupPtr);
+    private static native void nativeAttachCheckpointer(long connectionPtr,
+            long checkpointerPtr);
+    private static native long nativeSnapshotGet(long connectionPtr);
+    private static native void nativeSnapshotOpen(long connectionPtr, long snapshotPtr);
+    private static native int nativeSnapshotCompare(long snapshotPtr, long otherPtr);
+    private static native void nativeSnapshotFree(long snapshotPtr);
+
+    // Results of nativeBackupStep.
+    static final int BACKUP_MORE = 0;
+    static final int BACKUP_DONE = 1;
+    static final int BACKUP_BUSY = 2;
 
     public static boolean hasCodec(){ return nativeHasCodec(); }
 
@@ -180,8 +230,6 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         mConnectionId = connectionId;
         mIsPrimaryConnection = primaryConnection;
         mIsReadOnlyConnection = (configuration.openFlags & SQLiteDatabase.OPEN_READONLY) != 0;
-        mPreparedStatementCache = new PreparedStatementCache(
-                mConfiguration.maxSqlCacheSize);
         mCloseGuard.open("close");
     }
 
@@ -222,16 +270,25 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     }
 
     private void open() {
+        SQLiteGlobal.onConnectionOpened();
         mConnectionPtr = nativeOpen(mConfiguration.path,
                 // remove the wal flag as its a custom flag not supported by sqlite3_open_v2
                 mConfiguration.openFlags & ~SQLiteDatabase.ENABLE_WRITE_AHEAD_LOGGING,
-                mConfiguration.label,
-                SQLiteDebug.DEBUG_SQL_STATEMENTS, SQLiteDebug.DEBUG_SQL_TIME);
+                mConfiguration.label, mConfiguration.vfsName,
+                SQLiteDebug.DEBUG_SQL_STATEMENTS, SQLiteDebug.DEBUG_SQL_TIME,
+                mConfiguration.nativeFunctions.toArray(
+                        new String[mConfiguration.nativeFunctions.size()]),
+                mConfiguration.lookasideSlotSize, mConfiguration.lookasideSlotCount);
+        nativeResizeStatementCache(mConnectionPtr, mConfiguration.maxSqlCacheSize);
+        nativeApplyMemoryPolicy(mConnectionPtr);
 
         setPageSize();
         setForeignKeyModeFromConfiguration();
         setJournalSizeLimit();
         setAutoCheckpointInterval();
+        if (mConfiguration.mmapSize != 0) {
+            setMmapSizeFromConfiguration();
+        }
         if (!nativeHasCodec()) {
             setWalModeFromConfiguration();
             setLocaleFromConfiguration();
@@ -251,6 +308,13 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             nativeRegisterFunction(mConnectionPtr, function);
         }
 
+        // Register aggregate functions
+        final int aggregateFunctionCount = mConfiguration.aggregateFunctions.size();
+        for (int i = 0; i < aggregateFunctionCount; i++) {
+            SQLiteAggregateFunction function = mConfiguration.aggregateFunctions.get(i);
+            nativeRegisterAggregateFunction(mConnectionPtr, function);
+        }
+
         // Register custom extensions
         for (SQLiteCustomExtension extension : mConfiguration.customExtensions) {
             nativeLoadExtension(mConnectionPtr, extension.path, extension.entryPoint);
@@ -268,7 +332,7 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         if (mConnectionPtr != 0) {
             final int cookie = mRecentOperations.beginOperation("close", null, null);
             try {
-                mPreparedStatementCache.evictAll();
+                // Finalizes the statements in the native statement cache as well.
                 nativeClose(mConnectionPtr);
                 mConnectionPtr = 0;
             } finally {
@@ -289,6 +353,14 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
 
     private void setAutoCheckpointInterval() {
         if (!mConfiguration.isInMemoryDb() && !mIsReadOnlyConnection) {
+            final SQLiteCheckpointer checkpointer =
+                    mPool != null ? mPool.getCheckpointer() : null;
+            if (checkpointer != null) {
+                // Replaces the auto-checkpoint of the connection.
+                nativeAttachCheckpointer(mConnectionPtr, checkpointer.getNativePtr());
+                return;
+            }
+
             final long newValue = SQLiteGlobal.getWALAutoCheckpoint();
             long value = executeForLong("PRAGMA wal_autocheckpoint", null, null);
             if (value != newValue) {
@@ -307,6 +379,13 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         }
     }
 
+    private void setMmapSizeFromConfiguration() {
+        if (!mConfiguration.isInMemoryDb()) {
+            // The size granted may be less than the one asked for, so it is always set.
+            executeForLong("PRAGMA mmap_size=" + mConfiguration.mmapSize, null, null);
+        }
+    }
+
     private void setForeignKeyModeFromConfiguration() {
         if (!mIsReadOnlyConnection) {
             final long newValue = mConfiguration.foreignKeyConstraintsEnabled ? 1 : 0;
@@ -403,10 +482,18 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             // Ensure the android metadata table exists.
             execute("CREATE TABLE IF NOT EXISTS android_metadata (locale TEXT)", null, null);
 
-            // Check whether the locale was actually changed.
+            // Check whether the locale or the collation order was actually changed. The
+            // version is kept in a column of its own, which stock Android leaves NULL when
+            // it changes the locale and rebuilds the indexes with its own collation.
             final String oldLocale = executeForString("SELECT locale FROM android_metadata "
                     + "UNION SELECT NULL ORDER BY locale DESC LIMIT 1", null, null);
-            if (oldLocale != null && oldLocale.equals(newLocale)) {
+            final boolean hasVersion = executeForLong("SELECT count(*) FROM "
+                    + "pragma_table_info('android_metadata') WHERE name = 'collation_version'",
+                    null, null) != 0;
+            final long oldVersion = hasVersion ? executeForLong("SELECT "
+                    + "ifnull(max(collation_version), 0) FROM android_metadata", null, null) : 0;
+            final int newVersion = nativeGetLocalizedCollatorVersion();
+            if (oldLocale != null && oldLocale.equals(newLocale) && oldVersion == newVersion) {
                 return;
             }
 
@@ -414,9 +501,13 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             execute("BEGIN", null, null);
             boolean success = false;
             try {
+                if (!hasVersion) {
+                    execute("ALTER TABLE android_metadata ADD COLUMN collation_version INTEGER",
+                            null, null);
+                }
                 execute("DELETE FROM android_metadata", null, null);
-                execute("INSERT INTO android_metadata (locale) VALUES(?)",
-                        new Object[] { newLocale }, null);
+                execute("INSERT INTO android_metadata (locale, collation_version) VALUES(?, ?)",
+                        new Object[] { newLocale, newVersion }, null);
                 execute("REINDEX LOCALIZED", null, null);
                 success = true;
             } finally {
@@ -434,6 +525,17 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         }
     }
 
+    /**
+     * Adopts the page cache size of the memory governor and, under memory pressure,
+     * releases the unused cache pages by which SQLite exceeds its soft heap limit. Called
+     * by the connection pool while it owns the connection.
+     */
+    void applyMemoryPolicy() {
+        if (mConnectionPtr != 0) {
+            nativeApplyMemoryPolicy(mConnectionPtr);
+        }
+    }
+
     // Called by SQLiteConnectionPool only.
     void reconfigure(SQLiteDatabaseConfiguration configuration) {
         mOnlyAllowReadOnlyOperations = false;
@@ -456,24 +558,51 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             }
         }
 
+        // Register aggregate functions
+        final int aggregateFunctionCount = configuration.aggregateFunctions.size();
+        for (int i = 0; i < aggregateFunctionCount; i++) {
+            SQLiteAggregateFunction function = configuration.aggregateFunctions.get(i);
+            if (!mConfiguration.aggregateFunctions.contains(function)) {
+                nativeRegisterAggregateFunction(mConnectionPtr, function);
+            }
+        }
+
+        // Register native functions
+        ArrayList<String> nativeFunctions = new ArrayList<>();
+        for (String group : configuration.nativeFunctions) {
+            if (!mConfiguration.nativeFunctions.contains(group)) {
+                nativeFunctions.add(group);
+            }
+        }
+        if (!nativeFunctions.isEmpty()) {
+            nativeRegisterNativeFunctions(mConnectionPtr,
+                    nativeFunctions.toArray(new String[nativeFunctions.size()]));
+        }
+
         // Remember what changed.
         boolean foreignKeyModeChanged = configuration.foreignKeyConstraintsEnabled
                 != mConfiguration.foreignKeyConstraintsEnabled;
         boolean walModeChanged = ((configuration.openFlags ^ mConfiguration.openFlags)
                 & SQLiteDatabase.ENABLE_WRITE_AHEAD_LOGGING) != 0;
         boolean localeChanged = !configuration.locale.equals(mConfiguration.locale);
+        boolean mmapSizeChanged = configuration.mmapSize != mConfiguration.mmapSize;
 
         // Update configuration parameters.
         mConfiguration.updateParametersFrom(configuration);
 
         // Update prepared statement cache size.
-        /* mPreparedStatementCache.resize(configuration.maxSqlCacheSize); */
+        nativeResizeStatementCache(mConnectionPtr, configuration.maxSqlCacheSize);
 
         // Update foreign key mode.
         if (foreignKeyModeChanged) {
             setForeignKeyModeFromConfiguration();
         }
 
+        // Update memory-mapped I/O.
+        if (mmapSizeChanged) {
+            setMmapSizeFromConfiguration();
+        }
+
         // Update WAL.
         if (walModeChanged) {
             setWalModeFromConfiguration();
@@ -495,7 +624,7 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     // Called by SQLiteConnectionPool only.
     // Returns true if the prepared statement cache contains the specified SQL.
     boolean isPreparedStatementInCache(String sql) {
-        return mPreparedStatementCache.get(sql) != null;
+        return nativeHasCachedStatement(mConnectionPtr, sql);
     }
 
     /**
@@ -693,6 +822,285 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         }
     }
 
+    /**
+     * Opens a handle for incremental I/O on a single BLOB value.
+     * <p>
+     * The returned handle refers to this connection and must be closed with
+     * {@link SQLiteBlob#close} before the connection is released.
+     * </p>
+     *
+     * @param database The symbolic name of the database, such as "main".
+     * @param table The name of the table containing the BLOB.
+     * @param column The name of the column containing the BLOB.
+     * @param rowId The row id of the row containing the BLOB.
+     * @param writable True to open the BLOB for writing.
+     * @return A pointer to the native blob handle.
+     *
+     * @throws SQLiteException if an error occurs, such as a missing row or column.
+     */
+    public long openBlob(String database, String table, String column, long rowId,
+            boolean writable) {
+        if (database == null || table == null || column == null) {
+            throw new IllegalArgumentException("database, table and column must not be null.");
+        }
+
+        final int cookie = mRecentOperations.beginOperation("openBlob",
+                table + "." + column, null);
+        try {
+            if (writable && mOnlyAllowReadOnlyOperations) {
+                throw new SQLiteException("Cannot open this blob for writing because "
+                        + "the connection is read-only.");
+            }
+            return nativeOpenBlob(mConnectionPtr, database, table, column, rowId, writable);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Returns the content of a database as a byte array in the format of a database file.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @return The serialized database.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read.
+     */
+    public byte[] serialize(String schema) {
+        if (schema == null) {
+            throw new IllegalArgumentException("schema must not be null.");
+        }
+
+        final int cookie = mRecentOperations.beginOperation("serialize", schema, null);
+        try {
+            return nativeSerialize(mConnectionPtr, schema);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Writes the content of a database to a file descriptor in the format of a database
+     * file, starting at its current offset.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param fd The file descriptor to write to.
+     * @return The number of bytes written.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read, or
+     * {@link android.database.sqlite.SQLiteDiskIOException} if writing to fd fails.
+     */
+    public long serialize(String schema, ParcelFileDescriptor fd) {
+        if (schema == null || fd == null) {
+            throw new IllegalArgumentException("schema and fd must not be null.");
+        }
+
+        final int cookie = mRecentOperations.beginOperation("serialize", schema, null);
+        try {
+            return nativeSerializeToFileDescriptor(mConnectionPtr, schema, fd.getFd());
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Replaces a database of this connection with an in-memory database holding the
+     * remaining bytes of a direct buffer, which are in the format of a database file.
+     * <p>
+     * A read-only database is read from the buffer in place, which must not change while
+     * the database is open. A writable database is a copy of the buffer.
+     * </p>
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param buffer The direct buffer holding the database.
+     * @param readOnly True to read the buffer in place.
+     *
+     * @throws SQLiteException if the database cannot be replaced.
+     */
+    public void deserialize(String schema, ByteBuffer buffer, boolean readOnly) {
+        if (schema == null || buffer == null) {
+            throw new IllegalArgumentException("schema and buffer must not be null.");
+        }
+        if (!buffer.isDirect()) {
+            throw new IllegalArgumentException("Deserializing requires a direct buffer.");
+        }
+
+        final int cookie = mRecentOperations.beginOperation("deserialize", schema, null);
+        try {
+            throwIfDeserializeForbidden();
+            nativeDeserialize(mConnectionPtr, schema, buffer, buffer.position(),
+                    buffer.remaining(), readOnly);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Replaces a database of this connection with an in-memory database holding the
+     * content of a database file.
+     * <p>
+     * A read-only database is read from a mapping of the file, which must not change while
+     * the database is open. A writable database is a copy of the file.
+     * </p>
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param path The path of the database file.
+     * @param readOnly True to map the file rather than copy it.
+     *
+     * @throws SQLiteException if the database cannot be replaced, or
+     * {@link android.database.sqlite.SQLiteDiskIOException} if the file cannot be read.
+     */
+    public void deserialize(String schema, String path, boolean readOnly) {
+        if (schema == null || path == null) {
+            throw new IllegalArgumentException("schema and path must not be null.");
+        }
+
+        final int cookie = mRecentOperations.beginOperation("deserialize", schema, null);
+        try {
+            throwIfDeserializeForbidden();
+            nativeDeserializeFile(mConnectionPtr, schema, path, readOnly);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Starts an online backup of the main database of this connection into the main
+     * database of another connection.
+     * <p>
+     * Changes made through this connection while the backup is in progress are copied to
+     * the destination as they are made; changes made through any other connection restart
+     * the backup. The backup must be finished with {@link #finishBackup} before either
+     * connection is released.
+     * </p>
+     *
+     * @param destination The connection to copy the database into.
+     * @return A pointer to the native backup handle.
+     *
+     * @throws SQLiteException if the backup cannot be started, for instance because the
+     * destination is in use.
+     */
+    public long openBackup(SQLiteConnection destination) {
+        final int cookie = mRecentOperations.beginOperation("openBackup",
+                destination.mConfiguration.label, null);
+        try {
+            return nativeBackupOpen(mConnectionPtr, destination.mConnectionPtr);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Copies up to the given number of pages of a backup started by {@link #openBackup}.
+     *
+     * @param backupPtr The native backup handle.
+     * @param pages The number of pages to copy, or a negative number to copy all of them.
+     * @param progress Receives the number of pages left to copy and the number of pages
+     * of the database.
+     * @return {@link #BACKUP_DONE} once the database has been copied, {@link #BACKUP_BUSY}
+     * if the database was locked and the step should be tried again later, or
+     * {@link #BACKUP_MORE}.
+     *
+     * @throws SQLiteException if copying fails.
+     */
+    public int stepBackup(long backupPtr, int pages, int[] progress) {
+        final int cookie = mRecentOperations.beginOperation("stepBackup", null, null);
+        try {
+            return nativeBackupStep(backupPtr, pages, progress);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Releases a backup started by {@link #openBackup}, whether it is complete or not.
+     *
+     * @param backupPtr The native backup handle.
+     *
+     * @throws SQLiteException if a step of the backup failed.
+     */
+    public void finishBackup(long backupPtr) {
+        nativeBackupFinish(backupPtr);
+    }
+
+    /**
+     * Records the state of the database read by the transaction in progress, which must
+     * not have written yet. A read transaction is opened first if it has not read yet.
+     *
+     * @return A pointer to the native snapshot, which must be freed with
+     * {@link #freeSnapshot}.
+     *
+     * @throws SQLiteException if the database is not in WAL mode, or a snapshot cannot be
+     * taken.
+     */
+    public long getSnapshot() {
+        final int cookie = mRecentOperations.beginOperation("getSnapshot", null, null);
+        try {
+            return nativeSnapshotGet(mConnectionPtr);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    /**
+     * Makes the transaction in progress, which must have just begun, read the state of
+     * the database recorded by a snapshot taken by {@link #getSnapshot}, on this or any
+     * other connection of the database.
+     *
+     * @param snapshotPtr The native snapshot.
+     *
+     * @throws SQLiteException if the snapshot is no longer available.
+     */
+    public void openSnapshot(long snapshotPtr) {
+        final int cookie = mRecentOperations.beginOperation("openSnapshot", null, null);
+        try {
+            nativeSnapshotOpen(mConnectionPtr, snapshotPtr);
+        } catch (RuntimeException ex) {
+            mRecentOperations.failOperation(cookie, ex);
+            throw ex;
+        } finally {
+            mRecentOperations.endOperation(cookie);
+        }
+    }
+
+    static int compareSnapshots(long snapshotPtr, long otherPtr) {
+        return nativeSnapshotCompare(snapshotPtr, otherPtr);
+    }
+
+    static void freeSnapshot(long snapshotPtr) {
+        nativeSnapshotFree(snapshotPtr);
+    }
+
+    private void throwIfDeserializeForbidden() {
+        if (mOnlyAllowReadOnlyOperations) {
+            throw new SQLiteException("Cannot deserialize a database because "
+                    + "the connection is read-only.");
+        }
+    }
+
     /**
      * Executes a statement that returns a single BLOB result as a
      * file descriptor to a shared memory region.
@@ -892,7 +1300,8 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
                     try {
                         final long result = nativeExecuteForCursorWindow(
                                 mConnectionPtr, statement.mStatementPtr, window.mWindowPtr,
-                                startPos, requiredPos, countAllRows);
+                                startPos, requiredPos, countAllRows,
+                                mConfiguration.lazyBlobThreshold);
                         actualPos = (int)(result >> 32);
                         countedRows = (int)result;
                         filledRows = window.getNumRows();
@@ -922,34 +1331,38 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     }
 
     private PreparedStatement acquirePreparedStatement(String sql) {
-        PreparedStatement statement = mPreparedStatementCache.get(sql);
-        boolean skipCache = false;
-        if (statement != null) {
-            if (!statement.mInUse) {
-                return statement;
-            }
-            // The statement is already in the cache but is in use (this statement appears
-            // to be not only re-entrant but recursive!).  So prepare a new copy of the
-            // statement but do not cache it.
-            skipCache = true;
+        PreparedStatement statement = obtainPreparedStatement(sql);
+        if (nativeAcquireCachedStatement(mConnectionPtr, sql, statement)) {
+            // The native cache had an idle copy and filled in the statement for us.
+            statement.mInCache = true;
+            statement.mInUse = true;
+            return statement;
+        }
+
+        // Either the statement is not cached or the cached copy is in use (this statement
+        // appears to be not only re-entrant but recursive!), in which case the new copy
+        // will not be cached.
+        final int type = SQLiteStatementType.getSqlStatementType(sql);
+        final boolean cacheable = isCacheable(type);
+        final long statementPtr;
+        try {
+            statementPtr = nativePrepareStatement(mConnectionPtr, sql, cacheable);
+        } catch (RuntimeException ex) {
+            recyclePreparedStatement(statement);
+            throw ex;
         }
-
-        final long statementPtr = nativePrepareStatement(mConnectionPtr, sql);
         try {
-            final int numParameters = nativeGetParameterCount(mConnectionPtr, statementPtr);
-            final int type = SQLiteStatementType.getSqlStatementType(sql);
-            final boolean readOnly = nativeIsReadOnly(mConnectionPtr, statementPtr);
-            statement = obtainPreparedStatement(sql, statementPtr, numParameters, type, readOnly);
-            if (!skipCache && isCacheable(type)) {
-                mPreparedStatementCache.put(sql, statement);
-                statement.mInCache = true;
+            statement.mStatementPtr = statementPtr;
+            statement.mNumParameters = nativeGetParameterCount(mConnectionPtr, statementPtr);
+            statement.mType = type;
+            statement.mReadOnly = nativeIsReadOnly(mConnectionPtr, statementPtr);
+            if (cacheable) {
+                statement.mInCache = nativeCacheStatement(mConnectionPtr, sql, statementPtr, type);
             }
         } catch (RuntimeException ex) {
-            // Finalize the statement if an exception occurred and we did not add
-            // it to the cache.  If it is already in the cache, then leave it there.
-            if (statement == null || !statement.mInCache) {
-                nativeFinalizeStatement(mConnectionPtr, statementPtr);
-            }
+            // Finalize the statement if an exception occurred, it has not been cached.
+            nativeFinalizeStatement(mConnectionPtr, statementPtr);
+            recyclePreparedStatement(statement);
             throw ex;
         }
         statement.mInUse = true;
@@ -959,28 +1372,12 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     private void releasePreparedStatement(PreparedStatement statement) {
         statement.mInUse = false;
         if (statement.mInCache) {
-            try {
-                nativeResetStatementAndClearBindings(mConnectionPtr, statement.mStatementPtr);
-            } catch (SQLiteException ex) {
-                // The statement could not be reset due to an error.  Remove it from the cache.
-                // When remove() is called, the cache will invoke its entryRemoved() callback,
-                // which will in turn call finalizePreparedStatement() to finalize and
-                // recycle the statement.
-                if (DEBUG) {
-                    Log.d(TAG, "Could not reset prepared statement due to an exception.  "
-                            + "Removing it from the cache.  SQL: "
-                            + trimSqlForDisplay(statement.mSql), ex);
-                }
-
-                mPreparedStatementCache.remove(statement.mSql);
-            }
+            // Resets the statement and clears its bindings for reuse.  The cache finalizes
+            // the statement instead if it could not be reset or no longer fits.
+            nativeReleaseCachedStatement(mConnectionPtr, statement.mStatementPtr);
         } else {
-            finalizePreparedStatement(statement);
+            nativeFinalizeStatement(mConnectionPtr, statement.mStatementPtr);
         }
-    }
-
-    private void finalizePreparedStatement(PreparedStatement statement) {
-        nativeFinalizeStatement(mConnectionPtr, statement.mStatementPtr);
         recyclePreparedStatement(statement);
     }
 
@@ -1056,7 +1453,14 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
                             ((Number)arg).doubleValue());
                     break;
                 case Cursor.FIELD_TYPE_BLOB:
-                    nativeBindBlob(mConnectionPtr, statementPtr, i + 1, (byte[])arg);
+                    if (arg instanceof byte[]) {
+                        nativeBindBlob(mConnectionPtr, statementPtr, i + 1, (byte[])arg);
+                    } else if (arg instanceof ByteBuffer) {
+                        bindBlobBuffer(statementPtr, i + 1, (ByteBuffer)arg);
+                    } else {
+                        nativeBindZeroBlob(mConnectionPtr, statementPtr, i + 1,
+                                ((SQLiteBlob.ZeroBlob)arg).length);
+                    }
                     break;
                 case Cursor.FIELD_TYPE_STRING:
                 default:
@@ -1072,6 +1476,19 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         }
     }
 
+    private void bindBlobBuffer(long statementPtr, int index, ByteBuffer buffer) {
+        if (buffer.isDirect()) {
+            // Bound in place, the buffer stays referenced by the bind arguments until the
+            // statement has been reset.
+            nativeBindBlobBuffer(mConnectionPtr, statementPtr, index, buffer,
+                    buffer.position(), buffer.remaining());
+        } else {
+            byte[] value = new byte[buffer.remaining()];
+            buffer.duplicate().get(value);
+            nativeBindBlob(mConnectionPtr, statementPtr, index, value);
+        }
+    }
+
     /**
      * Returns data type of the given object's value.
      *<p>
@@ -1092,7 +1509,8 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     private static int getTypeOfObject(Object obj) {
         if (obj == null) {
             return Cursor.FIELD_TYPE_NULL;
-        } else if (obj instanceof byte[]) {
+        } else if (obj instanceof byte[] || obj instanceof ByteBuffer
+            || obj instanceof SQLiteBlob.ZeroBlob) {
             return Cursor.FIELD_TYPE_BLOB;
         } else if (obj instanceof Float || obj instanceof Double) {
             return Cursor.FIELD_TYPE_FLOAT;
@@ -1163,8 +1581,12 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
 
         mRecentOperations.dump(printer, verbose);
 
-        if (verbose) {
-            mPreparedStatementCache.dump(printer);
+        if (verbose && mConnectionPtr != 0) {
+            final int[] stats = getStatementCacheStatsUnsafe();
+            printer.println("  Prepared statement cache: size=" + stats[STATEMENT_CACHE_SIZE]
+                    + ", hits=" + stats[STATEMENT_CACHE_HITS]
+                    + ", misses=" + stats[STATEMENT_CACHE_MISSES]
+                    + ", evictions=" + stats[STATEMENT_CACHE_EVICTIONS]);
         }
     }
 
@@ -1193,7 +1615,8 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
      */
     void collectDbStats(ArrayList<SQLiteDebug.DbStats> dbStatsList) {
         // Get information about the main database.
-        int lookaside = nativeGetDbLookaside(mConnectionPtr);
+        final int[] lookasideStats = new int[3];
+        int lookaside = nativeGetDbLookaside(mConnectionPtr, lookasideStats);
         long pageCount = 0;
         long pageSize = 0;
         try {
@@ -1202,7 +1625,11 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         } catch (SQLiteException ex) {
             // Ignore.
         }
-        dbStatsList.add(getMainDbStatsUnsafe(lookaside, pageCount, pageSize));
+        SQLiteDebug.DbStats mainStats = getMainDbStatsUnsafe(lookaside, pageCount, pageSize);
+        mainStats.lookasideHits = lookasideStats[LOOKASIDE_HITS];
+        mainStats.lookasideMissesSize = lookasideStats[LOOKASIDE_MISSES_SIZE];
+        mainStats.lookasideMissesFull = lookasideStats[LOOKASIDE_MISSES_FULL];
+        dbStatsList.add(mainStats);
 
         // Get information about attached databases.
         // We ignore the first row in the database list because it corresponds to
@@ -1243,16 +1670,26 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
     }
 
     private SQLiteDebug.DbStats getMainDbStatsUnsafe(int lookaside, long pageCount, long pageSize) {
-        // The prepared statement cache is thread-safe so we can access its statistics
-        // even if we do not own the database connection.
+        // The native statement cache counters can be read from any thread so we can access
+        // them even if we do not own the database connection.
+        final int[] stats = getStatementCacheStatsUnsafe();
         String label = mConfiguration.path;
         if (!mIsPrimaryConnection) {
             label += " (" + mConnectionId + ")";
         }
         return new SQLiteDebug.DbStats(label, pageCount, pageSize, lookaside,
-                mPreparedStatementCache.hitCount(),
-                mPreparedStatementCache.missCount(),
-                mPreparedStatementCache.size());
+                stats[STATEMENT_CACHE_HITS],
+                stats[STATEMENT_CACHE_MISSES],
+                stats[STATEMENT_CACHE_SIZE],
+                stats[STATEMENT_CACHE_EVICTIONS]);
+    }
+
+    private int[] getStatementCacheStatsUnsafe() {
+        final int[] stats = new int[4];
+        if (mConnectionPtr != 0) {
+            nativeGetStatementCacheStats(mConnectionPtr, stats);
+        }
+        return stats;
     }
 
     @Override
@@ -1260,8 +1697,7 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         return "SQLiteConnection: " + mConfiguration.path + " (" + mConnectionId + ")";
     }
 
-    private PreparedStatement obtainPreparedStatement(String sql, long statementPtr,
-            int numParameters, int type, boolean readOnly) {
+    private PreparedStatement obtainPreparedStatement(String sql) {
         PreparedStatement statement = mPreparedStatementPool;
         if (statement != null) {
             mPreparedStatementPool = statement.mPoolNext;
@@ -1271,10 +1707,6 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
             statement = new PreparedStatement();
         }
         statement.mSql = sql;
-        statement.mStatementPtr = statementPtr;
-        statement.mNumParameters = numParameters;
-        statement.mType = type;
-        statement.mReadOnly = readOnly;
         return statement;
     }
 
@@ -1297,6 +1729,9 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
      * In particular, closing the connection requires a guarantee of deterministic
      * resource disposal because all native statement objects must be freed before
      * the native database object can be closed.  So no finalizers here.
+     *
+     * Cached statements are owned by the native statement cache, which fills in
+     * the statement fields when it hands out a cached copy.
      */
     private static final class PreparedStatement {
         // Next item in pool.
@@ -1306,7 +1741,7 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         public String mSql;
 
         // The native sqlite3_stmt object pointer.
-        // Lifetime is managed explicitly by the connection.
+        // Lifetime is managed explicitly by the connection or its statement cache.
         public long mStatementPtr;
 
         // The number of parameters that the prepared statement has.
@@ -1328,45 +1763,6 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
         public boolean mInUse;
     }
 
-    private final class PreparedStatementCache
-            extends LruCache<String, PreparedStatement> {
-        public PreparedStatementCache(int size) {
-            super(size);
-        }
-
-        @Override
-        protected void entryRemoved(boolean evicted, String key,
-                PreparedStatement oldValue, PreparedStatement newValue) {
-            oldValue.mInCache = false;
-            if (!oldValue.mInUse) {
-                finalizePreparedStatement(oldValue);
-            }
-        }
-
-        public void dump(Printer printer) {
-            printer.println("  Prepared statement cache:");
-            Map<String, PreparedStatement> cache = snapshot();
-            if (!cache.isEmpty()) {
-                int i = 0;
-                for (Map.Entry<String, PreparedStatement> entry : cache.entrySet()) {
-                    PreparedStatement statement = entry.getValue();
-                    if (statement.mInCache) { // might be false due to a race with entryRemoved
-                        String sql = entry.getKey();
-                        printer.println("    " + i + ": statementPtr=0x"
-                                + Long.toHexString(statement.mStatementPtr)
-                                + ", numParameters=" + statement.mNumParameters
-                                + ", type=" + statement.mType
-                                + ", readOnly=" + statement.mReadOnly
-                                + ", sql=\"" + trimSqlForDisplay(sql) + "\"");
-                    }
-                    i += 1;
-                }
-            } else {
-                printer.println("    <none>");
-            }
-        }
-    }
-
     private static final class OperationLog {
         private static final int MAX_RECENT_OPERATIONS = 20;
         private static final int COOKIE_GENERATION_SHIFT = 8;
@@ -1400,7 +1796,7 @@ public final class SQLiteConnection implements CancellationSignal.OnCancelListen
                         operation.mBindArgs.clear();
                     }
                     for (final Object arg : bindArgs) {
-                        if (arg != null && arg instanceof byte[]) {
+                        if (arg instanceof byte[] || arg instanceof ByteBuffer) {
                             // Don't hold onto the real byte array longer than necessary.
                             operation.mBindArgs.add(EMPTY_BYTE_ARRAY);
                         } else {
@@ -95,6 +95,10 @@ public final class SQLiteConnectionPool implements Closeable {
     private final ArrayList<SQLiteConnection> mAvailableNonPrimaryConnections = new ArrayList<>();
     private SQLiteConnection mAvailablePrimaryConnection;
 
+    // Checkpoints the WAL in the background, if the configuration asked for it when the
+    // pool was opened.
+    private SQLiteCheckpointer mCheckpointer;
+
     // Describes what should happen to an acquired connection when it is returned to the pool.
     enum AcquiredConnectionStatus {
         // The connection should be returned to the pool as usual.
@@ -183,10 +187,21 @@ public final class SQLiteConnectionPool implements Closeable {
 
     // Might throw
     private void open() {
+        // Start the checkpointer before any connection reports commits to it.
+        if (mConfiguration.backgroundCheckpoint && !mConfiguration.isInMemoryDb()
+                && (mConfiguration.openFlags & SQLiteDatabase.OPEN_READONLY) == 0) {
+            mCheckpointer = new SQLiteCheckpointer(mConfiguration);
+        }
+
         // Open the primary connection.
         // This might throw if the database is corrupt.
-        mAvailablePrimaryConnection = openConnectionLocked(mConfiguration,
-                true /*primaryConnection*/); // might throw
+        try {
+            mAvailablePrimaryConnection = openConnectionLocked(mConfiguration,
+                    true /*primaryConnection*/); // might throw
+        } catch (RuntimeException ex) {
+            releaseCheckpointer();
+            throw ex;
+        }
 
         // Mark the pool as being open for business.
         mIsOpen = true;
@@ -239,6 +254,9 @@ public final class SQLiteConnectionPool implements Closeable {
                 wakeConnectionWaitersLocked();
             }
         }
+
+        // Connections still open keep the checkpointer until they are closed.
+        releaseCheckpointer();
     }
 
     /**
@@ -408,9 +426,25 @@ public final class SQLiteConnectionPool implements Closeable {
             closeConnectionAndLogExceptionsLocked(connection);
             return false;
         }
+        connection.applyMemoryPolicy();
         return true;
     }
 
+    /**
+     * Applies the memory policy to the connections that are not currently in use.
+     * Connections in use catch up once they are released.
+     */
+    public void applyMemoryPolicy() {
+        synchronized (mLock) {
+            if (mAvailablePrimaryConnection != null) {
+                mAvailablePrimaryConnection.applyMemoryPolicy();
+            }
+            for (SQLiteConnection connection : mAvailableNonPrimaryConnections) {
+                connection.applyMemoryPolicy();
+            }
+        }
+    }
+
     /**
      * Returns true if the session should yield the connection due to
      * contention over available database connections.
@@ -497,6 +531,23 @@ public final class SQLiteConnectionPool implements Closeable {
         mConnectionLeaked.set(true);
     }
 
+    /**
+     * Gets the checkpointer that checkpoints the WAL of the database in the background.
+     *
+     * @return The checkpointer, or null if the database was not opened with
+     * {@link SQLiteDatabaseConfiguration#backgroundCheckpoint} set.
+     */
+    public SQLiteCheckpointer getCheckpointer() {
+        return mCheckpointer;
+    }
+
+    // Can't throw.
+    private void releaseCheckpointer() {
+        if (mCheckpointer != null) {
+            mCheckpointer.release();
+        }
+    }
+
     // Can't throw.
     private void closeAvailableConnectionsAndLogExceptionsLocked() {
         closeAvailableNonPrimaryConnectionsAndLogExceptionsLocked();
@@ -136,6 +136,37 @@ public class SQLiteCursor extends AbstractWindowedCursor {
         }
     }
 
+    /**
+     * {@inheritDoc}
+     * <p>
+     * Blobs that were left in the database because they exceed the
+     * {@link SQLiteDatabase#setLazyBlobThreshold lazy blob threshold} are read from it now.
+     * </p>
+     */
+    @Override
+    public byte[] getBlob(int columnIndex) {
+        byte[] value = super.getBlob(columnIndex);
+        if (value == null) {
+            CursorWindow.BlobReference reference = mWindow.getBlobReference(mPos, columnIndex);
+            if (reference != null) {
+                value = readBlob(reference);
+            }
+        }
+        return value;
+    }
+
+    private byte[] readBlob(CursorWindow.BlobReference reference) {
+        SQLiteBlob blob = getDatabase().openBlob(reference.database, reference.table,
+                reference.column, reference.rowId, false);
+        try {
+            byte[] value = new byte[blob.getLength()];
+            blob.read(value, 0, value.length, 0);
+            return value;
+        } finally {
+            blob.close();
+        }
+    }
+
     @Override
     public int getColumnIndex(String columnName) {
         // Create mColumnNameMap on demand
@@ -52,6 +52,7 @@ import java.io.FileFilter;
 import java.io.IOException;
 import java.lang.annotation.Retention;
 import java.lang.annotation.RetentionPolicy;
+import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.List;
 import java.util.Locale;
@@ -271,6 +272,74 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
      */
     public static final int MAX_SQL_CACHE_SIZE = 100;
 
+    /**
+     * Native functions regexp(P, X), which also implements the X REGEXP P operator,
+     * matching X against the POSIX extended regular expression P.
+     *
+     * @see #addNativeFunctions(String...)
+     */
+    public static final String NATIVE_FUNCTIONS_REGEXP = "regexp";
+
+    /**
+     * Native functions unicode_lower(X), unicode_upper(X) and unicode_casefold(X), which
+     * map the case of Latin, Greek, Cyrillic and Armenian letters.
+     *
+     * @see #addNativeFunctions(String...)
+     */
+    public static final String NATIVE_FUNCTIONS_UNICODE = "unicode";
+
+    /**
+     * Native function unaccent(X), which replaces accented letters with their base letters.
+     *
+     * @see #addNativeFunctions(String...)
+     */
+    public static final String NATIVE_FUNCTIONS_UNACCENT = "unaccent";
+
+    /**
+     * Native function haversine(LAT1, LON1, LAT2, LON2), the great-circle distance in
+     * meters between two points given in degrees.
+     *
+     * @see #addNativeFunctions(String...)
+     */
+    public static final String NATIVE_FUNCTIONS_HAVERSINE = "haversine";
+
+    /**
+     * Native functions bit_and(X, Y), bit_or(X, Y), bit_xor(X, Y), bit_not(X) and
+     * bit_count(X) on blobs, padding the shorter operand with zero bytes.
+     *
+     * @see #addNativeFunctions(String...)
+     */
+    public static final String NATIVE_FUNCTIONS_BITOPS = "bitops";
+
+    /**
+     * VFS that stores the pages of new databases compressed with LZ4, for large databases
+     * that are mostly read. Set it as the {@link SQLiteDatabaseConfiguration#vfsName} of
+     * the database before opening it.
+     * <p>
+     * A new database file becomes a container of compressed pages, which other VFSes
+     * cannot open. A database that already exists as a plain file is opened as it is;
+     * copy it with VACUUM INTO to a new database opened through this VFS to compress it.
+     * Journals and WAL files are not compressed, and memory-mapped I/O is not available.
+     * Only one process may open a compressed database. Decompressed pages are kept in a
+     * cache sized with {@link SQLiteGlobal#setCompressedCacheSize(long)}.
+     * </p>
+     */
+    public static final String VFS_COMPRESSED = "android-compressed";
+
+    /**
+     * Read-only VFS that opens a database stored in a ZIP archive, such as an asset of the
+     * APK, in place rather than extracting it first. The path of the database is the path of the
+     * archive, "!/" and the name of the entry. See
+     * {@link #openZipDatabase(String, String, CursorFactory)}.
+     * <p>
+     * The entry must be stored rather than deflated, for instance by listing its extension
+     * in the noCompress option of aaptOptions. A database in WAL mode must be checkpointed
+     * before it is packed, since it is opened as immutable: it is neither locked nor
+     * checked for journals, and changes to the archive while it is open are not seen.
+     * </p>
+     */
+    public static final String VFS_ZIP = "android-zip";
+
     private SQLiteDatabase(SQLiteDatabaseConfiguration configuration,
                            CursorFactory cursorFactory,
                            DatabaseErrorHandler errorHandler) {
@@ -329,6 +398,24 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         return SQLiteGlobal.releaseMemory();
     }
 
+    /**
+     * Shrinks the memory used by SQLite according to a memory trim level, such as one
+     * passed to {@link android.content.ComponentCallbacks2#onTrimMemory(int)}. The more
+     * severe the level, the smaller the page caches of connections and the lower the heap
+     * limit of SQLite, which grow back gradually once no further signals arrive.
+     *
+     * @param level the memory trim level
+     * @return the number of bytes actually released
+     * @see SQLiteGlobal#setMemoryPolicy(long, long, int, int)
+     */
+    public static int onTrimMemory(int level) {
+        int released = SQLiteGlobal.onTrimMemory(level);
+        for (SQLiteDatabase db : getActiveDatabases()) {
+            db.applyMemoryPolicy();
+        }
+        return released;
+    }
+
     /**
      * Gets a label to use when describing the database in log messages.
      * @return The label.
@@ -720,6 +807,28 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         return db;
     }
 
+    /**
+     * Opens a database stored in a ZIP archive for reading, through the {@link #VFS_ZIP}
+     * VFS. To open a database packed in the assets of the APK, pass
+     * {@code context.getApplicationInfo().sourceDir} and "assets/" followed by its name.
+     *
+     * @param archivePath path of the archive
+     * @param entryName name of the entry of the database in the archive, which must not be
+     * compressed
+     * @param factory an optional factory class that is called to instantiate a
+     *            cursor when query is called, or null for default
+     * @return the newly opened database
+     * @throws SQLiteException if the archive or the entry cannot be opened
+     */
+    public static SQLiteDatabase openZipDatabase(String archivePath,
+                                                 String entryName,
+                                                 CursorFactory factory) {
+        SQLiteDatabaseConfiguration configuration =
+                new SQLiteDatabaseConfiguration(archivePath + "!/" + entryName, OPEN_READONLY);
+        configuration.vfsName = VFS_ZIP;
+        return openDatabase(configuration, factory, null);
+    }
+
     /**
      * Equivalent to openDatabase(file.getPath(), factory, CREATE_IF_NECESSARY).
      */
@@ -924,8 +1033,26 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
      * @hide
      */
     public void addFunction(String name, int numArgs, Function function, int flags) {
+        addFunction(name, numArgs, function, flags, 0);
+    }
+
+    /**
+     * Registers a deterministic Function callback whose results are cached in native
+     * code, so that repeated calls with the same arguments do not reach the callback.
+     *
+     * @param name the name of the sqlite3 function
+     * @param numArgs the number of arguments for the function
+     * @param function callback to call when the function is executed
+     * @param flags extra flags, which must include {@link Function#FLAG_DETERMINISTIC}
+     *              if cacheSize is not 0
+     * @param cacheSize the number of bytes of arguments and results each connection may
+     *                  cache, least recently used first out, or 0 to disable the cache
+     * @see #getFunctionCacheStats(String)
+     */
+    public void addFunction(String name, int numArgs, Function function, int flags,
+                            int cacheSize) {
         // Create wrapper (also validates arguments).
-        SQLiteFunction wrapper = new SQLiteFunction(name, numArgs, function, flags);
+        SQLiteFunction wrapper = new SQLiteFunction(name, numArgs, function, flags, cacheSize);
 
         synchronized (mLock) {
             throwIfNotOpenLocked();
@@ -940,6 +1067,28 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         }
     }
 
+    /**
+     * Gets the counters of the result cache of a function added with
+     * {@link #addFunction(String, int, Function, int, int)}, summed over all connections.
+     *
+     * @param name the name of the sqlite3 function
+     * @return the counters of the most recently added function with that name, or null
+     * if there is none or its results are not cached
+     */
+    public SQLiteFunction.CacheStats getFunctionCacheStats(String name) {
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            for (int i = mConfigurationLocked.functions.size() - 1; i >= 0; i--) {
+                SQLiteFunction function = mConfigurationLocked.functions.get(i);
+                if (function.name.equalsIgnoreCase(name)) {
+                    return function.getCacheStats();
+                }
+            }
+            return null;
+        }
+    }
+
     /**
      * Gets the database version.
      *
@@ -2036,6 +2185,97 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         }
     }
 
+    /**
+     * Registers an aggregate function that can be called from SQL statements.
+     *
+     * @param name the name of the sqlite3 function
+     * @param numArgs the number of arguments for the function, or -1 for any number
+     * @param function callback which creates the state of each aggregate
+     */
+    public void addAggregateFunction(String name, int numArgs, AggregateFunction function) {
+        addAggregateFunction(name, numArgs, function, 0);
+    }
+
+    /**
+     * Registers an aggregate function that can be called from SQL statements.
+     *
+     * @param name the name of the sqlite3 function
+     * @param numArgs the number of arguments for the function, or -1 for any number
+     * @param function callback which creates the state of each aggregate
+     * @param flags extra flags such as {@link Function#FLAG_DETERMINISTIC}
+     */
+    public void addAggregateFunction(String name, int numArgs, AggregateFunction function,
+                                     int flags) {
+        addAggregateFunction(new SQLiteAggregateFunction(name, numArgs, function, flags));
+    }
+
+    /**
+     * Registers an aggregate function that can also be used as a window function.
+     *
+     * @param name the name of the sqlite3 function
+     * @param numArgs the number of arguments for the function, or -1 for any number
+     * @param function callback which creates the state of each aggregate
+     */
+    public void addWindowFunction(String name, int numArgs, WindowFunction function) {
+        addWindowFunction(name, numArgs, function, 0);
+    }
+
+    /**
+     * Registers an aggregate function that can also be used as a window function.
+     *
+     * @param name the name of the sqlite3 function
+     * @param numArgs the number of arguments for the function, or -1 for any number
+     * @param function callback which creates the state of each aggregate
+     * @param flags extra flags such as {@link Function#FLAG_DETERMINISTIC}
+     */
+    public void addWindowFunction(String name, int numArgs, WindowFunction function,
+                                  int flags) {
+        addAggregateFunction(new SQLiteAggregateFunction(name, numArgs, function, flags));
+    }
+
+    private void addAggregateFunction(SQLiteAggregateFunction wrapper) {
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            mConfigurationLocked.aggregateFunctions.add(wrapper);
+            try {
+                mConnectionPoolLocked.reconfigure(mConfigurationLocked);
+            } catch (RuntimeException ex) {
+                mConfigurationLocked.aggregateFunctions.remove(wrapper);
+                throw ex;
+            }
+        }
+    }
+
+    /**
+     * Registers groups of functions implemented in native code, which run without calling
+     * into Java. Groups can also be added to {@link SQLiteDatabaseConfiguration#nativeFunctions}
+     * to register them as each connection is opened.
+     *
+     * @param groups the groups to register, such as {@link #NATIVE_FUNCTIONS_REGEXP}
+     * @throws IllegalArgumentException if a group does not exist
+     */
+    public void addNativeFunctions(String... groups) {
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            List<String> added = new ArrayList<>();
+            for (String group : groups) {
+                if (!mConfigurationLocked.nativeFunctions.contains(group)
+                        && !added.contains(group)) {
+                    added.add(group);
+                }
+            }
+            mConfigurationLocked.nativeFunctions.addAll(added);
+            try {
+                mConnectionPoolLocked.reconfigure(mConfigurationLocked);
+            } catch (RuntimeException ex) {
+                mConfigurationLocked.nativeFunctions.removeAll(added);
+                throw ex;
+            }
+        }
+    }
+
     /**
      * Sets the maximum size of the prepared-statement cache for this database.
      * (size of the cache = number of compiled-sql-statements stored in the cache).
@@ -2070,6 +2310,77 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         }
     }
 
+    /**
+     * Sets the size above which blobs are left in the database when query results are
+     * copied into a cursor window.
+     * <p>
+     * Blobs that are left behind do not take up window space, so windows hold more rows
+     * and are refilled less often when scrolling over large values. {@link SQLiteCursor}
+     * reads such a blob from the database when {@link SQLiteCursor#getBlob} is called,
+     * so the value returned is the one stored at that time. Only blobs read directly from
+     * a table column are eligible, by a query which reads the table once, not as part of a
+     * compound SELECT, and which also selects its row id.
+     * </p><p>
+     * This method is thread-safe.
+     * </p>
+     *
+     * @param bytes The size in bytes, or 0 to copy all blobs into the window.
+     */
+    public void setLazyBlobThreshold(int bytes) {
+        if (bytes < 0) {
+            throw new IllegalArgumentException("bytes must not be negative.");
+        }
+
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            final int oldLazyBlobThreshold = mConfigurationLocked.lazyBlobThreshold;
+            mConfigurationLocked.lazyBlobThreshold = bytes;
+            try {
+                mConnectionPoolLocked.reconfigure(mConfigurationLocked);
+            } catch (RuntimeException ex) {
+                mConfigurationLocked.lazyBlobThreshold = oldLazyBlobThreshold;
+                throw ex;
+            }
+        }
+    }
+
+    /**
+     * Sets how much of the database file is read through a memory mapping instead of
+     * being copied into the page cache by read calls.
+     * <p>
+     * Mapped pages are shared with the operating system's file cache, which saves memory
+     * and copying for read-heavy databases. Every connection of the process maps its file
+     * out of the budget set with {@link SQLiteGlobal#setMmapBudget}, so a connection may be
+     * granted less than asked for; the rest of the file is read as usual. If reading
+     * through a mapping fails with an I/O error, that connection reads its pages without
+     * the mapping from then on. See {@link SQLiteDebug#getMmapStats()} for how many page
+     * reads were served from mappings.
+     * </p><p>
+     * This method is thread-safe.
+     * </p>
+     *
+     * @param bytes The number of bytes to map, or 0 to disable memory-mapped I/O.
+     */
+    public void setMmapSize(long bytes) {
+        if (bytes < 0) {
+            throw new IllegalArgumentException("bytes must not be negative.");
+        }
+
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            final long oldMmapSize = mConfigurationLocked.mmapSize;
+            mConfigurationLocked.mmapSize = bytes;
+            try {
+                mConnectionPoolLocked.reconfigure(mConfigurationLocked);
+            } catch (RuntimeException ex) {
+                mConfigurationLocked.mmapSize = oldMmapSize;
+                throw ex;
+            }
+        }
+    }
+
     /**
      * Sets whether foreign key constraints are enabled for the database.
      * <p>
@@ -2288,6 +2599,14 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         }
     }
 
+    private void applyMemoryPolicy() {
+        synchronized (mLock) {
+            if (mConnectionPoolLocked != null) {
+                mConnectionPoolLocked.applyMemoryPolicy();
+            }
+        }
+    }
+
     private static ArrayList<SQLiteDatabase> getActiveDatabases() {
         ArrayList<SQLiteDatabase> databases = new ArrayList<>();
         synchronized (sActiveDatabases) {
@@ -2431,11 +2750,26 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
                          SQLiteQuery query);
     }
 
+    /**
+     * Receives the progress of a backup started with
+     * {@link #backup(SQLiteDatabase, int, long, BackupProgressListener, CancellationSignal)}.
+     */
+    public interface BackupProgressListener {
+        /**
+         * Called on the thread of the backup after each step.
+         *
+         * @param remainingPages the number of pages left to copy
+         * @param pageCount the number of pages of the database
+         */
+        void onProgress(int remainingPages, int pageCount);
+    }
+
     /**
      * A callback interface for a custom sqlite3 function. This can be used to create a function
      * that can be called from sqlite3 database triggers.
      *
-     * This interface is deprecated; new code should prefer {@link Function}
+     * This interface is deprecated; new code should prefer {@link Function}, which passes
+     * numbers without converting them to and from strings.
      */
     @Deprecated
     public interface CustomFunction {
@@ -2458,7 +2792,17 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
          */
         public static final int FLAG_DETERMINISTIC = 0x800;
 
+        /**
+         * The arguments of a call. Numeric and NULL arguments are passed from native code
+         * by value, so reading them does not call back into native code or allocate;
+         * strings and blobs are converted when requested.
+         */
         interface Args {
+            /**
+             * @return The type of the argument, one of the {@code Cursor.FIELD_TYPE_*}
+             * constants.
+             */
+            int getType(int arg);
             byte[] getBlob(int arg);
             String getString(int arg);
             double getDouble(int arg);
@@ -2484,6 +2828,83 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         void callback(Args args, Result result);
     }
 
+    /**
+     * A callback interface for a custom aggregate function, such as one used with
+     * {@code GROUP BY}.
+     * <p>
+     * The arguments of consecutive rows are collected in native code and passed to
+     * {@link Aggregate#step} in batches, so a group of rows costs a few calls into Java
+     * rather than one per row.
+     * </p>
+     */
+    public interface AggregateFunction {
+        /**
+         * Creates the state for one aggregate, such as one group. An aggregate over no
+         * rows is created only to produce its result.
+         */
+        Aggregate newAggregate();
+
+        /**
+         * The arguments of a batch of rows. The getters inherited from
+         * {@link Function.Args} read the current row. The batch is only valid until
+         * the call it was passed to returns.
+         */
+        interface Rows extends Function.Args {
+            /**
+             * @return The number of rows in the batch.
+             */
+            int getCount();
+
+            /**
+             * Moves to the next row. The batch is initially positioned before the first row.
+             *
+             * @return False if there are no more rows.
+             */
+            boolean moveToNext();
+        }
+
+        interface Aggregate {
+            /**
+             * Adds rows to the aggregate.
+             */
+            void step(Rows rows);
+
+            /**
+             * Sets the final value of the aggregate. Called once, after the last row; the
+             * aggregate is not used afterwards.
+             */
+            void finish(Function.Result result);
+        }
+    }
+
+    /**
+     * A callback interface for a custom aggregate function which can also be used as a
+     * window function, such as {@code f(x) OVER (ORDER BY y ROWS 2 PRECEDING)}.
+     * <p>
+     * Rows are batched as for {@link AggregateFunction}, but every time SQLite needs the
+     * current value the pending rows are delivered first, so window frames which move by
+     * one row per output row are delivered one row at a time.
+     * </p>
+     */
+    public interface WindowFunction {
+        /**
+         * Creates the state for one window partition or aggregate.
+         */
+        WindowAggregate newAggregate();
+
+        interface WindowAggregate extends AggregateFunction.Aggregate {
+            /**
+             * Removes rows which left the window frame, in the order they were added.
+             */
+            void inverse(AggregateFunction.Rows rows);
+
+            /**
+             * Sets the value of the aggregate over the current window frame.
+             */
+            void value(Function.Result result);
+        }
+    }
+
     static boolean hasCodec() {
         return SQLiteConnection.hasCodec();
     }
@@ -2574,6 +2995,370 @@ public final class SQLiteDatabase extends SQLiteClosable implements SupportSQLit
         return prog.simpleQueryForString();
     }
 
+    /**
+     * Opens a handle for incremental I/O on the blob stored in the given column and row
+     * of the main database.
+     *
+     * @see #openBlob(String, String, String, long, boolean)
+     */
+    public SQLiteBlob openBlob(String table, String column, long rowId, boolean writable) {
+        return openBlob("main", table, column, rowId, writable);
+    }
+
+    /**
+     * Opens a handle for incremental I/O on the blob stored in the given column and row.
+     * <p>
+     * Large values can be streamed through the handle without materializing them in a
+     * byte array. The handle holds on to a database connection until it is closed and
+     * must be closed on the thread that opened it. Use {@link SQLiteProgram#bindZeroBlob}
+     * to reserve space for a value before writing it incrementally.
+     * </p>
+     *
+     * @param database The symbolic name of the database, such as "main" or the name of an
+     * attached database.
+     * @param table The name of the table containing the blob.
+     * @param column The name of the column containing the blob.
+     * @param rowId The row id of the row containing the blob.
+     * @param writable True to open the blob for writing.
+     * @return The blob handle, which must be closed when done.
+     *
+     * @throws SQLiteException if the row or column does not exist.
+     */
+    public SQLiteBlob openBlob(String database, String table, String column, long rowId,
+                               boolean writable) {
+        acquireReference();
+        try {
+            return getThreadSession().openBlob(database, table, column, rowId, writable,
+                    getThreadDefaultConnectionFlags(!writable));
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Returns the content of a database in the format of a database file, as a single
+     * byte array.
+     *
+     * @param schema The symbolic name of the database, such as "main" or the name of an
+     * attached database.
+     * @return The serialized database.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read.
+     */
+    public byte[] serialize(String schema) {
+        acquireReference();
+        try {
+            return getThreadSession().serialize(schema, getThreadDefaultConnectionFlags(true));
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Writes the content of a database to a file descriptor in the format of a database
+     * file, starting at its current offset.
+     * <p>
+     * The pages of an in-memory database are written as they are. Other databases are
+     * read into memory as a whole first.
+     * </p>
+     *
+     * @param schema The symbolic name of the database, such as "main" or the name of an
+     * attached database.
+     * @param fd The file descriptor to write to.
+     * @return The number of bytes written.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read.
+     */
+    public long serialize(String schema, ParcelFileDescriptor fd) {
+        acquireReference();
+        try {
+            return getThreadSession().serialize(schema, fd,
+                    getThreadDefaultConnectionFlags(true));
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Replaces a database of this in-memory database with the remaining bytes of a direct
+     * buffer, which are in the format of a database file, such as the result of
+     * {@link #serialize(String)} or a {@link java.nio.MappedByteBuffer} of a database file.
+     * <p>
+     * A read-only database is read from the buffer in place, without copying it; the
+     * buffer must not change while the database is open. A writable database is a copy of
+     * the buffer that grows as rows are added.
+     * </p>
+     *
+     * @param schema The symbolic name of the database, such as "main" or the name of an
+     * attached in-memory database.
+     * @param buffer The direct buffer holding the database.
+     * @param readOnly True to read the buffer in place.
+     *
+     * @throws IllegalStateException if this is not an in-memory database.
+     * @throws SQLiteException if the database cannot be replaced, for instance while a
+     * transaction is open.
+     */
+    public void deserialize(String schema, ByteBuffer buffer, boolean readOnly) {
+        acquireReference();
+        try {
+            throwIfNotInMemory();
+            getThreadSession().deserialize(schema, buffer, readOnly,
+                    getThreadDefaultConnectionFlags(false));
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Replaces a database of this in-memory database with the content of a database file.
+     * <p>
+     * A read-only database is read from a mapping of the file, so its pages are only
+     * loaded as they are used and are shared with the page cache of the system; the file
+     * must not change while the database is open. A writable database is a copy of the
+     * file.
+     * </p>
+     * <p>
+     * Only the database file is read. A database in WAL mode whose WAL file still holds
+     * commits is refused, since they would be missing; checkpoint it first with
+     * {@code PRAGMA wal_checkpoint(TRUNCATE)}, or open it and copy it into this database
+     * with {@link #backup(SQLiteDatabase, int, long, BackupProgressListener,
+     * CancellationSignal)} instead.
+     * </p>
+     *
+     * @param schema The symbolic name of the database, such as "main" or the name of an
+     * attached in-memory database.
+     * @param file The database file.
+     * @param readOnly True to map the file rather than copy it.
+     *
+     * @throws IllegalStateException if this is not an in-memory database.
+     * @throws SQLiteException if the database cannot be replaced, for instance while a
+     * transaction is open, or if the WAL file of the database is not empty.
+     */
+    public void deserialize(String schema, File file, boolean readOnly) {
+        acquireReference();
+        try {
+            throwIfNotInMemory();
+            getThreadSession().deserialize(schema, file.getPath(), readOnly,
+                    getThreadDefaultConnectionFlags(false));
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Opens an in-memory database holding the content of a database file, in one step
+     * rather than copying its rows. A database in WAL mode must have been checkpointed
+     * into its database file first, as described by {@link #deserialize(String, File,
+     * boolean)}.
+     *
+     * @param file The database file.
+     * @param readOnly True to map the file rather than copy it.
+     * @param factory an optional factory class that is called to instantiate a
+     *            cursor when query is called, or null for default
+     * @return the newly opened database
+     * @see #deserialize(String, File, boolean)
+     */
+    public static SQLiteDatabase openInMemory(File file, boolean readOnly,
+                                              CursorFactory factory) {
+        SQLiteDatabase db = create(factory);
+        try {
+            db.deserialize("main", file, readOnly);
+        } catch (RuntimeException ex) {
+            db.close();
+            throw ex;
+        }
+        return db;
+    }
+
+    private void throwIfNotInMemory() {
+        if (!isInMemoryDatabase()) {
+            throw new IllegalStateException("Only in-memory databases can be deserialized "
+                    + "into, since the connections of a database file do not share memory.");
+        }
+    }
+
+    /**
+     * Copies this database into a database file with an online backup. The file is created
+     * if it does not exist, and its content is replaced.
+     *
+     * @see #backup(SQLiteDatabase, int, long, BackupProgressListener, CancellationSignal)
+     */
+    public void backup(File destination, int pagesPerStep, long stepDelayMillis,
+                       BackupProgressListener listener, CancellationSignal cancellationSignal) {
+        SQLiteDatabase db = openOrCreateDatabase(destination, null);
+        try {
+            backup(db, pagesPerStep, stepDelayMillis, listener, cancellationSignal);
+        } finally {
+            db.close();
+        }
+    }
+
+    /**
+     * Copies the main database of this database into the main database of another one,
+     * such as a database file or an in-memory database, with an online backup.
+     * <p>
+     * The database is copied a few pages at a time, and the backup waits between steps, so
+     * that it never holds the database for long. Writers of this database can continue in
+     * the meantime: their changes are copied to the destination as they are made. Changes
+     * made by other processes restart the backup. The content of the destination is
+     * replaced, and the destination must not be used by anyone else until the backup is
+     * done. This method blocks until the backup is complete or canceled, and should not be
+     * called from the main thread.
+     * </p>
+     *
+     * @param destination The database to copy into.
+     * @param pagesPerStep The number of pages copied by each step, or a negative number to
+     * copy the database in one step.
+     * @param stepDelayMillis How long to wait between steps.
+     * @param listener The listener told about the progress after each step, or null.
+     * @param cancellationSignal A signal to cancel the backup between steps, or null.
+     *
+     * @throws SQLiteException if the backup fails, for instance because the page size of a
+     * destination in WAL mode differs.
+     * @throws OperationCanceledException if the backup was canceled, which leaves the
+     * destination as it was before.
+     */
+    public void backup(SQLiteDatabase destination, int pagesPerStep, long stepDelayMillis,
+                       BackupProgressListener listener, CancellationSignal cancellationSignal) {
+        if (destination == this) {
+            throw new IllegalArgumentException("A database cannot be backed up into itself.");
+        }
+        if (pagesPerStep == 0 || stepDelayMillis < 0) {
+            throw new IllegalArgumentException("pagesPerStep must not be 0 and "
+                    + "stepDelayMillis must be non-negative.");
+        }
+        acquireReference();
+        try {
+            destination.acquireReference();
+            try {
+                getThreadSession().backup(destination.getThreadSession(), pagesPerStep,
+                        stepDelayMillis, listener, cancellationSignal);
+            } finally {
+                destination.releaseReference();
+            }
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Opens a group commit, which commits the statements of concurrent threads together in
+     * one transaction so that they share its syncs.
+     * <p>
+     * A batch is committed once it holds maxBatchSize statements, or its oldest statement
+     * has waited maxLatencyMicros. Statements that arrive while a batch commits form the
+     * next batch, so a latency of 0 still groups statements under load. The group commit
+     * has a connection of its own and must be closed before the database is.
+     * </p>
+     *
+     * @param maxBatchSize The maximum number of statements committed together.
+     * @param maxLatencyMicros The longest time a statement waits for its batch to fill up.
+     * @return The group commit, which must be closed when done.
+     *
+     * @throws SQLiteException if the connection of the group commit could not be opened.
+     * @see SQLiteGroupCommit
+     */
+    public SQLiteGroupCommit openGroupCommit(int maxBatchSize, long maxLatencyMicros) {
+        if (maxBatchSize < 1) {
+            throw new IllegalArgumentException("maxBatchSize must be at least 1.");
+        }
+        if (maxLatencyMicros < 0) {
+            throw new IllegalArgumentException("maxLatencyMicros must not be negative.");
+        }
+
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            if (mConfigurationLocked.isInMemoryDb()) {
+                throw new IllegalStateException(
+                        "Cannot open a group commit on an in-memory database.");
+            }
+            if (isReadOnlyLocked()) {
+                throw new IllegalStateException(
+                        "Cannot open a group commit on a read-only database.");
+            }
+            return new SQLiteGroupCommit(mConfigurationLocked, maxBatchSize, maxLatencyMicros);
+        }
+    }
+
+    /**
+     * Records the current state of the database, so that transactions begun later with
+     * {@link #beginTransactionAtSnapshot} read the same data on whichever connection of the
+     * pool they get. The database must be in WAL mode.
+     * <p>
+     * If the calling thread is in a transaction that has not written yet, the snapshot
+     * records the state that transaction reads.
+     * </p>
+     *
+     * @return The snapshot, which must be closed when done.
+     *
+     * @throws SQLiteException if the database is not in WAL mode, or no transaction has
+     * been committed to its WAL yet.
+     * @see SQLiteSnapshot
+     */
+    public SQLiteSnapshot getSnapshot() {
+        acquireReference();
+        try {
+            return getThreadSession().getSnapshot(
+                    getThreadDefaultConnectionFlags(true /*readOnly*/), null);
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Begins a read transaction that sees the database as it was when a snapshot was
+     * taken by {@link #getSnapshot}. The transaction uses any connection of the pool, and
+     * must be ended with {@link #endTransaction}.
+     * <p>
+     * Here is the idiom for reading a page of results at a snapshot:
+     *
+     * <pre>
+     *   db.beginTransactionAtSnapshot(snapshot);
+     *   try {
+     *     ...
+     *   } finally {
+     *     db.endTransaction();
+     *   }
+     * </pre>
+     *
+     * @param snapshot The snapshot to read.
+     *
+     * @throws IllegalStateException if the calling thread is already in a transaction, or
+     * the snapshot has been closed.
+     * @throws SQLiteException if the snapshot is no longer available, because a checkpoint
+     * has copied later changes into the database since it was taken.
+     */
+    public void beginTransactionAtSnapshot(SQLiteSnapshot snapshot) {
+        if (snapshot == null) {
+            throw new IllegalArgumentException("snapshot must not be null.");
+        }
+
+        acquireReference();
+        try {
+            getThreadSession().beginTransactionAtSnapshot(snapshot,
+                    getThreadDefaultConnectionFlags(true /*readOnly*/), null);
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Gets the counters of the checkpoints run in the background, for a database opened
+     * with {@link SQLiteDatabaseConfiguration#backgroundCheckpoint} set.
+     *
+     * @return The counters, or null if the WAL is checkpointed by the writers themselves.
+     * @see SQLiteCheckpointer
+     */
+    public SQLiteCheckpointer.Stats getCheckpointStats() {
+        synchronized (mLock) {
+            throwIfNotOpenLocked();
+
+            final SQLiteCheckpointer checkpointer = mConnectionPoolLocked.getCheckpointer();
+            return checkpointer != null ? checkpointer.getStats() : null;
+        }
+    }
+
     /**
      * Utility method to run the query on the db and return the blob value in the
      * first column of the first row.
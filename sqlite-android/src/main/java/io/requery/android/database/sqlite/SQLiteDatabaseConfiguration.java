@@ -71,6 +71,56 @@ public final class SQLiteDatabaseConfiguration {
      */
     public int maxSqlCacheSize;
 
+    /**
+     * Blobs larger than this many bytes are left in the database when a query fills a
+     * cursor window, and read on demand when the cursor's getBlob is called. Only blobs
+     * whose table and row id can be determined from the query are left behind.
+     *
+     * Default is 0, which copies every blob into the window.
+     */
+    public int lazyBlobThreshold;
+
+    /**
+     * The number of bytes of the database file to read through a memory mapping rather
+     * than with read calls, limited by the budget set with
+     * {@link SQLiteGlobal#setMmapBudget}.
+     *
+     * Default is 0, which disables memory-mapped I/O.
+     */
+    public long mmapSize;
+
+    /**
+     * The size in bytes of each lookaside slot of a connection, or -1 to use the default
+     * configured by {@link SQLiteGlobal#configureMemory}.
+     */
+    public int lookasideSlotSize;
+
+    /**
+     * The number of lookaside slots of a connection, or -1 to use the default configured
+     * by {@link SQLiteGlobal#configureMemory}. Zero disables the lookaside.
+     */
+    public int lookasideSlotCount;
+
+    /**
+     * The name of the SQLite VFS to open the database through, such as
+     * {@link SQLiteDatabase#VFS_COMPRESSED}, or null to use the default one. Connections
+     * already open keep the VFS they were opened with, so this should be set before the
+     * database is opened.
+     *
+     * Default is null.
+     */
+    public String vfsName;
+
+    /**
+     * True if the WAL is checkpointed by a background thread, as described by
+     * {@link SQLiteCheckpointer}, rather than by the writer whose commit makes it reach the
+     * auto-checkpoint size. The checkpointer is started when the database is opened, so
+     * this should be set before then.
+     *
+     * Default is false.
+     */
+    public boolean backgroundCheckpoint;
+
     /**
      * The database locale.
      *
@@ -98,11 +148,22 @@ public final class SQLiteDatabaseConfiguration {
      */
     public final List<SQLiteFunction> functions = new ArrayList<>();
 
+    /**
+     * The {@link SQLiteAggregateFunction}s to register.
+     */
+    public final List<SQLiteAggregateFunction> aggregateFunctions = new ArrayList<>();
+
     /**
      * The custom extensions to register.
      */
     public final List<SQLiteCustomExtension> customExtensions = new ArrayList<>();
 
+    /**
+     * The groups of built-in native functions to register when a connection is opened,
+     * such as {@link SQLiteDatabase#NATIVE_FUNCTIONS_REGEXP}.
+     */
+    public final List<String> nativeFunctions = new ArrayList<>();
+
     /**
      * Creates a database configuration with the required parameters for opening a
      * database and default values for all other parameters.
@@ -121,6 +182,8 @@ public final class SQLiteDatabaseConfiguration {
 
         // Set default values for optional parameters.
         maxSqlCacheSize = 25;
+        lookasideSlotSize = -1;
+        lookasideSlotCount = -1;
         locale = Locale.getDefault();
     }
 
@@ -176,6 +239,12 @@ public final class SQLiteDatabaseConfiguration {
 
         openFlags = other.openFlags;
         maxSqlCacheSize = other.maxSqlCacheSize;
+        lazyBlobThreshold = other.lazyBlobThreshold;
+        mmapSize = other.mmapSize;
+        lookasideSlotSize = other.lookasideSlotSize;
+        lookasideSlotCount = other.lookasideSlotCount;
+        vfsName = other.vfsName;
+        backgroundCheckpoint = other.backgroundCheckpoint;
         locale = other.locale;
         foreignKeyConstraintsEnabled = other.foreignKeyConstraintsEnabled;
         customFunctions.clear();
@@ -184,6 +253,10 @@ public final class SQLiteDatabaseConfiguration {
         customExtensions.addAll(other.customExtensions);
         functions.clear();
         functions.addAll(other.functions);
+        aggregateFunctions.clear();
+        aggregateFunctions.addAll(other.aggregateFunctions);
+        nativeFunctions.clear();
+        nativeFunctions.addAll(other.nativeFunctions);
     }
 
     /**
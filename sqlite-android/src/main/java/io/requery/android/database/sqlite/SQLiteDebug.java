@@ -20,7 +20,9 @@ package io.requery.android.database.sqlite;
 import android.util.Log;
 import android.util.Printer;
 
+import java.io.File;
 import java.util.ArrayList;
+import java.util.Arrays;
 
 /**
  * Provides debugging info about all SQLite databases running in the current process.
@@ -30,6 +32,85 @@ import java.util.ArrayList;
 @SuppressWarnings("unused")
 public final class SQLiteDebug {
     private static native void nativeGetPagerStats(PagerStats stats);
+    private static native void nativeGetAllocatorStats(long[] stats);
+
+    // Indices of the counters filled in by nativeGetAllocatorStats.
+    private static final int ALLOCATOR_BYTES_IN_USE = 0;
+    private static final int ALLOCATOR_HIGH_WATER = 1;
+    private static final int ALLOCATOR_REALLOCATIONS = 2;
+    private static final int ALLOCATOR_SIZE_CLASSES = 3;
+
+    private static native void nativeGetMemoryGovernorStats(long[] stats);
+
+    // Indices of the values filled in by nativeGetMemoryGovernorStats.
+    private static final int MEMORY_PRESSURE = 0;
+    private static final int MEMORY_SOFT_HEAP_LIMIT = 1;
+    private static final int MEMORY_HARD_HEAP_LIMIT = 2;
+    private static final int MEMORY_CACHE_SIZE_KIB = 3;
+    private static final int MEMORY_POLICY_SOFT_HEAP_LIMIT = 4;
+    private static final int MEMORY_POLICY_HARD_HEAP_LIMIT = 5;
+    private static final int MEMORY_POLICY_MAX_CACHE_SIZE_KIB = 6;
+    private static final int MEMORY_POLICY_MIN_CACHE_SIZE_KIB = 7;
+    private static final int MEMORY_BYTES_IN_USE = 8;
+    private static final int MEMORY_STAT_COUNT = 9;
+
+    private static native void nativeGetMmapStats(long[] stats);
+
+    // Indices of the counters filled in by nativeGetMmapStats.
+    private static final int MMAP_BUDGET = 0;
+    private static final int MMAP_RESERVED = 1;
+    private static final int MMAP_MAPPED_READS = 2;
+    private static final int MMAP_FILE_READS = 3;
+    private static final int MMAP_FALLBACKS = 4;
+    private static final int MMAP_STAT_COUNT = 5;
+
+    private static native void nativeGetReadaheadStats(long[] stats);
+    private static native boolean nativeEvictFileCache(String path);
+    private static native void nativeGetIoUringStats(long[] stats);
+
+    // Indices of the counters filled in by nativeGetReadaheadStats.
+    private static final int READAHEAD_SIZE = 0;
+    private static final int READAHEAD_BATCHED_READS = 1;
+    private static final int READAHEAD_BYTES_READ_AHEAD = 2;
+    private static final int READAHEAD_BUFFERED_READS = 3;
+    private static final int READAHEAD_STAT_COUNT = 4;
+
+    // Indices of the counters filled in by nativeGetIoUringStats.
+    private static final int IO_URING_ENABLED = 0;
+    private static final int IO_URING_RING_READS = 1;
+    private static final int IO_URING_SUBMITS = 2;
+    private static final int IO_URING_MAX_BATCH = 3;
+    private static final int IO_URING_FALLBACK_READS = 4;
+    private static final int IO_URING_STAT_COUNT = 5;
+
+    private static native void nativeGetCompressedVfsStats(long[] stats);
+
+    // Indices of the counters filled in by nativeGetCompressedVfsStats.
+    private static final int COMPRESSED_CACHE_SIZE = 0;
+    private static final int COMPRESSED_CACHE_USED = 1;
+    private static final int COMPRESSED_CACHE_HITS = 2;
+    private static final int COMPRESSED_CACHE_MISSES = 3;
+    private static final int COMPRESSED_PAGES_WRITTEN = 4;
+    private static final int COMPRESSED_BYTES_STORED = 5;
+    private static final int COMPRESSED_COMMITS = 6;
+    private static final int COMPRESSED_STAT_COUNT = 7;
+
+    private static native String[] nativeGetIoStatsDatabases();
+    private static native boolean nativeGetIoStats(String path, long[] stats);
+    private static native void nativeResetIoStats();
+
+    // Indices of the counters of one kind of file filled in by nativeGetIoStats, which
+    // fills in those of the database, journal and WAL file, IO_FILE_STAT_COUNT apart.
+    private static final int IO_READS = 0;
+    private static final int IO_BYTES_READ = 1;
+    private static final int IO_WRITES = 2;
+    private static final int IO_BYTES_WRITTEN = 3;
+    private static final int IO_SYNCS = 4;
+    private static final int IO_LOCKS = 5;
+    private static final int IO_READ_LATENCY = 6;
+    private static final int IO_WRITE_LATENCY = IO_READ_LATENCY + IoStats.LATENCY_BUCKETS;
+    private static final int IO_SYNC_LATENCY = IO_WRITE_LATENCY + IoStats.LATENCY_BUCKETS;
+    private static final int IO_FILE_STAT_COUNT = IO_SYNC_LATENCY + IoStats.LATENCY_BUCKETS;
 
     /**
      * Controls the printing of informational SQL log messages.
@@ -131,19 +212,451 @@ public final class SQLiteDebug {
         /** documented here http://www.sqlite.org/c3ref/c_dbstatus_lookaside_used.html */
         public int lookaside;
 
+        /** number of memory allocations satisfied from the lookaside */
+        public int lookasideHits;
+
+        /** number of memory allocations too large for a lookaside slot */
+        public int lookasideMissesSize;
+
+        /** number of memory allocations made while every lookaside slot was in use */
+        public int lookasideMissesFull;
+
         /** statement cache stats: hits/misses/cachesize */
         public String cache;
 
+        /** number of statements evicted from the statement cache */
+        public int cacheEvictions;
+
         public DbStats(String dbName, long pageCount, long pageSize, int lookaside,
             int hits, int misses, int cachesize) {
+            this(dbName, pageCount, pageSize, lookaside, hits, misses, cachesize, 0);
+        }
+
+        public DbStats(String dbName, long pageCount, long pageSize, int lookaside,
+            int hits, int misses, int cachesize, int evictions) {
             this.dbName = dbName;
             this.pageSize = pageSize / 1024;
             dbSize = (pageCount * pageSize) / 1024;
             this.lookaside = lookaside;
             this.cache = hits + "/" + misses + "/" + cachesize;
+            this.cacheEvictions = evictions;
+        }
+    }
+
+    /**
+     * Contains the counters of the allocator of SQLite.
+     *
+     * @see SQLiteGlobal#setPoolAllocatorEnabled(boolean)
+     */
+    public static class AllocatorStats {
+        /** The sizes in bytes of the size classes of pooled allocations. */
+        public static final int[] SIZE_CLASSES = {
+            16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+        };
+
+        /** the number of bytes currently allocated by sqlite */
+        public long bytesInUse;
+
+        /** the largest number of bytes allocated by sqlite at any one time */
+        public long highWater;
+
+        /** the number of allocations made of each of {@link #SIZE_CLASSES} */
+        public long[] sizeClassAllocations;
+
+        /** the number of allocations made outside of the size classes, because they were
+         * larger or pooling was disabled at the time */
+        public long largeAllocations;
+
+        /** the number of times an allocation was resized, which the allocation counts
+         * leave out */
+        public long reallocations;
+    }
+
+    /**
+     * Returns the counters of the allocator of SQLite, which are kept even while pooling
+     * is disabled.
+     */
+    public static AllocatorStats getAllocatorStats() {
+        final int classCount = AllocatorStats.SIZE_CLASSES.length;
+        long[] counters = new long[ALLOCATOR_SIZE_CLASSES + classCount + 1];
+        nativeGetAllocatorStats(counters);
+
+        AllocatorStats stats = new AllocatorStats();
+        stats.bytesInUse = counters[ALLOCATOR_BYTES_IN_USE];
+        stats.highWater = counters[ALLOCATOR_HIGH_WATER];
+        stats.sizeClassAllocations = new long[classCount];
+        System.arraycopy(counters, ALLOCATOR_SIZE_CLASSES, stats.sizeClassAllocations, 0,
+                classCount);
+        stats.largeAllocations = counters[ALLOCATOR_SIZE_CLASSES + classCount];
+        stats.reallocations = counters[ALLOCATOR_REALLOCATIONS];
+        return stats;
+    }
+
+    /**
+     * Contains the policy and current limits of the memory governor.
+     *
+     * @see SQLiteGlobal#setMemoryPolicy(long, long, int, int)
+     */
+    public static class MemoryGovernorStats {
+        /** the current memory pressure, from 0 for none to 3 for critical */
+        public int pressure;
+
+        /** the soft heap limit in bytes at the current pressure */
+        public long softHeapLimit;
+
+        /** the hard heap limit in bytes, or 0 for none */
+        public long hardHeapLimit;
+
+        /** the page cache size of connections in KiB at the current pressure */
+        public int cacheSizeKiB;
+
+        /** the soft heap limit of the policy */
+        public long policySoftHeapLimit;
+
+        /** the hard heap limit of the policy */
+        public long policyHardHeapLimit;
+
+        /** the largest page cache size of the policy in KiB */
+        public int policyMaxCacheSizeKiB;
+
+        /** the smallest page cache size of the policy in KiB */
+        public int policyMinCacheSizeKiB;
+
+        /** the number of bytes currently allocated by sqlite */
+        public long bytesInUse;
+
+        @Override
+        public String toString() {
+            return "pressure=" + pressure + ", softHeapLimit=" + softHeapLimit
+                + ", hardHeapLimit=" + hardHeapLimit + ", cacheSizeKiB=" + cacheSizeKiB
+                + ", bytesInUse=" + bytesInUse;
+        }
+    }
+
+    /**
+     * Returns the policy and current limits of the memory governor.
+     */
+    public static MemoryGovernorStats getMemoryGovernorStats() {
+        long[] values = new long[MEMORY_STAT_COUNT];
+        nativeGetMemoryGovernorStats(values);
+
+        MemoryGovernorStats stats = new MemoryGovernorStats();
+        stats.pressure = (int) values[MEMORY_PRESSURE];
+        stats.softHeapLimit = values[MEMORY_SOFT_HEAP_LIMIT];
+        stats.hardHeapLimit = values[MEMORY_HARD_HEAP_LIMIT];
+        stats.cacheSizeKiB = (int) values[MEMORY_CACHE_SIZE_KIB];
+        stats.policySoftHeapLimit = values[MEMORY_POLICY_SOFT_HEAP_LIMIT];
+        stats.policyHardHeapLimit = values[MEMORY_POLICY_HARD_HEAP_LIMIT];
+        stats.policyMaxCacheSizeKiB = (int) values[MEMORY_POLICY_MAX_CACHE_SIZE_KIB];
+        stats.policyMinCacheSizeKiB = (int) values[MEMORY_POLICY_MIN_CACHE_SIZE_KIB];
+        stats.bytesInUse = values[MEMORY_BYTES_IN_USE];
+        return stats;
+    }
+
+    /**
+     * Contains the counters of memory-mapped I/O of all databases.
+     *
+     * @see SQLiteDatabase#setMmapSize(long)
+     */
+    public static class MmapStats {
+        /** the number of bytes all files may map together */
+        public long budget;
+
+        /** the number of bytes of the budget granted to open files */
+        public long reserved;
+
+        /** the number of database page reads served from a memory mapping */
+        public long mappedReads;
+
+        /** the number of database page reads made with read calls */
+        public long fileReads;
+
+        /** the number of files that stopped using their mapping after an I/O error */
+        public long fallbacks;
+
+        @Override
+        public String toString() {
+            return "budget=" + budget + ", reserved=" + reserved + ", mappedReads="
+                + mappedReads + ", fileReads=" + fileReads + ", fallbacks=" + fallbacks;
         }
     }
 
+    /**
+     * Returns the counters of memory-mapped I/O of all databases.
+     */
+    public static MmapStats getMmapStats() {
+        long[] values = new long[MMAP_STAT_COUNT];
+        nativeGetMmapStats(values);
+
+        MmapStats stats = new MmapStats();
+        stats.budget = values[MMAP_BUDGET];
+        stats.reserved = values[MMAP_RESERVED];
+        stats.mappedReads = values[MMAP_MAPPED_READS];
+        stats.fileReads = values[MMAP_FILE_READS];
+        stats.fallbacks = values[MMAP_FALLBACKS];
+        return stats;
+    }
+
+    /**
+     * Contains the counters of reading ahead of sequential reads of all databases.
+     *
+     * @see SQLiteGlobal#setReadaheadSize(int)
+     */
+    public static class ReadaheadStats {
+        /** the largest number of bytes read ahead at once */
+        public long readaheadSize;
+
+        /** the number of reads that read ahead of the requested page */
+        public long batchedReads;
+
+        /** the number of bytes read past the requested pages */
+        public long bytesReadAhead;
+
+        /** the number of page reads served from pages read ahead */
+        public long bufferedReads;
+
+        @Override
+        public String toString() {
+            return "readaheadSize=" + readaheadSize + ", batchedReads=" + batchedReads
+                + ", bytesReadAhead=" + bytesReadAhead + ", bufferedReads=" + bufferedReads;
+        }
+    }
+
+    /**
+     * Returns the counters of reading ahead of sequential reads of all databases.
+     */
+    public static ReadaheadStats getReadaheadStats() {
+        long[] values = new long[READAHEAD_STAT_COUNT];
+        nativeGetReadaheadStats(values);
+
+        ReadaheadStats stats = new ReadaheadStats();
+        stats.readaheadSize = values[READAHEAD_SIZE];
+        stats.batchedReads = values[READAHEAD_BATCHED_READS];
+        stats.bytesReadAhead = values[READAHEAD_BYTES_READ_AHEAD];
+        stats.bufferedReads = values[READAHEAD_BUFFERED_READS];
+        return stats;
+    }
+
+    /**
+     * Contains the counters of reads through io_uring.
+     *
+     * @see SQLiteGlobal#setIoUringEnabled(boolean)
+     */
+    public static class IoUringStats {
+        /** whether reads go through io_uring */
+        public boolean enabled;
+
+        /** the number of reads served through io_uring */
+        public long ringReads;
+
+        /** the number of times reads were submitted to the kernel */
+        public long submits;
+
+        /** the largest number of reads submitted at once */
+        public long maxBatch;
+
+        /** the number of reads made again with read calls after a short read or an error */
+        public long fallbackReads;
+
+        @Override
+        public String toString() {
+            return "enabled=" + enabled + ", ringReads=" + ringReads + ", submits=" + submits
+                + ", maxBatch=" + maxBatch + ", fallbackReads=" + fallbackReads;
+        }
+    }
+
+    /**
+     * Returns the counters of reads through io_uring.
+     */
+    public static IoUringStats getIoUringStats() {
+        long[] values = new long[IO_URING_STAT_COUNT];
+        nativeGetIoUringStats(values);
+
+        IoUringStats stats = new IoUringStats();
+        stats.enabled = values[IO_URING_ENABLED] != 0;
+        stats.ringReads = values[IO_URING_RING_READS];
+        stats.submits = values[IO_URING_SUBMITS];
+        stats.maxBatch = values[IO_URING_MAX_BATCH];
+        stats.fallbackReads = values[IO_URING_FALLBACK_READS];
+        return stats;
+    }
+
+    /**
+     * Asks the kernel to drop the cached pages of a file, so that it is next read from
+     * storage, as when measuring cold reads. The file must not be open by any database of
+     * this process, since closing another descriptor of a file releases the locks that the
+     * process holds on it.
+     *
+     * @param file The file to evict.
+     * @return true if the pages were dropped.
+     */
+    public static boolean evictFileCache(File file) {
+        return nativeEvictFileCache(file.getPath());
+    }
+
+    /**
+     * Contains the counters of the databases opened through
+     * {@link SQLiteDatabase#VFS_COMPRESSED}.
+     */
+    public static class CompressedVfsStats {
+        /** the number of bytes the cache of decompressed pages may take */
+        public long cacheSize;
+
+        /** the number of bytes the cache of decompressed pages takes */
+        public long cacheUsed;
+
+        /** the number of page reads served from the cache */
+        public long cacheHits;
+
+        /** the number of page reads that decompressed the page */
+        public long cacheMisses;
+
+        /** the number of pages written */
+        public long pagesWritten;
+
+        /** the number of bytes the pages written took once compressed */
+        public long bytesStored;
+
+        /** the number of times the index of pages was written */
+        public long commits;
+
+        @Override
+        public String toString() {
+            return "cacheSize=" + cacheSize + ", cacheUsed=" + cacheUsed + ", cacheHits="
+                + cacheHits + ", cacheMisses=" + cacheMisses + ", pagesWritten="
+                + pagesWritten + ", bytesStored=" + bytesStored + ", commits=" + commits;
+        }
+    }
+
+    /**
+     * Returns the counters of the databases opened through
+     * {@link SQLiteDatabase#VFS_COMPRESSED}.
+     */
+    public static CompressedVfsStats getCompressedVfsStats() {
+        long[] values = new long[COMPRESSED_STAT_COUNT];
+        nativeGetCompressedVfsStats(values);
+
+        CompressedVfsStats stats = new CompressedVfsStats();
+        stats.cacheSize = values[COMPRESSED_CACHE_SIZE];
+        stats.cacheUsed = values[COMPRESSED_CACHE_USED];
+        stats.cacheHits = values[COMPRESSED_CACHE_HITS];
+        stats.cacheMisses = values[COMPRESSED_CACHE_MISSES];
+        stats.pagesWritten = values[COMPRESSED_PAGES_WRITTEN];
+        stats.bytesStored = values[COMPRESSED_BYTES_STORED];
+        stats.commits = values[COMPRESSED_COMMITS];
+        return stats;
+    }
+
+    /**
+     * Contains the I/O counters of one file of a database.
+     */
+    public static class FileIoStats {
+        /** the number of reads */
+        public long reads;
+
+        /** the number of bytes read */
+        public long bytesRead;
+
+        /** the number of writes */
+        public long writes;
+
+        /** the number of bytes written */
+        public long bytesWritten;
+
+        /** the number of syncs */
+        public long syncs;
+
+        /** the number of file and shared memory lock and unlock calls */
+        public long locks;
+
+        /** the latency histogram of reads, see {@link IoStats#LATENCY_BUCKETS} */
+        public long[] readLatency;
+
+        /** the latency histogram of writes, see {@link IoStats#LATENCY_BUCKETS} */
+        public long[] writeLatency;
+
+        /** the latency histogram of syncs, see {@link IoStats#LATENCY_BUCKETS} */
+        public long[] syncLatency;
+
+        FileIoStats(long[] values, int offset) {
+            reads = values[offset + IO_READS];
+            bytesRead = values[offset + IO_BYTES_READ];
+            writes = values[offset + IO_WRITES];
+            bytesWritten = values[offset + IO_BYTES_WRITTEN];
+            syncs = values[offset + IO_SYNCS];
+            locks = values[offset + IO_LOCKS];
+            readLatency = Arrays.copyOfRange(values, offset + IO_READ_LATENCY,
+                offset + IO_READ_LATENCY + IoStats.LATENCY_BUCKETS);
+            writeLatency = Arrays.copyOfRange(values, offset + IO_WRITE_LATENCY,
+                offset + IO_WRITE_LATENCY + IoStats.LATENCY_BUCKETS);
+            syncLatency = Arrays.copyOfRange(values, offset + IO_SYNC_LATENCY,
+                offset + IO_SYNC_LATENCY + IoStats.LATENCY_BUCKETS);
+        }
+
+        @Override
+        public String toString() {
+            return "reads=" + reads + " (" + bytesRead + " bytes), writes=" + writes + " ("
+                + bytesWritten + " bytes), syncs=" + syncs + ", locks=" + locks
+                + ", syncLatency=" + Arrays.toString(syncLatency);
+        }
+    }
+
+    /**
+     * Contains the I/O counters of a database, counted while enabled with
+     * {@link SQLiteGlobal#setIoStatsEnabled(boolean)}.
+     */
+    public static class IoStats {
+        /**
+         * The number of buckets of the latency histograms. Bucket 0 counts calls that took
+         * less than 2 microseconds, bucket i those that took from 2^i to 2^(i+1)
+         * microseconds, and the last bucket all slower ones.
+         */
+        public static final int LATENCY_BUCKETS = 20;
+
+        /** the path of the database */
+        public String path;
+
+        /** the counters of the database file */
+        public FileIoStats database;
+
+        /** the counters of the rollback journal */
+        public FileIoStats journal;
+
+        /** the counters of the write-ahead log */
+        public FileIoStats wal;
+
+        @Override
+        public String toString() {
+            return path + ": database " + database + "; journal " + journal + "; wal " + wal;
+        }
+    }
+
+    /**
+     * Returns the I/O counters of every database opened by the process.
+     */
+    public static ArrayList<IoStats> getIoStats() {
+        ArrayList<IoStats> list = new ArrayList<>();
+        long[] values = new long[IO_FILE_STAT_COUNT * 3];
+        for (String path : nativeGetIoStatsDatabases()) {
+            if (nativeGetIoStats(path, values)) {
+                IoStats stats = new IoStats();
+                stats.path = path;
+                stats.database = new FileIoStats(values, 0);
+                stats.journal = new FileIoStats(values, IO_FILE_STAT_COUNT);
+                stats.wal = new FileIoStats(values, IO_FILE_STAT_COUNT * 2);
+                list.add(stats);
+            }
+        }
+        return list;
+    }
+
+    /**
+     * Resets the I/O counters of every database.
+     */
+    public static void resetIoStats() {
+        nativeResetIoStats();
+    }
+
     /**
      * return all pager and database stats for the current process.
      * @return {@link PagerStats}
@@ -168,6 +681,14 @@ public final class SQLiteDebug {
             }
         }
 
+        printer.println("SQLite memory governor: " + getMemoryGovernorStats());
+        printer.println("SQLite memory-mapped I/O: " + getMmapStats());
+        printer.println("SQLite readahead: " + getReadaheadStats());
+        printer.println("SQLite io_uring: " + getIoUringStats());
+        printer.println("SQLite compressed VFS: " + getCompressedVfsStats());
+        for (IoStats stats : getIoStats()) {
+            printer.println("SQLite I/O of " + stats);
+        }
         SQLiteDatabase.dumpAll(printer, verbose);
     }
 }
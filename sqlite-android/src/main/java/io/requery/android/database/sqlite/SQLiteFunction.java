@@ -1,5 +1,11 @@
 package io.requery.android.database.sqlite;
 
+import android.database.Cursor;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+
 /**
  * @author dhleong
  */
@@ -10,12 +16,10 @@ public class SQLiteFunction {
 
     // accessed from native code
     final int flags;
+    final int cacheSize;
+    final ByteBuffer cacheStats;
 
-    // NOTE: from a single database connection, all calls to
-    // functions are serialized by SQLITE-internal mutexes,
-    // so we save on GC churn by reusing a single, shared instance
-    private final MyArgs args = new MyArgs();
-    private final MyResult result = new MyResult();
+    private static final Charset UTF_8 = Charset.forName("UTF-8");
 
     /**
      * Create custom function.
@@ -45,35 +49,130 @@ public class SQLiteFunction {
     public SQLiteFunction(String name, int numArgs,
             SQLiteDatabase.Function callback,
             int flags) {
+        this(name, numArgs, callback, flags, 0);
+    }
+
+    /**
+     * Create custom function whose results are memoized.
+     *
+     * @param name The name of the sqlite3 function.
+     * @param numArgs The number of arguments for the function, or -1 to
+     * support any number of arguments.
+     * @param callback The callback to invoke when the function is executed.
+     * @param flags Extra SQLITE flags to pass when creating the function
+     * in native code, which must include {@link SQLiteDatabase.Function#FLAG_DETERMINISTIC}
+     * if cacheSize is not 0.
+     * @param cacheSize The number of bytes each connection may use to cache results,
+     * or 0 to call the callback every time.
+     */
+    public SQLiteFunction(String name, int numArgs,
+            SQLiteDatabase.Function callback,
+            int flags, int cacheSize) {
         if (name == null) {
             throw new IllegalArgumentException("name must not be null.");
         }
+        if (cacheSize < 0) {
+            throw new IllegalArgumentException("cacheSize must not be negative.");
+        }
+        if (cacheSize > 0 && (flags & SQLiteDatabase.Function.FLAG_DETERMINISTIC) == 0) {
+            throw new IllegalArgumentException("Only deterministic functions can be memoized.");
+        }
 
         this.name = name;
         this.numArgs = numArgs;
         this.callback = callback;
         this.flags = flags;
+        this.cacheSize = cacheSize;
+        this.cacheStats = cacheSize > 0
+                ? ByteBuffer.allocateDirect(STAT_COUNT * 8).order(ByteOrder.nativeOrder())
+                : null;
+    }
+
+    /**
+     * @return The counters of the result cache, summed over the connections the function
+     * is registered on, or null if results are not memoized.
+     */
+    public CacheStats getCacheStats() {
+        if (cacheStats == null) {
+            return null;
+        }
+        return new CacheStats(cacheStats.getLong(STAT_HITS * 8),
+                cacheStats.getLong(STAT_MISSES * 8),
+                cacheStats.getLong(STAT_EVICTIONS * 8),
+                cacheStats.getLong(STAT_SIZE * 8));
     }
 
-    // Called from native.
+    // Indices of the counters in cacheStats, which native code updates.
+    private static final int STAT_HITS = 0;
+    private static final int STAT_MISSES = 1;
+    private static final int STAT_EVICTIONS = 2;
+    private static final int STAT_SIZE = 3;
+    private static final int STAT_COUNT = 4;
+
+    // Layout of the buffer native code passes to Invocation.dispatch, in native byte order.
+    // A header holding the result is followed by one slot per argument. Both store a
+    // Cursor.FIELD_TYPE_* at offset 0 and, for numbers, the value at VALUE_OFFSET.
+    static final int HEADER_SIZE = 16;
+    static final int SLOT_SIZE = 16;
+    static final int VALUE_OFFSET = 8;
+
+    // Called from native when the function is registered on a connection.
     @SuppressWarnings("unused")
-    private void dispatchCallback(long contextPtr, long argsPtr, int argsCount) {
-        result.contextPtr = contextPtr;
-        args.argsPtr = argsPtr;
-        args.argsCount = argsCount;
+    private Invocation newInvocation() {
+        return new Invocation(callback, cacheSize > 0);
+    }
 
-        try {
-            callback.callback(args, result);
+    /**
+     * Dispatches the calls made on one connection, reusing the same argument and result
+     * holders for every call.
+     */
+    static final class Invocation {
+        private final SQLiteDatabase.Function callback;
+        private final MyArgs args = new MyArgs();
+        private final MyResult result = new MyResult();
+        private boolean active;
+
+        Invocation(SQLiteDatabase.Function callback, boolean returnObjects) {
+            this.callback = callback;
+            result.returnObjects = returnObjects;
+        }
 
-            if (!result.isSet) {
-                result.setNull();
+        // Called from native. Returns the string or blob result if the result holder
+        // returns objects, so that native code can cache it.
+        @SuppressWarnings("unused")
+        private Object dispatch(long contextPtr, long argsPtr, int argsCount, ByteBuffer values) {
+            if (active) {
+                // The callback ran a query which calls the function again.
+                return new Invocation(callback, result.returnObjects)
+                        .dispatch(contextPtr, argsPtr, argsCount, values);
             }
 
-        } finally {
-            result.contextPtr = 0;
-            result.isSet = false;
-            args.argsPtr = 0;
-            args.argsCount = 0;
+            values.order(ByteOrder.nativeOrder());
+            active = true;
+            result.contextPtr = contextPtr;
+            result.values = values;
+            args.argsPtr = argsPtr;
+            args.argsCount = argsCount;
+            args.values = values;
+
+            try {
+                callback.callback(args, result);
+
+                if (!result.isSet) {
+                    result.setNull();
+                }
+                return result.object;
+
+            } finally {
+                result.contextPtr = 0;
+                result.values = null;
+                result.isSet = false;
+                result.object = null;
+                args.argsPtr = 0;
+                args.argsCount = 0;
+                args.values = null;
+                active = false;
+            }
         }
     }
 
@@ -82,6 +181,7 @@ public class SQLiteFunction {
     static native double nativeGetArgDouble(long argsPtr, int arg);
     static native int nativeGetArgInt(long argsPtr, int arg);
     static native long nativeGetArgLong(long argsPtr, int arg);
+    static native String nativeFormatDouble(double value);
 
     static native void nativeSetResultBlob(long contextPtr, byte[] result);
     static native void nativeSetResultString(long contextPtr, String result);
@@ -91,78 +191,145 @@ public class SQLiteFunction {
     static native void nativeSetResultError(long contextPtr, String error);
     static native void nativeSetResultNull(long contextPtr);
 
-    private static class MyArgs implements SQLiteDatabase.Function.Args {
+    static class MyArgs implements SQLiteDatabase.Function.Args {
         long argsPtr;
         int argsCount;
+        ByteBuffer values;
+        // Index of the first argument of the current row in values and argsPtr.
+        int base;
+
+        @Override
+        public int getType(int arg) {
+            return values.getInt(slot(arg));
+        }
 
         @Override
         public byte[] getBlob(int arg) {
-            return nativeGetArgBlob(argsPtr, checkArg(arg));
+            switch (values.getInt(slot(arg))) {
+                case Cursor.FIELD_TYPE_NULL:
+                    return null;
+                case Cursor.FIELD_TYPE_INTEGER:
+                case Cursor.FIELD_TYPE_FLOAT:
+                    // The text of the number, like sqlite3_value_blob.
+                    return getString(arg).getBytes(UTF_8);
+                default:
+                    return nativeGetArgBlob(argsPtr, base + arg);
+            }
         }
 
         @Override
         public String getString(int arg) {
-            return nativeGetArgString(argsPtr, checkArg(arg));
+            final int slot = slot(arg);
+            switch (values.getInt(slot)) {
+                case Cursor.FIELD_TYPE_NULL:
+                    return null;
+                case Cursor.FIELD_TYPE_INTEGER:
+                    return Long.toString(values.getLong(slot + VALUE_OFFSET));
+                case Cursor.FIELD_TYPE_FLOAT:
+                    return nativeFormatDouble(values.getDouble(slot + VALUE_OFFSET));
+                default:
+                    return nativeGetArgString(argsPtr, base + arg);
+            }
         }
 
         @Override
         public double getDouble(int arg) {
-            return nativeGetArgDouble(argsPtr, checkArg(arg));
+            final int slot = slot(arg);
+            switch (values.getInt(slot)) {
+                case Cursor.FIELD_TYPE_FLOAT:
+                    return values.getDouble(slot + VALUE_OFFSET);
+                case Cursor.FIELD_TYPE_INTEGER:
+                    return values.getLong(slot + VALUE_OFFSET);
+                case Cursor.FIELD_TYPE_NULL:
+                    return 0;
+                default:
+                    return nativeGetArgDouble(argsPtr, base + arg);
+            }
         }
 
         @Override
         public int getInt(int arg) {
-            return nativeGetArgInt(argsPtr, checkArg(arg));
+            // Truncates like sqlite3_value_int.
+            return (int) getLong(arg);
         }
 
         @Override
         public long getLong(int arg) {
-            return nativeGetArgLong(argsPtr, checkArg(arg));
+            final int slot = slot(arg);
+            switch (values.getInt(slot)) {
+                case Cursor.FIELD_TYPE_INTEGER:
+                    return values.getLong(slot + VALUE_OFFSET);
+                case Cursor.FIELD_TYPE_FLOAT:
+                    return (long) values.getDouble(slot + VALUE_OFFSET);
+                case Cursor.FIELD_TYPE_NULL:
+                    return 0;
+                default:
+                    return nativeGetArgLong(argsPtr, base + arg);
+            }
         }
 
-        private int checkArg(int arg) {
+        void checkRow() {
+        }
+
+        private int slot(int arg) {
+            checkRow();
             if (arg < 0 || arg >= argsCount) {
                 throw new IllegalArgumentException(
                     "Requested arg " + arg + " but had " + argsCount
                 );
             }
 
-            return arg;
+            return HEADER_SIZE + (base + arg) * SLOT_SIZE;
         }
     }
 
-    private static class MyResult implements SQLiteDatabase.Function.Result {
+    static class MyResult implements SQLiteDatabase.Function.Result {
         long contextPtr;
+        ByteBuffer values;
         boolean isSet;
+        // When set, strings and blobs are kept in object for the caller to set.
+        boolean returnObjects;
+        Object object;
 
         @Override
         public void set(byte[] value) {
             checkSet();
-            nativeSetResultBlob(contextPtr, value);
+            if (returnObjects && value != null) {
+                object = value;
+                values.putInt(0, Cursor.FIELD_TYPE_BLOB);
+            } else {
+                nativeSetResultBlob(contextPtr, value);
+            }
         }
 
         @Override
         public void set(double value) {
             checkSet();
-            nativeSetResultDouble(contextPtr, value);
+            values.putDouble(VALUE_OFFSET, value);
+            values.putInt(0, Cursor.FIELD_TYPE_FLOAT);
         }
 
         @Override
         public void set(int value) {
-            checkSet();
-            nativeSetResultInt(contextPtr, value);
+            set((long) value);
         }
 
         @Override
         public void set(long value) {
             checkSet();
-            nativeSetResultLong(contextPtr, value);
+            values.putLong(VALUE_OFFSET, value);
+            values.putInt(0, Cursor.FIELD_TYPE_INTEGER);
         }
 
         @Override
         public void set(String value) {
             checkSet();
-            nativeSetResultString(contextPtr, value);
+            if (returnObjects && value != null) {
+                object = value;
+                values.putInt(0, Cursor.FIELD_TYPE_STRING);
+            } else {
+                nativeSetResultString(contextPtr, value);
+            }
         }
 
         @Override
@@ -174,7 +341,7 @@ public class SQLiteFunction {
         @Override
         public void setNull() {
             checkSet();
-            nativeSetResultNull(contextPtr);
+            values.putInt(0, Cursor.FIELD_TYPE_NULL);
         }
 
         private void checkSet() {
@@ -182,4 +349,39 @@ public class SQLiteFunction {
             isSet = true;
         }
     }
+
+    /**
+     * Counters of the result cache of a memoized function.
+     */
+    public static final class CacheStats {
+        /** Calls answered from the cache. */
+        public final long hits;
+        /** Calls which invoked the callback. */
+        public final long misses;
+        /** Results dropped to stay within the cache size. */
+        public final long evictions;
+        /** Approximate number of bytes held by the caches. */
+        public final long size;
+
+        CacheStats(long hits, long misses, long evictions, long size) {
+            this.hits = hits;
+            this.misses = misses;
+            this.evictions = evictions;
+            this.size = size;
+        }
+
+        /**
+         * @return The fraction of calls answered from the cache, or 0 if there were none.
+         */
+        public float getHitRate() {
+            long calls = hits + misses;
+            return calls == 0 ? 0 : (float) hits / calls;
+        }
+
+        @Override
+        public String toString() {
+            return "hits=" + hits + " misses=" + misses + " evictions=" + evictions
+                    + " size=" + size;
+        }
+    }
 }
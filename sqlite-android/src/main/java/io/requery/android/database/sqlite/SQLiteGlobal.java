@@ -21,6 +21,7 @@
 
 package io.requery.android.database.sqlite;
 
+import android.content.ComponentCallbacks2;
 import android.os.StatFs;
 
 /**
@@ -40,15 +41,34 @@ import android.os.StatFs;
 public final class SQLiteGlobal {
     private static final Object sLock = new Object();
     private static int sDefaultPageSize;
+    private static boolean sConnectionOpened;
 
     private static native int nativeReleaseMemory();
+    private static native void nativeConfigureMemory(int pageSize, int pageCount,
+            int lookasideSlotSize, int lookasideSlotCount);
+    private static native void nativeSetPoolAllocatorEnabled(boolean enabled);
+    private static native void nativeSetMemoryPolicy(long softHeapLimit, long hardHeapLimit,
+            int maxCacheSizeKiB, int minCacheSizeKiB);
+    private static native int nativeOnMemoryPressure(int level);
+    private static native void nativeSetMmapBudget(long bytes);
+    private static native void nativeSetReadaheadSize(int bytes);
+    private static native boolean nativeSetIoUringEnabled(boolean enabled);
+    private static native void nativeSetIoStatsEnabled(boolean enabled);
+    private static native void nativeSetCompressedCacheSize(long bytes);
+
+    // Memory pressure levels of the native memory governor.
+    private static final int PRESSURE_NONE = 0;
+    private static final int PRESSURE_MODERATE = 1;
+    private static final int PRESSURE_HIGH = 2;
+    private static final int PRESSURE_CRITICAL = 3;
 
     private SQLiteGlobal() {
     }
 
     /**
      * Attempts to release memory by pruning the SQLite page cache and other
-     * internal data structures.
+     * internal data structures. Only the memory above the soft heap limit of the
+     * current memory pressure is released, or all of it under critical pressure.
      *
      * @return The number of bytes that were freed.
      */
@@ -56,6 +76,196 @@ public final class SQLiteGlobal {
         return nativeReleaseMemory();
     }
 
+    /**
+     * Sets the memory limits of SQLite in the absence of memory pressure. Each level of
+     * pressure halves the soft heap limit and the page cache size of connections, down to
+     * the minimum cache size.
+     *
+     * The limits count every allocation of SQLite. Above the soft heap limit, unused pages
+     * of the page caches are released before more memory is allocated. Statements that
+     * need memory beyond the hard heap limit fail with
+     * {@link android.database.sqlite.SQLiteOutOfMemoryException}.
+     *
+     * Defaults are a soft heap limit of 8 MiB, no hard heap limit and page caches of
+     * 2000 KiB down to 128 KiB.
+     *
+     * @param softHeapLimit The soft heap limit in bytes.
+     * @param hardHeapLimit The hard heap limit in bytes, or 0 for none.
+     * @param maxCacheSizeKiB The page cache size of a connection in KiB.
+     * @param minCacheSizeKiB The page cache size of a connection in KiB under critical
+     *                        memory pressure.
+     */
+    public static void setMemoryPolicy(long softHeapLimit, long hardHeapLimit,
+                                       int maxCacheSizeKiB, int minCacheSizeKiB) {
+        if (softHeapLimit < 0 || hardHeapLimit < 0) {
+            throw new IllegalArgumentException("Heap limits must be non-negative.");
+        }
+        if (minCacheSizeKiB <= 0 || maxCacheSizeKiB < minCacheSizeKiB) {
+            throw new IllegalArgumentException("Cache sizes must be positive and "
+                    + "maxCacheSizeKiB must be at least minCacheSizeKiB.");
+        }
+        nativeSetMemoryPolicy(softHeapLimit, hardHeapLimit, maxCacheSizeKiB, minCacheSizeKiB);
+    }
+
+    /**
+     * Signals memory pressure of a {@link ComponentCallbacks2} trim level to the memory
+     * governor and releases memory accordingly.
+     *
+     * @return The number of bytes that were freed.
+     */
+    static int onTrimMemory(int level) {
+        final int pressure;
+        if (level >= ComponentCallbacks2.TRIM_MEMORY_COMPLETE
+                || level == ComponentCallbacks2.TRIM_MEMORY_RUNNING_CRITICAL) {
+            pressure = PRESSURE_CRITICAL;
+        } else if (level >= ComponentCallbacks2.TRIM_MEMORY_MODERATE
+                || level == ComponentCallbacks2.TRIM_MEMORY_RUNNING_LOW) {
+            pressure = PRESSURE_HIGH;
+        } else if (level >= ComponentCallbacks2.TRIM_MEMORY_BACKGROUND
+                || level == ComponentCallbacks2.TRIM_MEMORY_RUNNING_MODERATE) {
+            pressure = PRESSURE_MODERATE;
+        } else {
+            pressure = PRESSURE_NONE;
+        }
+        return nativeOnMemoryPressure(pressure);
+    }
+
+    /**
+     * Configures how SQLite allocates memory for every database connection of the process.
+     * This must be called before the first database is opened.
+     *
+     * @param pageSize The largest page size held by the page cache arena, a power of two
+     *                 from 512 to 65536.
+     * @param pageCount The number of pages preallocated for the page caches of all
+     *                  connections, or 0 to allocate every page from the heap. Pages that do
+     *                  not fit into the arena overflow to the heap, which is reported by
+     *                  {@link SQLiteDebug.PagerStats#pageCacheOverflow}.
+     * @param lookasideSlotSize The default size in bytes of each lookaside slot, or -1 to
+     *                          keep the SQLite default.
+     * @param lookasideSlotCount The default number of lookaside slots of each connection, or
+     *                           -1 to keep the SQLite default.
+     * @throws IllegalStateException if a database has already been opened.
+     */
+    public static void configureMemory(int pageSize, int pageCount,
+                                       int lookasideSlotSize, int lookasideSlotCount) {
+        if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0) {
+            throw new IllegalArgumentException("pageSize must be a power of two from 512 "
+                    + "to 65536.");
+        }
+        if (pageCount < 0) {
+            throw new IllegalArgumentException("pageCount must be non-negative.");
+        }
+        synchronized (sLock) {
+            if (sConnectionOpened) {
+                throw new IllegalStateException("The memory of SQLite must be configured "
+                        + "before the first database is opened.");
+            }
+            nativeConfigureMemory(pageSize, pageCount, lookasideSlotSize, lookasideSlotCount);
+        }
+    }
+
+    /**
+     * Enables or disables pooling in the allocator of SQLite. When enabled, allocations of
+     * up to 4096 bytes are rounded up to a size class and freed memory is kept for reuse
+     * by the freeing thread, instead of going to malloc every time. This may be changed
+     * at any time. Allocations are counted either way; see
+     * {@link SQLiteDebug#getAllocatorStats()}.
+     *
+     * Default is disabled.
+     */
+    public static void setPoolAllocatorEnabled(boolean enabled) {
+        nativeSetPoolAllocatorEnabled(enabled);
+    }
+
+    /**
+     * Sets how many bytes the memory mappings of all database files may take together,
+     * see {@link SQLiteDatabase#setMmapSize(long)}. Files keep what they have been granted
+     * until their mmap size is next set.
+     *
+     * Default is 2 GiB for 64-bit processes and 256 MiB for 32-bit ones.
+     *
+     * @param bytes The budget in bytes, or 0 to disable memory-mapped I/O.
+     */
+    public static void setMmapBudget(long bytes) {
+        if (bytes < 0) {
+            throw new IllegalArgumentException("bytes must be non-negative.");
+        }
+        nativeSetMmapBudget(bytes);
+    }
+
+    /**
+     * Sets how many bytes of a database file may be read at once when its pages are read
+     * in ascending order, as by full table scans and index builds. The pages read ahead
+     * are kept in a buffer of the connection until its transaction ends or a database is
+     * written. Reads that are not sequential are not affected. See
+     * {@link SQLiteDebug#getReadaheadStats()}.
+     *
+     * Default is 128 KiB.
+     *
+     * @param bytes The readahead size in bytes, or 0 to disable reading ahead.
+     */
+    public static void setReadaheadSize(int bytes) {
+        if (bytes < 0) {
+            throw new IllegalArgumentException("bytes must be non-negative.");
+        }
+        nativeSetReadaheadSize(bytes);
+    }
+
+    /**
+     * Enables or disables reading database and WAL files through io_uring. Reads of
+     * connections that run at the same time, such as those of the connection pool of a
+     * database in WAL mode, are then submitted to the kernel together. Reads go through
+     * read calls as before where the kernel does not support io_uring. See
+     * {@link SQLiteDebug#getIoUringStats()}.
+     *
+     * The seccomp policy of apps on many Android releases does not allow io_uring and may
+     * end the process when it is used, so this must only be enabled where the policy is
+     * known to allow it.
+     *
+     * Default is disabled.
+     *
+     * @return true if reads now go through io_uring.
+     */
+    public static boolean setIoUringEnabled(boolean enabled) {
+        return nativeSetIoUringEnabled(enabled);
+    }
+
+    /**
+     * Enables or disables counting the reads, writes, syncs and locks of every database
+     * file, journal and WAL file, along with the latency of reads, writes and syncs. The
+     * overhead is a clock read and a few atomic increments per call. This may be changed
+     * at any time. See {@link SQLiteDebug#getIoStats()}.
+     *
+     * Default is disabled.
+     */
+    public static void setIoStatsEnabled(boolean enabled) {
+        nativeSetIoStatsEnabled(enabled);
+    }
+
+    /**
+     * Sets how many bytes the decompressed pages of the databases opened through
+     * {@link SQLiteDatabase#VFS_COMPRESSED} may take together. The cache is shared by all
+     * connections, so a page read by one of them is not decompressed again by the others.
+     *
+     * Default is 4 MiB.
+     *
+     * @param bytes The cache size in bytes, or 0 to disable the cache.
+     */
+    public static void setCompressedCacheSize(long bytes) {
+        if (bytes < 0) {
+            throw new IllegalArgumentException("bytes must be non-negative.");
+        }
+        nativeSetCompressedCacheSize(bytes);
+    }
+
+    // Called by SQLiteConnection before opening a connection, after which the memory
+    // configuration can no longer change.
+    static void onConnectionOpened() {
+        synchronized (sLock) {
+            sConnectionOpened = true;
+        }
+    }
+
     // values derived from:
     // https://android.googlesource.com/platform/frameworks/base.git/+/master/core/res/res/values/config.xml
 
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.sqlite;
+
+import android.database.sqlite.SQLiteException;
+
+import java.io.Closeable;
+
+/**
+ * Commits single statements of many threads together, obtained from
+ * {@link SQLiteDatabase#openGroupCommit}.
+ * <p>
+ * Each call to {@link #executeInsert} or {@link #executeUpdateDelete} waits until its
+ * statement has been committed, just like a statement executed outside of a transaction.
+ * Statements of concurrent callers are committed together in one transaction by a native
+ * commit thread, so they share its syncs: a batch is committed once it holds the maximum
+ * number of statements, or its oldest statement has waited the maximum latency. A failing
+ * statement is rolled back on its own and does not affect the others of its batch.
+ * </p><p>
+ * The commit thread has a database connection of its own, which uses the locale and
+ * foreign key mode of the database but none of its custom functions. Statements run
+ * outside of the transactions of the calling thread, which they must not be called from.
+ * </p><p>
+ * This class is thread-safe.
+ * </p>
+ */
+public final class SQLiteGroupCommit implements Closeable {
+
+    private final CloseGuard mCloseGuard = CloseGuard.get();
+
+    private final Object mLock = new Object();
+    private final long mCommitterPtr;
+    private boolean mClosed;
+    private int mActiveCalls;
+
+    private static native long nativeOpen(String path, String vfsName, String syncMode,
+            boolean foreignKeys, String locale, int maxBatchSize, long maxLatencyMicros);
+    private static native void nativeClose(long committerPtr);
+    private static native void nativeDestroy(long committerPtr);
+    private static native void nativeExecute(long committerPtr, String sql, Object[] args,
+            long[] result);
+    private static native void nativeGetStats(long committerPtr, long[] stats);
+
+    // Indices of the results filled in by nativeExecute.
+    private static final int RESULT_CHANGES = 0;
+    private static final int RESULT_LAST_INSERT_ROW_ID = 1;
+
+    // Indices of the counters filled in by nativeGetStats.
+    private static final int STAT_BATCHES = 0;
+    private static final int STAT_OPERATIONS = 1;
+    private static final int STAT_FAILED_OPERATIONS = 2;
+    private static final int STAT_FAILED_BATCHES = 3;
+    private static final int STAT_MAX_BATCH_SIZE = 4;
+    private static final int STAT_LAST_BATCH_SIZE = 5;
+    private static final int STAT_LAST_BATCH_WAIT_MICROS = 6;
+    private static final int STAT_LAST_BATCH_COMMIT_MICROS = 7;
+    private static final int STAT_TOTAL_WAIT_MICROS = 8;
+    private static final int STAT_TOTAL_COMMIT_MICROS = 9;
+    private static final int STAT_COUNT = 10;
+
+    /**
+     * Contains the counters of the batches committed.
+     */
+    public static class Stats {
+        /** the number of batches committed or failed */
+        public long batches;
+
+        /** the number of statements executed */
+        public long operations;
+
+        /** the number of statements that failed */
+        public long failedOperations;
+
+        /** the number of batches whose transaction failed as a whole */
+        public long failedBatches;
+
+        /** the largest number of statements in one batch */
+        public long maxBatchSize;
+
+        /** the number of statements in the last batch */
+        public long lastBatchSize;
+
+        /** how long the oldest statement of the last batch waited for it to start */
+        public long lastBatchWaitMicros;
+
+        /** how long the transaction of the last batch took */
+        public long lastBatchCommitMicros;
+
+        /** how long the oldest statements of all batches waited for them to start */
+        public long totalWaitMicros;
+
+        /** how long the transactions of all batches took */
+        public long totalCommitMicros;
+
+        @Override
+        public String toString() {
+            return "batches=" + batches + ", operations=" + operations + ", failedOperations="
+                + failedOperations + ", failedBatches=" + failedBatches + ", maxBatchSize="
+                + maxBatchSize + ", lastBatchSize=" + lastBatchSize + ", lastBatchWaitMicros="
+                + lastBatchWaitMicros + ", lastBatchCommitMicros=" + lastBatchCommitMicros;
+        }
+    }
+
+    SQLiteGroupCommit(SQLiteDatabaseConfiguration configuration, int maxBatchSize,
+                      long maxLatencyMicros) {
+        final boolean wal =
+                (configuration.openFlags & SQLiteDatabase.ENABLE_WRITE_AHEAD_LOGGING) != 0;
+        mCommitterPtr = nativeOpen(configuration.path, configuration.vfsName,
+                wal ? SQLiteGlobal.getWALSyncMode() : SQLiteGlobal.getDefaultSyncMode(),
+                configuration.foreignKeyConstraintsEnabled, configuration.locale.toString(),
+                maxBatchSize, maxLatencyMicros);
+        mCloseGuard.open("close");
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            if (mCloseGuard != null) {
+                mCloseGuard.warnIfOpen();
+            }
+            close();
+        } finally {
+            super.finalize();
+        }
+    }
+
+    /**
+     * Executes an INSERT statement once its batch commits.
+     *
+     * @param sql The statement.
+     * @param bindArgs The arguments of the statement, which may be null, numbers, booleans,
+     *                 strings or byte arrays.
+     * @return The row id of the last row inserted by the statement, or -1 if none was.
+     *
+     * @throws SQLiteException if the statement or its batch failed, or the SQL holds more
+     * than one statement.
+     */
+    public long executeInsert(String sql, Object... bindArgs) {
+        long[] result = execute(sql, bindArgs);
+        return result[RESULT_CHANGES] > 0 ? result[RESULT_LAST_INSERT_ROW_ID] : -1;
+    }
+
+    /**
+     * Executes an UPDATE or DELETE statement, or any other statement that changes the
+     * database, once its batch commits.
+     *
+     * @param sql The statement.
+     * @param bindArgs The arguments of the statement, which may be null, numbers, booleans,
+     *                 strings or byte arrays.
+     * @return The number of rows changed by the statement.
+     *
+     * @throws SQLiteException if the statement or its batch failed, or the SQL holds more
+     * than one statement.
+     */
+    public int executeUpdateDelete(String sql, Object... bindArgs) {
+        return (int) execute(sql, bindArgs)[RESULT_CHANGES];
+    }
+
+    /**
+     * Returns the counters of the batches committed so far.
+     */
+    public Stats getStats() {
+        long[] values = new long[STAT_COUNT];
+        acquire();
+        try {
+            nativeGetStats(mCommitterPtr, values);
+        } finally {
+            release();
+        }
+
+        Stats stats = new Stats();
+        stats.batches = values[STAT_BATCHES];
+        stats.operations = values[STAT_OPERATIONS];
+        stats.failedOperations = values[STAT_FAILED_OPERATIONS];
+        stats.failedBatches = values[STAT_FAILED_BATCHES];
+        stats.maxBatchSize = values[STAT_MAX_BATCH_SIZE];
+        stats.lastBatchSize = values[STAT_LAST_BATCH_SIZE];
+        stats.lastBatchWaitMicros = values[STAT_LAST_BATCH_WAIT_MICROS];
+        stats.lastBatchCommitMicros = values[STAT_LAST_BATCH_COMMIT_MICROS];
+        stats.totalWaitMicros = values[STAT_TOTAL_WAIT_MICROS];
+        stats.totalCommitMicros = values[STAT_TOTAL_COMMIT_MICROS];
+        return stats;
+    }
+
+    /**
+     * Commits the statements still pending, then closes the connection of the commit
+     * thread. Statements executed afterwards throw {@link IllegalStateException}.
+     */
+    @Override
+    public void close() {
+        synchronized (mLock) {
+            if (mClosed) {
+                return;
+            }
+            mClosed = true;
+            mCloseGuard.close();
+            // Callers already waiting still get their statements committed.
+            nativeClose(mCommitterPtr);
+
+            boolean interrupted = false;
+            while (mActiveCalls > 0) {
+                try {
+                    mLock.wait();
+                } catch (InterruptedException ex) {
+                    interrupted = true;
+                }
+            }
+            if (interrupted) {
+                Thread.currentThread().interrupt();
+            }
+        }
+        nativeDestroy(mCommitterPtr);
+    }
+
+    private long[] execute(String sql, Object[] bindArgs) {
+        if (sql == null) {
+            throw new IllegalArgumentException("sql must not be null.");
+        }
+        switch (SQLiteStatementType.getSqlStatementType(sql)) {
+            case SQLiteStatementType.STATEMENT_SELECT:
+            case SQLiteStatementType.STATEMENT_ATTACH:
+            case SQLiteStatementType.STATEMENT_BEGIN:
+            case SQLiteStatementType.STATEMENT_COMMIT:
+            case SQLiteStatementType.STATEMENT_ABORT:
+            case SQLiteStatementType.STATEMENT_PRAGMA:
+                throw new IllegalArgumentException("Only statements that change the database "
+                        + "can be group committed: " + sql);
+        }
+
+        Object[] args = null;
+        if (bindArgs != null) {
+            args = new Object[bindArgs.length];
+            for (int i = 0; i < bindArgs.length; i++) {
+                args[i] = toNativeArg(bindArgs[i]);
+            }
+        }
+
+        long[] result = new long[2];
+        acquire();
+        try {
+            nativeExecute(mCommitterPtr, sql, args, result);
+        } finally {
+            release();
+        }
+        return result;
+    }
+
+    // Converts an argument to a Long, Double, String or byte[], as the native code expects.
+    private static Object toNativeArg(Object arg) {
+        if (arg == null || arg instanceof Long || arg instanceof Double
+                || arg instanceof String || arg instanceof byte[]) {
+            return arg;
+        } else if (arg instanceof Float) {
+            return ((Float) arg).doubleValue();
+        } else if (arg instanceof Number) {
+            return ((Number) arg).longValue();
+        } else if (arg instanceof Boolean) {
+            return (Boolean) arg ? 1L : 0L;
+        }
+        return arg.toString();
+    }
+
+    private void acquire() {
+        synchronized (mLock) {
+            if (mClosed) {
+                throw new IllegalStateException("The group commit has been closed.");
+            }
+            mActiveCalls++;
+        }
+    }
+
+    private void release() {
+        synchronized (mLock) {
+            mActiveCalls--;
+            if (mActiveCalls == 0) {
+                mLock.notifyAll();
+            }
+        }
+    }
+}
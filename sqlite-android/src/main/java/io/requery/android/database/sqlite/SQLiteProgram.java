@@ -20,6 +20,7 @@ package io.requery.android.database.sqlite;
 import androidx.core.os.CancellationSignal;
 import androidx.sqlite.db.SupportSQLiteProgram;
 
+import java.nio.ByteBuffer;
 import java.util.Arrays;
 
 /**
@@ -178,6 +179,35 @@ public abstract class SQLiteProgram extends SQLiteClosable implements SupportSQL
         bind(index, value);
     }
 
+    /**
+     * Bind the remaining bytes of a buffer as a blob value to this statement. The value
+     * remains bound until {@link #clearBindings} is called.
+     * <p>
+     * The contents of a direct buffer are handed to SQLite without being copied, so the
+     * buffer must not be modified while the statement executes.
+     * </p>
+     *
+     * @param index The 1-based index to the parameter to bind
+     * @param value The value to bind, must not be null
+     */
+    public void bindBlob(int index, ByteBuffer value) {
+        if (value == null) {
+            throw new IllegalArgumentException("the bind value at index " + index + " is null");
+        }
+        bind(index, value);
+    }
+
+    /**
+     * Bind a blob of the given length filled with zeroes to this statement. The blob
+     * content can then be written incrementally with {@link SQLiteDatabase#openBlob}.
+     *
+     * @param index The 1-based index to the parameter to bind
+     * @param length The length of the blob in bytes
+     */
+    public void bindZeroBlob(int index, long length) {
+        bind(index, new SQLiteBlob.ZeroBlob(length));
+    }
+
     /**
      * Binds the given Object to the given SQLiteProgram using the proper
      * typing. For example, bind numbers as longs/doubles, and everything else
@@ -202,6 +232,10 @@ public abstract class SQLiteProgram extends SQLiteClosable implements SupportSQL
             }
         } else if (value instanceof byte[]){
             bindBlob(index, (byte[]) value);
+        } else if (value instanceof ByteBuffer) {
+            bindBlob(index, (ByteBuffer) value);
+        } else if (value instanceof SQLiteBlob.ZeroBlob) {
+            bind(index, value);
         } else {
             bindString(index, value.toString());
         }
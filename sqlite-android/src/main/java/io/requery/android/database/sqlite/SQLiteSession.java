@@ -25,10 +25,13 @@ import android.annotation.SuppressLint;
 import android.database.sqlite.SQLiteException;
 import android.database.sqlite.SQLiteTransactionListener;
 import android.os.ParcelFileDescriptor;
+import android.os.SystemClock;
 import androidx.core.os.CancellationSignal;
 import androidx.core.os.OperationCanceledException;
 import io.requery.android.database.CursorWindow;
 
+import java.nio.ByteBuffer;
+
 /**
  * Provides a single client the ability to use a database.
  *
@@ -228,6 +231,10 @@ public final class SQLiteSession {
      */
     public static final int TRANSACTION_MODE_EXCLUSIVE = 2;
 
+    // How long a backup waits at least before trying a step again after the database was
+    // locked by another connection.
+    private static final long BACKUP_BUSY_DELAY_MILLIS = 10;
+
     /**
      * Creates a session bound to the specified connection pool.
      *
@@ -306,12 +313,38 @@ public final class SQLiteSession {
                                  CancellationSignal cancellationSignal) {
         throwIfTransactionMarkedSuccessful();
         beginTransactionUnchecked(transactionMode, transactionListener, connectionFlags,
-                cancellationSignal);
+                cancellationSignal, null);
+    }
+
+    /**
+     * Begins a transaction that reads the state of the database recorded by a snapshot.
+     * <p>
+     * The transaction is begun in DEFERRED mode, and may not be nested in another one.
+     * It must be ended with {@link #endTransaction}, like any other.
+     * </p>
+     *
+     * @param snapshot The snapshot, taken by {@link #getSnapshot}.
+     * @param connectionFlags The connection flags to use to acquire a connection.
+     * Refer to {@link SQLiteConnectionPool}.
+     * @param cancellationSignal A signal to cancel the operation in progress, or null if none.
+     *
+     * @throws IllegalStateException if a transaction is already in progress.
+     * @throws SQLiteException if the snapshot is no longer available.
+     * @throws OperationCanceledException if the operation was canceled.
+     */
+    public void beginTransactionAtSnapshot(SQLiteSnapshot snapshot, int connectionFlags,
+            CancellationSignal cancellationSignal) {
+        if (mTransactionStack != null) {
+            throw new IllegalStateException("Cannot begin a transaction at a snapshot "
+                    + "while a transaction is already in progress.");
+        }
+        beginTransactionUnchecked(TRANSACTION_MODE_DEFERRED, null, connectionFlags,
+                cancellationSignal, snapshot);
     }
 
     private void beginTransactionUnchecked(int transactionMode,
             SQLiteTransactionListener transactionListener, int connectionFlags,
-            CancellationSignal cancellationSignal) {
+            CancellationSignal cancellationSignal, SQLiteSnapshot snapshot) {
         if (cancellationSignal != null) {
             cancellationSignal.throwIfCanceled();
         }
@@ -337,6 +370,16 @@ public final class SQLiteSession {
                         mConnection.execute("BEGIN;", null, cancellationSignal); // might throw
                         break;
                 }
+
+                // Opening the snapshot must come before the transaction reads anything.
+                if (snapshot != null) {
+                    try {
+                        snapshot.openOn(mConnection); // might throw
+                    } catch (RuntimeException ex) {
+                        mConnection.execute("ROLLBACK;", null, cancellationSignal); // might throw
+                        throw ex;
+                    }
+                }
             }
 
             // Listener might throw a runtime exception.
@@ -555,7 +598,7 @@ public final class SQLiteSession {
         }
 
         beginTransactionUnchecked(transactionMode, listener, connectionFlags,
-                cancellationSignal); // might throw
+                cancellationSignal, null); // might throw
         return true;
     }
 
@@ -698,6 +741,297 @@ public final class SQLiteSession {
         }
     }
 
+    /**
+     * Opens a handle for incremental I/O on a single BLOB value.
+     * <p>
+     * The session holds on to its connection until the returned blob is closed,
+     * so the blob must be closed on the thread that opened it.
+     * </p>
+     *
+     * @param database The symbolic name of the database, such as "main".
+     * @param table The name of the table containing the BLOB.
+     * @param column The name of the column containing the BLOB.
+     * @param rowId The row id of the row containing the BLOB.
+     * @param writable True to open the BLOB for writing.
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     * @return The blob handle, never null.
+     *
+     * @throws SQLiteException if an error occurs, such as a missing row or column.
+     */
+    public SQLiteBlob openBlob(String database, String table, String column, long rowId,
+            boolean writable, int connectionFlags) {
+        acquireConnection(null, connectionFlags, null); // might throw
+        try {
+            long blobPtr = mConnection.openBlob(database, table, column, rowId,
+                    writable); // might throw
+            return new SQLiteBlob(this, blobPtr);
+        } catch (RuntimeException ex) {
+            releaseConnection(); // might throw
+            throw ex;
+        }
+    }
+
+    /**
+     * Releases the connection held on behalf of a blob opened by {@link #openBlob}.
+     */
+    void closeBlob() {
+        releaseConnection(); // might throw
+    }
+
+    /**
+     * Returns the content of a database in the format of a database file.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     * @return The serialized database.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read.
+     */
+    public byte[] serialize(String schema, int connectionFlags) {
+        acquireConnection(null, connectionFlags, null); // might throw
+        try {
+            return mConnection.serialize(schema); // might throw
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    /**
+     * Writes the content of a database to a file descriptor in the format of a database
+     * file.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param fd The file descriptor to write to.
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     * @return The number of bytes written.
+     *
+     * @throws SQLiteException if the database does not exist or cannot be read.
+     */
+    public long serialize(String schema, ParcelFileDescriptor fd, int connectionFlags) {
+        acquireConnection(null, connectionFlags, null); // might throw
+        try {
+            return mConnection.serialize(schema, fd); // might throw
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    /**
+     * Replaces a database with an in-memory database holding the remaining bytes of a
+     * direct buffer.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param buffer The direct buffer holding the database.
+     * @param readOnly True to read the buffer in place rather than copy it.
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     *
+     * @throws SQLiteException if the database cannot be replaced.
+     */
+    public void deserialize(String schema, ByteBuffer buffer, boolean readOnly,
+            int connectionFlags) {
+        acquireConnection(null, connectionFlags, null); // might throw
+        try {
+            mConnection.deserialize(schema, buffer, readOnly); // might throw
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    /**
+     * Replaces a database with an in-memory database holding the content of a database
+     * file.
+     *
+     * @param schema The symbolic name of the database, such as "main".
+     * @param path The path of the database file.
+     * @param readOnly True to map the file rather than copy it.
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     *
+     * @throws SQLiteException if the database cannot be replaced.
+     */
+    public void deserialize(String schema, String path, boolean readOnly,
+            int connectionFlags) {
+        acquireConnection(null, connectionFlags, null); // might throw
+        try {
+            mConnection.deserialize(schema, path, readOnly); // might throw
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    /**
+     * Records the current state of the database, for transactions begun later with
+     * {@link #beginTransactionAtSnapshot}.
+     * <p>
+     * Within a transaction, the snapshot records the state that transaction reads, which
+     * must not have written yet. Otherwise a read transaction is begun and ended around it.
+     * </p>
+     *
+     * @param connectionFlags The connection flags to use if a connection must be
+     * acquired by this operation.  Refer to {@link SQLiteConnectionPool}.
+     * @param cancellationSignal A signal to cancel the operation in progress, or null if none.
+     * @return The snapshot, which must be closed when done.
+     *
+     * @throws SQLiteException if the database is not in WAL mode, or an error occurs.
+     * @throws OperationCanceledException if the operation was canceled.
+     */
+    public SQLiteSnapshot getSnapshot(int connectionFlags,
+                                      CancellationSignal cancellationSignal) {
+        if (mTransactionStack != null) {
+            return new SQLiteSnapshot(mConnection.getSnapshot()); // might throw
+        }
+
+        acquireConnection(null, connectionFlags, cancellationSignal); // might throw
+        try {
+            mConnection.execute("BEGIN;", null, cancellationSignal); // might throw
+            final long snapshotPtr;
+            try {
+                snapshotPtr = mConnection.getSnapshot(); // might throw
+            } catch (RuntimeException ex) {
+                // The read transaction has nothing to keep, and failing to end it must not
+                // hide why no snapshot was taken.
+                try {
+                    mConnection.execute("ROLLBACK;", null, null); // might throw
+                } catch (RuntimeException rollbackEx) {
+                    // ignored
+                }
+                throw ex;
+            }
+            final SQLiteSnapshot snapshot = new SQLiteSnapshot(snapshotPtr);
+            try {
+                mConnection.execute("COMMIT;", null, null); // might throw
+            } catch (RuntimeException ex) {
+                snapshot.close();
+                throw ex;
+            }
+            return snapshot;
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    /**
+     * Copies the main database of this session into the main database of another session
+     * with an online backup, a few pages at a time.
+     * <p>
+     * The destination connection is held for the whole backup, while the primary
+     * connection of this session is only held for each step, so that writers can use it in
+     * between. Their changes are copied to the destination as they are made.
+     * </p>
+     *
+     * @param destination The session of the database to copy into.
+     * @param pagesPerStep The number of pages copied by each step, or a negative number to
+     * copy the database in one step.
+     * @param stepDelayMillis How long to wait between steps.
+     * @param listener The listener told about the progress after each step, or null.
+     * @param cancellationSignal A signal to cancel the backup between steps, or null.
+     *
+     * @throws SQLiteException if an error occurs.
+     * @throws OperationCanceledException if the backup was canceled.
+     */
+    public void backup(SQLiteSession destination, int pagesPerStep, long stepDelayMillis,
+            SQLiteDatabase.BackupProgressListener listener,
+            CancellationSignal cancellationSignal) {
+        final int flags = SQLiteConnectionPool.CONNECTION_FLAG_PRIMARY_CONNECTION_AFFINITY;
+        destination.acquireConnection(null, flags, cancellationSignal); // might throw
+        try {
+            final int[] progress = new int[2];
+            long backupPtr = 0;
+            boolean done = false;
+            try {
+                while (!done) {
+                    if (cancellationSignal != null) {
+                        cancellationSignal.throwIfCanceled();
+                    }
+                    int result;
+                    acquireConnection(null, flags, cancellationSignal); // might throw
+                    try {
+                        if (backupPtr == 0) {
+                            backupPtr = mConnection.openBackup(
+                                    destination.mConnection); // might throw
+                        }
+                        result = mConnection.stepBackup(backupPtr, pagesPerStep,
+                                progress); // might throw
+                    } finally {
+                        releaseConnection(); // might throw
+                    }
+
+                    done = result == SQLiteConnection.BACKUP_DONE;
+                    if (listener != null && result != SQLiteConnection.BACKUP_BUSY) {
+                        listener.onProgress(progress[0], progress[1]);
+                    }
+                    if (!done) {
+                        waitForBackupStep(result == SQLiteConnection.BACKUP_BUSY
+                                ? Math.max(stepDelayMillis, BACKUP_BUSY_DELAY_MILLIS)
+                                : stepDelayMillis, cancellationSignal);
+                    }
+                }
+            } finally {
+                if (backupPtr != 0) {
+                    finishBackup(backupPtr, done, flags);
+                }
+            }
+        } finally {
+            destination.releaseConnection(); // might throw
+        }
+    }
+
+    // Releases the backup with the primary connection held, as the connection refers to
+    // it. Errors are only reported if the backup completed, so that they do not hide the
+    // reason it stopped.
+    private void finishBackup(long backupPtr, boolean done, int flags) {
+        acquireConnection(null, flags, null); // might throw
+        try {
+            mConnection.finishBackup(backupPtr);
+        } catch (RuntimeException ex) {
+            if (done) {
+                throw ex;
+            }
+        } finally {
+            releaseConnection(); // might throw
+        }
+    }
+
+    private static void waitForBackupStep(long delayMillis,
+            CancellationSignal cancellationSignal) {
+        if (delayMillis <= 0) {
+            return;
+        }
+        final Object lock = new Object();
+        if (cancellationSignal != null) {
+            cancellationSignal.setOnCancelListener(new CancellationSignal.OnCancelListener() {
+                @Override
+                public void onCancel() {
+                    synchronized (lock) {
+                        lock.notifyAll();
+                    }
+                }
+            });
+        }
+        try {
+            final long deadline = SystemClock.uptimeMillis() + delayMillis;
+            synchronized (lock) {
+                long remaining = delayMillis;
+                while (remaining > 0
+                        && (cancellationSignal == null || !cancellationSignal.isCanceled())) {
+                    lock.wait(remaining);
+                    remaining = deadline - SystemClock.uptimeMillis();
+                }
+            }
+        } catch (InterruptedException ex) {
+            Thread.currentThread().interrupt();
+            throw new OperationCanceledException("The backup was interrupted.");
+        } finally {
+            if (cancellationSignal != null) {
+                cancellationSignal.setOnCancelListener(null);
+            }
+        }
+    }
+
     /**
      * Executes a statement that returns a single BLOB result as a
      * file descriptor to a shared memory region.
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package io.requery.android.database.sqlite;
+
+import java.io.Closeable;
+
+/**
+ * A state of a database in WAL mode, obtained from {@link SQLiteDatabase#getSnapshot}.
+ * <p>
+ * Transactions begun with {@link SQLiteDatabase#beginTransactionAtSnapshot} read the
+ * database as it was when the snapshot was taken, on whichever connection of the pool
+ * they get, so that reads split over several transactions see the same data without
+ * holding one connection throughout.
+ * </p><p>
+ * A snapshot can only be opened as long as the WAL still holds the frames it reads: once
+ * a checkpoint has copied later frames into the database, or the WAL has been reset,
+ * opening it throws {@link android.database.sqlite.SQLiteException} and a new snapshot
+ * must be taken. Open transactions are not affected.
+ * </p><p>
+ * This class is thread-safe.
+ * </p>
+ */
+public final class SQLiteSnapshot implements Closeable, Comparable<SQLiteSnapshot> {
+
+    private final CloseGuard mCloseGuard = CloseGuard.get();
+
+    private final Object mLock = new Object();
+    private final long mSnapshotPtr;
+    private boolean mClosed;
+    private int mActiveCalls;
+
+    SQLiteSnapshot(long snapshotPtr) {
+        mSnapshotPtr = snapshotPtr;
+        mCloseGuard.open("close");
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            if (mCloseGuard != null) {
+                mCloseGuard.warnIfOpen();
+            }
+            close();
+        } finally {
+            super.finalize();
+        }
+    }
+
+    /**
+     * Compares the age of two snapshots of the same database.
+     *
+     * @param other The other snapshot.
+     * @return A negative number if this snapshot is older than the other one, a positive
+     * number if it is newer, or 0 if both read the same state. The result is undefined
+     * if the WAL has been reset since the older one was taken.
+     *
+     * @throws IllegalStateException if either snapshot has been closed.
+     */
+    @Override
+    public int compareTo(SQLiteSnapshot other) {
+        acquire();
+        try {
+            other.acquire();
+            try {
+                return SQLiteConnection.compareSnapshots(mSnapshotPtr, other.mSnapshotPtr);
+            } finally {
+                other.release();
+            }
+        } finally {
+            release();
+        }
+    }
+
+    /**
+     * Releases the snapshot. Transactions it was opened by are not affected.
+     */
+    @Override
+    public void close() {
+        synchronized (mLock) {
+            if (mClosed) {
+                return;
+            }
+            mClosed = true;
+            mCloseGuard.close();
+
+            boolean interrupted = false;
+            while (mActiveCalls > 0) {
+                try {
+                    mLock.wait();
+                } catch (InterruptedException ex) {
+                    interrupted = true;
+                }
+            }
+            if (interrupted) {
+                Thread.currentThread().interrupt();
+            }
+        }
+        SQLiteConnection.freeSnapshot(mSnapshotPtr);
+    }
+
+    // Called by SQLiteSession only, right after it has begun a transaction on connection.
+    void openOn(SQLiteConnection connection) {
+        acquire();
+        try {
+            connection.openSnapshot(mSnapshotPtr);
+        } finally {
+            release();
+        }
+    }
+
+    private void acquire() {
+        synchronized (mLock) {
+            if (mClosed) {
+                throw new IllegalStateException("The snapshot has been closed.");
+            }
+            mActiveCalls++;
+        }
+    }
+
+    private void release() {
+        synchronized (mLock) {
+            mActiveCalls--;
+            if (mActiveCalls == 0) {
+                mLock.notifyAll();
+            }
+        }
+    }
+}
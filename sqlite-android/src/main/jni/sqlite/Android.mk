@@ -31,6 +31,8 @@ sqlite_flags := \
     -DSQLITE_MAX_EXPR_DEPTH=0 \
     -DSQLITE_USE_ALLOCA \
     -DSQLITE_ENABLE_BATCH_ATOMIC_WRITE \
+    -DSQLITE_ENABLE_COLUMN_METADATA \
+    -DSQLITE_ENABLE_SNAPSHOT \
     -O3
 
 LOCAL_CFLAGS += $(sqlite_flags)
@@ -39,6 +41,13 @@ LOCAL_CFLAGS += -Wno-uninitialized -Wno-parentheses
 LOCAL_CPPFLAGS += -Wno-conversion-null
 
 
+# Bounds PRAGMA mmap_size, which defaults to 0. 32-bit processes have little address space.
+ifneq ($(filter arm64-v8a x86_64,$(TARGET_ARCH_ABI)),)
+	LOCAL_CFLAGS += -DSQLITE_MAX_MMAP_SIZE=2147483648
+else
+	LOCAL_CFLAGS += -DSQLITE_MAX_MMAP_SIZE=268435456
+endif
+
 ifeq ($(TARGET_ARCH), arm)
 	LOCAL_CFLAGS += -DPACKED="__attribute__ ((packed))"
 else
@@ -47,6 +56,9 @@ endif
 
 LOCAL_SRC_FILES:= \
 	android_database_SQLiteCommon.cpp \
+	android_database_SQLiteBlob.cpp \
+	android_database_SQLiteGroupCommit.cpp \
+	android_database_SQLiteCheckpointer.cpp \
 	android_database_SQLiteConnection.cpp \
 	android_database_SQLiteFunction.cpp \
 	android_database_SQLiteGlobal.cpp \
@@ -54,7 +66,24 @@ LOCAL_SRC_FILES:= \
 	android_database_CursorWindow.cpp \
 	CursorWindow.cpp \
 	JNIHelp.cpp \
-	JNIString.cpp
+	JNIString.cpp \
+	StatementCache.cpp \
+	FunctionResultCache.cpp \
+	NativeFunctions.cpp \
+	Unicode.cpp \
+	LocalizedCollator.cpp \
+	PoolAllocator.cpp \
+	MemoryGovernor.cpp \
+	IoUringVfs.cpp \
+	ReadaheadVfs.cpp \
+	MmapVfs.cpp \
+	IoStatsVfs.cpp \
+	VfsShim.cpp \
+	GroupCommitter.cpp \
+	Checkpointer.cpp \
+	Lz4.cpp \
+	CompressedVfs.cpp \
+	ZipVfs.cpp
 
 LOCAL_SRC_FILES += sqlite3.c
 
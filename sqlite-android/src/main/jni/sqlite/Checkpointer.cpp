@@ -0,0 +1,203 @@
+#undef LOG_TAG
+#define LOG_TAG "Checkpointer"
+
+#include "Checkpointer.h"
+#include "ALog-priv.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace android {
+
+// The busy handler of the checkpoint connection waits this long between attempts. A
+// RESTART or TRUNCATE checkpoint keeps writers out while it waits for readers, so it gives
+// up well before writers would reach the busy timeout of the connection pool.
+static const int BUSY_RETRY_DELAY_US = 10000;
+static const int MAX_BUSY_RETRIES = 10;
+
+// How long to wait before trying again after readers or writers kept a checkpoint from
+// completing.
+static const int64_t BUSY_BACKOFF_MICROS = 1000000;
+
+static int64_t nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+Checkpointer::Checkpointer(const char* path, const char* vfsName, int passiveFrames,
+        int restartFrames, int truncateFrames, int idleMillis) :
+        mPath(path), mVfsName(vfsName ? vfsName : ""), mHasVfsName(vfsName != NULL),
+        mPassiveFrames(passiveFrames), mRestartFrames(restartFrames),
+        mTruncateFrames(truncateFrames), mIdleMicros(int64_t(idleMillis) * 1000),
+        mReferences(1), mClosed(false), mWalFrames(0), mLastCommitAt(0),
+        mBusyRetries(0) {
+    memset(mStats, 0, sizeof(mStats));
+    mThread = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mClosed = true;
+        mChanged.notify_one();
+    }
+    mThread.join();
+}
+
+void Checkpointer::acquire() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mReferences++;
+}
+
+void Checkpointer::release() {
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        last = --mReferences == 0;
+    }
+    if (last) {
+        delete this;
+    }
+}
+
+void Checkpointer::attach(sqlite3* db) {
+    acquire();
+    // Replaces the auto-checkpoint, which is a WAL hook as well.
+    sqlite3_wal_hook(db, walHook, this);
+}
+
+void Checkpointer::getStats(int64_t* stats) {
+    std::lock_guard<std::mutex> lock(mLock);
+    memcpy(stats, mStats, sizeof(mStats));
+}
+
+// Called by writers after each commit, with the number of frames in the WAL.
+int Checkpointer::walHook(void* data, sqlite3* db, const char* schema, int frames) {
+    if (strcmp(schema, "main") != 0) {
+        return SQLITE_OK;
+    }
+    Checkpointer* checkpointer = static_cast<Checkpointer*>(data);
+    std::lock_guard<std::mutex> lock(checkpointer->mLock);
+    checkpointer->mWalFrames = frames;
+    checkpointer->mLastCommitAt = nowMicros();
+    if (frames > checkpointer->mStats[STAT_MAX_WAL_FRAMES]) {
+        checkpointer->mStats[STAT_MAX_WAL_FRAMES] = frames;
+    }
+    if (frames >= checkpointer->mPassiveFrames) {
+        checkpointer->mChanged.notify_one();
+    }
+    return SQLITE_OK;
+}
+
+int Checkpointer::busyHandler(void* data, int count) {
+    Checkpointer* checkpointer = static_cast<Checkpointer*>(data);
+    if (count >= MAX_BUSY_RETRIES) {
+        return 0;
+    }
+    checkpointer->mBusyRetries++;
+    usleep(BUSY_RETRY_DELAY_US);
+    return 1;
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    for (;;) {
+        while (!mClosed && mWalFrames < mPassiveFrames) {
+            mChanged.wait(lock);
+        }
+
+        // A PASSIVE checkpoint waits until writers pause, unless the WAL grows enough in
+        // the meantime to need a stronger one.
+        int mode = SQLITE_CHECKPOINT_PASSIVE;
+        while (!mClosed) {
+            mode = mWalFrames >= mTruncateFrames ? SQLITE_CHECKPOINT_TRUNCATE
+                    : mWalFrames >= mRestartFrames ? SQLITE_CHECKPOINT_RESTART
+                    : SQLITE_CHECKPOINT_PASSIVE;
+            int64_t idleAt = mLastCommitAt + mIdleMicros;
+            int64_t now = nowMicros();
+            if (mode != SQLITE_CHECKPOINT_PASSIVE || now >= idleAt) {
+                break;
+            }
+            mChanged.wait_for(lock, std::chrono::microseconds(idleAt - now));
+        }
+        if (mClosed) {
+            return;
+        }
+
+        // Commits made during the checkpoint report the size of the WAL again.
+        int frames = mWalFrames;
+        mWalFrames = 0;
+        lock.unlock();
+        int64_t start = nowMicros();
+        int walFrames = -1;
+        int checkpointedFrames = -1;
+        int err = checkpoint(mode, &walFrames, &checkpointedFrames);
+        int64_t duration = nowMicros() - start;
+        int64_t busyRetries = mBusyRetries;
+        mBusyRetries = 0;
+        lock.lock();
+
+        mStats[STAT_CHECKPOINTS]++;
+        mStats[mode == SQLITE_CHECKPOINT_PASSIVE ? STAT_PASSIVE_CHECKPOINTS
+                : mode == SQLITE_CHECKPOINT_RESTART ? STAT_RESTART_CHECKPOINTS
+                : STAT_TRUNCATE_CHECKPOINTS]++;
+        mStats[STAT_BUSY_RETRIES] += busyRetries;
+        mStats[STAT_LAST_DURATION_MICROS] = duration;
+        mStats[STAT_TOTAL_DURATION_MICROS] += duration;
+        if (duration > mStats[STAT_MAX_DURATION_MICROS]) {
+            mStats[STAT_MAX_DURATION_MICROS] = duration;
+        }
+        if (checkpointedFrames > 0) {
+            mStats[STAT_FRAMES_CHECKPOINTED] += checkpointedFrames;
+        }
+        mStats[STAT_LAST_FRAMES_CHECKPOINTED] = checkpointedFrames > 0 ? checkpointedFrames : 0;
+
+        if (err != SQLITE_OK) {
+            mStats[STAT_FAILED_CHECKPOINTS]++;
+            ALOGW("Checkpoint of %s failed: %d", mPath.c_str(), err);
+            // Try again later, unless a commit reported a new size in the meantime.
+            if (mWalFrames < frames) {
+                mWalFrames = frames;
+            }
+            int64_t retryAt = nowMicros() + BUSY_BACKOFF_MICROS;
+            while (!mClosed && nowMicros() < retryAt) {
+                mChanged.wait_for(lock, std::chrono::microseconds(retryAt - nowMicros()));
+            }
+        }
+    }
+}
+
+// Runs a checkpoint on a connection of the checkpoint thread, which is closed again so that
+// it does not keep PRAGMA journal_mode from leaving WAL mode.
+int Checkpointer::checkpoint(int mode, int* walFrames, int* checkpointedFrames) {
+    sqlite3* db = NULL;
+    int err = sqlite3_open_v2(mPath.c_str(), &db, SQLITE_OPEN_READWRITE,
+            mHasVfsName ? mVfsName.c_str() : NULL);
+    if (err == SQLITE_OK) {
+        err = sqlite3_busy_handler(db, busyHandler, this);
+    }
+    if (err == SQLITE_OK) {
+        // Reading the database opens its WAL, which a checkpoint alone does not do on a new
+        // connection.
+        err = sqlite3_exec(db, "PRAGMA schema_version", NULL, NULL, NULL);
+    }
+    if (err != SQLITE_OK) {
+        ALOGE("Could not open %s for checkpoints: %s", mPath.c_str(),
+                db ? sqlite3_errmsg(db) : sqlite3_errstr(err));
+        sqlite3_close(db);
+        return err;
+    }
+
+    err = sqlite3_wal_checkpoint_v2(db, "main", mode, walFrames, checkpointedFrames);
+    int closeErr = sqlite3_close(db);
+    if (closeErr != SQLITE_OK) {
+        ALOGE("sqlite3_close(%p) failed: %d", db, closeErr);
+    }
+    return err;
+}
+
+} // namespace android
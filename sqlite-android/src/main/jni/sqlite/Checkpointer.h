@@ -0,0 +1,101 @@
+#ifndef _ANDROID__DATABASE_CHECKPOINTER_H
+#define _ANDROID__DATABASE_CHECKPOINTER_H
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace android {
+
+/**
+ * Checkpoints the WAL of a database on a thread of its own, instead of on the writer whose
+ * commit crosses the auto-checkpoint size.
+ *
+ * The connections of the database report the size of the WAL after each commit through a
+ * WAL hook, which replaces their auto-checkpoint. Once the WAL holds passiveFrames, the
+ * checkpoint thread waits until no commit has happened for idleMillis and runs a PASSIVE
+ * checkpoint, which never waits for readers or writers. If readers keep the WAL from
+ * being reset so that it grows to restartFrames, a RESTART checkpoint runs right away,
+ * waiting for readers so that the next writer starts the WAL over; past truncateFrames,
+ * a TRUNCATE checkpoint also gives the space of the WAL file back.
+ *
+ * The checkpoint thread opens a connection of its own for each checkpoint and closes it
+ * right after, since an open connection keeps the database from leaving WAL mode. The
+ * checkpointer is reference counted, since connections may outlive the pool that created
+ * it; it is deleted, stopping its thread, once the last reference is released.
+ */
+class Checkpointer {
+public:
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_CHECKPOINTS = 0,
+        STAT_PASSIVE_CHECKPOINTS = 1,
+        STAT_RESTART_CHECKPOINTS = 2,
+        STAT_TRUNCATE_CHECKPOINTS = 3,
+        STAT_FAILED_CHECKPOINTS = 4,
+        STAT_BUSY_RETRIES = 5,
+        STAT_FRAMES_CHECKPOINTED = 6,
+        STAT_LAST_FRAMES_CHECKPOINTED = 7,
+        STAT_MAX_WAL_FRAMES = 8,
+        STAT_LAST_DURATION_MICROS = 9,
+        STAT_MAX_DURATION_MICROS = 10,
+        STAT_TOTAL_DURATION_MICROS = 11,
+        STAT_COUNT = 12,
+    };
+
+    /* Starts the checkpoint thread of the database at path, which is opened through the
+     * named VFS, or the default one if vfsName is NULL. The caller holds the first
+     * reference. */
+    Checkpointer(const char* path, const char* vfsName, int passiveFrames, int restartFrames,
+            int truncateFrames, int idleMillis);
+
+    void acquire();
+
+    /* Releases a reference, and deletes the checkpointer with the last one. */
+    void release();
+
+    /* Makes the checkpointer track the WAL of the main database of db, which must release
+     * a reference once it is closed. */
+    void attach(sqlite3* db);
+
+    void getStats(int64_t* stats);
+
+private:
+    const std::string mPath;
+    const std::string mVfsName;
+    const bool mHasVfsName;
+    const int mPassiveFrames;
+    const int mRestartFrames;
+    const int mTruncateFrames;
+    const int64_t mIdleMicros;
+
+    std::mutex mLock;
+    std::condition_variable mChanged;
+    int mReferences;
+    bool mClosed;
+    // The number of frames in the WAL after the last commit, or 0 once checkpointed.
+    int mWalFrames;
+    int64_t mLastCommitAt;
+    int64_t mStats[STAT_COUNT];
+    std::thread mThread;
+
+    // Used by the checkpoint thread only.
+    int64_t mBusyRetries;
+
+    ~Checkpointer();
+
+    static int walHook(void* data, sqlite3* db, const char* schema, int frames);
+    static int busyHandler(void* data, int count);
+
+    void run();
+    int checkpoint(int mode, int* walFrames, int* checkpointedFrames);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_CHECKPOINTER_H
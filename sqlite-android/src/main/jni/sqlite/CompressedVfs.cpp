@@ -0,0 +1,1042 @@
+#undef LOG_TAG
+#define LOG_TAG "CompressedVfs"
+
+#include "CompressedVfs.h"
+#include "ALog-priv.h"
+#include "Lz4.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+static const char* const VFS_NAME = "android-compressed";
+
+static const char PLAIN_MAGIC[16] = "SQLite format 3";
+static const char CONTAINER_MAGIC[16] = "SQLite LZ4 v1";
+
+// The container starts with two copies of its header, the current one being the valid
+// one of the higher generation. Each copy takes a sector of its own, and holds in
+// little endian:
+//    0  magic
+//   16  u32 block size
+//   20  u32 number of blocks in the index
+//   24  u64 generation
+//   32  u64 size of the database
+//   40  u64 offset of the index
+//   48  u32 checksum of the index
+//   52  u32 checksum of the previous bytes
+// The index holds a u32 offset in SLOT_ALIGN units and a u32 length for each block, the
+// top bit of the length marking a block stored uncompressed. Offset 0 marks a block of
+// zeros, which takes no slot.
+static const int HEADER_SLOT_SIZE = 512;
+static const int HEADER_SIZE = 56;
+static const int INDEX_ENTRY_SIZE = 8;
+static const uint32_t RAW_FLAG = 0x80000000U;
+
+// Slots start past the header copies, so that a container never written to but for its
+// slots reads as zeros up to here.
+static const int64_t DATA_START = 4096;
+static const int64_t SLOT_ALIGN = 64;
+// Slots are moved down once a third of the container, and at least this much, is free.
+static const int64_t MIN_COMPACTION = 1024 * 1024;
+
+static const int DEFAULT_BLOCK_SIZE = 4096;
+static const int MIN_BLOCK_SIZE = 512;
+static const int MAX_BLOCK_SIZE = 65536;
+
+static const int64_t DEFAULT_CACHE_SIZE = 4 * 1024 * 1024;
+
+static void put32(char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = char(value >> (8 * i));
+    }
+}
+
+static void put64(char* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = char(value >> (8 * i));
+    }
+}
+
+static uint32_t get32(const char* p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= uint32_t(uint8_t(p[i])) << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get64(const char* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= uint64_t(uint8_t(p[i])) << (8 * i);
+    }
+    return value;
+}
+
+// FNV-1a.
+static uint32_t checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ uint8_t(data[i])) * 16777619U;
+    }
+    return hash;
+}
+
+static int64_t slotSize(uint32_t length) {
+    return (int64_t(length) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+}
+
+static bool isZero(const char* data, int size) {
+    for (int i = 0; i < size; i++) {
+        if (data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::atomic<int64_t> gCacheHits(0);
+static std::atomic<int64_t> gCacheMisses(0);
+static std::atomic<int64_t> gBlocksWritten(0);
+static std::atomic<int64_t> gBytesStored(0);
+static std::atomic<int64_t> gCommits(0);
+
+// Cache of decompressed blocks of all containers, least recently used first out.
+typedef std::pair<const void*, int64_t> BlockKey;
+
+struct BlockKeyHash {
+    size_t operator()(const BlockKey& key) const {
+        return std::hash<const void*>()(key.first)
+                ^ std::hash<int64_t>()(key.second * 0x9E3779B97F4A7C15LL);
+    }
+};
+
+struct CachedBlock {
+    BlockKey key;
+    std::vector<char> data;
+};
+
+static std::mutex gCacheLock;
+static std::list<CachedBlock> gLru;
+static std::unordered_map<BlockKey, std::list<CachedBlock>::iterator, BlockKeyHash> gCached;
+static int64_t gCacheSize = DEFAULT_CACHE_SIZE;
+static int64_t gCacheUsed;
+
+static void evictLocked() {
+    while (gCacheUsed > gCacheSize && !gLru.empty()) {
+        CachedBlock& block = gLru.back();
+        gCacheUsed -= int64_t(block.data.size());
+        gCached.erase(block.key);
+        gLru.pop_back();
+    }
+}
+
+static bool cacheGet(const void* container, int64_t block, char* out, int size) {
+    std::lock_guard<std::mutex> lock(gCacheLock);
+    std::unordered_map<BlockKey, std::list<CachedBlock>::iterator, BlockKeyHash>::iterator it =
+            gCached.find(BlockKey(container, block));
+    if (it == gCached.end()) {
+        return false;
+    }
+    gLru.splice(gLru.begin(), gLru, it->second);
+    memcpy(out, it->second->data.data(), size);
+    return true;
+}
+
+static void cachePut(const void* container, int64_t block, const char* data, int size) {
+    std::lock_guard<std::mutex> lock(gCacheLock);
+    if (size > gCacheSize) {
+        return;
+    }
+    BlockKey key(container, block);
+    std::unordered_map<BlockKey, std::list<CachedBlock>::iterator, BlockKeyHash>::iterator it =
+            gCached.find(key);
+    if (it != gCached.end()) {
+        gLru.splice(gLru.begin(), gLru, it->second);
+        gCacheUsed += size - int64_t(it->second->data.size());
+        it->second->data.assign(data, data + size);
+    } else {
+        gLru.push_front(CachedBlock());
+        gLru.front().key = key;
+        gLru.front().data.assign(data, data + size);
+        gCached[key] = gLru.begin();
+        gCacheUsed += size;
+    }
+    evictLocked();
+}
+
+// Drops the blocks of the container from first on.
+static void cacheErase(const void* container, int64_t first) {
+    std::lock_guard<std::mutex> lock(gCacheLock);
+    for (std::list<CachedBlock>::iterator it = gLru.begin(); it != gLru.end();) {
+        if (it->key.first == container && it->key.second >= first) {
+            gCacheUsed -= int64_t(it->data.size());
+            gCached.erase(it->key);
+            it = gLru.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static void cacheEraseBlock(const void* container, int64_t block) {
+    std::lock_guard<std::mutex> lock(gCacheLock);
+    std::unordered_map<BlockKey, std::list<CachedBlock>::iterator, BlockKeyHash>::iterator it =
+            gCached.find(BlockKey(container, block));
+    if (it != gCached.end()) {
+        gCacheUsed -= int64_t(it->second->data.size());
+        gLru.erase(it->second);
+        gCached.erase(it);
+    }
+}
+
+// The free extents of a container, coalesced. Extents are handed out lowest first, which
+// packs the slots towards the start so that the end of the file can be given back.
+class FreeSpace {
+public:
+    FreeSpace() : mTotal(0) {
+    }
+
+    void add(int64_t offset, int64_t length) {
+        mTotal += length;
+        std::map<int64_t, int64_t>::iterator next = mExtents.lower_bound(offset);
+        if (next != mExtents.begin()) {
+            std::map<int64_t, int64_t>::iterator prev = next;
+            --prev;
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                length += prev->second;
+                mExtents.erase(prev);
+            }
+        }
+        if (next != mExtents.end() && offset + length == next->first) {
+            length += next->second;
+            mExtents.erase(next);
+        }
+        mExtents[offset] = length;
+    }
+
+    /* Takes length bytes out of the lowest extent that holds them before limit. Returns
+     * 0 if none does. */
+    int64_t take(int64_t length, int64_t limit) {
+        for (std::map<int64_t, int64_t>::iterator it = mExtents.begin();
+                it != mExtents.end() && it->first + length <= limit; ++it) {
+            if (it->second >= length) {
+                int64_t offset = it->first;
+                int64_t extent = it->second;
+                mExtents.erase(it);
+                if (extent > length) {
+                    mExtents[offset + length] = extent - length;
+                }
+                mTotal -= length;
+                return offset;
+            }
+        }
+        return 0;
+    }
+
+    /* Removes the extent ending at end, returning where the used space now ends. */
+    int64_t trimTail(int64_t end) {
+        if (mExtents.empty()) {
+            return end;
+        }
+        std::map<int64_t, int64_t>::iterator last = --mExtents.end();
+        if (last->first + last->second != end) {
+            return end;
+        }
+        int64_t offset = last->first;
+        mTotal -= last->second;
+        mExtents.erase(last);
+        return offset;
+    }
+
+    int64_t total() const {
+        return mTotal;
+    }
+
+private:
+    std::map<int64_t, int64_t> mExtents;
+    int64_t mTotal;
+};
+
+struct Slot {
+    // Offset 0 marks a block of zeros.
+    int64_t offset;
+    uint32_t length;
+    bool raw;
+    // Set if the synced index refers to the slot, which must then not be overwritten.
+    bool durable;
+};
+
+// The state of a compressed database, shared by the connections that have it open.
+class Container {
+public:
+    explicit Container(const std::string& path) :
+            mPath(path), mRefs(0), mBlockSize(0), mSize(0), mEnd(DATA_START),
+            mIndexOffset(0), mIndexLength(0), mGeneration(0), mVersion(0), mLoads(0), mDirty(false) {
+    }
+
+    const std::string& path() const {
+        return mPath;
+    }
+
+    int& refs() {
+        return mRefs;
+    }
+
+    /* Reads the container from the file. Sets plain instead if the file is a plain
+     * database, or not a container. */
+    int load(sqlite3_file* real, bool* plain);
+
+    int read(sqlite3_file* real, void* buffer, int amount, int64_t offset);
+    int write(sqlite3_file* real, const void* buffer, int amount, int64_t offset);
+    int truncate(sqlite3_file* real, int64_t size);
+
+    /* Writes the index and switches the header to it. With sync set, the file is synced
+     * before and after the switch. */
+    int commit(sqlite3_file* real, int flags, bool sync);
+
+    int64_t size() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mSize;
+    }
+
+private:
+    const std::string mPath;
+    int mRefs;
+
+    std::mutex mLock;
+    int mBlockSize;
+    int64_t mSize;
+    std::vector<Slot> mSlots;
+    FreeSpace mFreeSpace;
+    // Slots replaced since the index was synced, free once the next one is.
+    std::vector<std::pair<int64_t, int64_t> > mPendingFree;
+    int64_t mEnd;
+    int64_t mIndexOffset;
+    int64_t mIndexLength;
+    uint64_t mGeneration;
+    // Changed by every write, so that a block read while one happens is not cached.
+    uint64_t mVersion;
+    // The number of blocks being read from the file without the lock. Space freed
+    // meanwhile is only reused once none are, since one of them may be reading it.
+    int mLoads;
+    std::vector<std::pair<int64_t, int64_t> > mDeferredFree;
+    bool mDirty;
+    std::vector<char> mCompressed;
+
+    int loadBlock(sqlite3_file* real, const Slot& slot, char* out);
+    int readBlock(std::unique_lock<std::mutex>& lock, sqlite3_file* real, int64_t block,
+            char* out);
+    int storeBlock(sqlite3_file* real, int64_t block, const char* data);
+    int64_t allocate(int64_t length);
+    void release(const Slot& slot);
+    void freeSpace(int64_t offset, int64_t length);
+    bool parseHeader(const char* header, uint64_t* generation);
+    int commitLocked(sqlite3_file* real, int flags, bool sync);
+    bool compactLocked(sqlite3_file* real);
+};
+
+bool Container::parseHeader(const char* header, uint64_t* generation) {
+    if (memcmp(header, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0
+            || get32(header + 52) != checksum(header, 52)) {
+        return false;
+    }
+    *generation = get64(header + 24);
+    return true;
+}
+
+int Container::load(sqlite3_file* real, bool* plain) {
+    *plain = false;
+    sqlite3_int64 fileSize;
+    int err = real->pMethods->xFileSize(real, &fileSize);
+    if (err != SQLITE_OK || fileSize == 0) {
+        return err;
+    }
+
+    char headers[2 * HEADER_SLOT_SIZE];
+    memset(headers, 0, sizeof(headers));
+    err = real->pMethods->xRead(real, headers, sizeof(headers), 0);
+    if (err != SQLITE_OK && err != SQLITE_IOERR_SHORT_READ) {
+        return err;
+    }
+    if (memcmp(headers, PLAIN_MAGIC, sizeof(PLAIN_MAGIC)) == 0) {
+        *plain = true;
+        return SQLITE_OK;
+    }
+
+    const char* header = NULL;
+    uint64_t generation = 0;
+    for (int i = 0; i < 2; i++) {
+        uint64_t g;
+        if (parseHeader(headers + i * HEADER_SLOT_SIZE, &g) && (!header || g > generation)) {
+            header = headers + i * HEADER_SLOT_SIZE;
+            generation = g;
+        }
+    }
+    if (!header) {
+        // Slots written before the first commit leave the header zero, which holds an
+        // empty container. Anything else is left to SQLite to reject.
+        *plain = !isZero(headers, sizeof(headers));
+        return SQLITE_OK;
+    }
+
+    int blockSize = int(get32(header + 16));
+    uint32_t blockCount = get32(header + 20);
+    int64_t size = int64_t(get64(header + 32));
+    int64_t indexOffset = int64_t(get64(header + 40));
+    int64_t indexLength = int64_t(blockCount) * INDEX_ENTRY_SIZE;
+    if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE
+            || (blockSize & (blockSize - 1)) || size < 0
+            || blockCount > (size + blockSize - 1) / blockSize
+            || (blockCount && indexOffset < DATA_START)) {
+        ALOGE("Corrupt header in %s", mPath.c_str());
+        return SQLITE_CORRUPT;
+    }
+
+    std::vector<char> index(indexLength);
+    if (blockCount) {
+        err = real->pMethods->xRead(real, &index[0], int(indexLength), indexOffset);
+        if (err != SQLITE_OK || checksum(&index[0], index.size()) != get32(header + 48)) {
+            ALOGE("Corrupt index in %s: %d", mPath.c_str(), err);
+            return err != SQLITE_OK && err != SQLITE_IOERR_SHORT_READ ? err : SQLITE_CORRUPT;
+        }
+    }
+
+    // Whatever lies between the slots and the index is free.
+    std::vector<std::pair<int64_t, int64_t> > used;
+    mSlots.resize(blockCount);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        const char* entry = &index[size_t(i) * INDEX_ENTRY_SIZE];
+        Slot& slot = mSlots[i];
+        slot.offset = int64_t(get32(entry)) * SLOT_ALIGN;
+        slot.length = get32(entry + 4) & ~RAW_FLAG;
+        slot.raw = (get32(entry + 4) & RAW_FLAG) != 0;
+        slot.durable = true;
+        if (!slot.offset) {
+            continue;
+        }
+        if (slot.offset < DATA_START || slot.length == 0 || int(slot.length) > blockSize
+                || (slot.raw && int(slot.length) != blockSize)) {
+            ALOGE("Corrupt index entry %u in %s", i, mPath.c_str());
+            mSlots.clear();
+            return SQLITE_CORRUPT;
+        }
+        used.push_back(std::make_pair(slot.offset, slotSize(slot.length)));
+    }
+    if (blockCount) {
+        used.push_back(std::make_pair(indexOffset, slotSize(uint32_t(indexLength))));
+    }
+    std::sort(used.begin(), used.end());
+    int64_t end = DATA_START;
+    for (size_t i = 0; i < used.size(); i++) {
+        if (used[i].first > end) {
+            mFreeSpace.add(end, used[i].first - end);
+        }
+        end = std::max(end, used[i].first + used[i].second);
+    }
+
+    mBlockSize = blockSize;
+    mSize = size;
+    mEnd = end;
+    mIndexOffset = blockCount ? indexOffset : 0;
+    mIndexLength = blockCount ? slotSize(uint32_t(indexLength)) : 0;
+    mGeneration = generation;
+    return SQLITE_OK;
+}
+
+int Container::loadBlock(sqlite3_file* real, const Slot& slot, char* out) {
+    int err;
+    if (slot.raw) {
+        err = real->pMethods->xRead(real, out, mBlockSize, slot.offset);
+    } else {
+        std::vector<char> stored(slot.length);
+        err = real->pMethods->xRead(real, &stored[0], int(slot.length), slot.offset);
+        if (err == SQLITE_OK
+                && Lz4::decompress(&stored[0], int(slot.length), out, mBlockSize) < 0) {
+            ALOGE("Corrupt block at %lld in %s", (long long) slot.offset, mPath.c_str());
+            err = SQLITE_IOERR_READ;
+        }
+    }
+    // A slot cut short is as corrupt as one that does not decompress.
+    return err == SQLITE_IOERR_SHORT_READ ? SQLITE_IOERR_READ : err;
+}
+
+// Reads a block, unlocking while it is read from the file.
+int Container::readBlock(std::unique_lock<std::mutex>& lock, sqlite3_file* real,
+        int64_t block, char* out) {
+    if (block >= int64_t(mSlots.size()) || !mSlots[block].offset) {
+        memset(out, 0, mBlockSize);
+        return SQLITE_OK;
+    }
+    if (cacheGet(this, block, out, mBlockSize)) {
+        gCacheHits.fetch_add(1, std::memory_order_relaxed);
+        return SQLITE_OK;
+    }
+    gCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    Slot slot = mSlots[block];
+    uint64_t version = mVersion;
+    mLoads++;
+    lock.unlock();
+    int err = loadBlock(real, slot, out);
+    lock.lock();
+    if (--mLoads == 0) {
+        for (size_t i = 0; i < mDeferredFree.size(); i++) {
+            mFreeSpace.add(mDeferredFree[i].first, mDeferredFree[i].second);
+        }
+        mDeferredFree.clear();
+    }
+    if (err == SQLITE_OK && version == mVersion) {
+        cachePut(this, block, out, mBlockSize);
+    }
+    return err;
+}
+
+int Container::read(sqlite3_file* real, void* buffer, int amount, int64_t offset) {
+    std::unique_lock<std::mutex> lock(mLock);
+    char* out = static_cast<char*>(buffer);
+    int64_t end = offset + amount;
+    int64_t available = std::min(end, mSize);
+    std::vector<char> partial;
+
+    for (int64_t pos = offset; pos < available;) {
+        int64_t block = pos / mBlockSize;
+        int within = int(pos - block * mBlockSize);
+        int length = int(std::min(int64_t(mBlockSize - within), available - pos));
+        bool whole = within == 0 && length == mBlockSize;
+        if (!whole) {
+            partial.resize(mBlockSize);
+        }
+        char* dest = whole ? out + (pos - offset) : &partial[0];
+        int err = readBlock(lock, real, block, dest);
+        if (err != SQLITE_OK) {
+            return err;
+        }
+        if (!whole) {
+            memcpy(out + (pos - offset), dest + within, length);
+        }
+        pos += length;
+    }
+
+    if (available < end) {
+        int64_t from = std::max(available, offset);
+        memset(out + (from - offset), 0, size_t(end - from));
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+int64_t Container::allocate(int64_t length) {
+    int64_t offset = mFreeSpace.take(length, mEnd);
+    if (!offset) {
+        offset = mEnd;
+        mEnd += length;
+    }
+    return offset;
+}
+
+void Container::release(const Slot& slot) {
+    if (!slot.offset) {
+        return;
+    }
+    if (slot.durable) {
+        mPendingFree.push_back(std::make_pair(slot.offset, slotSize(slot.length)));
+    } else {
+        freeSpace(slot.offset, slotSize(slot.length));
+    }
+}
+
+// Frees space that slots referred to. Since it is not reused or trimmed off the file while
+// blocks are read without the lock, compaction and commits leave their reads intact.
+void Container::freeSpace(int64_t offset, int64_t length) {
+    if (mLoads) {
+        mDeferredFree.push_back(std::make_pair(offset, length));
+    } else {
+        mFreeSpace.add(offset, length);
+    }
+}
+
+int Container::storeBlock(sqlite3_file* real, int64_t block, const char* data) {
+    mVersion++;
+    if (block >= int64_t(mSlots.size())) {
+        Slot none = { 0, 0, false, false };
+        mSlots.resize(size_t(block) + 1, none);
+    }
+
+    Slot slot = { 0, 0, false, false };
+    if (!isZero(data, mBlockSize)) {
+        mCompressed.resize(Lz4::compressBound(mBlockSize));
+        // Blocks that do not shrink are stored as they are.
+        int length = Lz4::compress(data, mBlockSize, &mCompressed[0], mBlockSize - 1);
+        const char* stored = length ? &mCompressed[0] : data;
+        slot.raw = !length;
+        slot.length = uint32_t(length ? length : mBlockSize);
+
+        const Slot& old = mSlots[block];
+        int64_t needed = slotSize(slot.length);
+        bool inPlace = old.offset && !old.durable && slotSize(old.length) >= needed;
+        slot.offset = inPlace ? old.offset : allocate(needed);
+        int err = real->pMethods->xWrite(real, stored, int(slot.length), slot.offset);
+        if (err != SQLITE_OK) {
+            if (!inPlace) {
+                mFreeSpace.add(slot.offset, needed);
+            }
+            return err;
+        }
+        if (inPlace && slotSize(old.length) > needed) {
+            mFreeSpace.add(old.offset + needed, slotSize(old.length) - needed);
+        }
+        if (!inPlace) {
+            release(old);
+        }
+        gBytesStored.fetch_add(slot.length, std::memory_order_relaxed);
+        cachePut(this, block, data, mBlockSize);
+    } else {
+        release(mSlots[block]);
+        cacheEraseBlock(this, block);
+    }
+    gBlocksWritten.fetch_add(1, std::memory_order_relaxed);
+
+    mSlots[block] = slot;
+    mDirty = true;
+    return SQLITE_OK;
+}
+
+int Container::write(sqlite3_file* real, const void* buffer, int amount, int64_t offset) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!mBlockSize) {
+        // The first write of a new database is its first page.
+        mBlockSize = offset == 0 && amount >= MIN_BLOCK_SIZE && amount <= MAX_BLOCK_SIZE
+                && !(amount & (amount - 1)) ? amount : DEFAULT_BLOCK_SIZE;
+    }
+
+    const char* in = static_cast<const char*>(buffer);
+    int64_t end = offset + amount;
+    std::vector<char> partial;
+    for (int64_t pos = offset; pos < end;) {
+        int64_t block = pos / mBlockSize;
+        int within = int(pos - block * mBlockSize);
+        int length = int(std::min(int64_t(mBlockSize - within), end - pos));
+        const char* data = in + (pos - offset);
+        if (within != 0 || length != mBlockSize) {
+            partial.resize(mBlockSize);
+            int err = readBlock(lock, real, block, &partial[0]);
+            if (err != SQLITE_OK) {
+                return err;
+            }
+            memcpy(&partial[within], data, length);
+            data = &partial[0];
+        }
+        int err = storeBlock(real, block, data);
+        if (err != SQLITE_OK) {
+            return err;
+        }
+        pos += length;
+    }
+
+    if (end > mSize) {
+        mSize = end;
+        mDirty = true;
+    }
+    return SQLITE_OK;
+}
+
+int Container::truncate(sqlite3_file* real, int64_t size) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!mBlockSize) {
+        // Keep the block size open for the first page written.
+        if (size == 0) {
+            return SQLITE_OK;
+        }
+        mBlockSize = DEFAULT_BLOCK_SIZE;
+    }
+    if (size >= mSize) {
+        mSize = size;
+        mDirty = true;
+        return SQLITE_OK;
+    }
+
+    int64_t count = (size + mBlockSize - 1) / mBlockSize;
+    if (count < int64_t(mSlots.size())) {
+        for (size_t i = size_t(count); i < mSlots.size(); i++) {
+            release(mSlots[i]);
+        }
+        mSlots.resize(size_t(count));
+        cacheErase(this, count);
+    }
+    mVersion++;
+    mSize = size;
+    mDirty = true;
+
+    // The tail of the last block must read as zeros should the database grow again.
+    int within = int(size % mBlockSize);
+    if (within && count <= int64_t(mSlots.size()) && mSlots[count - 1].offset) {
+        std::vector<char> data(mBlockSize);
+        int err = readBlock(lock, real, count - 1, &data[0]);
+        if (err != SQLITE_OK) {
+            return err;
+        }
+        memset(&data[within], 0, mBlockSize - within);
+        return storeBlock(real, count - 1, &data[0]);
+    }
+    return SQLITE_OK;
+}
+
+int Container::commit(sqlite3_file* real, int flags, bool sync) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mDirty) {
+        return SQLITE_OK;
+    }
+    int err = commitLocked(real, flags, sync);
+    // Moved slots are committed right away, which frees the end of the file.
+    if (err == SQLITE_OK && compactLocked(real)) {
+        err = commitLocked(real, flags, sync);
+    }
+    return err;
+}
+
+// Moves slots from the end into free space before them, once enough of the container is
+// free. Returns whether any slot was moved.
+bool Container::compactLocked(sqlite3_file* real) {
+    int64_t free = mFreeSpace.total();
+    if (free < MIN_COMPACTION || free * 3 < mEnd - DATA_START) {
+        return false;
+    }
+
+    std::vector<std::pair<int64_t, size_t> > order;
+    for (size_t i = 0; i < mSlots.size(); i++) {
+        if (mSlots[i].offset) {
+            order.push_back(std::make_pair(mSlots[i].offset, i));
+        }
+    }
+    std::sort(order.rbegin(), order.rend());
+
+    bool moved = false;
+    std::vector<char> stored;
+    for (size_t i = 0; i < order.size(); i++) {
+        Slot& slot = mSlots[order[i].second];
+        int64_t length = slotSize(slot.length);
+        int64_t to = mFreeSpace.take(length, slot.offset);
+        if (!to) {
+            continue;
+        }
+        stored.resize(slot.length);
+        int err = real->pMethods->xRead(real, &stored[0], int(slot.length), slot.offset);
+        if (err == SQLITE_OK) {
+            err = real->pMethods->xWrite(real, &stored[0], int(slot.length), to);
+        }
+        if (err != SQLITE_OK) {
+            ALOGW("Could not compact %s: %d", mPath.c_str(), err);
+            mFreeSpace.add(to, length);
+            break;
+        }
+        release(slot);
+        slot.offset = to;
+        slot.durable = false;
+        moved = true;
+    }
+    if (moved) {
+        mDirty = true;
+    }
+    return moved;
+}
+
+int Container::commitLocked(sqlite3_file* real, int flags, bool sync) {
+    uint32_t blockCount = uint32_t(mSlots.size());
+    std::vector<char> index(size_t(blockCount) * INDEX_ENTRY_SIZE);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        const Slot& slot = mSlots[i];
+        char* entry = &index[size_t(i) * INDEX_ENTRY_SIZE];
+        put32(entry, uint32_t(slot.offset / SLOT_ALIGN));
+        put32(entry + 4, slot.length | (slot.raw ? RAW_FLAG : 0));
+    }
+    int64_t indexLength = blockCount ? slotSize(uint32_t(index.size())) : 0;
+    int64_t indexOffset = blockCount ? allocate(indexLength) : 0;
+
+    char header[HEADER_SLOT_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+    put32(header + 16, uint32_t(mBlockSize ? mBlockSize : DEFAULT_BLOCK_SIZE));
+    put32(header + 20, blockCount);
+    put64(header + 24, mGeneration + 1);
+    put64(header + 32, uint64_t(mSize));
+    put64(header + 40, uint64_t(indexOffset));
+    put32(header + 48, checksum(index.data(), index.size()));
+    put32(header + 52, checksum(header, 52));
+
+    int err = SQLITE_OK;
+    if (blockCount) {
+        err = real->pMethods->xWrite(real, &index[0], int(index.size()), indexOffset);
+    }
+    if (err == SQLITE_OK && sync) {
+        err = real->pMethods->xSync(real, flags);
+    }
+    if (err == SQLITE_OK) {
+        err = real->pMethods->xWrite(real, header, HEADER_SLOT_SIZE,
+                int64_t((mGeneration + 1) % 2) * HEADER_SLOT_SIZE);
+    }
+    if (err == SQLITE_OK && sync) {
+        err = real->pMethods->xSync(real, flags);
+    }
+    if (err != SQLITE_OK) {
+        if (blockCount) {
+            mFreeSpace.add(indexOffset, indexLength);
+        }
+        return err;
+    }
+
+    // The new index is current, so what the previous one referred to is free.
+    for (size_t i = 0; i < mPendingFree.size(); i++) {
+        freeSpace(mPendingFree[i].first, mPendingFree[i].second);
+    }
+    mPendingFree.clear();
+    if (mIndexLength) {
+        freeSpace(mIndexOffset, mIndexLength);
+    }
+    mIndexOffset = indexOffset;
+    mIndexLength = indexLength;
+    for (size_t i = 0; i < mSlots.size(); i++) {
+        mSlots[i].durable = true;
+    }
+    mGeneration++;
+    mDirty = false;
+    gCommits.fetch_add(1, std::memory_order_relaxed);
+
+    // Give the free space at the end back to the file system.
+    int64_t end = mFreeSpace.trimTail(mEnd);
+    if (end < mEnd) {
+        mEnd = end;
+        err = real->pMethods->xTruncate(real, mEnd);
+        if (err != SQLITE_OK) {
+            ALOGW("Could not truncate %s to %lld: %d", mPath.c_str(), (long long) mEnd, err);
+        }
+    }
+    return SQLITE_OK;
+}
+
+struct CompressedFile : VfsShimFile {
+    Container* container;
+    bool writable;
+};
+
+static sqlite3_vfs gVfs;
+static bool gInitialized;
+
+static std::mutex gContainersLock;
+static std::map<std::string, Container*> gContainers;
+
+static CompressedFile* toCompressedFile(sqlite3_file* file) {
+    return reinterpret_cast<CompressedFile*>(file);
+}
+
+// Returns the container of the file, which is NULL for a plain database.
+static int acquireContainer(const char* path, sqlite3_file* real, Container** container) {
+    std::lock_guard<std::mutex> lock(gContainersLock);
+    std::map<std::string, Container*>::iterator it = gContainers.find(path);
+    if (it != gContainers.end()) {
+        it->second->refs()++;
+        *container = it->second;
+        return SQLITE_OK;
+    }
+
+    Container* c = new Container(path);
+    bool plain;
+    int err = c->load(real, &plain);
+    if (err != SQLITE_OK || plain) {
+        delete c;
+        *container = NULL;
+        return err;
+    }
+    c->refs() = 1;
+    gContainers[path] = c;
+    *container = c;
+    return SQLITE_OK;
+}
+
+static void releaseContainer(CompressedFile* p) {
+    Container* c = p->container;
+    int err = SQLITE_OK;
+    if (p->writable) {
+        // Changes made without syncs are committed once a writer is done with them.
+        err = c->commit(p->real, SQLITE_SYNC_NORMAL, true);
+    }
+
+    std::lock_guard<std::mutex> lock(gContainersLock);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not commit %s on close: %d", c->path().c_str(), err);
+    }
+    if (--c->refs() == 0) {
+        gContainers.erase(c->path());
+        cacheErase(c, 0);
+        delete c;
+    }
+}
+
+static int compressedClose(sqlite3_file* file) {
+    CompressedFile* p = toCompressedFile(file);
+    releaseContainer(p);
+    return p->real->pMethods->xClose(p->real);
+}
+
+static int compressedRead(sqlite3_file* file, void* buffer, int amount,
+        sqlite3_int64 offset) {
+    CompressedFile* p = toCompressedFile(file);
+    return p->container->read(p->real, buffer, amount, offset);
+}
+
+static int compressedWrite(sqlite3_file* file, const void* buffer, int amount,
+        sqlite3_int64 offset) {
+    CompressedFile* p = toCompressedFile(file);
+    return p->container->write(p->real, buffer, amount, offset);
+}
+
+static int compressedTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    CompressedFile* p = toCompressedFile(file);
+    return p->container->truncate(p->real, size);
+}
+
+static int compressedSync(sqlite3_file* file, int flags) {
+    CompressedFile* p = toCompressedFile(file);
+    return p->container->commit(p->real, flags, true);
+}
+
+static int compressedFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    CompressedFile* p = toCompressedFile(file);
+    *size = p->container->size();
+    return SQLITE_OK;
+}
+
+static int compressedFileControl(sqlite3_file* file, int op, void* arg) {
+    CompressedFile* p = toCompressedFile(file);
+    switch (op) {
+    case SQLITE_FCNTL_SIZE_HINT:
+    case SQLITE_FCNTL_CHUNK_SIZE:
+        // The size of the container does not follow the size of the database.
+        return SQLITE_OK;
+    case SQLITE_FCNTL_MMAP_SIZE: {
+        // Blocks are never mapped, so they take none of the mmap budget.
+        int64_t* size = static_cast<int64_t*>(arg);
+        *size = 0;
+        return SQLITE_OK;
+    }
+    case SQLITE_FCNTL_SYNC_OMITTED:
+        // Without syncs, the index is still written so that replaced slots are reused.
+        return p->container->commit(p->real, 0, false);
+    default:
+        return p->real->pMethods->xFileControl(p->real, op, arg);
+    }
+}
+
+// Writes go to new slots and are made durable by the header switch, so no atomic or
+// sequential write guarantees of the file carry over.
+static int compressedDeviceCharacteristics(sqlite3_file* file) {
+    CompressedFile* p = toCompressedFile(file);
+    return p->real->pMethods->xDeviceCharacteristics(p->real)
+            & (SQLITE_IOCAP_POWERSAFE_OVERWRITE | SQLITE_IOCAP_UNDELETABLE_WHEN_OPEN);
+}
+
+static sqlite3_io_methods gIoMethods;
+
+static int compressedOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file,
+        int flags, int* outFlags) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    if (!(flags & SQLITE_OPEN_MAIN_DB) || !name) {
+        return root->xOpen(root, name, file, flags, outFlags);
+    }
+
+    CompressedFile* p = toCompressedFile(file);
+    memset(p, 0, sizeof(CompressedFile));
+    p->real = reinterpret_cast<sqlite3_file*>(p + 1);
+    int openedFlags = 0;
+    int err = root->xOpen(root, name, p->real, flags, &openedFlags);
+    Container* container = NULL;
+    if (err == SQLITE_OK) {
+        err = acquireContainer(name, p->real, &container);
+    }
+    if (container) {
+        p->container = container;
+        p->writable = (openedFlags & SQLITE_OPEN_READWRITE) != 0;
+        if (outFlags) {
+            *outFlags = openedFlags;
+        }
+        file->pMethods = &gIoMethods;
+        return SQLITE_OK;
+    }
+
+    if (p->real->pMethods) {
+        p->real->pMethods->xClose(p->real);
+    }
+    file->pMethods = NULL;
+    if (err != SQLITE_OK) {
+        return err;
+    }
+    // A plain database is opened as it is, by the VFS below.
+    return root->xOpen(root, name, file, flags, outFlags);
+}
+
+int CompressedVfs::install() {
+    if (!gInitialized) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(CompressedFile)), compressedOpen);
+        VfsShim::initIoMethods(&gIoMethods);
+        gIoMethods.xClose = compressedClose;
+        gIoMethods.xRead = compressedRead;
+        gIoMethods.xWrite = compressedWrite;
+        gIoMethods.xTruncate = compressedTruncate;
+        gIoMethods.xSync = compressedSync;
+        gIoMethods.xFileSize = compressedFileSize;
+        gIoMethods.xFileControl = compressedFileControl;
+        gIoMethods.xDeviceCharacteristics = compressedDeviceCharacteristics;
+        // Version 2, without xFetch, so that SQLite reads every page through xRead.
+        gIoMethods.iVersion = 2;
+        gIoMethods.xFetch = NULL;
+        gIoMethods.xUnfetch = NULL;
+        gInitialized = true;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 0);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the compressed VFS: %d", err);
+    }
+    return err;
+}
+
+void CompressedVfs::setCacheSize(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(gCacheLock);
+    gCacheSize = bytes;
+    evictLocked();
+}
+
+void CompressedVfs::getStats(int64_t* stats) {
+    {
+        std::lock_guard<std::mutex> lock(gCacheLock);
+        stats[STAT_CACHE_SIZE] = gCacheSize;
+        stats[STAT_CACHE_USED] = gCacheUsed;
+    }
+    stats[STAT_CACHE_HITS] = gCacheHits.load(std::memory_order_relaxed);
+    stats[STAT_CACHE_MISSES] = gCacheMisses.load(std::memory_order_relaxed);
+    stats[STAT_BLOCKS_WRITTEN] = gBlocksWritten.load(std::memory_order_relaxed);
+    stats[STAT_BYTES_STORED] = gBytesStored.load(std::memory_order_relaxed);
+    stats[STAT_COMMITS] = gCommits.load(std::memory_order_relaxed);
+}
+
+} // namespace android
@@ -0,0 +1,51 @@
+#ifndef _ANDROID__DATABASE_COMPRESSED_VFS_H
+#define _ANDROID__DATABASE_COMPRESSED_VFS_H
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * VFS shim named "android-compressed" that stores the pages of new databases compressed
+ * with LZ4, for large databases that are mostly read.
+ *
+ * The database file becomes a container of blocks of the page size, each stored in a
+ * slot that fits its compressed size, found through an index of slots. Slots that the
+ * last synced index refers to are never overwritten: a changed block goes to a new slot,
+ * and an xSync writes a new index and then switches between two header copies to it.
+ * A crash thus leaves the container as of the last xSync, which is all SQLite relies on.
+ * Space of replaced slots is reused once the index no longer refers to them.
+ *
+ * Decompressed blocks are kept in a cache shared by all containers, so hot pages are not
+ * decompressed again by each connection. The state of a container is shared by the
+ * connections of a process, which must be the only one to open it. Journals and WAL
+ * files are not compressed, and neither are databases that already exist as plain
+ * SQLite files, which are passed through. Containers are never memory-mapped.
+ */
+class CompressedVfs {
+public:
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_CACHE_SIZE = 0,
+        STAT_CACHE_USED = 1,
+        STAT_CACHE_HITS = 2,
+        STAT_CACHE_MISSES = 3,
+        STAT_BLOCKS_WRITTEN = 4,
+        STAT_BYTES_STORED = 5,
+        STAT_COMMITS = 6,
+        STAT_COUNT = 7,
+    };
+
+    /* Registers the shim on top of the default VFS, without making it the default. Must
+     * be called again after SQLite was shut down, right after IoStatsVfs::install. */
+    static int install();
+
+    /* Sets the size in bytes of the cache of decompressed blocks. */
+    static void setCacheSize(int64_t bytes);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_COMPRESSED_VFS_H
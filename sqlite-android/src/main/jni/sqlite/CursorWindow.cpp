@@ -231,6 +231,40 @@ status_t CursorWindow::putBlobOrString(uint32_t row, uint32_t column,
     return OK;
 }
 
+status_t CursorWindow::putBlobReference(uint32_t row, uint32_t column, const char* database,
+        const char* table, const char* columnName, int64_t rowId, size_t size) {
+    if (mReadOnly) {
+        return INVALID_OPERATION;
+    }
+
+    FieldSlot* fieldSlot = getFieldSlot(row, column);
+    if (!fieldSlot) {
+        return BAD_VALUE;
+    }
+
+    size_t databaseSize = strlen(database) + 1;
+    size_t tableSize = strlen(table) + 1;
+    size_t columnNameSize = strlen(columnName) + 1;
+    size_t referenceSize = sizeof(BlobReference) + databaseSize + tableSize + columnNameSize;
+    uint32_t offset = alloc(referenceSize, true);
+    if (!offset) {
+        return NO_MEMORY;
+    }
+
+    BlobReference* reference = static_cast<BlobReference*>(offsetToPtr(offset));
+    reference->rowId = rowId;
+    reference->size = size;
+    char* names = reference->names;
+    memcpy(names, database, databaseSize);
+    memcpy(names + databaseSize, table, tableSize);
+    memcpy(names + databaseSize + tableSize, columnName, columnNameSize);
+
+    fieldSlot->type = FIELD_TYPE_BLOB_REFERENCE;
+    fieldSlot->data.buffer.offset = offset;
+    fieldSlot->data.buffer.size = referenceSize;
+    return OK;
+}
+
 status_t CursorWindow::putLong(uint32_t row, uint32_t column, int64_t value) {
     if (mReadOnly) {
         return INVALID_OPERATION;
@@ -21,6 +21,7 @@
 #include "ALog-priv.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "Errors.h"
 #include <string>
@@ -60,6 +61,10 @@ public:
         FIELD_TYPE_FLOAT = 2,
         FIELD_TYPE_STRING = 3,
         FIELD_TYPE_BLOB = 4,
+
+        /* A blob left in the database, stored as a reference to its row.
+         * Reported as FIELD_TYPE_BLOB to Java. */
+        FIELD_TYPE_BLOB_REFERENCE = 5,
     };
 
     /* Opaque type that describes a field slot. */
@@ -104,6 +109,13 @@ public:
     status_t putDouble(uint32_t row, uint32_t column, double value);
     status_t putNull(uint32_t row, uint32_t column);
 
+    /**
+     * Stores a reference to a blob which stays in the database, so it can be read
+     * later with incremental blob I/O. The names are NUL-terminated UTF-8.
+     */
+    status_t putBlobReference(uint32_t row, uint32_t column, const char* database,
+            const char* table, const char* columnName, int64_t rowId, size_t size);
+
     /**
      * Gets the field slot at the specified row and column.
      * Returns null if the requested row or column is not in the window.
@@ -133,9 +145,31 @@ public:
         return offsetToPtr(fieldSlot->data.buffer.offset);
     }
 
+    /**
+     * Gets the target of a blob reference. The names point into the window.
+     */
+    inline void getFieldSlotValueBlobReference(FieldSlot* fieldSlot, const char** outDatabase,
+            const char** outTable, const char** outColumnName, int64_t* outRowId,
+            size_t* outSize) {
+        BlobReference* reference =
+                static_cast<BlobReference*>(offsetToPtr(fieldSlot->data.buffer.offset));
+        *outRowId = reference->rowId;
+        *outSize = reference->size;
+        *outDatabase = reference->names;
+        *outTable = *outDatabase + strlen(*outDatabase) + 1;
+        *outColumnName = *outTable + strlen(*outTable) + 1;
+    }
+
 private:
     static const size_t ROW_SLOT_CHUNK_NUM_ROWS = 100;
 
+    struct BlobReference {
+        int64_t rowId;
+        uint32_t size;
+        // Database, table and column names, each NUL-terminated.
+        char names[];
+    } __attribute((packed));
+
     struct Header {
         // Offset of the lowest unused byte in the window.
         uint32_t freeOffset;
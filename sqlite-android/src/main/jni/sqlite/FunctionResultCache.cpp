@@ -0,0 +1,169 @@
+#undef LOG_TAG
+#define LOG_TAG "FunctionResultCache"
+
+#include "FunctionResultCache.h"
+#include "ALog-priv.h"
+
+#include <string.h>
+
+namespace android {
+
+// Approximate allocator and container overhead of an entry, on top of its size.
+static const size_t ENTRY_OVERHEAD = 64;
+
+FunctionResultCache::FunctionResultCache(size_t capacity, int64_t* stats) :
+        mCapacity(capacity), mSize(0), mStats(stats), mKeyHash(0) {
+}
+
+FunctionResultCache::~FunctionResultCache() {
+    count(STAT_SIZE, -int64_t(mSize));
+}
+
+void FunctionResultCache::count(int stat, int64_t delta) {
+    // The counters are shared with the caches of other connections.
+    __atomic_fetch_add(&mStats[stat], delta, __ATOMIC_RELAXED);
+}
+
+uint32_t FunctionResultCache::hash(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void append(std::vector<uint8_t>& key, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    key.insert(key.end(), bytes, bytes + size);
+}
+
+bool FunctionResultCache::setKey(int argc, sqlite3_value** argv) {
+    mKey.clear();
+    for (int i = 0; i < argc; i++) {
+        int type = sqlite3_value_type(argv[i]);
+        mKey.push_back(uint8_t(type));
+        switch (type) {
+            case SQLITE_INTEGER: {
+                int64_t value = sqlite3_value_int64(argv[i]);
+                append(mKey, &value, sizeof(value));
+                break;
+            }
+            case SQLITE_FLOAT: {
+                double value = sqlite3_value_double(argv[i]);
+                append(mKey, &value, sizeof(value));
+                break;
+            }
+            case SQLITE_TEXT:
+            case SQLITE_BLOB: {
+                const void* data = type == SQLITE_TEXT
+                        ? static_cast<const void*>(sqlite3_value_text(argv[i]))
+                        : sqlite3_value_blob(argv[i]);
+                uint32_t size = uint32_t(sqlite3_value_bytes(argv[i]));
+                if (!data && size) {
+                    return false;
+                }
+                append(mKey, &size, sizeof(size));
+                append(mKey, data, size);
+                break;
+            }
+            default:
+                break;
+        }
+        if (mKey.size() + ENTRY_OVERHEAD > mCapacity) {
+            // The entry could never fit.
+            return false;
+        }
+    }
+    mKeyHash = hash(mKey.empty() ? NULL : &mKey[0], mKey.size());
+    return true;
+}
+
+FunctionResultCache::EntryList::iterator FunctionResultCache::find() {
+    std::pair<EntryMap::iterator, EntryMap::iterator> range =
+            mEntriesByHash.equal_range(mKeyHash);
+    for (EntryMap::iterator it = range.first; it != range.second; ++it) {
+        if (it->second->key == mKey) {
+            return it->second;
+        }
+    }
+    return mEntries.end();
+}
+
+bool FunctionResultCache::lookup(sqlite3_context* context) {
+    EntryList::iterator it = find();
+    if (it == mEntries.end()) {
+        count(STAT_MISSES, 1);
+        return false;
+    }
+    count(STAT_HITS, 1);
+    mEntries.splice(mEntries.begin(), mEntries, it);
+
+    const Entry& entry = *it;
+    // Empty strings and blobs still need a non-NULL pointer.
+    const void* data = entry.data.empty() ? static_cast<const void*>("")
+            : static_cast<const void*>(&entry.data[0]);
+    switch (entry.type) {
+        case SQLITE_INTEGER:
+            sqlite3_result_int64(context, entry.value);
+            break;
+        case SQLITE_FLOAT: {
+            double value;
+            memcpy(&value, &entry.value, sizeof(value));
+            sqlite3_result_double(context, value);
+            break;
+        }
+        case SQLITE_TEXT:
+            sqlite3_result_text16(context, data, int(entry.data.size()), SQLITE_TRANSIENT);
+            break;
+        case SQLITE_BLOB:
+            sqlite3_result_blob(context, data, int(entry.data.size()), SQLITE_TRANSIENT);
+            break;
+        default:
+            sqlite3_result_null(context);
+            break;
+    }
+    return true;
+}
+
+void FunctionResultCache::put(int type, int64_t value, const void* data, size_t size) {
+    size_t cost = ENTRY_OVERHEAD + sizeof(Entry) + mKey.size() + size;
+    if (cost > mCapacity || find() != mEntries.end()) {
+        return;
+    }
+    while (mSize + cost > mCapacity) {
+        evictLast();
+    }
+
+    mEntries.push_front(Entry());
+    Entry& entry = mEntries.front();
+    entry.key = mKey;
+    entry.hash = mKeyHash;
+    entry.type = type;
+    entry.value = value;
+    if (size) {
+        append(entry.data, data, size);
+    }
+    entry.cost = cost;
+    mEntriesByHash.insert(EntryMap::value_type(mKeyHash, mEntries.begin()));
+    mSize += cost;
+    count(STAT_SIZE, int64_t(cost));
+}
+
+void FunctionResultCache::evictLast() {
+    EntryList::iterator last = --mEntries.end();
+    std::pair<EntryMap::iterator, EntryMap::iterator> range =
+            mEntriesByHash.equal_range(last->hash);
+    for (EntryMap::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == last) {
+            mEntriesByHash.erase(it);
+            break;
+        }
+    }
+    mSize -= last->cost;
+    count(STAT_SIZE, -int64_t(last->cost));
+    count(STAT_EVICTIONS, 1);
+    mEntries.erase(last);
+}
+
+} // namespace android
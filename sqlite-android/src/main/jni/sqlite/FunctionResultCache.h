@@ -0,0 +1,81 @@
+#ifndef _ANDROID__DATABASE_FUNCTION_RESULT_CACHE_H
+#define _ANDROID__DATABASE_FUNCTION_RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+/**
+ * Least recently used cache of the results of a deterministic function, keyed by the
+ * types and values of its arguments.
+ *
+ * A call first sets the key from its arguments, then either looks up the result or,
+ * after computing it, puts it. The memory held by keys and results is capped; entries
+ * that would not fit on their own are not cached.
+ *
+ * Counters are added to a shared array of STAT_COUNT 64-bit values, which may be read
+ * from any thread and shared by the caches of several connections. The cache itself is
+ * not thread-safe.
+ */
+class FunctionResultCache {
+public:
+    enum {
+        STAT_HITS = 0,
+        STAT_MISSES = 1,
+        STAT_EVICTIONS = 2,
+        STAT_SIZE = 3,
+        STAT_COUNT = 4,
+    };
+
+    FunctionResultCache(size_t capacity, int64_t* stats);
+    ~FunctionResultCache();
+
+    /* Sets the key for the given arguments. Returns false if they cannot be cached. */
+    bool setKey(int argc, sqlite3_value** argv);
+
+    /* Sets the cached result for the current key on the context. Returns false on a miss. */
+    bool lookup(sqlite3_context* context);
+
+    /* Caches a result for the current key. The type is one of the SQLITE_* fundamental
+     * datatypes; numbers are passed as value, text as UTF-16 and blobs as data. */
+    void put(int type, int64_t value, const void* data, size_t size);
+
+private:
+    struct Entry {
+        std::vector<uint8_t> key;
+        uint32_t hash;
+        int type;
+        int64_t value;
+        std::vector<uint8_t> data;
+        size_t cost;
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_multimap<uint32_t, EntryList::iterator> EntryMap;
+
+    size_t mCapacity;
+    size_t mSize;
+    int64_t* mStats;
+    // Most recently used first.
+    EntryList mEntries;
+    EntryMap mEntriesByHash;
+    std::vector<uint8_t> mKey;
+    uint32_t mKeyHash;
+
+    static uint32_t hash(const uint8_t* data, size_t size);
+
+    EntryList::iterator find();
+    void evictLast();
+    void count(int stat, int64_t delta);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_FUNCTION_RESULT_CACHE_H
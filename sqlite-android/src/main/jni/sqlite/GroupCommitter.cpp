@@ -0,0 +1,316 @@
+#undef LOG_TAG
+#define LOG_TAG "GroupCommitter"
+
+#include "GroupCommitter.h"
+#include "ALog-priv.h"
+#include "LocalizedCollator.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+
+namespace android {
+
+// Matches the busy timeout of the connections of the connection pool.
+static const int BUSY_TIMEOUT_MS = 2500;
+
+// Statements prepared by the commit thread are kept up to this number, then all dropped.
+static const size_t MAX_CACHED_STATEMENTS = 64;
+
+static int64_t nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+GroupCommitter* GroupCommitter::open(const char* path, const char* vfsName,
+        const char* syncMode, bool foreignKeys, const char* locale, int maxBatchSize,
+        int64_t maxLatencyMicros, int* err, std::string* message) {
+    sqlite3* db = NULL;
+    *err = sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE, vfsName);
+    if (*err == SQLITE_OK) {
+        *err = sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    }
+    if (*err == SQLITE_OK) {
+        std::string sql = std::string("PRAGMA synchronous=") + syncMode;
+        if (foreignKeys) {
+            sql += "; PRAGMA foreign_keys=1";
+        }
+        *err = sqlite3_exec(db, sql.c_str(), NULL, NULL, NULL);
+    }
+    if (*err == SQLITE_OK) {
+        // Indexes using the LOCALIZED collation must be kept in the order of the database.
+        *err = LocalizedCollator::registerCollation(db, locale);
+    }
+    if (*err != SQLITE_OK) {
+        *message = db ? sqlite3_errmsg(db) : sqlite3_errstr(*err);
+        sqlite3_close(db);
+        return NULL;
+    }
+    return new GroupCommitter(db, maxBatchSize, maxLatencyMicros);
+}
+
+GroupCommitter::GroupCommitter(sqlite3* db, int maxBatchSize, int64_t maxLatencyMicros) :
+        mDb(db), mMaxBatchSize(maxBatchSize), mMaxLatencyMicros(maxLatencyMicros),
+        mClosed(false) {
+    memset(mStats, 0, sizeof(mStats));
+    mThread = std::thread(&GroupCommitter::run, this);
+}
+
+GroupCommitter::~GroupCommitter() {
+    close();
+    mThread.join();
+    for (std::map<std::string, sqlite3_stmt*>::iterator it = mStatements.begin();
+            it != mStatements.end(); ++it) {
+        sqlite3_finalize(it->second);
+    }
+    int err = sqlite3_close(mDb);
+    if (err != SQLITE_OK) {
+        ALOGE("sqlite3_close(%p) failed: %d", mDb, err);
+    }
+}
+
+int GroupCommitter::execute(Operation* operation) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mClosed) {
+        operation->err = SQLITE_MISUSE;
+        operation->message = "The group commit has been closed";
+        return operation->err;
+    }
+    operation->done = false;
+    operation->enqueuedAt = nowMicros();
+    mQueue.push_back(operation);
+    mQueued.notify_one();
+    while (!operation->done) {
+        mCommitted.wait(lock);
+    }
+    return operation->err;
+}
+
+void GroupCommitter::close() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mClosed = true;
+    mQueued.notify_one();
+}
+
+void GroupCommitter::getStats(int64_t* stats) {
+    std::lock_guard<std::mutex> lock(mLock);
+    memcpy(stats, mStats, sizeof(mStats));
+}
+
+void GroupCommitter::run() {
+    std::vector<Operation*> batch;
+    std::unique_lock<std::mutex> lock(mLock);
+    for (;;) {
+        while (mQueue.empty() && !mClosed) {
+            mQueued.wait(lock);
+        }
+        if (mQueue.empty()) {
+            // Closed, with every statement committed.
+            return;
+        }
+
+        // Wait for the batch to fill up until its oldest statement is due.
+        int64_t deadline = mQueue.front()->enqueuedAt + mMaxLatencyMicros;
+        while (int(mQueue.size()) < mMaxBatchSize && !mClosed) {
+            int64_t now = nowMicros();
+            if (now >= deadline) {
+                break;
+            }
+            mQueued.wait_for(lock, std::chrono::microseconds(deadline - now));
+        }
+
+        batch.clear();
+        while (!mQueue.empty() && int(batch.size()) < mMaxBatchSize) {
+            batch.push_back(mQueue.front());
+            mQueue.pop_front();
+        }
+        int64_t start = nowMicros();
+        int64_t wait = start - batch.front()->enqueuedAt;
+
+        lock.unlock();
+        bool committed = commit(batch);
+        int64_t duration = nowMicros() - start;
+        lock.lock();
+
+        int64_t size = int64_t(batch.size());
+        mStats[STAT_BATCHES]++;
+        mStats[STAT_OPERATIONS] += size;
+        if (!committed) {
+            mStats[STAT_FAILED_BATCHES]++;
+        }
+        if (size > mStats[STAT_MAX_BATCH_SIZE]) {
+            mStats[STAT_MAX_BATCH_SIZE] = size;
+        }
+        mStats[STAT_LAST_BATCH_SIZE] = size;
+        mStats[STAT_LAST_BATCH_WAIT_MICROS] = wait;
+        mStats[STAT_LAST_BATCH_COMMIT_MICROS] = duration;
+        mStats[STAT_TOTAL_WAIT_MICROS] += wait;
+        mStats[STAT_TOTAL_COMMIT_MICROS] += duration;
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch[i]->err != SQLITE_OK) {
+                mStats[STAT_FAILED_OPERATIONS]++;
+            }
+            batch[i]->done = true;
+        }
+        mCommitted.notify_all();
+    }
+}
+
+// Runs the batch in one transaction. If the transaction fails as a whole, every
+// statement of the batch fails with its error.
+bool GroupCommitter::commit(std::vector<Operation*>& batch) {
+    int err = sqlite3_exec(mDb, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    if (err == SQLITE_OK) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            runOperation(batch[i]);
+            if (sqlite3_get_autocommit(mDb)) {
+                // The statement rolled back the whole transaction, as ON CONFLICT
+                // ROLLBACK or an I/O error does. Later statements would each run in a
+                // transaction of their own, so none of them is run.
+                failRolledBack(batch, batch[i]);
+                return false;
+            }
+        }
+        err = sqlite3_exec(mDb, "COMMIT", NULL, NULL, NULL);
+        if (err == SQLITE_OK) {
+            return true;
+        }
+    }
+
+    std::string message = sqlite3_errmsg(mDb);
+    if (!sqlite3_get_autocommit(mDb)) {
+        sqlite3_exec(mDb, "ROLLBACK", NULL, NULL, NULL);
+    }
+    ALOGE("Could not commit a batch of %zu statements: %d %s", batch.size(), err,
+            message.c_str());
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i]->err = err;
+        batch[i]->message = message;
+    }
+    return false;
+}
+
+void GroupCommitter::failRolledBack(std::vector<Operation*>& batch, Operation* cause) {
+    ALOGE("A statement rolled back a batch of %zu statements: %d %s", batch.size(),
+            cause->err, cause->message.c_str());
+    std::string message = "Rolled back with its batch by another statement: "
+            + cause->message;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch[i] != cause) {
+            batch[i]->err = SQLITE_ABORT_ROLLBACK;
+            batch[i]->message = message;
+        }
+    }
+}
+
+void GroupCommitter::runOperation(Operation* operation) {
+    int err = sqlite3_exec(mDb, "SAVEPOINT group_commit", NULL, NULL, NULL);
+    sqlite3_stmt* statement = NULL;
+    if (err == SQLITE_OK) {
+        statement = prepare(operation->sql, &err, &operation->message);
+    }
+
+    for (size_t i = 0; err == SQLITE_OK && i < operation->args.size(); i++) {
+        const Value& value = operation->args[i];
+        int index = int(i) + 1;
+        switch (value.type) {
+        case SQLITE_INTEGER:
+            err = sqlite3_bind_int64(statement, index, value.integer);
+            break;
+        case SQLITE_FLOAT:
+            err = sqlite3_bind_double(statement, index, value.real);
+            break;
+        case SQLITE_TEXT:
+            err = sqlite3_bind_text16(statement, index, value.bytes.data(),
+                    int(value.bytes.size()), SQLITE_STATIC);
+            break;
+        case SQLITE_BLOB:
+            err = sqlite3_bind_blob(statement, index, value.bytes.data(),
+                    int(value.bytes.size()), SQLITE_STATIC);
+            break;
+        default:
+            err = sqlite3_bind_null(statement, index);
+            break;
+        }
+    }
+
+    if (err == SQLITE_OK) {
+        do {
+            err = sqlite3_step(statement);
+        } while (err == SQLITE_ROW);
+        if (err == SQLITE_DONE) {
+            err = SQLITE_OK;
+        }
+    }
+
+    operation->err = err;
+    if (err == SQLITE_OK) {
+        operation->changes = sqlite3_changes(mDb);
+        operation->lastInsertRowId = sqlite3_last_insert_rowid(mDb);
+    } else {
+        if (operation->message.empty()) {
+            operation->message = sqlite3_errmsg(mDb);
+        }
+        if (!sqlite3_get_autocommit(mDb)) {
+            sqlite3_exec(mDb, "ROLLBACK TO group_commit", NULL, NULL, NULL);
+        }
+    }
+    if (statement) {
+        sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+    }
+    // Once the transaction has been rolled back, the savepoint is gone with it.
+    if (!sqlite3_get_autocommit(mDb)) {
+        sqlite3_exec(mDb, "RELEASE group_commit", NULL, NULL, NULL);
+    }
+}
+
+// Prepares the statement of sql, which must hold exactly one. On failure, returns NULL and
+// sets err, and message if SQLite has no message for it.
+sqlite3_stmt* GroupCommitter::prepare(const std::string& sql, int* err,
+        std::string* message) {
+    std::map<std::string, sqlite3_stmt*>::iterator it = mStatements.find(sql);
+    if (it != mStatements.end()) {
+        *err = SQLITE_OK;
+        return it->second;
+    }
+
+    if (mStatements.size() >= MAX_CACHED_STATEMENTS) {
+        for (it = mStatements.begin(); it != mStatements.end(); ++it) {
+            sqlite3_finalize(it->second);
+        }
+        mStatements.clear();
+    }
+    sqlite3_stmt* statement = NULL;
+    const void* tail = NULL;
+    *err = sqlite3_prepare16_v3(mDb, sql.data(), int(sql.size()), SQLITE_PREPARE_PERSISTENT,
+            &statement, &tail);
+    if (*err == SQLITE_OK && !statement) {
+        *err = SQLITE_MISUSE;
+        *message = "The SQL holds no statement";
+    }
+    if (*err != SQLITE_OK) {
+        return NULL;
+    }
+
+    // Only whitespace and comments may follow, which prepare to no statement. Further
+    // statements would not be run.
+    int tailBytes = int(sql.data() + sql.size() - static_cast<const char*>(tail));
+    if (tailBytes > 0) {
+        sqlite3_stmt* next = NULL;
+        int tailErr = sqlite3_prepare16_v3(mDb, tail, tailBytes, 0, &next, NULL);
+        if (tailErr != SQLITE_OK || next) {
+            sqlite3_finalize(next);
+            sqlite3_finalize(statement);
+            *err = SQLITE_ERROR;
+            *message = "The SQL holds more than one statement";
+            return NULL;
+        }
+    }
+    mStatements[sql] = statement;
+    return statement;
+}
+
+} // namespace android
@@ -0,0 +1,115 @@
+#ifndef _ANDROID__DATABASE_GROUP_COMMITTER_H
+#define _ANDROID__DATABASE_GROUP_COMMITTER_H
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+/**
+ * Commits the writes of many threads together, so that they share the syncs of one
+ * transaction.
+ *
+ * Writers enqueue single statements and wait. A commit thread with its own connection
+ * takes up to maxBatchSize of them, once the batch is full or its oldest statement has
+ * waited maxLatencyMicros, and runs them in one transaction. Each statement runs in a
+ * savepoint of its own, so a failing statement is rolled back and reported without
+ * affecting the others. Statements that arrive while a batch is committing form the next
+ * batch, so even with no latency commits are grouped under load.
+ */
+class GroupCommitter {
+public:
+    // A bound value of one of the SQLite fundamental types. Text is held in UTF-16 of
+    // the native byte order, as Java strings are.
+    struct Value {
+        int type;
+        int64_t integer;
+        double real;
+        std::string bytes;
+    };
+
+    struct Operation {
+        // The SQL in UTF-16 of the native byte order.
+        std::string sql;
+        std::vector<Value> args;
+
+        int err;
+        std::string message;
+        int64_t changes;
+        int64_t lastInsertRowId;
+
+        bool done;
+        int64_t enqueuedAt;
+    };
+
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_BATCHES = 0,
+        STAT_OPERATIONS = 1,
+        STAT_FAILED_OPERATIONS = 2,
+        STAT_FAILED_BATCHES = 3,
+        STAT_MAX_BATCH_SIZE = 4,
+        STAT_LAST_BATCH_SIZE = 5,
+        STAT_LAST_BATCH_WAIT_MICROS = 6,
+        STAT_LAST_BATCH_COMMIT_MICROS = 7,
+        STAT_TOTAL_WAIT_MICROS = 8,
+        STAT_TOTAL_COMMIT_MICROS = 9,
+        STAT_COUNT = 10,
+    };
+
+    /* Opens the connection through the named VFS, or the default one if vfsName is NULL,
+     * and starts the commit thread. On failure, returns NULL and sets err and message. */
+    static GroupCommitter* open(const char* path, const char* vfsName, const char* syncMode,
+            bool foreignKeys, const char* locale, int maxBatchSize, int64_t maxLatencyMicros,
+            int* err, std::string* message);
+
+    /* Commits the pending statements, stops the commit thread and closes the
+     * connection. */
+    ~GroupCommitter();
+
+    /* Enqueues a statement and waits until the batch holding it has committed. Returns
+     * the result of the statement, or SQLITE_MISUSE after close has been called. */
+    int execute(Operation* operation);
+
+    /* Rejects further statements. Pending statements are still committed. */
+    void close();
+
+    void getStats(int64_t* stats);
+
+private:
+    sqlite3* mDb;
+    const int mMaxBatchSize;
+    const int64_t mMaxLatencyMicros;
+
+    std::mutex mLock;
+    std::condition_variable mQueued;
+    std::condition_variable mCommitted;
+    std::deque<Operation*> mQueue;
+    bool mClosed;
+    int64_t mStats[STAT_COUNT];
+    std::thread mThread;
+
+    // Used by the commit thread only.
+    std::map<std::string, sqlite3_stmt*> mStatements;
+
+    GroupCommitter(sqlite3* db, int maxBatchSize, int64_t maxLatencyMicros);
+
+    void run();
+    bool commit(std::vector<Operation*>& batch);
+    void failRolledBack(std::vector<Operation*>& batch, Operation* cause);
+    void runOperation(Operation* operation);
+    sqlite3_stmt* prepare(const std::string& sql, int* err, std::string* message);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_GROUP_COMMITTER_H
@@ -0,0 +1,246 @@
+#undef LOG_TAG
+#define LOG_TAG "IoStatsVfs"
+
+#include "IoStatsVfs.h"
+#include "ALog-priv.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+
+static const char* const VFS_NAME = "android-iostats";
+
+typedef std::atomic<int64_t> Counter;
+
+struct DatabaseIoStats {
+    Counter counters[IoStatsVfs::STAT_COUNT];
+};
+
+struct IoStatsFile : VfsShimFile {
+    // The counters of the kind of this file, or NULL if it is not counted.
+    Counter* counters;
+};
+
+static sqlite3_vfs gVfs;
+static bool gInstalled;
+static std::atomic<bool> gEnabled(false);
+
+// Entries are kept for the lifetime of the process, so files can refer to them freely.
+static std::mutex gDatabasesLock;
+static std::map<std::string, DatabaseIoStats*> gDatabases;
+
+static IoStatsFile* toIoStatsFile(sqlite3_file* file) {
+    return reinterpret_cast<IoStatsFile*>(file);
+}
+
+static int64_t nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void add(Counter* counters, int index, int64_t value) {
+    counters[index].fetch_add(value, std::memory_order_relaxed);
+}
+
+// Returns the start of a timed call, or 0 if the call is not counted.
+static int64_t begin(IoStatsFile* p) {
+    return p->counters && gEnabled.load(std::memory_order_relaxed) ? nowNanos() : 0;
+}
+
+static void end(IoStatsFile* p, int64_t start, int count, int latency, int64_t bytes,
+        int bytesIndex) {
+    int64_t micros = (nowNanos() - start) / 1000;
+    int bucket = 0;
+    while (micros >= 2 && bucket < IoStatsVfs::LATENCY_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    add(p->counters, count, 1);
+    add(p->counters, latency + bucket, 1);
+    if (bytesIndex >= 0) {
+        add(p->counters, bytesIndex, bytes);
+    }
+}
+
+static void countLock(IoStatsFile* p) {
+    if (p->counters && gEnabled.load(std::memory_order_relaxed)) {
+        add(p->counters, IoStatsVfs::STAT_LOCKS, 1);
+    }
+}
+
+static int ioStatsRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    IoStatsFile* p = toIoStatsFile(file);
+    int64_t start = begin(p);
+    int err = p->real->pMethods->xRead(p->real, buffer, amount, offset);
+    if (start) {
+        end(p, start, IoStatsVfs::STAT_READS, IoStatsVfs::STAT_READ_LATENCY, amount,
+                IoStatsVfs::STAT_BYTES_READ);
+    }
+    return err;
+}
+
+static int ioStatsWrite(sqlite3_file* file, const void* buffer, int amount,
+        sqlite3_int64 offset) {
+    IoStatsFile* p = toIoStatsFile(file);
+    int64_t start = begin(p);
+    int err = p->real->pMethods->xWrite(p->real, buffer, amount, offset);
+    if (start) {
+        end(p, start, IoStatsVfs::STAT_WRITES, IoStatsVfs::STAT_WRITE_LATENCY, amount,
+                IoStatsVfs::STAT_BYTES_WRITTEN);
+    }
+    return err;
+}
+
+static int ioStatsSync(sqlite3_file* file, int flags) {
+    IoStatsFile* p = toIoStatsFile(file);
+    int64_t start = begin(p);
+    int err = p->real->pMethods->xSync(p->real, flags);
+    if (start) {
+        end(p, start, IoStatsVfs::STAT_SYNCS, IoStatsVfs::STAT_SYNC_LATENCY, 0, -1);
+    }
+    return err;
+}
+
+static int ioStatsLock(sqlite3_file* file, int lock) {
+    IoStatsFile* p = toIoStatsFile(file);
+    countLock(p);
+    return p->real->pMethods->xLock(p->real, lock);
+}
+
+static int ioStatsUnlock(sqlite3_file* file, int lock) {
+    IoStatsFile* p = toIoStatsFile(file);
+    countLock(p);
+    return p->real->pMethods->xUnlock(p->real, lock);
+}
+
+static int ioStatsShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    IoStatsFile* p = toIoStatsFile(file);
+    if (p->real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR_SHMLOCK;
+    }
+    countLock(p);
+    return p->real->pMethods->xShmLock(p->real, offset, n, flags);
+}
+
+static sqlite3_io_methods gIoMethods;
+
+// Returns the counters of a file opened with the given flags, or NULL if it is not
+// counted, such as temporary files.
+static Counter* findCounters(const char* name, int flags) {
+    int kind;
+    if (flags & SQLITE_OPEN_MAIN_DB) {
+        kind = IoStatsVfs::FILE_DATABASE;
+    } else if (flags & SQLITE_OPEN_MAIN_JOURNAL) {
+        kind = IoStatsVfs::FILE_JOURNAL;
+    } else if (flags & SQLITE_OPEN_WAL) {
+        kind = IoStatsVfs::FILE_WAL;
+    } else {
+        return NULL;
+    }
+    if (!name) {
+        return NULL;
+    }
+    // Journal and WAL names come from SQLite, which can map them to their database.
+    const char* path = kind == IoStatsVfs::FILE_DATABASE ? name
+            : sqlite3_filename_database(name);
+
+    std::lock_guard<std::mutex> lock(gDatabasesLock);
+    DatabaseIoStats*& stats = gDatabases[path];
+    if (!stats) {
+        stats = new DatabaseIoStats();
+        for (int i = 0; i < IoStatsVfs::STAT_COUNT; i++) {
+            stats->counters[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    return stats->counters + kind * IoStatsVfs::STAT_FILE_COUNT;
+}
+
+static int ioStatsOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags,
+        int* outFlags) {
+    IoStatsFile* p = toIoStatsFile(file);
+    memset(p, 0, sizeof(IoStatsFile));
+    p->real = reinterpret_cast<sqlite3_file*>(p + 1);
+    p->counters = findCounters(name, flags);
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    int err = root->xOpen(root, name, p->real, flags, outFlags);
+    // The wrapped file must be closed if it has methods, even when opening failed.
+    file->pMethods = p->real->pMethods ? &gIoMethods : NULL;
+    return err;
+}
+
+int IoStatsVfs::install() {
+    if (!gInstalled) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(IoStatsFile)), ioStatsOpen);
+        VfsShim::initIoMethods(&gIoMethods);
+        gIoMethods.xRead = ioStatsRead;
+        gIoMethods.xWrite = ioStatsWrite;
+        gIoMethods.xSync = ioStatsSync;
+        gIoMethods.xLock = ioStatsLock;
+        gIoMethods.xUnlock = ioStatsUnlock;
+        gIoMethods.xShmLock = ioStatsShmLock;
+        gInstalled = true;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 1);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the I/O statistics VFS: %d", err);
+    }
+    return err;
+}
+
+void IoStatsVfs::setEnabled(bool enabled) {
+    gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+std::vector<std::string> IoStatsVfs::getDatabases() {
+    std::vector<std::string> paths;
+    std::lock_guard<std::mutex> lock(gDatabasesLock);
+    for (std::map<std::string, DatabaseIoStats*>::const_iterator it = gDatabases.begin();
+            it != gDatabases.end(); ++it) {
+        paths.push_back(it->first);
+    }
+    return paths;
+}
+
+bool IoStatsVfs::getStats(const char* path, int64_t* stats) {
+    DatabaseIoStats* entry;
+    {
+        std::lock_guard<std::mutex> lock(gDatabasesLock);
+        std::map<std::string, DatabaseIoStats*>::const_iterator it = gDatabases.find(path);
+        if (it == gDatabases.end()) {
+            return false;
+        }
+        entry = it->second;
+    }
+    for (int i = 0; i < STAT_COUNT; i++) {
+        stats[i] = entry->counters[i].load(std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void IoStatsVfs::reset() {
+    std::lock_guard<std::mutex> lock(gDatabasesLock);
+    for (std::map<std::string, DatabaseIoStats*>::const_iterator it = gDatabases.begin();
+            it != gDatabases.end(); ++it) {
+        for (int i = 0; i < STAT_COUNT; i++) {
+            it->second->counters[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+} // namespace android
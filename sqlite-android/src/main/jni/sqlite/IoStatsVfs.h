@@ -0,0 +1,69 @@
+#ifndef _ANDROID__DATABASE_IO_STATS_VFS_H
+#define _ANDROID__DATABASE_IO_STATS_VFS_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+
+/**
+ * VFS shim that counts the I/O of each database, registered as the default VFS on top of
+ * the MmapVfs.
+ *
+ * The database file, its rollback journal and its WAL file are counted separately, under
+ * the path of the database. Besides the number of calls and bytes, the latency of reads,
+ * writes and syncs is recorded in histograms with power-of-two buckets in microseconds:
+ * bucket 0 counts calls of less than 2us, bucket i those of 2^i to 2^(i+1)us, and the last
+ * bucket all slower ones. Counters are relaxed atomics and the clock is only read while
+ * counting is enabled, so the shim is cheap enough to stay installed.
+ */
+class IoStatsVfs {
+public:
+    enum {
+        FILE_DATABASE = 0,
+        FILE_JOURNAL = 1,
+        FILE_WAL = 2,
+        FILE_KIND_COUNT = 3,
+    };
+
+    enum {
+        LATENCY_BUCKETS = 20,
+    };
+
+    // Indices of the counters of one kind of file filled in by getStats, which fills in
+    // FILE_KIND_COUNT of them, STAT_FILE_COUNT apart.
+    enum {
+        STAT_READS = 0,
+        STAT_BYTES_READ = 1,
+        STAT_WRITES = 2,
+        STAT_BYTES_WRITTEN = 3,
+        STAT_SYNCS = 4,
+        STAT_LOCKS = 5,
+        STAT_READ_LATENCY = 6,
+        STAT_WRITE_LATENCY = STAT_READ_LATENCY + LATENCY_BUCKETS,
+        STAT_SYNC_LATENCY = STAT_WRITE_LATENCY + LATENCY_BUCKETS,
+        STAT_FILE_COUNT = STAT_SYNC_LATENCY + LATENCY_BUCKETS,
+        STAT_COUNT = STAT_FILE_COUNT * FILE_KIND_COUNT,
+    };
+
+    /* Registers the shim as the default VFS. Must be called again after SQLite was shut
+     * down, right after MmapVfs::install. */
+    static int install();
+
+    static void setEnabled(bool enabled);
+
+    /* Returns the paths of the databases that have been opened. */
+    static std::vector<std::string> getDatabases();
+
+    /* Fills in the counters of a database, returning false if it has not been opened. */
+    static bool getStats(const char* path, int64_t* stats);
+
+    /* Resets the counters of every database. */
+    static void reset();
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_IO_STATS_VFS_H
@@ -0,0 +1,436 @@
+#undef LOG_TAG
+#define LOG_TAG "IoUringVfs"
+
+#include "IoUringVfs.h"
+#include "ALog-priv.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_OFF_SQES)
+#define HAVE_IO_URING 1
+#endif
+
+namespace android {
+
+static const char* const VFS_NAME = "android-io-uring";
+
+// The start of the file struct of the unix VFS, which has kept this layout since SQLite
+// 3.7. SQLite has no call that returns the descriptor of a file, so it is taken from
+// there, and only used once it was found to be the file that was opened.
+struct UnixFileHead {
+    const sqlite3_io_methods* pMethod;
+    sqlite3_vfs* pVfs;
+    void* pInode;
+    int h;
+};
+
+struct IoUringFile : VfsShimFile {
+    // The descriptor to read through the ring, or -1 if reads always pass through.
+    int fd;
+};
+
+static sqlite3_vfs* gRootVfs;
+static sqlite3_vfs gVfs;
+
+static std::atomic<bool> gEnabled(false);
+
+static std::atomic<int64_t> gRingReads(0);
+static std::atomic<int64_t> gSubmits(0);
+static std::atomic<int64_t> gMaxBatch(0);
+static std::atomic<int64_t> gFallbackReads(0);
+
+// Returned by Ring::read when the read must go through the platform VFS instead.
+static const int RING_UNAVAILABLE = INT_MIN;
+
+#ifdef HAVE_IO_URING
+
+static const unsigned RING_ENTRIES = 64;
+
+// How long a reader waits between looks at the completion queue of a failed ring.
+static const int FAILED_POLL_DELAY_US = 1000;
+
+struct ReadRequest {
+    struct iovec iov;
+    int fd;
+    int64_t offset;
+    // The number of bytes read, -errno, or RING_UNAVAILABLE, once done.
+    int result;
+    bool done;
+    // Signaled once the request is done, or when its reader is to take the ring.
+    std::condition_variable wake;
+};
+
+/**
+ * A ring with a single submitter at a time. Readers queue their requests, and the one
+ * that holds the submitter role moves the queue to the ring, waits for completions and
+ * wakes the readers whose requests completed.
+ */
+class Ring {
+public:
+    Ring() : mFd(-1), mSubmitting(false), mFailed(false), mSqLocalTail(0), mInFlight(0) {
+    }
+
+    bool setUp();
+
+    // Returns the number of bytes read, -errno, or RING_UNAVAILABLE.
+    int read(int fd, void* buffer, int amount, int64_t offset);
+
+private:
+    void queueLocked();
+    void reapLocked();
+    void failLocked(int error);
+
+    int mFd;
+    unsigned mEntries;
+    unsigned* mSqHead;
+    unsigned* mSqTail;
+    unsigned mSqMask;
+    unsigned* mSqArray;
+    io_uring_sqe* mSqes;
+    unsigned* mCqHead;
+    unsigned* mCqTail;
+    unsigned mCqMask;
+    io_uring_cqe* mCqes;
+
+    std::mutex mLock;
+    std::deque<ReadRequest*> mPending;
+    // The requests whose readers are in read.
+    std::vector<ReadRequest*> mReaders;
+    bool mSubmitting;
+    bool mFailed;
+    unsigned mSqLocalTail;
+    // Requests in the submission queue or in the kernel.
+    unsigned mInFlight;
+};
+
+bool Ring::setUp() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = int(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (fd < 0) {
+        ALOGW("io_uring is not available: %s", strerror(errno));
+        return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqSize = cqSize = sqSize > cqSize ? sqSize : cqSize;
+    }
+    size_t sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+            IORING_OFF_SQ_RING);
+    void* cq = singleMmap ? sq : mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+            IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        ALOGW("Could not map the io_uring queues: %s", strerror(errno));
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (!singleMmap && cq != MAP_FAILED) {
+            munmap(cq, cqSize);
+        }
+        if (sq != MAP_FAILED) {
+            munmap(sq, sqSize);
+        }
+        close(fd);
+        return false;
+    }
+
+    char* sqBase = static_cast<char*>(sq);
+    char* cqBase = static_cast<char*>(cq);
+    mFd = fd;
+    mEntries = params.sq_entries;
+    mSqHead = reinterpret_cast<unsigned*>(sqBase + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+    mSqMask = *reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+    mSqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+    mSqes = static_cast<io_uring_sqe*>(sqes);
+    mCqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+    mCqMask = *reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+    mSqLocalTail = *mSqTail;
+    return true;
+}
+
+// Moves queued requests to the submission queue. At most mEntries requests are in flight,
+// so that neither queue of the ring can overflow.
+void Ring::queueLocked() {
+    while (!mPending.empty() && mInFlight < mEntries) {
+        ReadRequest* request = mPending.front();
+        mPending.pop_front();
+        unsigned index = mSqLocalTail & mSqMask;
+        io_uring_sqe* sqe = &mSqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = request->fd;
+        sqe->off = uint64_t(request->offset);
+        sqe->addr = uint64_t(uintptr_t(&request->iov));
+        sqe->len = 1;
+        sqe->user_data = uint64_t(uintptr_t(request));
+        mSqArray[index] = index;
+        mSqLocalTail++;
+        mInFlight++;
+    }
+    __atomic_store_n(mSqTail, mSqLocalTail, __ATOMIC_RELEASE);
+}
+
+void Ring::reapLocked() {
+    unsigned head = *mCqHead;
+    unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        io_uring_cqe* cqe = &mCqes[head & mCqMask];
+        ReadRequest* request = reinterpret_cast<ReadRequest*>(uintptr_t(cqe->user_data));
+        request->result = cqe->res;
+        request->done = true;
+        request->wake.notify_one();
+        mInFlight--;
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+}
+
+// Gives up on the ring after the kernel refused to take requests. Those it has not taken
+// are taken back from the submission queue and read through the platform VFS, while
+// those it took are still waited for.
+void Ring::failLocked(int error) {
+    if (!mFailed) {
+        mFailed = true;
+        ALOGE("io_uring failed, reading through the platform VFS: %s", strerror(error));
+    }
+    unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+    for (unsigned i = head; i != mSqLocalTail; i++) {
+        io_uring_sqe* sqe = &mSqes[mSqArray[i & mSqMask]];
+        ReadRequest* request = reinterpret_cast<ReadRequest*>(uintptr_t(sqe->user_data));
+        request->result = RING_UNAVAILABLE;
+        request->done = true;
+        request->wake.notify_one();
+        mInFlight--;
+    }
+    mSqLocalTail = head;
+    __atomic_store_n(mSqTail, mSqLocalTail, __ATOMIC_RELEASE);
+    for (ReadRequest* request : mPending) {
+        request->result = RING_UNAVAILABLE;
+        request->done = true;
+        request->wake.notify_one();
+    }
+    mPending.clear();
+}
+
+int Ring::read(int fd, void* buffer, int amount, int64_t offset) {
+    ReadRequest request;
+    request.iov.iov_base = buffer;
+    request.iov.iov_len = size_t(amount);
+    request.fd = fd;
+    request.offset = offset;
+    request.result = 0;
+    request.done = false;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mFailed) {
+        return RING_UNAVAILABLE;
+    }
+    mPending.push_back(&request);
+    mReaders.push_back(&request);
+    while (!request.done) {
+        if (mSubmitting) {
+            request.wake.wait(lock);
+            continue;
+        }
+
+        // Submit whatever is queued and wait for completions until this request is done,
+        // then hand the role on to a reader still waiting. Once the ring has failed, the
+        // request can only be in the kernel, which is waited for without submitting more.
+        mSubmitting = true;
+        while (!request.done) {
+            bool failed = mFailed;
+            unsigned toSubmit = 0;
+            if (!failed) {
+                queueLocked();
+                toSubmit = mSqLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+            }
+            lock.unlock();
+            int submitted = int(syscall(__NR_io_uring_enter, mFd, toSubmit, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0));
+            int error = submitted < 0 ? errno : 0;
+            if (submitted < 0 && failed && error != EINTR) {
+                // The kernel posts completions without being entered, so they are polled
+                // for when even waiting fails.
+                usleep(FAILED_POLL_DELAY_US);
+            }
+            lock.lock();
+            if (submitted > 0) {
+                gSubmits.fetch_add(1, std::memory_order_relaxed);
+                if (submitted > gMaxBatch.load(std::memory_order_relaxed)) {
+                    gMaxBatch.store(submitted, std::memory_order_relaxed);
+                }
+            } else if (submitted < 0 && !failed && error != EINTR && error != EAGAIN
+                    && error != EBUSY) {
+                failLocked(error);
+            }
+            reapLocked();
+        }
+        mSubmitting = false;
+        for (ReadRequest* reader : mReaders) {
+            if (!reader->done) {
+                reader->wake.notify_one();
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < mReaders.size(); i++) {
+        if (mReaders[i] == &request) {
+            mReaders[i] = mReaders.back();
+            mReaders.pop_back();
+            break;
+        }
+    }
+    return request.result;
+}
+
+#else
+
+// Without io_uring in the headers the ring never sets up, and all reads pass through.
+class Ring {
+public:
+    bool setUp() {
+        return false;
+    }
+
+    int read(int fd, void* buffer, int amount, int64_t offset) {
+        return RING_UNAVAILABLE;
+    }
+};
+
+#endif // HAVE_IO_URING
+
+static std::mutex gRingLock;
+// Set up the first time reads are enabled, and kept for the life of the process.
+static Ring* gRing;
+static bool gRingSetUp;
+
+static IoUringFile* toIoUringFile(sqlite3_file* file) {
+    return reinterpret_cast<IoUringFile*>(file);
+}
+
+// Returns the descriptor of a file of the unix VFS, or -1 if it cannot be found.
+static int findDescriptor(sqlite3_file* real, const char* name) {
+    if (!name || strcmp(gRootVfs->zName, "unix") != 0) {
+        return -1;
+    }
+    const UnixFileHead* head = reinterpret_cast<const UnixFileHead*>(real);
+    if (head->pVfs != gRootVfs || head->h < 0) {
+        return -1;
+    }
+    struct stat byDescriptor;
+    struct stat byName;
+    if (fstat(head->h, &byDescriptor) != 0 || stat(name, &byName) != 0
+            || byDescriptor.st_dev != byName.st_dev || byDescriptor.st_ino != byName.st_ino) {
+        return -1;
+    }
+    return head->h;
+}
+
+static int ioUringRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    IoUringFile* p = toIoUringFile(file);
+    if (p->fd < 0 || !gEnabled.load(std::memory_order_acquire)) {
+        return p->real->pMethods->xRead(p->real, buffer, amount, offset);
+    }
+    int result = gRing->read(p->fd, buffer, amount, offset);
+    if (result == amount) {
+        gRingReads.fetch_add(1, std::memory_order_relaxed);
+        return SQLITE_OK;
+    }
+    // Short reads and errors are read again by the platform VFS, which fills in the
+    // missing bytes and keeps the error number as SQLite expects.
+    gFallbackReads.fetch_add(1, std::memory_order_relaxed);
+    return p->real->pMethods->xRead(p->real, buffer, amount, offset);
+}
+
+static sqlite3_io_methods gIoMethods;
+
+static int ioUringOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags,
+        int* outFlags) {
+    IoUringFile* p = toIoUringFile(file);
+    memset(p, 0, sizeof(IoUringFile));
+    p->fd = -1;
+    p->real = reinterpret_cast<sqlite3_file*>(p + 1);
+    int err = gRootVfs->xOpen(gRootVfs, name, p->real, flags, outFlags);
+    // Only the files that most reads go to are read through the ring.
+    if (err == SQLITE_OK && (flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_WAL))) {
+        p->fd = findDescriptor(p->real, name);
+    }
+    // The platform file must be closed if it has methods, even when opening failed.
+    file->pMethods = p->real->pMethods ? &gIoMethods : NULL;
+    return err;
+}
+
+int IoUringVfs::install() {
+    if (!gRootVfs) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(IoUringFile)), ioUringOpen);
+        VfsShim::initIoMethods(&gIoMethods);
+        gIoMethods.xRead = ioUringRead;
+        gRootVfs = root;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 1);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the io_uring VFS: %d", err);
+    }
+    return err;
+}
+
+bool IoUringVfs::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(gRingLock);
+    if (enabled && !gRingSetUp) {
+        gRingSetUp = true;
+        Ring* ring = new Ring();
+        if (ring->setUp()) {
+            gRing = ring;
+        } else {
+            delete ring;
+        }
+    }
+    bool reading = enabled && gRing;
+    gEnabled.store(reading, std::memory_order_release);
+    return reading;
+}
+
+void IoUringVfs::getStats(int64_t* stats) {
+    stats[STAT_ENABLED] = gEnabled.load(std::memory_order_relaxed) ? 1 : 0;
+    stats[STAT_RING_READS] = gRingReads.load(std::memory_order_relaxed);
+    stats[STAT_SUBMITS] = gSubmits.load(std::memory_order_relaxed);
+    stats[STAT_MAX_BATCH] = gMaxBatch.load(std::memory_order_relaxed);
+    stats[STAT_FALLBACK_READS] = gFallbackReads.load(std::memory_order_relaxed);
+}
+
+} // namespace android
@@ -0,0 +1,48 @@
+#ifndef _ANDROID__DATABASE_IO_URING_VFS_H
+#define _ANDROID__DATABASE_IO_URING_VFS_H
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * VFS shim over the platform VFS that can read database and WAL files through io_uring.
+ * The ReadaheadVfs wraps it in turn. It passes every call through until it is enabled.
+ *
+ * Once enabled, reads are queued to a ring shared by the process. The first reader to
+ * find no one submitting submits the queue, waits for completions and hands the ring on
+ * when its own read is done; readers that arrive meanwhile are queued and submitted
+ * together on the next round. Reads of pooled connections that run at the same time
+ * thus go to the kernel in batches, so the storage sees them in parallel.
+ *
+ * Reads fall back to the platform VFS where the kernel lacks io_uring, or denies it,
+ * and for files whose descriptor could not be found. Many Android releases deny io_uring
+ * to apps through their seccomp policy, which may end the process rather than fail the
+ * call, so it must only be enabled where the policy is known to allow it.
+ */
+class IoUringVfs {
+public:
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_ENABLED = 0,
+        STAT_RING_READS = 1,
+        STAT_SUBMITS = 2,
+        STAT_MAX_BATCH = 3,
+        STAT_FALLBACK_READS = 4,
+        STAT_COUNT = 5,
+    };
+
+    /* Registers the shim as the default VFS. Must be called again after SQLite was shut
+     * down, right before ReadaheadVfs::install. */
+    static int install();
+
+    /* Enables or disables reading through io_uring. Returns whether reads go through it,
+     * which is false if the ring could not be set up. */
+    static bool setEnabled(bool enabled);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_IO_URING_VFS_H
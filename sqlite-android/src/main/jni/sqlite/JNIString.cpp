@@ -19,6 +19,7 @@
 // https://android.googlesource.com/platform/libcore/+/master/libart/src/main/java/java/lang/StringFactory.java
 
 #include <jni.h>
+#include <stddef.h>
 
 #define REPLACEMENT_CHAR 0xfffd;
 
@@ -115,4 +116,61 @@ outer:
     }
     return s;
 }
-}
\ No newline at end of file
+
+// Returns the number of bytes needed to encode the given UTF-16 code units as
+// standard (not Java modified) UTF-8, excluding any terminator. Unpaired
+// surrogates are counted as U+FFFD, matching javaCharArrayToUtf8.
+size_t javaCharArrayUtf8Length(const jchar* v, jsize count) {
+    size_t length = 0;
+    for (jsize i = 0; i < count; i++) {
+        jchar c = v[i];
+        if (c < 0x80) {
+            length += 1;
+        } else if (c < 0x800) {
+            length += 2;
+        } else if (c >= 0xd800 && c <= 0xdbff && i + 1 < count
+                && v[i + 1] >= 0xdc00 && v[i + 1] <= 0xdfff) {
+            length += 4;
+            i++;
+        } else {
+            length += 3;
+        }
+    }
+    return length;
+}
+
+// Encodes the given UTF-16 code units as standard UTF-8 into d, which must have room
+// for at least javaCharArrayUtf8Length(v, count) bytes (3 * count is always enough).
+// No terminator is written. Returns the number of bytes written.
+size_t javaCharArrayToUtf8(const jchar* v, jsize count, char* d) {
+    char* out = d;
+    jsize i = 0;
+    while (i < count) {
+        jchar c = v[i++];
+        if (c < 0x80) {
+            *out++ = (char) c;
+        } else if (c < 0x800) {
+            *out++ = (char) (0xc0 | (c >> 6));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        } else if (c >= 0xd800 && c <= 0xdfff) {
+            if (c <= 0xdbff && i < count && v[i] >= 0xdc00 && v[i] <= 0xdfff) {
+                jint val = 0x10000 + (((c & 0x3ff) << 10) | (v[i++] & 0x3ff));
+                *out++ = (char) (0xf0 | (val >> 18));
+                *out++ = (char) (0x80 | ((val >> 12) & 0x3f));
+                *out++ = (char) (0x80 | ((val >> 6) & 0x3f));
+                *out++ = (char) (0x80 | (val & 0x3f));
+            } else {
+                // Unpaired surrogate, emit U+FFFD.
+                *out++ = (char) 0xef;
+                *out++ = (char) 0xbf;
+                *out++ = (char) 0xbd;
+            }
+        } else {
+            *out++ = (char) (0xe0 | (c >> 12));
+            *out++ = (char) (0x80 | ((c >> 6) & 0x3f));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        }
+    }
+    return out - d;
+}
+}
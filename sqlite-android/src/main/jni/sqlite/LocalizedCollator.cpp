@@ -0,0 +1,415 @@
+#undef LOG_TAG
+#define LOG_TAG "LocalizedCollator"
+
+#include "LocalizedCollator.h"
+#include "ALog-priv.h"
+#include "Unicode.h"
+
+#include <ctype.h>
+#include <string.h>
+
+namespace android {
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// Primary weights of the groups of characters, in collation order.
+static const uint32_t PRIMARY_CONTROL = 0x0100;
+static const uint32_t PRIMARY_PUNCTUATION = 0x0200;
+static const uint32_t PRIMARY_LATIN1_SYMBOL = 0x0300;
+static const uint32_t PRIMARY_GENERAL_PUNCTUATION = 0x0400;
+static const uint32_t PRIMARY_CURRENCY = 0x0500;
+static const uint32_t PRIMARY_DIGIT = 0x1000;
+static const uint32_t PRIMARY_LATIN = 0x2000;
+static const uint32_t PRIMARY_GREEK = 0x3000;
+static const uint32_t PRIMARY_CYRILLIC = 0x3400;
+static const uint32_t PRIMARY_CYRILLIC_EXTENDED = 0x3800;
+static const uint32_t PRIMARY_ARMENIAN = 0x3C00;
+static const uint32_t PRIMARY_OTHER = 0x10000;
+
+// Letters are this far apart, leaving room for tailored letters sorting after them.
+static const uint32_t LETTER_SPACING = 0x10;
+
+static const uint32_t SECONDARY_COMMON = 1;
+// Accented letters and combining marks add their code point.
+static const uint32_t SECONDARY_ACCENT = 0x200;
+static const uint32_t SECONDARY_MAX = 0xFEFF;
+
+static const uint8_t TERTIARY_LOWER = 1;
+static const uint8_t TERTIARY_UPPER = 2;
+// Added for fullwidth forms and katakana, which sort after their ordinary forms.
+static const uint8_t TERTIARY_VARIANT = 2;
+
+// ASCII punctuation and symbols in collation order.
+static const char PUNCTUATION_ORDER[] = " _-,;:!?.'\"()[]{}@*/\\&#%`^+<=>|~$";
+
+// Most recently compared strings whose sort keys are cached, and the longest cached text.
+static const size_t CACHE_SIZE = 256;
+static const size_t MAX_CACHED_TEXT = 256;
+
+struct CollationElement {
+    uint32_t primary;
+    uint32_t secondary;
+    uint8_t tertiary;
+};
+
+// A lower case letter which is a letter of its own in a language, sorting rank places
+// after an ASCII letter.
+struct TailoredLetter {
+    uint32_t letter;
+    char after;
+    uint8_t rank;
+};
+
+struct CollationTailoring {
+    // Space separated language codes.
+    const char* languages;
+    const TailoredLetter* letters;
+    size_t count;
+};
+
+static const TailoredLetter SWEDISH_LETTERS[] = {
+    { 0x00E5, 'z', 1 }, { 0x00E4, 'z', 2 }, { 0x00E6, 'z', 2 }, { 0x00F6, 'z', 3 },
+    { 0x00F8, 'z', 3 },
+};
+
+static const TailoredLetter DANISH_LETTERS[] = {
+    { 0x00E6, 'z', 1 }, { 0x00E4, 'z', 1 }, { 0x00F8, 'z', 2 }, { 0x00F6, 'z', 2 },
+    { 0x00E5, 'z', 3 },
+};
+
+static const TailoredLetter SPANISH_LETTERS[] = {
+    { 0x00F1, 'n', 1 },
+};
+
+static const TailoredLetter TURKISH_LETTERS[] = {
+    { 0x00E7, 'c', 1 }, { 0x011F, 'g', 1 }, { 0x0131, 'h', 1 }, { 0x00F6, 'o', 1 },
+    { 0x015F, 's', 1 }, { 0x00FC, 'u', 1 },
+};
+
+static const TailoredLetter POLISH_LETTERS[] = {
+    { 0x0105, 'a', 1 }, { 0x0107, 'c', 1 }, { 0x0119, 'e', 1 }, { 0x0142, 'l', 1 },
+    { 0x0144, 'n', 1 }, { 0x00F3, 'o', 1 }, { 0x015B, 's', 1 }, { 0x017A, 'z', 1 },
+    { 0x017C, 'z', 2 },
+};
+
+static const TailoredLetter CZECH_LETTERS[] = {
+    { 0x010D, 'c', 1 }, { 0x0159, 'r', 1 }, { 0x0161, 's', 1 }, { 0x017E, 'z', 1 },
+};
+
+static const CollationTailoring TAILORINGS[] = {
+    { "sv fi", SWEDISH_LETTERS, ARRAY_SIZE(SWEDISH_LETTERS) },
+    { "da nb nn no", DANISH_LETTERS, ARRAY_SIZE(DANISH_LETTERS) },
+    { "es", SPANISH_LETTERS, ARRAY_SIZE(SPANISH_LETTERS) },
+    { "tr az", TURKISH_LETTERS, ARRAY_SIZE(TURKISH_LETTERS) },
+    { "pl", POLISH_LETTERS, ARRAY_SIZE(POLISH_LETTERS) },
+    { "cs sk", CZECH_LETTERS, ARRAY_SIZE(CZECH_LETTERS) },
+};
+
+// Finds the tailoring for the language of a locale like "sv_SE", or NULL for the root order.
+static const CollationTailoring* findTailoring(const char* locale) {
+    char language[8];
+    size_t length = 0;
+    while (locale[length] && locale[length] != '_' && locale[length] != '-'
+            && length < sizeof(language) - 1) {
+        language[length] = char(tolower(locale[length]));
+        length++;
+    }
+    language[length] = '\0';
+    if (!length) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(TAILORINGS); i++) {
+        const char* languages = TAILORINGS[i].languages;
+        while (*languages) {
+            size_t size = strcspn(languages, " ");
+            if (size == length && !strncmp(languages, language, length)) {
+                return &TAILORINGS[i];
+            }
+            languages += size;
+            languages += strspn(languages, " ");
+        }
+    }
+    return NULL;
+}
+
+static uint32_t asciiPrimary(uint32_t c) {
+    if (c >= '0' && c <= '9') {
+        return PRIMARY_DIGIT + (c - '0');
+    }
+    if (c >= 'a' && c <= 'z') {
+        return PRIMARY_LATIN + (c - 'a') * LETTER_SPACING;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return PRIMARY_LATIN + (c - 'A') * LETTER_SPACING;
+    }
+    const char* punctuation = c ? strchr(PUNCTUATION_ORDER, int(c)) : NULL;
+    if (punctuation) {
+        return PRIMARY_PUNCTUATION + uint32_t(punctuation - PUNCTUATION_ORDER);
+    }
+    return PRIMARY_CONTROL + c;
+}
+
+static uint32_t hashText(const uint8_t* text, size_t size) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ text[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool isAscii(const uint8_t* text, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (text[i] >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compareBytes(const uint8_t* a, size_t sizeA, const uint8_t* b, size_t sizeB) {
+    size_t size = sizeA < sizeB ? sizeA : sizeB;
+    int rc = size ? memcmp(a, b, size) : 0;
+    if (rc == 0 && sizeA != sizeB) {
+        rc = sizeA < sizeB ? -1 : 1;
+    }
+    return rc;
+}
+
+LocalizedCollator::LocalizedCollator(const char* locale) :
+        mTailoring(findTailoring(locale)), mCache(CACHE_SIZE) {
+    for (uint32_t c = 0; c < 128; c++) {
+        mAsciiPrimary[c] = asciiPrimary(c);
+    }
+    for (size_t i = 0; i < mCache.size(); i++) {
+        mCache[i].hash = 0;
+    }
+}
+
+uint32_t LocalizedCollator::primary(uint32_t letter) const {
+    uint32_t c = letter;
+    if (c < 0x80) {
+        return mAsciiPrimary[c];
+    }
+    if (c >= 0x00A0 && c <= 0x00BF) {
+        return PRIMARY_LATIN1_SYMBOL + (c - 0x00A0);
+    }
+    if (c == 0x00D7 || c == 0x00F7) {
+        return PRIMARY_LATIN1_SYMBOL + 0x20 + (c == 0x00F7);
+    }
+    if (c >= 0x2000 && c <= 0x206F) {
+        return PRIMARY_GENERAL_PUNCTUATION + (c - 0x2000);
+    }
+    if (c >= 0x20A0 && c <= 0x20CF) {
+        return PRIMARY_CURRENCY + (c - 0x20A0);
+    }
+    if (c >= 0x03B1 && c <= 0x03C9) {
+        return PRIMARY_GREEK + (c - 0x03B1) * LETTER_SPACING;
+    }
+    if (c >= 0x0370 && c <= 0x03FF) {
+        return PRIMARY_GREEK + 0x200 + (c - 0x0370);
+    }
+    if (c >= 0x0430 && c <= 0x044F) {
+        return PRIMARY_CYRILLIC + (c - 0x0430) * LETTER_SPACING;
+    }
+    if (c >= 0x0450 && c <= 0x045F) {
+        return PRIMARY_CYRILLIC + 0x200 + (c - 0x0450) * LETTER_SPACING;
+    }
+    if (c >= 0x0460 && c <= 0x052F) {
+        return PRIMARY_CYRILLIC_EXTENDED + (c - 0x0460);
+    }
+    if (c >= 0x0561 && c <= 0x0587) {
+        return PRIMARY_ARMENIAN + (c - 0x0561) * LETTER_SPACING;
+    }
+    // Other scripts, including CJK, in code point order.
+    return PRIMARY_OTHER + c;
+}
+
+void LocalizedCollator::appendElements(uint32_t c,
+        std::vector<CollationElement>& elements) const {
+    CollationElement element;
+    if (c == 0x00AD || (c >= 0x200B && c <= 0x200F) || c == 0x2060 || c == 0xFEFF) {
+        // Soft hyphens, zero width spaces and joiners are ignored.
+        return;
+    }
+    if (c >= 0x0300 && c <= 0x036F) {
+        // Combining marks only weigh as accents.
+        element.primary = 0;
+        element.secondary = SECONDARY_ACCENT + c;
+        element.tertiary = TERTIARY_LOWER;
+        elements.push_back(element);
+        return;
+    }
+
+    uint8_t variant = 0;
+    if (c >= 0xFF01 && c <= 0xFF5E) {
+        // Fullwidth ASCII.
+        c -= 0xFEE0;
+        variant = TERTIARY_VARIANT;
+    } else if (c >= 0x30A1 && c <= 0x30F6) {
+        // Katakana sort with hiragana.
+        c -= 0x60;
+        variant = TERTIARY_VARIANT;
+    }
+    uint32_t lower = unicode_to_lower(c);
+    element.tertiary = (lower != c ? TERTIARY_UPPER : TERTIARY_LOWER) + variant;
+    element.secondary = SECONDARY_COMMON;
+
+    if (mTailoring) {
+        for (size_t i = 0; i < mTailoring->count; i++) {
+            const TailoredLetter& tailored = mTailoring->letters[i];
+            if (tailored.letter == lower) {
+                element.primary = primary(uint32_t(tailored.after)) + tailored.rank;
+                elements.push_back(element);
+                return;
+            }
+        }
+    }
+    if (lower == 0x0439) {
+        // The Cyrillic short i is a letter of its own rather than an accented i.
+        element.primary = primary(lower);
+        elements.push_back(element);
+        return;
+    }
+
+    uint32_t letters[UNICODE_MAX_BASE_LETTERS];
+    size_t count = unicode_base_letters(lower, letters);
+    for (size_t i = 0; i < count; i++) {
+        element.primary = primary(letters[i]);
+        if (i == 0 && (count > 1 || letters[0] != lower)) {
+            // Accented letters and ligatures sort after their base letters.
+            uint32_t secondary = SECONDARY_ACCENT + lower;
+            element.secondary = secondary < SECONDARY_MAX ? secondary : SECONDARY_MAX;
+        } else {
+            element.secondary = SECONDARY_COMMON;
+        }
+        elements.push_back(element);
+    }
+}
+
+void LocalizedCollator::buildKey(const uint8_t* text, size_t size, std::string& key) const {
+    std::vector<CollationElement> elements;
+    elements.reserve(size);
+    const uint8_t* end = text + size;
+    while (text < end) {
+        uint32_t c;
+        text += unicode_decode_utf8(text, end, &c);
+        appendElements(c == UNICODE_INVALID ? 0xFFFD : c, elements);
+    }
+
+    // The levels are separated by zero bytes, which are lower than any weight so that
+    // prefixes sort first.
+    key.clear();
+    key.reserve(elements.size() * 6 + 2);
+    for (size_t i = 0; i < elements.size(); i++) {
+        uint32_t weight = elements[i].primary;
+        if (weight) {
+            key += char((weight >> 16) + 1);
+            key += char(weight >> 8);
+            key += char(weight);
+        }
+    }
+    key += '\0';
+    for (size_t i = 0; i < elements.size(); i++) {
+        uint32_t weight = elements[i].secondary;
+        key += char((weight >> 8) + 1);
+        key += char(weight);
+    }
+    key += '\0';
+    for (size_t i = 0; i < elements.size(); i++) {
+        key += char(elements[i].tertiary);
+    }
+}
+
+const std::string& LocalizedCollator::sortKey(const uint8_t* text, size_t size,
+        uint32_t hash, std::string& scratch) {
+    if (size > MAX_CACHED_TEXT) {
+        buildKey(text, size, scratch);
+        return scratch;
+    }
+    CacheEntry& entry = mCache[hash % CACHE_SIZE];
+    if (entry.hash != hash || entry.text.size() != size
+            || memcmp(entry.text.data(), text, size) != 0) {
+        entry.hash = hash;
+        entry.text.assign(reinterpret_cast<const char*>(text), size);
+        buildKey(text, size, entry.key);
+    }
+    return entry.key;
+}
+
+int LocalizedCollator::compare(const uint8_t* a, size_t sizeA, const uint8_t* b,
+        size_t sizeB) {
+    if (isAscii(a, sizeA) && isAscii(b, sizeB)) {
+        // Every ASCII character is one element with a common secondary weight, so the
+        // levels can be compared without building keys.
+        size_t size = sizeA < sizeB ? sizeA : sizeB;
+        for (size_t i = 0; i < size; i++) {
+            uint32_t primaryA = mAsciiPrimary[a[i]];
+            uint32_t primaryB = mAsciiPrimary[b[i]];
+            if (primaryA != primaryB) {
+                return primaryA < primaryB ? -1 : 1;
+            }
+        }
+        if (sizeA != sizeB) {
+            return sizeA < sizeB ? -1 : 1;
+        }
+        for (size_t i = 0; i < size; i++) {
+            bool upperA = a[i] >= 'A' && a[i] <= 'Z';
+            bool upperB = b[i] >= 'A' && b[i] <= 'Z';
+            if (upperA != upperB) {
+                return upperA ? 1 : -1;
+            }
+        }
+        return compareBytes(a, sizeA, b, sizeB);
+    }
+
+    std::string scratchA;
+    std::string scratchB;
+    const std::string* keyA = &scratchA;
+    const std::string* keyB = &scratchB;
+    std::unique_lock<std::mutex> lock(mCacheLock, std::try_to_lock);
+    if (lock.owns_lock()) {
+        uint32_t hashA = hashText(a, sizeA);
+        uint32_t hashB = hashText(b, sizeB);
+        keyA = &sortKey(a, sizeA, hashA, scratchA);
+        if (hashA % CACHE_SIZE != hashB % CACHE_SIZE) {
+            keyB = &sortKey(b, sizeB, hashB, scratchB);
+        } else {
+            // Caching b would replace the key of a.
+            buildKey(b, sizeB, scratchB);
+        }
+    } else {
+        buildKey(a, sizeA, scratchA);
+        buildKey(b, sizeB, scratchB);
+    }
+
+    int rc = compareBytes(reinterpret_cast<const uint8_t*>(keyA->data()), keyA->size(),
+            reinterpret_cast<const uint8_t*>(keyB->data()), keyB->size());
+    return rc ? rc : compareBytes(a, sizeA, b, sizeB);
+}
+
+int LocalizedCollator::compareCallback(void* data, int sizeA, const void* a, int sizeB,
+        const void* b) {
+    LocalizedCollator* collator = static_cast<LocalizedCollator*>(data);
+    return collator->compare(static_cast<const uint8_t*>(a), size_t(sizeA),
+            static_cast<const uint8_t*>(b), size_t(sizeB));
+}
+
+void LocalizedCollator::destroyCallback(void* data) {
+    delete static_cast<LocalizedCollator*>(data);
+}
+
+int LocalizedCollator::registerCollation(sqlite3* db, const char* locale) {
+    LocalizedCollator* collator = new LocalizedCollator(locale);
+    int err = sqlite3_create_collation_v2(db, "localized", SQLITE_UTF8, collator,
+            compareCallback, destroyCallback);
+    if (err != SQLITE_OK) {
+        // Unlike functions, the destructor is not called when registration fails.
+        ALOGE("Could not register the LOCALIZED collation for '%s': %d", locale, err);
+        delete collator;
+    }
+    return err;
+}
+
+} // namespace android
@@ -0,0 +1,74 @@
+#ifndef _ANDROID__DATABASE_LOCALIZED_COLLATOR_H
+#define _ANDROID__DATABASE_LOCALIZED_COLLATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+
+struct CollationElement;
+struct CollationTailoring;
+
+/**
+ * Implements the LOCALIZED collation of a connection.
+ *
+ * Strings are compared by a simplified Unicode Collation Algorithm: letters first by
+ * their base letter, then by accents, then by case, and finally by their bytes so that
+ * only equal strings compare equal. Weights follow the root collation order of
+ * punctuation, digits, Latin, Greek, Cyrillic, Armenian and then other scripts by code
+ * point. The language of the locale can tailor the alphabet, such as sorting 'å' after
+ * 'z' in Swedish.
+ *
+ * Pure ASCII strings are compared directly from per character weights. Other strings
+ * are compared by their sort keys, the most recent of which are cached. The cache is
+ * only used by one thread at a time; SQLite sorter threads comparing concurrently build
+ * their keys without it.
+ */
+class LocalizedCollator {
+public:
+    /*
+     * Version of the collation order. It must be incremented whenever any two strings
+     * compare differently, since indexes stored with an older version are rebuilt only
+     * when it changes.
+     */
+    static const int VERSION = 1;
+
+    explicit LocalizedCollator(const char* locale);
+
+    int compare(const uint8_t* a, size_t sizeA, const uint8_t* b, size_t sizeB);
+
+    /* Registers a collator for the locale as the LOCALIZED collation of db. */
+    static int registerCollation(sqlite3* db, const char* locale);
+
+private:
+    struct CacheEntry {
+        uint32_t hash;
+        std::string text;
+        std::string key;
+    };
+
+    const CollationTailoring* mTailoring;
+    uint32_t mAsciiPrimary[128];
+    std::mutex mCacheLock;
+    std::vector<CacheEntry> mCache;
+
+    uint32_t primary(uint32_t letter) const;
+    void appendElements(uint32_t c, std::vector<CollationElement>& elements) const;
+    void buildKey(const uint8_t* text, size_t size, std::string& key) const;
+    const std::string& sortKey(const uint8_t* text, size_t size, uint32_t hash,
+            std::string& scratch);
+
+    static int compareCallback(void* data, int sizeA, const void* a, int sizeB,
+            const void* b);
+    static void destroyCallback(void* data);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_LOCALIZED_COLLATOR_H
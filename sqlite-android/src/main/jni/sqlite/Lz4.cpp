@@ -0,0 +1,198 @@
+#include "Lz4.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+
+static const int MIN_MATCH = 4;
+// The block format requires the last 5 bytes to be literals, and the last match to
+// start at least 12 bytes before the end.
+static const int LAST_LITERALS = 5;
+static const int MATCH_FIND_LIMIT = 12;
+static const int MAX_OFFSET = 65535;
+static const int HASH_LOG = 12;
+// After this many misses in a row, the compressor skips ahead faster through data that
+// does not compress.
+static const int SKIP_TRIGGER = 6;
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static uint8_t* writeLength(uint8_t* op, int length) {
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = uint8_t(length);
+    return op;
+}
+
+// Writes a sequence of literals followed by a match, or by nothing if matchLength is 0.
+// Returns NULL if it does not fit.
+static uint8_t* writeSequence(uint8_t* op, const uint8_t* end, const uint8_t* literals,
+        int literalLength, int offset, int matchLength) {
+    ptrdiff_t worstCase = 1 + literalLength / 255 + 1 + literalLength
+            + (matchLength ? 2 + matchLength / 255 + 1 : 0);
+    if (end - op < worstCase) {
+        return NULL;
+    }
+
+    uint8_t* token = op++;
+    int literalBits = literalLength < 15 ? literalLength : 15;
+    if (literalLength >= 15) {
+        op = writeLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    int matchBits = 0;
+    if (matchLength) {
+        *op++ = uint8_t(offset);
+        *op++ = uint8_t(offset >> 8);
+        int length = matchLength - MIN_MATCH;
+        matchBits = length < 15 ? length : 15;
+        if (length >= 15) {
+            op = writeLength(op, length - 15);
+        }
+    }
+    *token = uint8_t(literalBits << 4 | matchBits);
+    return op;
+}
+
+int Lz4::compress(const char* src, int size, char* dst, int capacity) {
+    const uint8_t* const base = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* const end = base + size;
+    const uint8_t* ip = base;
+    const uint8_t* anchor = base;
+    uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+    const uint8_t* const outEnd = op + capacity;
+
+    if (size > MATCH_FIND_LIMIT) {
+        const uint8_t* const matchFindLimit = end - MATCH_FIND_LIMIT;
+        const uint8_t* const matchLimit = end - LAST_LITERALS;
+        int32_t table[1 << HASH_LOG];
+        memset(table, 0, sizeof(table));
+        int misses = 0;
+
+        while (ip < matchFindLimit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hash(sequence);
+            const uint8_t* ref = base + table[h];
+            table[h] = int32_t(ip - base);
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != sequence) {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uint8_t* matchEnd = ip + MIN_MATCH;
+            const uint8_t* refEnd = ref + MIN_MATCH;
+            while (matchEnd < matchLimit && *matchEnd == *refEnd) {
+                matchEnd++;
+                refEnd++;
+            }
+
+            op = writeSequence(op, outEnd, anchor, int(ip - anchor), int(ip - ref),
+                    int(matchEnd - ip));
+            if (!op) {
+                return 0;
+            }
+            ip = matchEnd;
+            anchor = ip;
+            if (ip < matchFindLimit) {
+                table[hash(read32(ip - 2))] = int32_t(ip - 2 - base);
+            }
+        }
+    }
+
+    op = writeSequence(op, outEnd, anchor, int(end - anchor), 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return int(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+// Reads the bytes extending a length of 15 from its token. Returns false past the end.
+static bool readLength(const uint8_t*& ip, const uint8_t* end, int& length) {
+    uint8_t b;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+int Lz4::decompress(const char* src, int size, char* dst, int capacity) {
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* const end = ip + size;
+    uint8_t* const out = reinterpret_cast<uint8_t*>(dst);
+    uint8_t* op = out;
+    uint8_t* const outEnd = out + capacity;
+
+    for (;;) {
+        if (ip >= end) {
+            return -1;
+        }
+        uint8_t token = *ip++;
+
+        int literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength)) {
+            return -1;
+        }
+        if (literalLength > end - ip || literalLength > outEnd - op) {
+            return -1;
+        }
+        memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+        if (ip == end) {
+            // The last sequence holds literals only.
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op - out) {
+            return -1;
+        }
+        int matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength)) {
+            return -1;
+        }
+        matchLength += MIN_MATCH;
+        if (matchLength > outEnd - op) {
+            return -1;
+        }
+        const uint8_t* ref = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, ref, matchLength);
+            op += matchLength;
+        } else {
+            // The match overlaps its own output, repeating the last offset bytes.
+            for (int i = 0; i < matchLength; i++) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return op == outEnd ? capacity : -1;
+}
+
+} // namespace android
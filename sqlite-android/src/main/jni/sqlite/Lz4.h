@@ -0,0 +1,33 @@
+#ifndef _ANDROID__DATABASE_LZ4_H
+#define _ANDROID__DATABASE_LZ4_H
+
+namespace android {
+
+/**
+ * Compressor and decompressor of the LZ4 block format.
+ *
+ * The compressor is a greedy single-pass one with a small hash table, which favors speed
+ * over ratio like the reference LZ4 fast mode. Its output can be read by any LZ4 block
+ * decompressor. The decompressor checks every length and offset against the bounds of
+ * its buffers, so corrupt input fails rather than reading or writing out of bounds.
+ */
+class Lz4 {
+public:
+    /* Returns the size of the output buffer that always holds the compressed size of
+     * size bytes. */
+    static int compressBound(int size) {
+        return size + size / 255 + 16;
+    }
+
+    /* Compresses size bytes of src into dst. Returns the compressed size, or 0 if it
+     * would exceed capacity. */
+    static int compress(const char* src, int size, char* dst, int capacity);
+
+    /* Decompresses size bytes of src into dst, which must hold exactly capacity bytes
+     * once decompressed. Returns capacity, or -1 if src is corrupt. */
+    static int decompress(const char* src, int size, char* dst, int capacity);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_LZ4_H
@@ -0,0 +1,186 @@
+#undef LOG_TAG
+#define LOG_TAG "MemoryGovernor"
+
+#include "MemoryGovernor.h"
+#include "ALog-priv.h"
+#include "PoolAllocator.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <mutex>
+
+namespace android {
+
+struct MemoryPolicy {
+    int64_t softHeapLimit;
+    int64_t hardHeapLimit;
+    int maxCacheSizeKiB;
+    int minCacheSizeKiB;
+};
+
+// The soft heap limit is 4 times the maximum cursor window size, as has been used by
+// the original code in SQLiteDatabase for a long time. The page cache sizes default to
+// that of SQLite.
+static MemoryPolicy gPolicy = { 8 * 1024 * 1024, 0, 2000, 128 };
+
+static std::mutex gLock;
+
+// The last pressure signal, which decays over time.
+static int gSignaledLevel = MemoryGovernor::PRESSURE_NONE;
+static int64_t gSignaledAt;
+
+// The state derived from the policy and the decayed pressure. The generation changes
+// whenever connections need to change their page cache size.
+static int gLevel = MemoryGovernor::PRESSURE_NONE;
+static int64_t gSoftHeapLimit = gPolicy.softHeapLimit;
+static int gCacheSizeKiB = gPolicy.maxCacheSizeKiB;
+static uint32_t gGeneration;
+
+static int64_t nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static int64_t bytesInUse() {
+    int64_t stats[PoolAllocator::STAT_COUNT];
+    PoolAllocator::getStats(stats);
+    return stats[PoolAllocator::STAT_BYTES_IN_USE];
+}
+
+// Releases the unused cache pages that make the heap in use exceed softHeapLimit, least
+// recently used first. Returns the number of bytes released.
+static int releaseExcess(int64_t softHeapLimit) {
+    int64_t excess = bytesInUse() - softHeapLimit;
+    if (excess <= 0) {
+        return 0;
+    }
+    return sqlite3_release_memory(excess < INT_MAX ? int(excess) : INT_MAX);
+}
+
+// Recomputes the limits if the pressure has changed since they were last applied, or
+// always if force is set. Must be called with gLock held.
+static void updateLocked(bool force) {
+    int level = gSignaledLevel;
+    if (level != MemoryGovernor::PRESSURE_NONE) {
+        level -= int((nowSeconds() - gSignaledAt) / MemoryGovernor::PRESSURE_DECAY_SECONDS);
+        if (level < MemoryGovernor::PRESSURE_NONE) {
+            level = MemoryGovernor::PRESSURE_NONE;
+        }
+    }
+    if (level == gLevel && !force) {
+        return;
+    }
+    gLevel = level;
+
+    gSoftHeapLimit = gPolicy.softHeapLimit >> level;
+    // SQLite is built without memory statistics, which its own heap limits rely on.
+    PoolAllocator::setHeapLimits(gSoftHeapLimit, gPolicy.hardHeapLimit);
+
+    int cacheSizeKiB = gPolicy.maxCacheSizeKiB >> level;
+    if (level == MemoryGovernor::PRESSURE_CRITICAL || cacheSizeKiB < gPolicy.minCacheSizeKiB) {
+        cacheSizeKiB = gPolicy.minCacheSizeKiB;
+    }
+    if (cacheSizeKiB != gCacheSizeKiB) {
+        gCacheSizeKiB = cacheSizeKiB;
+        gGeneration++;
+    }
+}
+
+void MemoryGovernor::applyHeapLimits() {
+    std::lock_guard<std::mutex> lock(gLock);
+    updateLocked(true);
+}
+
+void MemoryGovernor::setPolicy(int64_t softHeapLimit, int64_t hardHeapLimit,
+        int maxCacheSizeKiB, int minCacheSizeKiB) {
+    std::lock_guard<std::mutex> lock(gLock);
+    gPolicy.softHeapLimit = softHeapLimit;
+    gPolicy.hardHeapLimit = hardHeapLimit;
+    gPolicy.maxCacheSizeKiB = maxCacheSizeKiB;
+    gPolicy.minCacheSizeKiB = minCacheSizeKiB;
+    updateLocked(true);
+}
+
+int MemoryGovernor::onPressure(int level) {
+    {
+        std::lock_guard<std::mutex> lock(gLock);
+        updateLocked(false);
+        // A milder signal does not end a more severe pressure before it has decayed.
+        if (level >= gLevel) {
+            gSignaledLevel = level;
+            gSignaledAt = nowSeconds();
+            updateLocked(false);
+        }
+    }
+    return releaseMemory();
+}
+
+int MemoryGovernor::releaseMemory() {
+    int level;
+    int64_t softHeapLimit;
+    {
+        std::lock_guard<std::mutex> lock(gLock);
+        updateLocked(false);
+        level = gLevel;
+        softHeapLimit = gSoftHeapLimit;
+    }
+    if (level == PRESSURE_CRITICAL) {
+        return sqlite3_release_memory(INT_MAX);
+    }
+
+    // Only release what exceeds the soft heap limit at the current pressure.
+    return releaseExcess(softHeapLimit);
+}
+
+void MemoryGovernor::applyTo(sqlite3* db, uint32_t* generation) {
+    int level;
+    int64_t softHeapLimit;
+    int cacheSizeKiB;
+    uint32_t currentGeneration;
+    {
+        std::lock_guard<std::mutex> lock(gLock);
+        updateLocked(false);
+        level = gLevel;
+        softHeapLimit = gSoftHeapLimit;
+        cacheSizeKiB = gCacheSizeKiB;
+        currentGeneration = gGeneration;
+    }
+
+    if (*generation != currentGeneration) {
+        // A negative cache size is in KiB rather than pages.
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA cache_size=-%d", cacheSizeKiB);
+        int err = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        if (err != SQLITE_OK) {
+            ALOGE("Could not set the cache size to %d KiB: %d", cacheSizeKiB, err);
+            return;
+        }
+        *generation = currentGeneration;
+    }
+
+    // Without pressure, the PoolAllocator keeps the heap in check as SQLite allocates.
+    if (level == PRESSURE_CRITICAL) {
+        sqlite3_db_release_memory(db);
+    } else if (level >= PRESSURE_MODERATE) {
+        releaseExcess(softHeapLimit);
+    }
+}
+
+void MemoryGovernor::getStats(int64_t* stats) {
+    std::lock_guard<std::mutex> lock(gLock);
+    updateLocked(false);
+    stats[STAT_PRESSURE] = gLevel;
+    stats[STAT_SOFT_HEAP_LIMIT] = gSoftHeapLimit;
+    stats[STAT_HARD_HEAP_LIMIT] = gPolicy.hardHeapLimit;
+    stats[STAT_CACHE_SIZE_KIB] = gCacheSizeKiB;
+    stats[STAT_POLICY_SOFT_HEAP_LIMIT] = gPolicy.softHeapLimit;
+    stats[STAT_POLICY_HARD_HEAP_LIMIT] = gPolicy.hardHeapLimit;
+    stats[STAT_POLICY_MAX_CACHE_SIZE_KIB] = gPolicy.maxCacheSizeKiB;
+    stats[STAT_POLICY_MIN_CACHE_SIZE_KIB] = gPolicy.minCacheSizeKiB;
+    stats[STAT_BYTES_IN_USE] = bytesInUse();
+}
+
+} // namespace android
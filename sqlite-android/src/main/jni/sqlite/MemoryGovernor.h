@@ -0,0 +1,78 @@
+#ifndef _ANDROID__DATABASE_MEMORY_GOVERNOR_H
+#define _ANDROID__DATABASE_MEMORY_GOVERNOR_H
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+namespace android {
+
+/**
+ * Adapts the memory limits of SQLite to the memory pressure of the process.
+ *
+ * The policy gives the soft and hard heap limits and the largest and smallest page cache
+ * of a connection when there is no pressure. Each pressure level halves the heap limit
+ * and the page cache, down to the smallest cache at PRESSURE_CRITICAL. Without further
+ * signals the pressure eases by one level every PRESSURE_DECAY_SECONDS, so caches grow
+ * back gradually.
+ *
+ * The heap limits apply to SQLite as a whole and are enforced by the PoolAllocator, which
+ * releases unused cache pages above the soft limit and fails allocations beyond the hard
+ * limit with SQLITE_NOMEM. Connections are not thread-safe, so each
+ * one adopts its page cache size from applyTo, called by the thread that owns it. Under
+ * pressure, applyTo also releases the unused cache pages by which the heap in use, as
+ * counted by the PoolAllocator, exceeds the soft limit, and all unused cache pages of the
+ * connection at PRESSURE_CRITICAL.
+ */
+class MemoryGovernor {
+public:
+    enum {
+        PRESSURE_NONE = 0,
+        PRESSURE_MODERATE = 1,
+        PRESSURE_HIGH = 2,
+        PRESSURE_CRITICAL = 3,
+    };
+
+    enum {
+        PRESSURE_DECAY_SECONDS = 30,
+    };
+
+    // Indices of the values filled in by getStats.
+    enum {
+        STAT_PRESSURE = 0,
+        STAT_SOFT_HEAP_LIMIT = 1,
+        STAT_HARD_HEAP_LIMIT = 2,
+        STAT_CACHE_SIZE_KIB = 3,
+        STAT_POLICY_SOFT_HEAP_LIMIT = 4,
+        STAT_POLICY_HARD_HEAP_LIMIT = 5,
+        STAT_POLICY_MAX_CACHE_SIZE_KIB = 6,
+        STAT_POLICY_MIN_CACHE_SIZE_KIB = 7,
+        STAT_BYTES_IN_USE = 8,
+        STAT_COUNT = 9,
+    };
+
+    /* Sets the heap limits of the PoolAllocator for the current pressure. */
+    static void applyHeapLimits();
+
+    /* Sets the policy. A hard heap limit of 0 disables it. */
+    static void setPolicy(int64_t softHeapLimit, int64_t hardHeapLimit, int maxCacheSizeKiB,
+            int minCacheSizeKiB);
+
+    /* Signals memory pressure of the given level, which also releases memory. Returns the
+     * number of bytes released. */
+    static int onPressure(int level);
+
+    /* Releases as much memory as the current pressure calls for. Returns the number of
+     * bytes released. */
+    static int releaseMemory();
+
+    /* Brings a connection up to date with the policy. generation holds the state last
+     * applied to the connection and starts out as 0. */
+    static void applyTo(sqlite3* db, uint32_t* generation);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_MEMORY_GOVERNOR_H
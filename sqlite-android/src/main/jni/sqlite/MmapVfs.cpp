@@ -0,0 +1,209 @@
+#undef LOG_TAG
+#define LOG_TAG "MmapVfs"
+
+#include "MmapVfs.h"
+#include "ALog-priv.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace android {
+
+static const char* const VFS_NAME = "android-mmap";
+
+// Mappings take address space rather than memory, of which 32-bit processes have little.
+static const int64_t DEFAULT_BUDGET = sizeof(void*) >= 8
+        ? int64_t(2048) * 1024 * 1024 : int64_t(256) * 1024 * 1024;
+
+struct MmapFile : VfsShimFile {
+    // The mmap size granted to the file out of the budget.
+    int64_t granted;
+    bool isMainDb;
+    // Set once an I/O error was seen, after which no more pages are mapped.
+    bool failed;
+    // The number of mapped pages handed out and not yet released.
+    int pagesOut;
+};
+
+static sqlite3_vfs* gRootVfs;
+static sqlite3_vfs gVfs;
+
+static std::mutex gBudgetLock;
+static int64_t gBudget = DEFAULT_BUDGET;
+static int64_t gReserved;
+
+static std::atomic<int64_t> gMappedReads(0);
+static std::atomic<int64_t> gFileReads(0);
+static std::atomic<int64_t> gFallbacks(0);
+
+static MmapFile* toMmapFile(sqlite3_file* file) {
+    return reinterpret_cast<MmapFile*>(file);
+}
+
+// Grants the file up to requested bytes of the budget, in place of what it held before.
+static int64_t reserve(MmapFile* file, int64_t requested) {
+    std::lock_guard<std::mutex> lock(gBudgetLock);
+    int64_t available = gBudget - (gReserved - file->granted);
+    int64_t granted = requested < available ? requested : available;
+    if (granted < 0) {
+        granted = 0;
+    }
+    gReserved += granted - file->granted;
+    file->granted = granted;
+    return granted;
+}
+
+// Makes the platform file drop its mapping, so that xRead no longer copies from it, and
+// returns its share of the budget. The platform VFS keeps the mapping while pages of it
+// are in use, so this waits for the last of them to be released.
+static void unmap(MmapFile* file) {
+    if (file->pagesOut > 0) {
+        return;
+    }
+    sqlite3_int64 size = 0;
+    file->real->pMethods->xFileControl(file->real, SQLITE_FCNTL_MMAP_SIZE, &size);
+    reserve(file, 0);
+}
+
+static void markFailed(MmapFile* file, int err) {
+    if (!file->failed) {
+        file->failed = true;
+        gFallbacks.fetch_add(1, std::memory_order_relaxed);
+        ALOGW("I/O error %d on a memory-mapped file, reading it without the mapping", err);
+        unmap(file);
+    }
+}
+
+static bool isIoError(int err) {
+    return (err & 0xff) == SQLITE_IOERR && err != SQLITE_IOERR_SHORT_READ;
+}
+
+static int mmapClose(sqlite3_file* file) {
+    MmapFile* p = toMmapFile(file);
+    reserve(p, 0);
+    return p->real->pMethods->xClose(p->real);
+}
+
+static int mmapRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    MmapFile* p = toMmapFile(file);
+    int err = p->real->pMethods->xRead(p->real, buffer, amount, offset);
+    if (p->isMainDb) {
+        gFileReads.fetch_add(1, std::memory_order_relaxed);
+        if (isIoError(err)) {
+            markFailed(p, err);
+        }
+    }
+    return err;
+}
+
+static int mmapFileControl(sqlite3_file* file, int op, void* arg) {
+    MmapFile* p = toMmapFile(file);
+    if (op == SQLITE_FCNTL_MMAP_SIZE) {
+        // A negative size only queries the current one.
+        // A file that saw an I/O error keeps no mapping.
+        int64_t* size = static_cast<int64_t*>(arg);
+        if (*size >= 0) {
+            *size = p->failed ? 0 : reserve(p, *size);
+        }
+    }
+    return p->real->pMethods->xFileControl(p->real, op, arg);
+}
+
+// Returning no page is always allowed, and makes SQLite read the page instead.
+static int mmapFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** pp) {
+    MmapFile* p = toMmapFile(file);
+    *pp = NULL;
+    if (p->failed || p->real->pMethods->iVersion < 3) {
+        return SQLITE_OK;
+    }
+    int err = p->real->pMethods->xFetch(p->real, offset, amount, pp);
+    if (err != SQLITE_OK) {
+        markFailed(p, err);
+        *pp = NULL;
+        return SQLITE_OK;
+    }
+    if (*pp) {
+        p->pagesOut++;
+        if (p->isMainDb) {
+            gMappedReads.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return SQLITE_OK;
+}
+
+static int mmapUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+    MmapFile* p = toMmapFile(file);
+    if (p->real->pMethods->iVersion < 3) {
+        return SQLITE_OK;
+    }
+    int err = p->real->pMethods->xUnfetch(p->real, offset, page);
+    // No page means the mapping is being dropped rather than a page released.
+    if (page) {
+        p->pagesOut--;
+        if (p->failed) {
+            unmap(p);
+        }
+    }
+    return err;
+}
+
+static sqlite3_io_methods gIoMethods;
+
+static int mmapOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags,
+        int* outFlags) {
+    MmapFile* p = toMmapFile(file);
+    memset(p, 0, sizeof(MmapFile));
+    p->real = reinterpret_cast<sqlite3_file*>(p + 1);
+    p->isMainDb = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+    int err = gRootVfs->xOpen(gRootVfs, name, p->real, flags, outFlags);
+    // The platform file must be closed if it has methods, even when opening failed.
+    file->pMethods = p->real->pMethods ? &gIoMethods : NULL;
+    return err;
+}
+
+int MmapVfs::install() {
+    if (!gRootVfs) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(MmapFile)), mmapOpen);
+        VfsShim::initIoMethods(&gIoMethods);
+        gIoMethods.xClose = mmapClose;
+        gIoMethods.xRead = mmapRead;
+        gIoMethods.xFileControl = mmapFileControl;
+        gIoMethods.xFetch = mmapFetch;
+        gIoMethods.xUnfetch = mmapUnfetch;
+        gRootVfs = root;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 1);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the mmap VFS: %d", err);
+    }
+    return err;
+}
+
+void MmapVfs::setBudget(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(gBudgetLock);
+    gBudget = bytes;
+}
+
+void MmapVfs::getStats(int64_t* stats) {
+    {
+        std::lock_guard<std::mutex> lock(gBudgetLock);
+        stats[STAT_BUDGET] = gBudget;
+        stats[STAT_RESERVED] = gReserved;
+    }
+    stats[STAT_MAPPED_READS] = gMappedReads.load(std::memory_order_relaxed);
+    stats[STAT_FILE_READS] = gFileReads.load(std::memory_order_relaxed);
+    stats[STAT_FALLBACKS] = gFallbacks.load(std::memory_order_relaxed);
+}
+
+} // namespace android
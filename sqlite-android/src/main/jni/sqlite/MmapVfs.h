@@ -0,0 +1,48 @@
+#ifndef _ANDROID__DATABASE_MMAP_VFS_H
+#define _ANDROID__DATABASE_MMAP_VFS_H
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * VFS shim over the ReadaheadVfs that governs memory-mapped I/O. The IoStatsVfs wraps it
+ * in turn as the default VFS.
+ *
+ * The mmap size a connection asks for with PRAGMA mmap_size is granted out of a budget
+ * shared by every open file of the process, since each mapping takes address space
+ * whether or not the same file is mapped elsewhere. A file is granted what is left of
+ * the budget and keeps its share until it asks again or is closed. Pages beyond the
+ * granted size are read with pread as usual.
+ *
+ * Once reading a file through its mapping fails, or a read of it reports an I/O error,
+ * the file stops handing out mapped pages, and drops its mapping and its share of the
+ * budget as soon as the pages it handed out are released, after which every page is read
+ * with pread. The shim counts the page reads served from mappings and from the file.
+ */
+class MmapVfs {
+public:
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_BUDGET = 0,
+        STAT_RESERVED = 1,
+        STAT_MAPPED_READS = 2,
+        STAT_FILE_READS = 3,
+        STAT_FALLBACKS = 4,
+        STAT_COUNT = 5,
+    };
+
+    /* Registers the shim as the default VFS. Must be called again after SQLite was shut
+     * down, right after ReadaheadVfs::install. */
+    static int install();
+
+    /* Sets the number of bytes all files may map together. Files keep what they were
+     * granted before, until they next set their mmap size. */
+    static void setBudget(int64_t bytes);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_MMAP_VFS_H
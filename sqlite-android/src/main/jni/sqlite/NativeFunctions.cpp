@@ -0,0 +1,325 @@
+#undef LOG_TAG
+#define LOG_TAG "NativeFunctions"
+
+#include "NativeFunctions.h"
+#include "ALog-priv.h"
+#include "Unicode.h"
+
+#include <math.h>
+#include <regex.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+namespace android {
+
+// Flags of every function, none of which have side effects.
+static const int FUNCTION_FLAGS = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+
+// Maps every code point of a UTF-8 text argument through map, which appends the
+// replacement to out. Invalid bytes are copied unchanged.
+template <typename Map>
+static void mapText(sqlite3_context* context, sqlite3_value* value, Map map) {
+    const uint8_t* text = sqlite3_value_text(value);
+    if (!text) {
+        if (sqlite3_value_type(value) != SQLITE_NULL) {
+            sqlite3_result_error_nomem(context);
+        }
+        return;
+    }
+    const uint8_t* end = text + sqlite3_value_bytes(value);
+
+    std::string out;
+    out.reserve(end - text);
+    while (text < end) {
+        if (*text < 0x80) {
+            map(out, uint32_t(*text));
+            text++;
+            continue;
+        }
+        uint32_t c;
+        size_t length = unicode_decode_utf8(text, end, &c);
+        if (c == UNICODE_INVALID) {
+            out += char(*text);
+        } else {
+            map(out, c);
+        }
+        text += length;
+    }
+    sqlite3_result_text64(context, out.data(), out.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+}
+
+// ---- regexp ----
+
+static void freeRegex(void* data) {
+    regex_t* regex = static_cast<regex_t*>(data);
+    regfree(regex);
+    sqlite3_free(regex);
+}
+
+// regexp(P, X): whether X matches the POSIX extended regular expression P anywhere.
+static void regexpFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    const char* text = reinterpret_cast<const char*>(sqlite3_value_text(argv[1]));
+    if (!text) {
+        return;
+    }
+
+    // The pattern is compiled once per statement.
+    regex_t* regex = static_cast<regex_t*>(sqlite3_get_auxdata(context, 0));
+    bool compiled = false;
+    if (!regex) {
+        const char* pattern = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+        if (!pattern) {
+            return;
+        }
+        regex = static_cast<regex_t*>(sqlite3_malloc(sizeof(regex_t)));
+        if (!regex) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        int err = regcomp(regex, pattern, REG_EXTENDED | REG_NOSUB);
+        if (err) {
+            char message[128];
+            regerror(err, regex, message, sizeof(message));
+            sqlite3_free(regex);
+            sqlite3_result_error(context, message, -1);
+            return;
+        }
+        compiled = true;
+    }
+
+    sqlite3_result_int(context, regexec(regex, text, 0, NULL, 0) == 0);
+
+    if (compiled) {
+        // SQLite may free the pattern right away, so it is only handed over last.
+        sqlite3_set_auxdata(context, 0, regex, freeRegex);
+    }
+}
+
+// ---- Case mapping ----
+
+enum {
+    CASE_LOWER,
+    CASE_UPPER,
+    CASE_FOLD,
+};
+
+struct CaseMap {
+    int mode;
+
+    void operator()(std::string& out, uint32_t c) const {
+        switch (mode) {
+            case CASE_LOWER:
+                unicode_encode_utf8(out, unicode_to_lower(c));
+                break;
+            case CASE_UPPER:
+                if (c == 0x00DF) {
+                    out += "SS";
+                } else {
+                    unicode_encode_utf8(out, unicode_to_upper(c));
+                }
+                break;
+            default:
+                // Full case folding where it differs from lower case.
+                switch (c) {
+                    case 0x00DF:
+                    case 0x1E9E:
+                        out += "ss";
+                        break;
+                    case 0x0130:
+                        out += "i\xCC\x87";
+                        break;
+                    case 0x00B5:
+                        unicode_encode_utf8(out, 0x03BC);
+                        break;
+                    case 0x017F:
+                        out += 's';
+                        break;
+                    case 0x03C2:
+                        unicode_encode_utf8(out, 0x03C3);
+                        break;
+                    default:
+                        unicode_encode_utf8(out, unicode_to_lower(c));
+                        break;
+                }
+                break;
+        }
+    }
+};
+
+static void caseFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    CaseMap map;
+    map.mode = int(reinterpret_cast<intptr_t>(sqlite3_user_data(context)));
+    mapText(context, argv[0], map);
+}
+
+// ---- unaccent ----
+
+static void unaccent(std::string& out, uint32_t c) {
+    uint32_t letters[UNICODE_MAX_BASE_LETTERS];
+    size_t count = unicode_base_letters(c, letters);
+    for (size_t i = 0; i < count; i++) {
+        unicode_encode_utf8(out, letters[i]);
+    }
+}
+
+static void unaccentFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    mapText(context, argv[0], unaccent);
+}
+
+// ---- haversine ----
+
+// Mean radius of the earth.
+static const double EARTH_RADIUS_METERS = 6371008.8;
+
+static double toRadians(double degrees) {
+    return degrees * (M_PI / 180.0);
+}
+
+// haversine(LAT1, LON1, LAT2, LON2): great-circle distance in meters.
+static void haversineFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    for (int i = 0; i < argc; i++) {
+        if (sqlite3_value_type(argv[i]) == SQLITE_NULL) {
+            return;
+        }
+    }
+    double lat1 = toRadians(sqlite3_value_double(argv[0]));
+    double lon1 = toRadians(sqlite3_value_double(argv[1]));
+    double lat2 = toRadians(sqlite3_value_double(argv[2]));
+    double lon2 = toRadians(sqlite3_value_double(argv[3]));
+
+    double sinLat = sin((lat2 - lat1) / 2);
+    double sinLon = sin((lon2 - lon1) / 2);
+    double a = sinLat * sinLat + cos(lat1) * cos(lat2) * sinLon * sinLon;
+    sqlite3_result_double(context, 2 * EARTH_RADIUS_METERS * asin(fmin(1.0, sqrt(a))));
+}
+
+// ---- Bit operations ----
+
+enum {
+    BIT_AND,
+    BIT_OR,
+    BIT_XOR,
+};
+
+// bit_and(X, Y), bit_or(X, Y) and bit_xor(X, Y), padding the shorter blob with zeros.
+static void bitBinaryFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL
+            || sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        return;
+    }
+    const uint8_t* a = static_cast<const uint8_t*>(sqlite3_value_blob(argv[0]));
+    size_t sizeA = size_t(sqlite3_value_bytes(argv[0]));
+    const uint8_t* b = static_cast<const uint8_t*>(sqlite3_value_blob(argv[1]));
+    size_t sizeB = size_t(sqlite3_value_bytes(argv[1]));
+    size_t size = sizeA > sizeB ? sizeA : sizeB;
+
+    uint8_t* result = static_cast<uint8_t*>(sqlite3_malloc64(size ? size : 1));
+    if (!result) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    int op = int(reinterpret_cast<intptr_t>(sqlite3_user_data(context)));
+    for (size_t i = 0; i < size; i++) {
+        uint8_t x = i < sizeA ? a[i] : 0;
+        uint8_t y = i < sizeB ? b[i] : 0;
+        switch (op) {
+            case BIT_AND:
+                result[i] = x & y;
+                break;
+            case BIT_OR:
+                result[i] = x | y;
+                break;
+            default:
+                result[i] = x ^ y;
+                break;
+        }
+    }
+    sqlite3_result_blob64(context, result, size, sqlite3_free);
+}
+
+// bit_not(X): the complement of every byte.
+static void bitNotFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    const uint8_t* a = static_cast<const uint8_t*>(sqlite3_value_blob(argv[0]));
+    size_t size = size_t(sqlite3_value_bytes(argv[0]));
+    uint8_t* result = static_cast<uint8_t*>(sqlite3_malloc64(size ? size : 1));
+    if (!result) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    for (size_t i = 0; i < size; i++) {
+        result[i] = ~a[i];
+    }
+    sqlite3_result_blob64(context, result, size, sqlite3_free);
+}
+
+// bit_count(X): the number of set bits.
+static void bitCountFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    const uint8_t* a = static_cast<const uint8_t*>(sqlite3_value_blob(argv[0]));
+    size_t size = size_t(sqlite3_value_bytes(argv[0]));
+    int64_t count = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, a + i, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+    for (; i < size; i++) {
+        count += __builtin_popcount(a[i]);
+    }
+    sqlite3_result_int64(context, count);
+}
+
+// ---- Registration ----
+
+struct NativeFunction {
+    const char* group;
+    const char* name;
+    int numArgs;
+    void (*callback)(sqlite3_context*, int, sqlite3_value**);
+    intptr_t data;
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static const NativeFunction NATIVE_FUNCTIONS[] = {
+    { "regexp", "regexp", 2, regexpFunction, 0 },
+    { "unicode", "unicode_lower", 1, caseFunction, CASE_LOWER },
+    { "unicode", "unicode_upper", 1, caseFunction, CASE_UPPER },
+    { "unicode", "unicode_casefold", 1, caseFunction, CASE_FOLD },
+    { "unaccent", "unaccent", 1, unaccentFunction, 0 },
+    { "haversine", "haversine", 4, haversineFunction, 0 },
+    { "bitops", "bit_and", 2, bitBinaryFunction, BIT_AND },
+    { "bitops", "bit_or", 2, bitBinaryFunction, BIT_OR },
+    { "bitops", "bit_xor", 2, bitBinaryFunction, BIT_XOR },
+    { "bitops", "bit_not", 1, bitNotFunction, 0 },
+    { "bitops", "bit_count", 1, bitCountFunction, 0 },
+};
+
+int register_native_functions(sqlite3* db, const char* group) {
+    bool found = false;
+    for (size_t i = 0; i < ARRAY_SIZE(NATIVE_FUNCTIONS); i++) {
+        const NativeFunction& function = NATIVE_FUNCTIONS[i];
+        if (sqlite3_stricmp(function.group, group) != 0) {
+            continue;
+        }
+        found = true;
+        int err = sqlite3_create_function_v2(db, function.name, function.numArgs,
+                FUNCTION_FLAGS, reinterpret_cast<void*>(function.data), function.callback,
+                NULL, NULL, NULL);
+        if (err != SQLITE_OK) {
+            ALOGE("Could not register native function %s: %d", function.name, err);
+            return err;
+        }
+    }
+    return found ? SQLITE_OK : SQLITE_NOTFOUND;
+}
+
+} // namespace android
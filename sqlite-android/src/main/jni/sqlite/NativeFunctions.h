@@ -0,0 +1,28 @@
+#ifndef _ANDROID__DATABASE_NATIVE_FUNCTIONS_H
+#define _ANDROID__DATABASE_NATIVE_FUNCTIONS_H
+
+#include "sqlite3.h"
+
+namespace android {
+
+/**
+ * Registers a group of SQL functions implemented in native code on a connection.
+ *
+ * The groups are:
+ *   "regexp"    regexp(P, X), which also backs the X REGEXP P operator, matching X
+ *               against the POSIX extended regular expression P.
+ *   "unicode"   unicode_lower(X), unicode_upper(X) and unicode_casefold(X), case mapping
+ *               of the Latin, Greek, Cyrillic and Armenian scripts.
+ *   "unaccent"  unaccent(X), replacing accented letters with their base letters.
+ *   "haversine" haversine(LAT1, LON1, LAT2, LON2), the great-circle distance in meters
+ *               between two points given in degrees.
+ *   "bitops"    bit_and(X, Y), bit_or(X, Y), bit_xor(X, Y), bit_not(X) and bit_count(X)
+ *               on blobs, where the shorter operand is padded with zero bytes.
+ *
+ * Returns SQLITE_NOTFOUND if there is no group with the given name.
+ */
+int register_native_functions(sqlite3* db, const char* group);
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_NATIVE_FUNCTIONS_H
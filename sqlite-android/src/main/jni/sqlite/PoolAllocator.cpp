@@ -0,0 +1,376 @@
+#undef LOG_TAG
+#define LOG_TAG "PoolAllocator"
+
+#include "PoolAllocator.h"
+#include "ALog-priv.h"
+
+#include "sqlite3.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace android {
+
+static const uint32_t SIZE_CLASSES[PoolAllocator::SIZE_CLASS_COUNT] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+};
+
+// Size class of blocks allocated straight from malloc.
+static const uint32_t UNPOOLED = PoolAllocator::SIZE_CLASS_COUNT;
+
+// Bytes of free blocks a thread keeps of each size class before handing half of them to
+// the shared pool, and of the shared pool before blocks are returned to malloc.
+static const uint32_t THREAD_CACHE_BYTES = 16 * 1024;
+static const uint32_t SHARED_POOL_BYTES = 256 * 1024;
+
+// Precedes every allocation, keeping the payload aligned to 8 bytes as SQLite requires.
+struct BlockHeader {
+    uint32_t size;
+    uint32_t sizeClass;
+};
+
+// A free block reuses its header as the link of a free list.
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct FreeList {
+    FreeBlock* head;
+    uint32_t count;
+};
+
+struct ThreadCache {
+    FreeList lists[PoolAllocator::SIZE_CLASS_COUNT];
+};
+
+static std::atomic<bool> gPooling(false);
+static std::atomic<int64_t> gBytesInUse(0);
+static std::atomic<int64_t> gHighWater(0);
+static std::atomic<int64_t> gAllocations[PoolAllocator::SIZE_CLASS_COUNT + 1];
+static std::atomic<int64_t> gReallocations(0);
+static std::atomic<int64_t> gSoftHeapLimit(0);
+static std::atomic<int64_t> gHardHeapLimit(0);
+
+static std::mutex gSharedPoolLock;
+static FreeList gSharedPool[PoolAllocator::SIZE_CLASS_COUNT];
+
+static pthread_once_t gThreadCacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gThreadCacheKey;
+static __thread ThreadCache* gThreadCache;
+static __thread bool gThreadCacheDestroyed;
+// Set while the thread has SQLite release memory, whose frees must not release again.
+static __thread bool gReleasingMemory;
+
+static uint32_t cacheLimit(uint32_t sizeClass, uint32_t bytes) {
+    uint32_t limit = bytes / SIZE_CLASSES[sizeClass];
+    return limit > 4 ? limit : 4;
+}
+
+static uint32_t roundUp8(uint32_t size) {
+    return (size + 7) & ~7u;
+}
+
+static uint32_t sizeClassOf(uint32_t size) {
+    uint32_t low = 0;
+    uint32_t high = PoolAllocator::SIZE_CLASS_COUNT - 1;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        if (SIZE_CLASSES[middle] < size) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void pushBlocks(FreeList& list, FreeBlock* first, FreeBlock* last, uint32_t count) {
+    last->next = list.head;
+    list.head = first;
+    list.count += count;
+}
+
+// Moves up to count blocks from the front of from, returning the first one and setting last.
+static FreeBlock* popBlocks(FreeList& from, uint32_t count, FreeBlock** last,
+        uint32_t* popped) {
+    FreeBlock* first = from.head;
+    FreeBlock* block = first;
+    uint32_t n = 1;
+    while (n < count && block->next) {
+        block = block->next;
+        n++;
+    }
+    from.head = block->next;
+    from.count -= n;
+    block->next = NULL;
+    *last = block;
+    *popped = n;
+    return first;
+}
+
+// Hands free blocks to the shared pool, or back to malloc once it is full.
+static void releaseToSharedPool(uint32_t sizeClass, FreeBlock* first, FreeBlock* last,
+        uint32_t count) {
+    {
+        std::lock_guard<std::mutex> lock(gSharedPoolLock);
+        FreeList& pool = gSharedPool[sizeClass];
+        if (pool.count + count <= cacheLimit(sizeClass, SHARED_POOL_BYTES)) {
+            pushBlocks(pool, first, last, count);
+            return;
+        }
+    }
+    while (first) {
+        FreeBlock* next = first->next;
+        free(first);
+        first = next;
+    }
+}
+
+static void destroyThreadCache(void* data) {
+    ThreadCache* cache = static_cast<ThreadCache*>(data);
+    for (uint32_t i = 0; i < PoolAllocator::SIZE_CLASS_COUNT; i++) {
+        FreeList& list = cache->lists[i];
+        if (list.head) {
+            FreeBlock* last;
+            uint32_t count;
+            FreeBlock* first = popBlocks(list, list.count, &last, &count);
+            releaseToSharedPool(i, first, last, count);
+        }
+    }
+    free(cache);
+    gThreadCache = NULL;
+    gThreadCacheDestroyed = true;
+}
+
+static void createThreadCacheKey() {
+    pthread_key_create(&gThreadCacheKey, destroyThreadCache);
+}
+
+// Returns the cache of the calling thread, or NULL once the thread is exiting.
+static ThreadCache* threadCache() {
+    ThreadCache* cache = gThreadCache;
+    if (cache || gThreadCacheDestroyed) {
+        return cache;
+    }
+    cache = static_cast<ThreadCache*>(calloc(1, sizeof(ThreadCache)));
+    if (cache) {
+        pthread_once(&gThreadCacheKeyOnce, createThreadCacheKey);
+        pthread_setspecific(gThreadCacheKey, cache);
+        gThreadCache = cache;
+    }
+    return cache;
+}
+
+static void addBytesInUse(int64_t delta) {
+    int64_t used = gBytesInUse.fetch_add(delta, std::memory_order_relaxed) + delta;
+    int64_t highWater = gHighWater.load(std::memory_order_relaxed);
+    while (used > highWater && !gHighWater.compare_exchange_weak(highWater, used,
+            std::memory_order_relaxed)) {
+    }
+}
+
+// Returns whether growing the heap by size bytes keeps it within the hard limit. Above the
+// soft limit, SQLite first releases unused cache pages, as it would with memory statistics.
+static bool reserveHeap(int64_t size) {
+    int64_t softHeapLimit = gSoftHeapLimit.load(std::memory_order_relaxed);
+    int64_t hardHeapLimit = gHardHeapLimit.load(std::memory_order_relaxed);
+    if (softHeapLimit <= 0 && hardHeapLimit <= 0) {
+        return true;
+    }
+    int64_t used = gBytesInUse.load(std::memory_order_relaxed) + size;
+    if (((softHeapLimit > 0 && used > softHeapLimit)
+            || (hardHeapLimit > 0 && used > hardHeapLimit)) && !gReleasingMemory) {
+        gReleasingMemory = true;
+        sqlite3_release_memory(size < INT_MAX ? int(size) : INT_MAX);
+        gReleasingMemory = false;
+        used = gBytesInUse.load(std::memory_order_relaxed) + size;
+    }
+    return hardHeapLimit <= 0 || used <= hardHeapLimit;
+}
+
+static void* toPayload(BlockHeader* header) {
+    return header + 1;
+}
+
+static BlockHeader* toHeader(void* p) {
+    return static_cast<BlockHeader*>(p) - 1;
+}
+
+static void* allocate(int size) {
+    uint32_t requested = roundUp8(uint32_t(size > 0 ? size : 1));
+    BlockHeader* header = NULL;
+    uint32_t sizeClass = UNPOOLED;
+    bool pooled = requested <= PoolAllocator::MAX_POOLED_SIZE
+            && gPooling.load(std::memory_order_relaxed);
+    if (pooled) {
+        sizeClass = sizeClassOf(requested);
+        requested = SIZE_CLASSES[sizeClass];
+    }
+    if (!reserveHeap(requested)) {
+        return NULL;
+    }
+
+    if (pooled) {
+        ThreadCache* cache = threadCache();
+        if (cache) {
+            FreeList& list = cache->lists[sizeClass];
+            if (!list.head) {
+                // Refill half of the thread cache from the shared pool.
+                std::lock_guard<std::mutex> lock(gSharedPoolLock);
+                FreeList& pool = gSharedPool[sizeClass];
+                if (pool.head) {
+                    FreeBlock* last;
+                    uint32_t count;
+                    FreeBlock* first = popBlocks(pool,
+                            cacheLimit(sizeClass, THREAD_CACHE_BYTES) / 2, &last, &count);
+                    pushBlocks(list, first, last, count);
+                }
+            }
+            if (list.head) {
+                FreeBlock* block = list.head;
+                list.head = block->next;
+                list.count--;
+                header = reinterpret_cast<BlockHeader*>(block);
+            }
+        }
+    }
+
+    if (!header) {
+        header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + requested));
+        if (!header) {
+            return NULL;
+        }
+    }
+    header->size = requested;
+    header->sizeClass = sizeClass;
+    addBytesInUse(requested);
+    return toPayload(header);
+}
+
+static void deallocate(void* p) {
+    BlockHeader* header = toHeader(p);
+    uint32_t sizeClass = header->sizeClass;
+    addBytesInUse(-int64_t(header->size));
+
+    ThreadCache* cache = sizeClass != UNPOOLED && gPooling.load(std::memory_order_relaxed)
+            ? threadCache() : NULL;
+    if (!cache) {
+        free(header);
+        return;
+    }
+
+    FreeList& list = cache->lists[sizeClass];
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+    pushBlocks(list, block, block, 1);
+    uint32_t limit = cacheLimit(sizeClass, THREAD_CACHE_BYTES);
+    if (list.count > limit) {
+        FreeBlock* last;
+        uint32_t count;
+        FreeBlock* first = popBlocks(list, limit / 2, &last, &count);
+        releaseToSharedPool(sizeClass, first, last, count);
+    }
+}
+
+static void* poolMalloc(int size) {
+    void* p = allocate(size);
+    if (p) {
+        gAllocations[toHeader(p)->sizeClass].fetch_add(1, std::memory_order_relaxed);
+    }
+    return p;
+}
+
+static void poolFree(void* p) {
+    deallocate(p);
+}
+
+static void* poolRealloc(void* p, int size) {
+    gReallocations.fetch_add(1, std::memory_order_relaxed);
+    BlockHeader* header = toHeader(p);
+    uint32_t requested = roundUp8(uint32_t(size > 0 ? size : 1));
+    if (header->sizeClass != UNPOOLED) {
+        if (requested <= header->size) {
+            return p;
+        }
+        void* q = allocate(size);
+        if (q) {
+            memcpy(q, p, header->size < requested ? header->size : requested);
+            deallocate(p);
+        }
+        return q;
+    }
+
+    uint32_t oldSize = header->size;
+    if (requested > oldSize && !reserveHeap(int64_t(requested) - int64_t(oldSize))) {
+        return NULL;
+    }
+    header = static_cast<BlockHeader*>(realloc(header, sizeof(BlockHeader) + requested));
+    if (!header) {
+        return NULL;
+    }
+    header->size = requested;
+    addBytesInUse(int64_t(requested) - int64_t(oldSize));
+    return toPayload(header);
+}
+
+static int poolSize(void* p) {
+    return int(toHeader(p)->size);
+}
+
+static int poolRoundup(int size) {
+    uint32_t requested = roundUp8(uint32_t(size > 0 ? size : 1));
+    if (requested <= PoolAllocator::MAX_POOLED_SIZE
+            && gPooling.load(std::memory_order_relaxed)) {
+        return int(SIZE_CLASSES[sizeClassOf(requested)]);
+    }
+    return int(requested);
+}
+
+static int poolInit(void* data) {
+    return SQLITE_OK;
+}
+
+static void poolShutdown(void* data) {
+}
+
+int PoolAllocator::install() {
+    static const sqlite3_mem_methods methods = {
+        poolMalloc,
+        poolFree,
+        poolRealloc,
+        poolSize,
+        poolRoundup,
+        poolInit,
+        poolShutdown,
+        NULL,
+    };
+    int err = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not install the pool allocator: %d", err);
+    }
+    return err;
+}
+
+void PoolAllocator::setPooling(bool enabled) {
+    gPooling.store(enabled, std::memory_order_relaxed);
+}
+
+void PoolAllocator::setHeapLimits(int64_t softHeapLimit, int64_t hardHeapLimit) {
+    gSoftHeapLimit.store(softHeapLimit, std::memory_order_relaxed);
+    gHardHeapLimit.store(hardHeapLimit, std::memory_order_relaxed);
+}
+
+void PoolAllocator::getStats(int64_t* stats) {
+    stats[STAT_BYTES_IN_USE] = gBytesInUse.load(std::memory_order_relaxed);
+    stats[STAT_HIGH_WATER] = gHighWater.load(std::memory_order_relaxed);
+    stats[STAT_REALLOCATIONS] = gReallocations.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i <= SIZE_CLASS_COUNT; i++) {
+        stats[STAT_SIZE_CLASS + i] = gAllocations[i].load(std::memory_order_relaxed);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,54 @@
+#ifndef _ANDROID__DATABASE_POOL_ALLOCATOR_H
+#define _ANDROID__DATABASE_POOL_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * Memory allocator of SQLite, registered with SQLITE_CONFIG_MALLOC.
+ *
+ * Every allocation carries a small header recording its size class, so the allocator
+ * keeps its own counters even though SQLite is built without memory statistics. For the
+ * same reason it enforces the heap limits itself: above the soft limit it has SQLite
+ * release unused cache pages before allocating, and allocations that would exceed the
+ * hard limit fail.
+ * Allocations start out passed through to malloc. Once pooling is enabled, requests of
+ * up to MAX_POOLED_SIZE bytes are rounded up to a size class and freed blocks are kept
+ * on a free list of the freeing thread, to be reused without locking. A thread keeps a
+ * limited number of blocks of each class and hands the rest to a shared pool. Pooling
+ * can be switched at any time, since blocks always record where they came from.
+ */
+class PoolAllocator {
+public:
+    enum {
+        SIZE_CLASS_COUNT = 16,
+        MAX_POOLED_SIZE = 4096,
+    };
+
+    // Indices of the counters filled in by getStats. STAT_SIZE_CLASS is followed by the
+    // number of allocations of each size class, and then of larger allocations. Reallocations
+    // are only counted by STAT_REALLOCATIONS.
+    enum {
+        STAT_BYTES_IN_USE = 0,
+        STAT_HIGH_WATER = 1,
+        STAT_REALLOCATIONS = 2,
+        STAT_SIZE_CLASS = 3,
+        STAT_COUNT = STAT_SIZE_CLASS + SIZE_CLASS_COUNT + 1,
+    };
+
+    /* Registers the allocator. Must be called before SQLite is initialized. */
+    static int install();
+
+    static void setPooling(bool enabled);
+
+    /* Sets the heap limits in bytes, where 0 disables a limit. */
+    static void setHeapLimits(int64_t softHeapLimit, int64_t hardHeapLimit);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_POOL_ALLOCATOR_H
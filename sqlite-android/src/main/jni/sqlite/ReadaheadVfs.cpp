@@ -0,0 +1,246 @@
+#undef LOG_TAG
+#define LOG_TAG "ReadaheadVfs"
+
+#include "ReadaheadVfs.h"
+#include "ALog-priv.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace android {
+
+static const char* const VFS_NAME = "android-readahead";
+
+static const int DEFAULT_READAHEAD_SIZE = 128 * 1024;
+// The size of the first batch after reads turned sequential.
+static const int MIN_WINDOW = 32 * 1024;
+// The number of reads in a row that must go forward before reading ahead.
+static const int SEQUENTIAL_TRIGGER = 4;
+// How far past the end of the previous read a read may start and still count as
+// sequential, since scans skip the interior pages of b-trees and pages of other tables.
+static const int64_t MAX_GAP = 64 * 1024;
+
+struct ReadaheadFile : VfsShimFile {
+    bool isMainDb;
+    // Where the last read ended, and how many reads in a row went forward from there.
+    int64_t nextOffset;
+    int sequentialReads;
+    // The size of the next batch.
+    int window;
+    // The bytes read ahead, valid while bufferLength is not 0 and no database file was
+    // written since they were read.
+    char* buffer;
+    int capacity;
+    int64_t bufferOffset;
+    int bufferLength;
+    uint64_t bufferGeneration;
+};
+
+static sqlite3_vfs* gRootVfs;
+static sqlite3_vfs gVfs;
+
+static std::atomic<int> gReadaheadSize(DEFAULT_READAHEAD_SIZE);
+// Incremented before each write of a database file of the process.
+static std::atomic<uint64_t> gWriteGeneration(0);
+
+static std::atomic<int64_t> gBatchedReads(0);
+static std::atomic<int64_t> gBytesReadAhead(0);
+static std::atomic<int64_t> gBufferedReads(0);
+
+static ReadaheadFile* toReadaheadFile(sqlite3_file* file) {
+    return reinterpret_cast<ReadaheadFile*>(file);
+}
+
+static void dropBuffer(ReadaheadFile* p) {
+    p->bufferLength = 0;
+}
+
+// Called before writing the file. Writes end a scan, and reading ahead of pages that are
+// read back between writes, as when the page cache spills, would mostly be wasted.
+static void onWrite(ReadaheadFile* p) {
+    // Before writing, so that a reader that sees the new bytes through another file
+    // also sees its buffer is stale.
+    gWriteGeneration.fetch_add(1, std::memory_order_acq_rel);
+    dropBuffer(p);
+    p->sequentialReads = 0;
+    p->window = MIN_WINDOW;
+}
+
+static bool isBuffered(ReadaheadFile* p, int amount, int64_t offset) {
+    return p->bufferLength > 0
+            && offset >= p->bufferOffset
+            && offset + amount <= p->bufferOffset + p->bufferLength
+            && p->bufferGeneration == gWriteGeneration.load(std::memory_order_acquire);
+}
+
+// Reads a batch of the file starting at offset into the buffer, and serves the read
+// from it. Falls back to reading only what was asked for when the batch cannot be read.
+static int readAhead(ReadaheadFile* p, void* buffer, int amount, int64_t offset,
+        int readaheadSize) {
+    sqlite3_file* real = p->real;
+    sqlite3_int64 size;
+    if (real->pMethods->xFileSize(real, &size) != SQLITE_OK || offset + amount > size) {
+        return real->pMethods->xRead(real, buffer, amount, offset);
+    }
+    int window = p->window < readaheadSize ? p->window : readaheadSize;
+    int length = size - offset < window ? int(size - offset) : window;
+    if (length > p->capacity) {
+        char* grown = static_cast<char*>(realloc(p->buffer, size_t(readaheadSize)));
+        if (!grown) {
+            return real->pMethods->xRead(real, buffer, amount, offset);
+        }
+        p->buffer = grown;
+        p->capacity = readaheadSize;
+    }
+
+    uint64_t generation = gWriteGeneration.load(std::memory_order_acquire);
+    int err = real->pMethods->xRead(real, p->buffer, length, offset);
+    if (err != SQLITE_OK) {
+        dropBuffer(p);
+        return real->pMethods->xRead(real, buffer, amount, offset);
+    }
+    p->bufferOffset = offset;
+    p->bufferLength = length;
+    p->bufferGeneration = generation;
+    p->window = window < readaheadSize / 2 ? window * 2 : readaheadSize;
+    gBatchedReads.fetch_add(1, std::memory_order_relaxed);
+    gBytesReadAhead.fetch_add(length - amount, std::memory_order_relaxed);
+
+    memcpy(buffer, p->buffer, amount);
+    return SQLITE_OK;
+}
+
+static int readaheadClose(sqlite3_file* file) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    free(p->buffer);
+    p->buffer = NULL;
+    return p->real->pMethods->xClose(p->real);
+}
+
+static int readaheadRead(sqlite3_file* file, void* buffer, int amount,
+        sqlite3_int64 offset) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    if (!p->isMainDb) {
+        return p->real->pMethods->xRead(p->real, buffer, amount, offset);
+    }
+
+    if (isBuffered(p, amount, offset)) {
+        memcpy(buffer, p->buffer + (offset - p->bufferOffset), amount);
+        p->nextOffset = offset + amount;
+        gBufferedReads.fetch_add(1, std::memory_order_relaxed);
+        return SQLITE_OK;
+    }
+
+    if (offset >= p->nextOffset && offset - p->nextOffset <= MAX_GAP) {
+        p->sequentialReads++;
+    } else {
+        p->sequentialReads = 0;
+        p->window = MIN_WINDOW;
+    }
+    p->nextOffset = offset + amount;
+
+    int readaheadSize = gReadaheadSize.load(std::memory_order_relaxed);
+    if (p->sequentialReads < SEQUENTIAL_TRIGGER || amount > readaheadSize / 2) {
+        return p->real->pMethods->xRead(p->real, buffer, amount, offset);
+    }
+    return readAhead(p, buffer, amount, offset, readaheadSize);
+}
+
+static int readaheadWrite(sqlite3_file* file, const void* buffer, int amount,
+        sqlite3_int64 offset) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    if (p->isMainDb) {
+        onWrite(p);
+    }
+    return p->real->pMethods->xWrite(p->real, buffer, amount, offset);
+}
+
+static int readaheadTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    if (p->isMainDb) {
+        onWrite(p);
+    }
+    return p->real->pMethods->xTruncate(p->real, size);
+}
+
+static int readaheadLock(sqlite3_file* file, int lock) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    dropBuffer(p);
+    return p->real->pMethods->xLock(p->real, lock);
+}
+
+static int readaheadUnlock(sqlite3_file* file, int lock) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    dropBuffer(p);
+    return p->real->pMethods->xUnlock(p->real, lock);
+}
+
+// In WAL mode the database file stays locked, and transactions begin and end with
+// locks of the shared memory instead.
+static int readaheadShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    dropBuffer(p);
+    if (p->real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR_SHMLOCK;
+    }
+    return p->real->pMethods->xShmLock(p->real, offset, n, flags);
+}
+
+static sqlite3_io_methods gIoMethods;
+
+static int readaheadOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file,
+        int flags, int* outFlags) {
+    ReadaheadFile* p = toReadaheadFile(file);
+    memset(p, 0, sizeof(ReadaheadFile));
+    p->real = reinterpret_cast<sqlite3_file*>(p + 1);
+    p->isMainDb = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+    p->window = MIN_WINDOW;
+    int err = gRootVfs->xOpen(gRootVfs, name, p->real, flags, outFlags);
+    // The platform file must be closed if it has methods, even when opening failed.
+    file->pMethods = p->real->pMethods ? &gIoMethods : NULL;
+    return err;
+}
+
+int ReadaheadVfs::install() {
+    if (!gRootVfs) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(ReadaheadFile)), readaheadOpen);
+        VfsShim::initIoMethods(&gIoMethods);
+        gIoMethods.xClose = readaheadClose;
+        gIoMethods.xRead = readaheadRead;
+        gIoMethods.xWrite = readaheadWrite;
+        gIoMethods.xTruncate = readaheadTruncate;
+        gIoMethods.xLock = readaheadLock;
+        gIoMethods.xUnlock = readaheadUnlock;
+        gIoMethods.xShmLock = readaheadShmLock;
+        gRootVfs = root;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 1);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the readahead VFS: %d", err);
+    }
+    return err;
+}
+
+void ReadaheadVfs::setReadaheadSize(int bytes) {
+    gReadaheadSize.store(bytes, std::memory_order_relaxed);
+}
+
+void ReadaheadVfs::getStats(int64_t* stats) {
+    stats[STAT_READAHEAD_SIZE] = gReadaheadSize.load(std::memory_order_relaxed);
+    stats[STAT_BATCHED_READS] = gBatchedReads.load(std::memory_order_relaxed);
+    stats[STAT_BYTES_READ_AHEAD] = gBytesReadAhead.load(std::memory_order_relaxed);
+    stats[STAT_BUFFERED_READS] = gBufferedReads.load(std::memory_order_relaxed);
+}
+
+} // namespace android
@@ -0,0 +1,47 @@
+#ifndef _ANDROID__DATABASE_READAHEAD_VFS_H
+#define _ANDROID__DATABASE_READAHEAD_VFS_H
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * VFS shim over the IoUringVfs that reads database files ahead of scans. The MmapVfs
+ * wraps it in turn.
+ *
+ * SQLite reads one page per call, so a full table scan or an index build makes one small
+ * read per page. Once a few reads of a database file in a row go forward by less than
+ * a small gap, the shim reads a window of the file past the requested page into a buffer
+ * of the file, and serves the following pages from there. The window doubles with each
+ * batch up to the readahead size. Reads that jump around never fill the buffer, so
+ * random access costs no more than a few comparisons per read.
+ *
+ * The buffer only holds what is in the file while no one can have changed it: it is
+ * dropped whenever the file is locked or unlocked, which starts and ends every
+ * transaction of every process, and whenever any database file of this process is
+ * written, which covers writers that share the file without taking its locks.
+ */
+class ReadaheadVfs {
+public:
+    // Indices of the counters filled in by getStats.
+    enum {
+        STAT_READAHEAD_SIZE = 0,
+        STAT_BATCHED_READS = 1,
+        STAT_BYTES_READ_AHEAD = 2,
+        STAT_BUFFERED_READS = 3,
+        STAT_COUNT = 4,
+    };
+
+    /* Registers the shim as the default VFS. Must be called again after SQLite was shut
+     * down, right after IoUringVfs::install. */
+    static int install();
+
+    /* Sets the largest number of bytes read ahead at once, or 0 to stop reading ahead. */
+    static void setReadaheadSize(int bytes);
+
+    static void getStats(int64_t* stats);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_READAHEAD_VFS_H
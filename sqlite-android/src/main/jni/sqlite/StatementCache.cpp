@@ -0,0 +1,202 @@
+#undef LOG_TAG
+#define LOG_TAG "StatementCache"
+
+#include "StatementCache.h"
+#include "ALog-priv.h"
+
+#include <string.h>
+
+namespace android {
+
+// Use counts are halved after this many lookups per cache slot.
+static const uint64_t AGING_PERIOD_PER_ENTRY = 8;
+
+StatementCache::StatementCache(size_t capacity) :
+        mCapacity(capacity), mClock(0), mNextAging(0),
+        mFinalizeListener(NULL), mFinalizeListenerData(NULL),
+        mSize(0), mHits(0), mMisses(0), mEvictions(0) {
+}
+
+StatementCache::~StatementCache() {
+    clear();
+}
+
+uint32_t StatementCache::hash(const jchar* sql, size_t length) {
+    // FNV-1a over the UTF-16 code units.
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ (sql[i] & 0xff)) * 16777619u;
+        h = (h ^ (sql[i] >> 8)) * 16777619u;
+    }
+    return h;
+}
+
+StatementCache::Entry* StatementCache::find(const jchar* sql, size_t length,
+        uint32_t hash) const {
+    std::pair<EntryMap::const_iterator, EntryMap::const_iterator> range =
+            mEntriesByHash.equal_range(hash);
+    for (EntryMap::const_iterator it = range.first; it != range.second; ++it) {
+        Entry* entry = it->second;
+        if (entry->sql.size() == length
+                && memcmp(&entry->sql[0], sql, length * sizeof(jchar)) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void StatementCache::touch(Entry* entry) {
+    entry->frequency += 1;
+    entry->lastUse = ++mClock;
+    if (mClock >= mNextAging) {
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            mEntries[i]->frequency >>= 1;
+        }
+        mNextAging = mClock + (mCapacity ? mCapacity : 1) * AGING_PERIOD_PER_ENTRY;
+    }
+}
+
+sqlite3_stmt* StatementCache::acquire(const jchar* sql, size_t length, int* outType) {
+    Entry* entry = length ? find(sql, length, hash(sql, length)) : NULL;
+    if (!entry || entry->inUse) {
+        // A statement that is in use is being executed recursively, the caller prepares
+        // a private copy.
+        mMisses += 1;
+        return NULL;
+    }
+    mHits += 1;
+    entry->inUse = true;
+    touch(entry);
+    *outType = entry->type;
+    return entry->statement;
+}
+
+bool StatementCache::contains(const jchar* sql, size_t length) const {
+    return length && find(sql, length, hash(sql, length)) != NULL;
+}
+
+bool StatementCache::put(const jchar* sql, size_t length, sqlite3_stmt* statement, int type) {
+    if (!length || mCapacity == 0) {
+        return false;
+    }
+    uint32_t h = hash(sql, length);
+    if (find(sql, length, h)) {
+        return false;
+    }
+    if (mEntries.size() >= mCapacity && !evictOne()) {
+        // Every cached statement is in use.
+        return false;
+    }
+
+    Entry* entry = new Entry();
+    entry->statement = statement;
+    entry->sql.assign(sql, sql + length);
+    entry->hash = h;
+    entry->frequency = 0;
+    entry->type = type;
+    entry->inUse = true;
+    touch(entry);
+    mEntriesByHash.insert(EntryMap::value_type(h, entry));
+    mEntries.push_back(entry);
+    mSize = int(mEntries.size());
+    return true;
+}
+
+bool StatementCache::release(sqlite3_stmt* statement) {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry* entry = mEntries[i];
+        if (entry->statement == statement) {
+            entry->inUse = false;
+            if (mEntries.size() > mCapacity) {
+                // The cache was shrunk while the statement was executing.
+                erase(entry);
+                mEvictions += 1;
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void StatementCache::remove(sqlite3_stmt* statement) {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i]->statement == statement) {
+            erase(mEntries[i]);
+            return;
+        }
+    }
+}
+
+void StatementCache::erase(Entry* entry) {
+    std::pair<EntryMap::iterator, EntryMap::iterator> range =
+            mEntriesByHash.equal_range(entry->hash);
+    for (EntryMap::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == entry) {
+            mEntriesByHash.erase(it);
+            break;
+        }
+    }
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i] == entry) {
+            mEntries.erase(mEntries.begin() + i);
+            break;
+        }
+    }
+    mSize = int(mEntries.size());
+    delete entry;
+}
+
+bool StatementCache::evictOne() {
+    Entry* victim = NULL;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry* entry = mEntries[i];
+        if (entry->inUse) {
+            continue;
+        }
+        if (!victim || entry->frequency < victim->frequency
+                || (entry->frequency == victim->frequency && entry->lastUse < victim->lastUse)) {
+            victim = entry;
+        }
+    }
+    if (!victim) {
+        return false;
+    }
+
+    ALOGV("Evicting statement %p (uses=%u)", victim->statement, victim->frequency);
+    finalize(victim->statement);
+    erase(victim);
+    mEvictions += 1;
+    return true;
+}
+
+void StatementCache::resize(size_t capacity) {
+    mCapacity = capacity;
+    while (mEntries.size() > mCapacity && evictOne()) {
+    }
+}
+
+void StatementCache::clear() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        // We ignore the result of sqlite3_finalize, the statement is always finalized.
+        finalize(mEntries[i]->statement);
+        delete mEntries[i];
+    }
+    mEntries.clear();
+    mEntriesByHash.clear();
+    mSize = 0;
+}
+
+void StatementCache::setFinalizeListener(FinalizeListener listener, void* data) {
+    mFinalizeListener = listener;
+    mFinalizeListenerData = data;
+}
+
+void StatementCache::finalize(sqlite3_stmt* statement) {
+    if (mFinalizeListener) {
+        mFinalizeListener(mFinalizeListenerData, statement);
+    }
+    sqlite3_finalize(statement);
+}
+
+} // namespace android
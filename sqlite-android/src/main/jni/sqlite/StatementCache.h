@@ -0,0 +1,105 @@
+#ifndef _ANDROID__DATABASE_STATEMENT_CACHE_H
+#define _ANDROID__DATABASE_STATEMENT_CACHE_H
+
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+/**
+ * Per-connection cache of prepared statements, keyed by a hash of the UTF-16 SQL text.
+ *
+ * Lookups hash the caller's characters and compare them against the cached copy, so no
+ * Java strings are created or compared. When the cache is full, the idle statement with
+ * the fewest uses is finalized, ties going to the least recently used one. Use counts
+ * are halved periodically so that statements which were only hot for a while age out.
+ *
+ * The cache owns the statements it holds and finalizes them when they are evicted or
+ * the cache is cleared. It is not thread-safe, except that the counters may be read
+ * from any thread.
+ */
+class StatementCache {
+public:
+    typedef void (*FinalizeListener)(void* data, sqlite3_stmt* statement);
+
+    explicit StatementCache(size_t capacity = 0);
+    ~StatementCache();
+
+    /* Returns the idle statement prepared from the given SQL and marks it in use,
+     * or NULL if there is none. Sets the type the statement was cached with. */
+    sqlite3_stmt* acquire(const jchar* sql, size_t length, int* outType);
+
+    /* Returns true if a statement prepared from the given SQL is cached. */
+    bool contains(const jchar* sql, size_t length) const;
+
+    /* Adds a statement which is in use by the caller. Returns false if it was not
+     * added, in which case the caller remains responsible for finalizing it. */
+    bool put(const jchar* sql, size_t length, sqlite3_stmt* statement, int type);
+
+    /* Marks a cached statement as idle. Returns false if the statement is not or
+     * should no longer be cached; it is then removed and the caller must finalize it. */
+    bool release(sqlite3_stmt* statement);
+
+    /* Removes a statement from the cache without finalizing it. */
+    void remove(sqlite3_stmt* statement);
+
+    /* Changes the capacity, finalizing idle statements that no longer fit. */
+    void resize(size_t capacity);
+
+    /* Finalizes all cached statements. */
+    void clear();
+
+    /* Sets the function called with each statement the cache finalizes, right before
+     * it is finalized. */
+    void setFinalizeListener(FinalizeListener listener, void* data);
+
+    inline size_t capacity() const { return mCapacity; }
+    inline int size() const { return mSize; }
+    inline int hits() const { return mHits; }
+    inline int misses() const { return mMisses; }
+    inline int evictions() const { return mEvictions; }
+
+private:
+    struct Entry {
+        sqlite3_stmt* statement;
+        std::vector<jchar> sql;
+        uint32_t hash;
+        uint32_t frequency;
+        uint64_t lastUse;
+        int type;
+        bool inUse;
+    };
+
+    typedef std::unordered_multimap<uint32_t, Entry*> EntryMap;
+
+    size_t mCapacity;
+    EntryMap mEntriesByHash;
+    std::vector<Entry*> mEntries;
+    uint64_t mClock;
+    uint64_t mNextAging;
+    FinalizeListener mFinalizeListener;
+    void* mFinalizeListenerData;
+
+    volatile int mSize;
+    volatile int mHits;
+    volatile int mMisses;
+    volatile int mEvictions;
+
+    static uint32_t hash(const jchar* sql, size_t length);
+
+    Entry* find(const jchar* sql, size_t length, uint32_t hash) const;
+    void erase(Entry* entry);
+    bool evictOne();
+    void finalize(sqlite3_stmt* statement);
+    void touch(Entry* entry);
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_STATEMENT_CACHE_H
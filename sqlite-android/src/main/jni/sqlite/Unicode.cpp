@@ -0,0 +1,267 @@
+#include "Unicode.h"
+
+#include <string.h>
+
+namespace android {
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// ---- UTF-8 ----
+
+size_t unicode_decode_utf8(const uint8_t* s, const uint8_t* end, uint32_t* codePoint) {
+    uint8_t lead = s[0];
+    size_t length;
+    uint32_t c;
+    if (lead < 0x80) {
+        *codePoint = lead;
+        return 1;
+    } else if ((lead & 0xE0) == 0xC0) {
+        length = 2;
+        c = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        c = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4;
+        c = lead & 0x07;
+    } else {
+        *codePoint = UNICODE_INVALID;
+        return 1;
+    }
+    if (size_t(end - s) < length) {
+        *codePoint = UNICODE_INVALID;
+        return 1;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *codePoint = UNICODE_INVALID;
+            return 1;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    *codePoint = c;
+    return length;
+}
+
+void unicode_encode_utf8(std::string& out, uint32_t c) {
+    if (c < 0x80) {
+        out += char(c);
+    } else if (c < 0x800) {
+        out += char(0xC0 | (c >> 6));
+        out += char(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out += char(0xE0 | (c >> 12));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
+    } else {
+        out += char(0xF0 | (c >> 18));
+        out += char(0x80 | ((c >> 12) & 0x3F));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
+    }
+}
+
+// ---- Case mapping ----
+
+// Upper case letters first..last, every stride code points, whose lower case is
+// delta code points further.
+struct CaseRange {
+    uint32_t first;
+    uint32_t last;
+    uint32_t delta;
+    uint32_t stride;
+};
+
+static const CaseRange CASE_RANGES[] = {
+    { 0x0041, 0x005A, 32, 1 },      // Basic Latin
+    { 0x00C0, 0x00D6, 32, 1 },      // Latin-1 Supplement
+    { 0x00D8, 0x00DE, 32, 1 },
+    { 0x0100, 0x012F, 1, 2 },       // Latin Extended-A
+    { 0x0132, 0x0137, 1, 2 },
+    { 0x0139, 0x0148, 1, 2 },
+    { 0x014A, 0x0177, 1, 2 },
+    { 0x0179, 0x017E, 1, 2 },
+    { 0x01CD, 0x01DC, 1, 2 },       // Latin Extended-B
+    { 0x01DE, 0x01EF, 1, 2 },
+    { 0x01F8, 0x021F, 1, 2 },
+    { 0x0222, 0x0233, 1, 2 },
+    { 0x0246, 0x024F, 1, 2 },
+    { 0x0370, 0x0373, 1, 2 },       // Greek
+    { 0x0391, 0x03A1, 32, 1 },
+    { 0x03A3, 0x03AB, 32, 1 },
+    { 0x03D8, 0x03EF, 1, 2 },
+    { 0x0400, 0x040F, 80, 1 },      // Cyrillic
+    { 0x0410, 0x042F, 32, 1 },
+    { 0x0460, 0x0481, 1, 2 },
+    { 0x048A, 0x04BF, 1, 2 },
+    { 0x04C1, 0x04CE, 1, 2 },
+    { 0x04D0, 0x052F, 1, 2 },
+    { 0x0531, 0x0556, 48, 1 },      // Armenian
+    { 0x10A0, 0x10C5, 7264, 1 },    // Georgian
+    { 0x1E00, 0x1E95, 1, 2 },       // Latin Extended Additional
+    { 0x1EA0, 0x1EFF, 1, 2 },
+    { 0x2160, 0x216F, 16, 1 },      // Roman numerals
+    { 0x24B6, 0x24CF, 26, 1 },      // Circled letters
+    { 0x2C00, 0x2C2E, 48, 1 },      // Glagolitic
+    { 0xFF21, 0xFF3A, 32, 1 },      // Fullwidth Latin
+    { 0x10400, 0x10427, 40, 1 },    // Deseret
+};
+
+struct CasePair {
+    uint32_t upper;
+    uint32_t lower;
+};
+
+// Letters which map to each other outside of the ranges.
+static const CasePair CASE_PAIRS[] = {
+    { 0x0178, 0x00FF }, { 0x0181, 0x0253 }, { 0x0186, 0x0254 }, { 0x0187, 0x0188 },
+    { 0x018B, 0x018C }, { 0x018F, 0x0259 }, { 0x0190, 0x025B }, { 0x0191, 0x0192 },
+    { 0x0193, 0x0260 }, { 0x0194, 0x0263 }, { 0x0196, 0x0269 }, { 0x0197, 0x0268 },
+    { 0x0198, 0x0199 }, { 0x019C, 0x026F }, { 0x019D, 0x0272 }, { 0x01A0, 0x01A1 },
+    { 0x01A2, 0x01A3 }, { 0x01A4, 0x01A5 }, { 0x01A7, 0x01A8 }, { 0x01A9, 0x0283 },
+    { 0x01AC, 0x01AD }, { 0x01AF, 0x01B0 }, { 0x01B1, 0x028A }, { 0x01B2, 0x028B },
+    { 0x01B3, 0x01B4 }, { 0x01B5, 0x01B6 }, { 0x01B7, 0x0292 }, { 0x01B8, 0x01B9 },
+    { 0x01BC, 0x01BD }, { 0x01C4, 0x01C6 }, { 0x01C7, 0x01C9 }, { 0x01CA, 0x01CC },
+    { 0x01F1, 0x01F3 }, { 0x01F4, 0x01F5 }, { 0x0386, 0x03AC }, { 0x0388, 0x03AD },
+    { 0x0389, 0x03AE }, { 0x038A, 0x03AF }, { 0x038C, 0x03CC }, { 0x038E, 0x03CD },
+    { 0x038F, 0x03CE }, { 0x04C0, 0x04CF },
+};
+
+// Letters whose lower case does not map back.
+static const CasePair LOWER_ONLY[] = {
+    { 0x0130, 0x0069 }, { 0x01C5, 0x01C6 }, { 0x01C8, 0x01C9 }, { 0x01CB, 0x01CC },
+    { 0x01F2, 0x01F3 }, { 0x1E9E, 0x00DF },
+};
+
+// Letters whose upper case does not map back.
+static const CasePair UPPER_ONLY[] = {
+    { 0x039C, 0x00B5 }, { 0x0049, 0x0131 }, { 0x0053, 0x017F }, { 0x03A3, 0x03C2 },
+    { 0x01C4, 0x01C5 }, { 0x01C7, 0x01C8 }, { 0x01CA, 0x01CB }, { 0x01F1, 0x01F2 },
+};
+
+uint32_t unicode_to_lower(uint32_t c) {
+    if (c < 0x80) {
+        return c >= 'A' && c <= 'Z' ? c + 32 : c;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(LOWER_ONLY); i++) {
+        if (LOWER_ONLY[i].upper == c) return LOWER_ONLY[i].lower;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(CASE_PAIRS); i++) {
+        if (CASE_PAIRS[i].upper == c) return CASE_PAIRS[i].lower;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(CASE_RANGES); i++) {
+        const CaseRange& range = CASE_RANGES[i];
+        if (c >= range.first && c <= range.last && (c - range.first) % range.stride == 0) {
+            return c + range.delta;
+        }
+    }
+    return c;
+}
+
+uint32_t unicode_to_upper(uint32_t c) {
+    if (c < 0x80) {
+        return c >= 'a' && c <= 'z' ? c - 32 : c;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(UPPER_ONLY); i++) {
+        if (UPPER_ONLY[i].lower == c) return UPPER_ONLY[i].upper;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(CASE_PAIRS); i++) {
+        if (CASE_PAIRS[i].lower == c) return CASE_PAIRS[i].upper;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(CASE_RANGES); i++) {
+        const CaseRange& range = CASE_RANGES[i];
+        uint32_t first = range.first + range.delta;
+        if (c >= first && c <= range.last + range.delta && (c - first) % range.stride == 0) {
+            return c - range.delta;
+        }
+    }
+    return c;
+}
+
+// ---- Base letters ----
+
+// Base letters of the code points of a block, where '.' keeps the code point and '*'
+// is replaced by a string from UNACCENT_STRINGS.
+struct UnaccentBlock {
+    uint32_t first;
+    const char* letters;
+};
+
+static const UnaccentBlock UNACCENT_BLOCKS[] = {
+    { 0x00C0, "AAAAAA*CEEEEIIII" "DNOOOOO.OUUUUY**" "aaaaaa*ceeeeiiii" "dnooooo.ouuuuy*y" },
+    { 0x0100, "AaAaAaCcCcCcCcDd" "DdEeEeEeEeEeGgGg" "GgGgHhHhIiIiIiIi" "Ii**JjKkkLlLlLlL"
+              "lLlNnNnNn*NnOoOo" "Oo**RrRrRrSsSsSs" "SsTtTtTtUuUuUuUu" "UuUuWwYyYZzZzZzs" },
+    { 0x01CD, "AaIiOoUuUuUuUuUu" },
+    { 0x1E00, "Aa" "BbBbBb" "Cc" "DdDdDdDdDd" "EeEeEeEeEe" "Ff" "Gg" "HhHhHhHhHh" "IiIi"
+              "KkKkKk" "LlLlLlLl" "MmMmMm" "NnNnNnNn" "OoOoOoOo" "PpPp" "RrRrRrRr"
+              "SsSsSsSsSs" "TtTtTtTt" "UuUuUuUuUu" "VvVv" "WwWwWwWwWw" "XxXx" "Yy"
+              "ZzZzZz" "htwyas" },
+    { 0x1EA0, "AaAaAaAaAaAaAaAaAaAaAaAa" "EeEeEeEeEeEeEeEe" "IiIi"
+              "OoOoOoOoOoOoOoOoOoOoOoOo" "UuUuUuUuUuUuUu" "YyYyYyYy" },
+};
+
+struct UnaccentString {
+    uint32_t codePoint;
+    const char* replacement;
+};
+
+static const UnaccentString UNACCENT_STRINGS[] = {
+    { 0x00C6, "AE" }, { 0x00DE, "TH" }, { 0x00DF, "ss" }, { 0x00E6, "ae" },
+    { 0x00FE, "th" }, { 0x0132, "IJ" }, { 0x0133, "ij" }, { 0x0149, "'n" },
+    { 0x0152, "OE" }, { 0x0153, "oe" },
+};
+
+// Single code point replacements outside of the blocks.
+static const CasePair UNACCENT_PAIRS[] = {
+    { 0x01A0, 'O' }, { 0x01A1, 'o' }, { 0x01AF, 'U' }, { 0x01B0, 'u' },
+    { 0x0386, 0x0391 }, { 0x0388, 0x0395 }, { 0x0389, 0x0397 }, { 0x038A, 0x0399 },
+    { 0x038C, 0x039F }, { 0x038E, 0x03A5 }, { 0x038F, 0x03A9 }, { 0x0390, 0x03B9 },
+    { 0x03AA, 0x0399 }, { 0x03AB, 0x03A5 }, { 0x03AC, 0x03B1 }, { 0x03AD, 0x03B5 },
+    { 0x03AE, 0x03B7 }, { 0x03AF, 0x03B9 }, { 0x03B0, 0x03C5 }, { 0x03CA, 0x03B9 },
+    { 0x03CB, 0x03C5 }, { 0x03CC, 0x03BF }, { 0x03CD, 0x03C5 }, { 0x03CE, 0x03C9 },
+    { 0x0401, 0x0415 }, { 0x0419, 0x0418 }, { 0x0439, 0x0438 }, { 0x0451, 0x0435 },
+};
+
+size_t unicode_base_letters(uint32_t c, uint32_t* out) {
+    if (c < 0xC0) {
+        out[0] = c;
+        return 1;
+    }
+    if (c >= 0x0300 && c <= 0x036F) {
+        // Combining diacritical marks.
+        return 0;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(UNACCENT_BLOCKS); i++) {
+        const UnaccentBlock& block = UNACCENT_BLOCKS[i];
+        if (c >= block.first && c - block.first < strlen(block.letters)) {
+            char letter = block.letters[c - block.first];
+            if (letter == '*') {
+                for (size_t j = 0; j < ARRAY_SIZE(UNACCENT_STRINGS); j++) {
+                    if (UNACCENT_STRINGS[j].codePoint == c) {
+                        const char* replacement = UNACCENT_STRINGS[j].replacement;
+                        size_t count = 0;
+                        while (replacement[count]) {
+                            out[count] = uint8_t(replacement[count]);
+                            count++;
+                        }
+                        return count;
+                    }
+                }
+            } else if (letter != '.') {
+                out[0] = uint8_t(letter);
+                return 1;
+            }
+            break;
+        }
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(UNACCENT_PAIRS); i++) {
+        if (UNACCENT_PAIRS[i].upper == c) {
+            out[0] = UNACCENT_PAIRS[i].lower;
+            return 1;
+        }
+    }
+    out[0] = c;
+    return 1;
+}
+
+} // namespace android
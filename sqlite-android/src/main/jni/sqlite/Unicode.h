@@ -0,0 +1,34 @@
+#ifndef _ANDROID__DATABASE_UNICODE_H
+#define _ANDROID__DATABASE_UNICODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace android {
+
+/* Returned by unicode_decode_utf8 for bytes which do not start a valid sequence. */
+static const uint32_t UNICODE_INVALID = 0xFFFFFFFF;
+
+/* The most code points unicode_base_letters writes. */
+static const size_t UNICODE_MAX_BASE_LETTERS = 2;
+
+/* Decodes the code point starting at s, before end, and returns its length in bytes. */
+size_t unicode_decode_utf8(const uint8_t* s, const uint8_t* end, uint32_t* codePoint);
+
+void unicode_encode_utf8(std::string& out, uint32_t c);
+
+/* Simple case mapping of the Latin, Greek, Cyrillic and Armenian scripts and a few
+ * other bicameral blocks. Other code points are returned unchanged. */
+uint32_t unicode_to_lower(uint32_t c);
+uint32_t unicode_to_upper(uint32_t c);
+
+/* Writes the letters of c without accents to out, and returns their count: c itself if
+ * it has no accents or is not a letter, up to UNICODE_MAX_BASE_LETTERS for ligatures
+ * like U+00C6, and 0 for combining marks. */
+size_t unicode_base_letters(uint32_t c, uint32_t* out);
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_UNICODE_H
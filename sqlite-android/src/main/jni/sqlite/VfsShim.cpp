@@ -0,0 +1,244 @@
+#include "VfsShim.h"
+
+#include <stddef.h>
+
+namespace android {
+
+static sqlite3_file* toReal(sqlite3_file* file) {
+    return reinterpret_cast<VfsShimFile*>(file)->real;
+}
+
+static int shimClose(sqlite3_file* file) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xClose(real);
+}
+
+static int shimRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xRead(real, buffer, amount, offset);
+}
+
+static int shimWrite(sqlite3_file* file, const void* buffer, int amount,
+        sqlite3_int64 offset) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xWrite(real, buffer, amount, offset);
+}
+
+static int shimTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xTruncate(real, size);
+}
+
+static int shimSync(sqlite3_file* file, int flags) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xSync(real, flags);
+}
+
+static int shimFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xFileSize(real, size);
+}
+
+static int shimLock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xLock(real, lock);
+}
+
+static int shimUnlock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xUnlock(real, lock);
+}
+
+static int shimCheckReservedLock(sqlite3_file* file, int* result) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xCheckReservedLock(real, result);
+}
+
+static int shimFileControl(sqlite3_file* file, int op, void* arg) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xFileControl(real, op, arg);
+}
+
+static int shimSectorSize(sqlite3_file* file) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xSectorSize(real);
+}
+
+static int shimDeviceCharacteristics(sqlite3_file* file) {
+    sqlite3_file* real = toReal(file);
+    return real->pMethods->xDeviceCharacteristics(real);
+}
+
+static int shimShmMap(sqlite3_file* file, int region, int regionSize, int extend,
+        void volatile** pp) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR_SHMMAP;
+    }
+    return real->pMethods->xShmMap(real, region, regionSize, extend, pp);
+}
+
+static int shimShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR_SHMLOCK;
+    }
+    return real->pMethods->xShmLock(real, offset, n, flags);
+}
+
+static void shimShmBarrier(sqlite3_file* file) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion >= 2) {
+        real->pMethods->xShmBarrier(real);
+    }
+}
+
+static int shimShmUnmap(sqlite3_file* file, int deleteFlag) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_OK;
+    }
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+static int shimFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** pp) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion < 3) {
+        *pp = NULL;
+        return SQLITE_OK;
+    }
+    return real->pMethods->xFetch(real, offset, amount, pp);
+}
+
+static int shimUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+    sqlite3_file* real = toReal(file);
+    if (real->pMethods->iVersion < 3) {
+        return SQLITE_OK;
+    }
+    return real->pMethods->xUnfetch(real, offset, page);
+}
+
+static int shimDelete(sqlite3_vfs* vfs, const char* name, int syncDir) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xDelete(root, name, syncDir);
+}
+
+static int shimAccess(sqlite3_vfs* vfs, const char* name, int flags, int* result) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xAccess(root, name, flags, result);
+}
+
+static int shimFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xFullPathname(root, name, size, out);
+}
+
+static void* shimDlOpen(sqlite3_vfs* vfs, const char* path) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xDlOpen(root, path);
+}
+
+static void shimDlError(sqlite3_vfs* vfs, int size, char* message) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    root->xDlError(root, size, message);
+}
+
+static void (*shimDlSym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xDlSym(root, handle, symbol);
+}
+
+static void shimDlClose(sqlite3_vfs* vfs, void* handle) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    root->xDlClose(root, handle);
+}
+
+static int shimRandomness(sqlite3_vfs* vfs, int size, char* out) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xRandomness(root, size, out);
+}
+
+static int shimSleep(sqlite3_vfs* vfs, int microseconds) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xSleep(root, microseconds);
+}
+
+static int shimCurrentTime(sqlite3_vfs* vfs, double* now) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xCurrentTime(root, now);
+}
+
+static int shimGetLastError(sqlite3_vfs* vfs, int size, char* message) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xGetLastError(root, size, message);
+}
+
+static int shimCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* now) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xCurrentTimeInt64(root, now);
+}
+
+static int shimSetSystemCall(sqlite3_vfs* vfs, const char* name, sqlite3_syscall_ptr call) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xSetSystemCall(root, name, call);
+}
+
+static sqlite3_syscall_ptr shimGetSystemCall(sqlite3_vfs* vfs, const char* name) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xGetSystemCall(root, name);
+}
+
+static const char* shimNextSystemCall(sqlite3_vfs* vfs, const char* name) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    return root->xNextSystemCall(root, name);
+}
+
+void VfsShim::init(sqlite3_vfs* vfs, sqlite3_vfs* root, const char* name, int fileSize,
+        OpenFunction open) {
+    vfs->iVersion = root->iVersion < 3 ? root->iVersion : 3;
+    vfs->szOsFile = fileSize + root->szOsFile;
+    vfs->mxPathname = root->mxPathname;
+    vfs->pNext = NULL;
+    vfs->zName = name;
+    vfs->pAppData = root;
+    vfs->xOpen = open;
+    vfs->xDelete = shimDelete;
+    vfs->xAccess = shimAccess;
+    vfs->xFullPathname = shimFullPathname;
+    vfs->xDlOpen = shimDlOpen;
+    vfs->xDlError = shimDlError;
+    vfs->xDlSym = shimDlSym;
+    vfs->xDlClose = shimDlClose;
+    vfs->xRandomness = shimRandomness;
+    vfs->xSleep = shimSleep;
+    vfs->xCurrentTime = shimCurrentTime;
+    vfs->xGetLastError = shimGetLastError;
+    vfs->xCurrentTimeInt64 = vfs->iVersion >= 2 ? shimCurrentTimeInt64 : NULL;
+    vfs->xSetSystemCall = vfs->iVersion >= 3 ? shimSetSystemCall : NULL;
+    vfs->xGetSystemCall = vfs->iVersion >= 3 ? shimGetSystemCall : NULL;
+    vfs->xNextSystemCall = vfs->iVersion >= 3 ? shimNextSystemCall : NULL;
+}
+
+void VfsShim::initIoMethods(sqlite3_io_methods* methods) {
+    methods->iVersion = 3;
+    methods->xClose = shimClose;
+    methods->xRead = shimRead;
+    methods->xWrite = shimWrite;
+    methods->xTruncate = shimTruncate;
+    methods->xSync = shimSync;
+    methods->xFileSize = shimFileSize;
+    methods->xLock = shimLock;
+    methods->xUnlock = shimUnlock;
+    methods->xCheckReservedLock = shimCheckReservedLock;
+    methods->xFileControl = shimFileControl;
+    methods->xSectorSize = shimSectorSize;
+    methods->xDeviceCharacteristics = shimDeviceCharacteristics;
+    methods->xShmMap = shimShmMap;
+    methods->xShmLock = shimShmLock;
+    methods->xShmBarrier = shimShmBarrier;
+    methods->xShmUnmap = shimShmUnmap;
+    methods->xFetch = shimFetch;
+    methods->xUnfetch = shimUnfetch;
+}
+
+} // namespace android
@@ -0,0 +1,43 @@
+#ifndef _ANDROID__DATABASE_VFS_SHIM_H
+#define _ANDROID__DATABASE_VFS_SHIM_H
+
+#include "sqlite3.h"
+
+namespace android {
+
+/**
+ * The start of the file struct of a shim that opens its files through another VFS.
+ */
+struct VfsShimFile {
+    sqlite3_file base;
+    // The file of the wrapped VFS, allocated right after the file struct of the shim.
+    sqlite3_file* real;
+};
+
+/**
+ * Helpers for VFS shims, which open their files through another VFS and pass on the
+ * calls they do not change.
+ */
+class VfsShim {
+public:
+    typedef int (*OpenFunction)(sqlite3_vfs* vfs, const char* name, sqlite3_file* file,
+            int flags, int* outFlags);
+
+    /* Fills in vfs to pass every call but xOpen to root, which is kept in pAppData.
+     * fileSize is the size of the file struct of the shim, which is followed by the file
+     * of root. */
+    static void init(sqlite3_vfs* vfs, sqlite3_vfs* root, const char* name, int fileSize,
+            OpenFunction open);
+
+    /* Fills in methods to pass every call on to the real file of a VfsShimFile. Shims
+     * then replace the calls they change. */
+    static void initIoMethods(sqlite3_io_methods* methods);
+
+    static sqlite3_vfs* root(sqlite3_vfs* vfs) {
+        return static_cast<sqlite3_vfs*>(vfs->pAppData);
+    }
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_VFS_SHIM_H
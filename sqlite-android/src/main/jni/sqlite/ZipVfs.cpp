@@ -0,0 +1,462 @@
+#undef LOG_TAG
+#define LOG_TAG "ZipVfs"
+
+#include "ZipVfs.h"
+#include "ALog-priv.h"
+#include "VfsShim.h"
+
+#include "sqlite3.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+
+static const char* const VFS_NAME = "android-zip";
+// Separates the path of the archive from the name of the entry.
+static const char* const ENTRY_SEPARATOR = "!/";
+
+static const uint32_t EOCD_SIGNATURE = 0x06054b50;
+static const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+static const uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+static const uint32_t CENTRAL_SIGNATURE = 0x02014b50;
+static const uint32_t LOCAL_SIGNATURE = 0x04034b50;
+static const int EOCD_SIZE = 22;
+static const int ZIP64_LOCATOR_SIZE = 20;
+static const int ZIP64_EOCD_SIZE = 56;
+static const int CENTRAL_SIZE = 46;
+static const int LOCAL_SIZE = 30;
+static const int MAX_COMMENT = 65535;
+static const uint16_t ZIP64_EXTRA_ID = 0x0001;
+static const uint16_t METHOD_STORED = 0;
+static const uint16_t FLAG_ENCRYPTED = 0x0001;
+
+struct ZipFile {
+    sqlite3_file base;
+    int fd;
+    // Where the entry starts in the archive, and its size.
+    int64_t dataOffset;
+    int64_t size;
+    // The largest size that may be mapped, as set by PRAGMA mmap_size.
+    int64_t mmapLimit;
+    // The mapping of the start of the entry, from the page that holds its first byte.
+    void* mapping;
+    size_t mappingLength;
+    const char* mapped;
+    int64_t mappedSize;
+};
+
+static sqlite3_vfs gVfs;
+static bool gInitialized;
+
+static ZipFile* toZipFile(sqlite3_file* file) {
+    return reinterpret_cast<ZipFile*>(file);
+}
+
+static uint16_t read16(const uint8_t* p) {
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+static uint32_t read32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static uint64_t read64(const uint8_t* p) {
+    return uint64_t(read32(p)) | uint64_t(read32(p + 4)) << 32;
+}
+
+// Reads exactly length bytes at offset. Returns false on errors and at the end of file.
+static bool readFully(int fd, void* buffer, size_t length, int64_t offset) {
+    char* out = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t got = pread(fd, out, length, off_t(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        out += got;
+        length -= size_t(got);
+        offset += got;
+    }
+    return true;
+}
+
+struct CentralDirectory {
+    int64_t offset;
+    int64_t size;
+    int64_t entries;
+};
+
+// Finds the central directory from the end of central directory record at the end of
+// the archive, and from its ZIP64 counterpart when the archive needs one.
+static bool findCentralDirectory(int fd, int64_t archiveSize, CentralDirectory* directory) {
+    int64_t tailLength = archiveSize < EOCD_SIZE + MAX_COMMENT
+            ? archiveSize : EOCD_SIZE + MAX_COMMENT;
+    if (tailLength < EOCD_SIZE) {
+        return false;
+    }
+    std::vector<uint8_t> tail(tailLength);
+    int64_t tailOffset = archiveSize - tailLength;
+    if (!readFully(fd, &tail[0], size_t(tailLength), tailOffset)) {
+        return false;
+    }
+
+    // The record ends the archive, followed only by a comment of the length it holds.
+    for (int64_t i = tailLength - EOCD_SIZE; i >= 0; i--) {
+        const uint8_t* record = &tail[i];
+        if (read32(record) != EOCD_SIGNATURE
+                || i + EOCD_SIZE + read16(record + 20) != tailLength) {
+            continue;
+        }
+        directory->entries = read16(record + 10);
+        directory->size = read32(record + 12);
+        directory->offset = read32(record + 16);
+        if (directory->entries != 0xffff && directory->offset != 0xffffffff) {
+            return true;
+        }
+
+        int64_t locatorOffset = tailOffset + i - ZIP64_LOCATOR_SIZE;
+        uint8_t locator[ZIP64_LOCATOR_SIZE];
+        uint8_t zip64[ZIP64_EOCD_SIZE];
+        if (locatorOffset < 0
+                || !readFully(fd, locator, sizeof(locator), locatorOffset)
+                || read32(locator) != ZIP64_LOCATOR_SIGNATURE
+                || !readFully(fd, zip64, sizeof(zip64), int64_t(read64(locator + 8)))
+                || read32(zip64) != ZIP64_EOCD_SIGNATURE) {
+            return false;
+        }
+        directory->entries = int64_t(read64(zip64 + 32));
+        directory->size = int64_t(read64(zip64 + 40));
+        directory->offset = int64_t(read64(zip64 + 48));
+        return true;
+    }
+    return false;
+}
+
+// Finds where the data of the named entry starts and its size. Returns SQLITE_OK, or
+// SQLITE_CANTOPEN if the archive has no such entry or it cannot be read in place.
+static int findEntry(int fd, const char* archive, const char* name, int64_t* dataOffset,
+        int64_t* size) {
+    struct stat st;
+    CentralDirectory directory;
+    if (fstat(fd, &st) != 0 || !findCentralDirectory(fd, st.st_size, &directory)
+            || directory.offset < 0 || directory.size < 0
+            || directory.offset + directory.size > st.st_size) {
+        ALOGE("Not a ZIP archive: %s", archive);
+        return SQLITE_CANTOPEN;
+    }
+    std::vector<uint8_t> central(size_t(directory.size) + 1);
+    if (directory.size > 0
+            && !readFully(fd, &central[0], size_t(directory.size), directory.offset)) {
+        return SQLITE_IOERR_READ;
+    }
+
+    size_t nameLength = strlen(name);
+    size_t pos = 0;
+    for (int64_t i = 0; i < directory.entries; i++) {
+        if (pos + CENTRAL_SIZE > size_t(directory.size)) {
+            break;
+        }
+        const uint8_t* header = &central[pos];
+        if (read32(header) != CENTRAL_SIGNATURE) {
+            break;
+        }
+        uint16_t flags = read16(header + 8);
+        uint16_t method = read16(header + 10);
+        uint64_t compressedSize = read32(header + 20);
+        uint64_t uncompressedSize = read32(header + 24);
+        size_t entryNameLength = read16(header + 28);
+        size_t extraLength = read16(header + 30);
+        size_t commentLength = read16(header + 32);
+        uint64_t localOffset = read32(header + 42);
+        size_t next = pos + CENTRAL_SIZE + entryNameLength + extraLength + commentLength;
+        if (next > size_t(directory.size)) {
+            break;
+        }
+        if (entryNameLength != nameLength
+                || memcmp(header + CENTRAL_SIZE, name, nameLength) != 0) {
+            pos = next;
+            continue;
+        }
+
+        // Sizes and offsets too large for their fields are in the ZIP64 extra field, in
+        // this order, for those fields that are saturated.
+        const uint8_t* extra = header + CENTRAL_SIZE + entryNameLength;
+        for (size_t at = 0; at + 4 <= extraLength;) {
+            uint16_t id = read16(extra + at);
+            size_t length = read16(extra + at + 2);
+            if (at + 4 + length > extraLength) {
+                break;
+            }
+            if (id == ZIP64_EXTRA_ID) {
+                const uint8_t* field = extra + at + 4;
+                const uint8_t* end = field + length;
+                if (uncompressedSize == 0xffffffff && field + 8 <= end) {
+                    uncompressedSize = read64(field);
+                    field += 8;
+                }
+                if (compressedSize == 0xffffffff && field + 8 <= end) {
+                    compressedSize = read64(field);
+                    field += 8;
+                }
+                if (localOffset == 0xffffffff && field + 8 <= end) {
+                    localOffset = read64(field);
+                }
+            }
+            at += 4 + length;
+        }
+
+        if (method != METHOD_STORED || (flags & FLAG_ENCRYPTED)
+                || compressedSize != uncompressedSize) {
+            ALOGE("%s!/%s is compressed or encrypted, it must be stored as it is",
+                    archive, name);
+            return SQLITE_CANTOPEN;
+        }
+        uint8_t local[LOCAL_SIZE];
+        if (!readFully(fd, local, sizeof(local), int64_t(localOffset))
+                || read32(local) != LOCAL_SIGNATURE) {
+            ALOGE("Bad local header of %s!/%s", archive, name);
+            return SQLITE_CANTOPEN;
+        }
+        *dataOffset = int64_t(localOffset) + LOCAL_SIZE + read16(local + 26)
+                + read16(local + 28);
+        *size = int64_t(uncompressedSize);
+        if (*dataOffset + *size > st.st_size) {
+            ALOGE("%s!/%s extends past the end of the archive", archive, name);
+            return SQLITE_CANTOPEN;
+        }
+        return SQLITE_OK;
+    }
+    ALOGE("No entry %s in %s", name, archive);
+    return SQLITE_CANTOPEN;
+}
+
+static int zipClose(sqlite3_file* file) {
+    ZipFile* p = toZipFile(file);
+    if (p->mapping) {
+        munmap(p->mapping, p->mappingLength);
+        p->mapping = NULL;
+    }
+    close(p->fd);
+    return SQLITE_OK;
+}
+
+static int zipRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    ZipFile* p = toZipFile(file);
+    int64_t available = offset < p->size ? p->size - offset : 0;
+    int length = available < amount ? int(available) : amount;
+    if (length > 0 && !readFully(p->fd, buffer, size_t(length), p->dataOffset + offset)) {
+        return SQLITE_IOERR_READ;
+    }
+    if (length < amount) {
+        memset(static_cast<char*>(buffer) + length, 0, size_t(amount - length));
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int zipWrite(sqlite3_file* file, const void* buffer, int amount,
+        sqlite3_int64 offset) {
+    return SQLITE_READONLY;
+}
+
+static int zipTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    return SQLITE_READONLY;
+}
+
+static int zipSync(sqlite3_file* file, int flags) {
+    return SQLITE_OK;
+}
+
+static int zipFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    *size = toZipFile(file)->size;
+    return SQLITE_OK;
+}
+
+// The file is immutable, so there is nothing to lock.
+static int zipLock(sqlite3_file* file, int lock) {
+    return SQLITE_OK;
+}
+
+static int zipUnlock(sqlite3_file* file, int lock) {
+    return SQLITE_OK;
+}
+
+static int zipCheckReservedLock(sqlite3_file* file, int* result) {
+    *result = 0;
+    return SQLITE_OK;
+}
+
+static int zipFileControl(sqlite3_file* file, int op, void* arg) {
+    ZipFile* p = toZipFile(file);
+    if (op == SQLITE_FCNTL_MMAP_SIZE) {
+        // A negative size only queries the current one.
+        int64_t* size = static_cast<int64_t*>(arg);
+        if (*size >= 0) {
+            p->mmapLimit = *size;
+        }
+        *size = p->mmapLimit;
+        return SQLITE_OK;
+    }
+    return SQLITE_NOTFOUND;
+}
+
+static int zipSectorSize(sqlite3_file* file) {
+    return 4096;
+}
+
+static int zipDeviceCharacteristics(sqlite3_file* file) {
+    return SQLITE_IOCAP_IMMUTABLE;
+}
+
+static int zipShmMap(sqlite3_file* file, int region, int regionSize, int extend,
+        void volatile** pp) {
+    return SQLITE_IOERR_SHMMAP;
+}
+
+static int zipShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    return SQLITE_IOERR_SHMLOCK;
+}
+
+static void zipShmBarrier(sqlite3_file* file) {
+}
+
+static int zipShmUnmap(sqlite3_file* file, int deleteFlag) {
+    return SQLITE_OK;
+}
+
+// Maps the entry up to the mmap size the first time a page is fetched. Pages past the
+// mapping are read instead, which returning no page always allows.
+static int zipFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** pp) {
+    ZipFile* p = toZipFile(file);
+    *pp = NULL;
+    if (!p->mapping && p->mmapLimit > 0 && p->size > 0) {
+        int64_t pageSize = sysconf(_SC_PAGESIZE);
+        int64_t start = p->dataOffset / pageSize * pageSize;
+        int64_t mappedSize = p->mmapLimit < p->size ? p->mmapLimit : p->size;
+        size_t length = size_t(p->dataOffset - start + mappedSize);
+        void* mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, p->fd, off_t(start));
+        if (mapping == MAP_FAILED) {
+            ALOGW("Could not map a database in an archive: %s", strerror(errno));
+            // Do not try again.
+            p->mmapLimit = 0;
+            return SQLITE_OK;
+        }
+        p->mapping = mapping;
+        p->mappingLength = length;
+        p->mapped = static_cast<const char*>(mapping) + (p->dataOffset - start);
+        p->mappedSize = mappedSize;
+    }
+    if (p->mapping && offset + amount <= p->mappedSize) {
+        *pp = const_cast<char*>(p->mapped + offset);
+    }
+    return SQLITE_OK;
+}
+
+static int zipUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+    return SQLITE_OK;
+}
+
+static const sqlite3_io_methods gIoMethods = {
+    3,
+    zipClose,
+    zipRead,
+    zipWrite,
+    zipTruncate,
+    zipSync,
+    zipFileSize,
+    zipLock,
+    zipUnlock,
+    zipCheckReservedLock,
+    zipFileControl,
+    zipSectorSize,
+    zipDeviceCharacteristics,
+    zipShmMap,
+    zipShmLock,
+    zipShmBarrier,
+    zipShmUnmap,
+    zipFetch,
+    zipUnfetch,
+};
+
+static int zipOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags,
+        int* outFlags) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    const char* separator = name ? strstr(name, ENTRY_SEPARATOR) : NULL;
+    if (!(flags & SQLITE_OPEN_MAIN_DB) || !separator) {
+        return root->xOpen(root, name, file, flags, outFlags);
+    }
+
+    ZipFile* p = toZipFile(file);
+    memset(p, 0, sizeof(ZipFile));
+    std::string archive(name, separator - name);
+    const char* entry = separator + strlen(ENTRY_SEPARATOR);
+    p->fd = open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (p->fd < 0) {
+        ALOGE("Could not open %s: %s", archive.c_str(), strerror(errno));
+        return SQLITE_CANTOPEN;
+    }
+    int err = findEntry(p->fd, archive.c_str(), entry, &p->dataOffset, &p->size);
+    if (err != SQLITE_OK) {
+        close(p->fd);
+        return err;
+    }
+
+    if (outFlags) {
+        *outFlags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE))
+                | SQLITE_OPEN_READONLY;
+    }
+    file->pMethods = &gIoMethods;
+    return SQLITE_OK;
+}
+
+// Only the path of the archive is made absolute, since the entry is not a file.
+static int zipFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out) {
+    sqlite3_vfs* root = VfsShim::root(vfs);
+    const char* separator = strstr(name, ENTRY_SEPARATOR);
+    if (!separator) {
+        return root->xFullPathname(root, name, size, out);
+    }
+    std::string archive(name, separator - name);
+    int err = root->xFullPathname(root, archive.c_str(), size, out);
+    if (err != SQLITE_OK) {
+        return err;
+    }
+    size_t length = strlen(out);
+    if (length + strlen(separator) >= size_t(size)) {
+        return SQLITE_CANTOPEN;
+    }
+    strcpy(out + length, separator);
+    return SQLITE_OK;
+}
+
+int ZipVfs::install() {
+    if (!gInitialized) {
+        sqlite3_vfs* root = sqlite3_vfs_find(NULL);
+        if (!root) {
+            ALOGE("No default VFS to wrap");
+            return SQLITE_ERROR;
+        }
+        VfsShim::init(&gVfs, root, VFS_NAME, int(sizeof(ZipFile)), zipOpen);
+        gVfs.xFullPathname = zipFullPathname;
+        gInitialized = true;
+    }
+
+    int err = sqlite3_vfs_register(&gVfs, 0);
+    if (err != SQLITE_OK) {
+        ALOGE("Could not register the ZIP VFS: %d", err);
+    }
+    return err;
+}
+
+} // namespace android
@@ -0,0 +1,26 @@
+#ifndef _ANDROID__DATABASE_ZIP_VFS_H
+#define _ANDROID__DATABASE_ZIP_VFS_H
+
+namespace android {
+
+/**
+ * Read-only VFS named "android-zip" that opens a database stored uncompressed in a ZIP
+ * archive, such as an asset of an APK, without extracting it.
+ *
+ * The database is named by the path of the archive, "!/" and the name of its entry, as
+ * in "/data/app/base.apk!/assets/prebuilt.db". The entry must be stored rather than
+ * deflated. Its pages are read with pread at the offset of the entry in the archive, or
+ * through a mapping of the entry once PRAGMA mmap_size allows it. The file reports
+ * itself as immutable, so SQLite neither locks it nor looks for a journal, just as with
+ * the immutable=1 URI parameter. Other names are passed to the default VFS.
+ */
+class ZipVfs {
+public:
+    /* Registers the VFS, without making it the default. Must be called again after
+     * SQLite was shut down, after IoStatsVfs::install. */
+    static int install();
+};
+
+} // namespace android
+
+#endif // _ANDROID__DATABASE_ZIP_VFS_H
@@ -36,6 +36,11 @@ static struct {
     jfieldID sizeCopied;
 } gCharArrayBufferClassInfo;
 
+static struct {
+    jclass clazz;
+    jmethodID ctor;
+} gBlobReferenceClassInfo;
+
 static jstring gEmptyString = NULL;
 
 static void throwExceptionWithRowCol(JNIEnv* env, jint row, jint column) {
@@ -121,7 +126,8 @@ static jint nativeGetType(JNIEnv* env, jclass clazz, jlong windowPtr,
     if (!fieldSlot) {
         return CursorWindow::FIELD_TYPE_NULL;
     }
-    return window->getFieldSlotType(fieldSlot);
+    int32_t type = window->getFieldSlotType(fieldSlot);
+    return type == CursorWindow::FIELD_TYPE_BLOB_REFERENCE ? CursorWindow::FIELD_TYPE_BLOB : type;
 }
 
 static jbyteArray nativeGetBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
@@ -153,12 +159,44 @@ static jbyteArray nativeGetBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
         throw_sqlite3_exception(env, "FLOAT data in nativeGetBlob ");
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
         // do nothing
+    } else if (type == CursorWindow::FIELD_TYPE_BLOB_REFERENCE) {
+        // The value is still in the database, the cursor reads it through the reference.
     } else {
         throwUnknownTypeException(env, type);
     }
     return NULL;
 }
 
+static jobject nativeGetBlobReference(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint row, jint column) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+
+    CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
+    if (!fieldSlot) {
+        throwExceptionWithRowCol(env, row, column);
+        return NULL;
+    }
+    if (window->getFieldSlotType(fieldSlot) != CursorWindow::FIELD_TYPE_BLOB_REFERENCE) {
+        return NULL;
+    }
+
+    const char* database;
+    const char* table;
+    const char* columnName;
+    int64_t rowId;
+    size_t size;
+    window->getFieldSlotValueBlobReference(fieldSlot, &database, &table, &columnName,
+            &rowId, &size);
+    jstring databaseStr = env->NewStringUTF(database);
+    jstring tableStr = env->NewStringUTF(table);
+    jstring columnNameStr = env->NewStringUTF(columnName);
+    if (!databaseStr || !tableStr || !columnNameStr) {
+        return NULL; // out of memory error already thrown
+    }
+    return env->NewObject(gBlobReferenceClassInfo.clazz, gBlobReferenceClassInfo.ctor,
+            databaseStr, tableStr, columnNameStr, jlong(rowId), jint(size));
+}
+
 extern int utf8ToJavaCharArray(const char* d, jchar v[], jint byteCount);
 
 static jstring nativeGetString(JNIEnv* env, jclass clazz, jlong windowPtr,
@@ -203,7 +241,8 @@ static jstring nativeGetString(JNIEnv* env, jclass clazz, jlong windowPtr,
         return env->NewStringUTF(buf);
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
         return NULL;
-    } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
+    } else if (type == CursorWindow::FIELD_TYPE_BLOB
+            || type == CursorWindow::FIELD_TYPE_BLOB_REFERENCE) {
         throw_sqlite3_exception(env, "Unable to convert BLOB to string");
         return NULL;
     } else {
@@ -234,7 +273,8 @@ static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
         return jlong(window->getFieldSlotValueDouble(fieldSlot));
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
         return 0;
-    } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
+    } else if (type == CursorWindow::FIELD_TYPE_BLOB
+            || type == CursorWindow::FIELD_TYPE_BLOB_REFERENCE) {
         throw_sqlite3_exception(env, "Unable to convert BLOB to long");
         return 0;
     } else {
@@ -265,7 +305,8 @@ static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
         return jdouble(window->getFieldSlotValueLong(fieldSlot));
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
         return 0.0;
-    } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
+    } else if (type == CursorWindow::FIELD_TYPE_BLOB
+            || type == CursorWindow::FIELD_TYPE_BLOB_REFERENCE) {
         throw_sqlite3_exception(env, "Unable to convert BLOB to double");
         return 0.0;
     } else {
@@ -379,6 +420,8 @@ static const JNINativeMethod sMethods[] =
             (void*)nativeGetType },
     { "nativeGetBlob", "(JII)[B",
             (void*)nativeGetBlob },
+    { "nativeGetBlobReference", "(JII)Lio/requery/android/database/CursorWindow$BlobReference;",
+            (void*)nativeGetBlobReference },
     { "nativeGetString", "(JII)Ljava/lang/String;",
             (void*)nativeGetString },
     { "nativeGetLong", "(JII)J",
@@ -405,6 +448,11 @@ int register_android_database_CursorWindow(JNIEnv* env)
     GET_FIELD_ID(gCharArrayBufferClassInfo.data, clazz, "data", "[C");
     GET_FIELD_ID(gCharArrayBufferClassInfo.sizeCopied, clazz, "sizeCopied", "I");
 
+    FIND_CLASS(clazz, "io/requery/android/database/CursorWindow$BlobReference");
+    gBlobReferenceClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+    GET_METHOD_ID(gBlobReferenceClassInfo.ctor, clazz, "<init>",
+            "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;JI)V");
+
     gEmptyString = static_cast<jstring>(env->NewGlobalRef(env->NewStringUTF("")));
     return jniRegisterNativeMethods(env,
     "io/requery/android/database/CursorWindow", sMethods, NELEM(sMethods));
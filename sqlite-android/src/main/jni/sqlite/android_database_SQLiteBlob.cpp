@@ -0,0 +1,254 @@
+#define LOG_TAG "SQLiteBlob"
+
+#include <jni.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sqlite3.h"
+#include "JNIHelp.h"
+#include "ALog-priv.h"
+#include "android_database_SQLiteCommon.h"
+
+namespace android {
+
+// Size of the bounce buffer used when copying between a blob and a file descriptor.
+static const int BLOB_TRANSFER_CHUNK_SIZE = 64 * 1024;
+
+/* Returns the address of the direct buffer at the given offset.
+ * If 0 is returned, an exception has been thrown to report the reason. */
+static uint8_t* toaddress(JNIEnv* env, jobject buffer, jint offset, jint count) {
+    uint8_t* address = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+    if (!address) {
+        throw_sqlite3_exception(env, "Blob buffer is not a direct buffer.");
+        return 0;
+    }
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (offset < 0 || count < 0 || jlong(offset) + count > capacity) {
+        throw_sqlite3_exception(env, "Blob buffer range is out of bounds.");
+        return 0;
+    }
+    return address + offset;
+}
+
+static void nativeClose(JNIEnv* env, jclass clazz, jlong blobPtr) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    // The handle is released even if an error is returned, for instance when committing
+    // the implicit transaction of a writable handle fails.
+    int err = sqlite3_blob_close(blob);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not close blob");
+    }
+}
+
+static void nativeReopen(JNIEnv* env, jclass clazz, jlong blobPtr, jlong rowId) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    int err = sqlite3_blob_reopen(blob, rowId);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not move blob to row");
+    }
+}
+
+static jint nativeGetLength(JNIEnv* env, jclass clazz, jlong blobPtr) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+    return sqlite3_blob_bytes(blob);
+}
+
+static void nativeRead(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jobject buffer, jint bufferOffset, jint count, jint blobOffset) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    uint8_t* address = toaddress(env, buffer, bufferOffset, count);
+    if (!address) return;
+
+    int err = sqlite3_blob_read(blob, address, count, blobOffset);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not read blob");
+    }
+}
+
+static void nativeWrite(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jobject buffer, jint bufferOffset, jint count, jint blobOffset) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    uint8_t* address = toaddress(env, buffer, bufferOffset, count);
+    if (!address) return;
+
+    int err = sqlite3_blob_write(blob, address, count, blobOffset);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not write blob");
+    }
+}
+
+static void nativeReadArray(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jbyteArray buffer, jint bufferOffset, jint count, jint blobOffset) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    // Reading can take a while when the blob spans overflow pages, so the array is not
+    // pinned; the bytes go through a bounce buffer instead.
+    int size = count < BLOB_TRANSFER_CHUNK_SIZE ? count : BLOB_TRANSFER_CHUNK_SIZE;
+    uint8_t* chunk = static_cast<uint8_t*>(malloc(size > 0 ? size : 1));
+    if (!chunk) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate transfer buffer");
+        return;
+    }
+
+    jint transferred = 0;
+    while (transferred < count) {
+        int length = count - transferred;
+        if (length > size) {
+            length = size;
+        }
+        int err = sqlite3_blob_read(blob, chunk, length, blobOffset + transferred);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception_errcode(env, err, "Could not read blob");
+            break;
+        }
+        env->SetByteArrayRegion(buffer, bufferOffset + transferred, length,
+                reinterpret_cast<const jbyte*>(chunk));
+        transferred += length;
+    }
+
+    free(chunk);
+}
+
+static void nativeWriteArray(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jbyteArray buffer, jint bufferOffset, jint count, jint blobOffset) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    int size = count < BLOB_TRANSFER_CHUNK_SIZE ? count : BLOB_TRANSFER_CHUNK_SIZE;
+    uint8_t* chunk = static_cast<uint8_t*>(malloc(size > 0 ? size : 1));
+    if (!chunk) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate transfer buffer");
+        return;
+    }
+
+    jint transferred = 0;
+    while (transferred < count) {
+        int length = count - transferred;
+        if (length > size) {
+            length = size;
+        }
+        env->GetByteArrayRegion(buffer, bufferOffset + transferred, length,
+                reinterpret_cast<jbyte*>(chunk));
+        int err = sqlite3_blob_write(blob, chunk, length, blobOffset + transferred);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception_errcode(env, err, "Could not write blob");
+            break;
+        }
+        transferred += length;
+    }
+
+    free(chunk);
+}
+
+static jint nativeReadToFileDescriptor(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jint fd, jint blobOffset, jint count) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    uint8_t* chunk = static_cast<uint8_t*>(malloc(BLOB_TRANSFER_CHUNK_SIZE));
+    if (!chunk) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate transfer buffer");
+        return 0;
+    }
+
+    jint transferred = 0;
+    while (transferred < count) {
+        int length = count - transferred;
+        if (length > BLOB_TRANSFER_CHUNK_SIZE) {
+            length = BLOB_TRANSFER_CHUNK_SIZE;
+        }
+        int err = sqlite3_blob_read(blob, chunk, length, blobOffset + transferred);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception_errcode(env, err, "Could not read blob");
+            break;
+        }
+        int written = 0;
+        while (written < length) {
+            ssize_t n = write(fd, chunk + written, length - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw_sqlite3_exception_errno(env, errno, "Could not write blob to file");
+                free(chunk);
+                return transferred + written;
+            }
+            written += n;
+        }
+        transferred += length;
+    }
+
+    free(chunk);
+    return transferred;
+}
+
+static jint nativeWriteFromFileDescriptor(JNIEnv* env, jclass clazz, jlong blobPtr,
+        jint fd, jint blobOffset, jint count) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    uint8_t* chunk = static_cast<uint8_t*>(malloc(BLOB_TRANSFER_CHUNK_SIZE));
+    if (!chunk) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate transfer buffer");
+        return 0;
+    }
+
+    jint transferred = 0;
+    while (transferred < count) {
+        int length = count - transferred;
+        if (length > BLOB_TRANSFER_CHUNK_SIZE) {
+            length = BLOB_TRANSFER_CHUNK_SIZE;
+        }
+        ssize_t n = read(fd, chunk, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_sqlite3_exception_errno(env, errno, "Could not read file into blob");
+            break;
+        }
+        if (n == 0) {
+            // End of file, the rest of the blob is left untouched.
+            break;
+        }
+        int err = sqlite3_blob_write(blob, chunk, int(n), blobOffset + transferred);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception_errcode(env, err, "Could not write blob");
+            break;
+        }
+        transferred += n;
+    }
+
+    free(chunk);
+    return transferred;
+}
+
+static const JNINativeMethod sMethods[] =
+{
+    /* name, signature, funcPtr */
+    { "nativeClose", "(J)V",
+            (void*)nativeClose },
+    { "nativeReopen", "(JJ)V",
+            (void*)nativeReopen },
+    { "nativeGetLength", "(J)I",
+            (void*)nativeGetLength },
+    { "nativeRead", "(JLjava/nio/ByteBuffer;III)V",
+            (void*)nativeRead },
+    { "nativeWrite", "(JLjava/nio/ByteBuffer;III)V",
+            (void*)nativeWrite },
+    { "nativeReadArray", "(J[BIII)V",
+            (void*)nativeReadArray },
+    { "nativeWriteArray", "(J[BIII)V",
+            (void*)nativeWriteArray },
+    { "nativeReadToFileDescriptor", "(JIII)I",
+            (void*)nativeReadToFileDescriptor },
+    { "nativeWriteFromFileDescriptor", "(JIII)I",
+            (void*)nativeWriteFromFileDescriptor },
+};
+
+int register_android_database_SQLiteBlob(JNIEnv* env)
+{
+    return jniRegisterNativeMethods(env,
+        "io/requery/android/database/sqlite/SQLiteBlob", sMethods, NELEM(sMethods));
+}
+
+} // namespace android
@@ -0,0 +1,60 @@
+#define LOG_TAG "SQLiteCheckpointer"
+
+#include <jni.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+#include "JNIHelp.h"
+#include "ALog-priv.h"
+#include "android_database_SQLiteCommon.h"
+#include "Checkpointer.h"
+
+namespace android {
+
+static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jstring vfsNameStr,
+        jint passiveFrames, jint restartFrames, jint truncateFrames, jint idleMillis) {
+    const char* path = env->GetStringUTFChars(pathStr, NULL);
+    const char* vfsName = vfsNameStr ? env->GetStringUTFChars(vfsNameStr, NULL) : NULL;
+    Checkpointer* checkpointer = new Checkpointer(path, vfsName, passiveFrames, restartFrames,
+            truncateFrames, idleMillis);
+    if (vfsName) {
+        env->ReleaseStringUTFChars(vfsNameStr, vfsName);
+    }
+    env->ReleaseStringUTFChars(pathStr, path);
+    return reinterpret_cast<jlong>(checkpointer);
+}
+
+static void nativeRelease(JNIEnv* env, jclass clazz, jlong checkpointerPtr) {
+    Checkpointer* checkpointer = reinterpret_cast<Checkpointer*>(checkpointerPtr);
+    checkpointer->release();
+}
+
+static void nativeGetStats(JNIEnv* env, jclass clazz, jlong checkpointerPtr,
+        jlongArray statsArray) {
+    Checkpointer* checkpointer = reinterpret_cast<Checkpointer*>(checkpointerPtr);
+
+    // Order matches the STAT_* indices in SQLiteCheckpointer.java.
+    int64_t stats[Checkpointer::STAT_COUNT];
+    checkpointer->getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, Checkpointer::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static JNINativeMethod sMethods[] =
+{
+    /* name, signature, funcPtr */
+    { "nativeOpen", "(Ljava/lang/String;Ljava/lang/String;IIII)J",
+            (void*)nativeOpen },
+    { "nativeRelease", "(J)V",
+            (void*)nativeRelease },
+    { "nativeGetStats", "(J[J)V",
+            (void*)nativeGetStats },
+};
+
+int register_android_database_SQLiteCheckpointer(JNIEnv* env)
+{
+    return jniRegisterNativeMethods(env,
+        "io/requery/android/database/sqlite/SQLiteCheckpointer", sMethods, NELEM(sMethods));
+}
+
+} // namespace android
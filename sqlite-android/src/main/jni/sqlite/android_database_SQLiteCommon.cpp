@@ -15,10 +15,55 @@
  */
 // modified from original source see README at the top level of this project
 
+#undef LOG_TAG
+#define LOG_TAG "SQLiteCommon"
+
 #include "android_database_SQLiteCommon.h"
+#include "ALog-priv.h"
+
+#include <pthread.h>
+#include <string.h>
 
 namespace android {
 
+static JavaVM* gpJavaVM = NULL;
+
+// Detaches threads attached by getJNIEnv when they exit.
+static pthread_key_t gDetachKey;
+
+// The env of the calling thread, once getJNIEnv has been called on it.
+static __thread JNIEnv* gThreadEnv = NULL;
+
+static void detachThread(void* vm) {
+    static_cast<JavaVM*>(vm)->DetachCurrentThread();
+}
+
+void setJavaVM(JavaVM* vm) {
+    gpJavaVM = vm;
+    pthread_key_create(&gDetachKey, detachThread);
+}
+
+JNIEnv* getJNIEnv() {
+    JNIEnv* env = gThreadEnv;
+    if (env) {
+        return env;
+    }
+
+    if (gpJavaVM->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_4) != JNI_OK) {
+        JavaVMAttachArgs args;
+        args.version = JNI_VERSION_1_4;
+        args.name = "SQLiteWorker";
+        args.group = NULL;
+        if (gpJavaVM->AttachCurrentThread(&env, &args) != JNI_OK) {
+            ALOGE("Failed to attach thread to the VM");
+            return NULL;
+        }
+        pthread_setspecific(gDetachKey, gpJavaVM);
+    }
+    gThreadEnv = env;
+    return env;
+}
+
 /* throw a SQLiteException with a message appropriate for the error in handle */
 void throw_sqlite3_exception(JNIEnv* env, sqlite3* handle) {
     throw_sqlite3_exception(env, handle, NULL);
@@ -54,6 +99,10 @@ void throw_sqlite3_exception_errcode(JNIEnv* env, int errcode, const char* messa
     throw_sqlite3_exception(env, errcode, "unknown error", message);
 }
 
+void throw_sqlite3_exception_errno(JNIEnv* env, int errnum, const char* message) {
+    throw_sqlite3_exception(env, SQLITE_IOERR, strerror(errnum), message);
+}
+
 /* throw a SQLiteException for a given error code, sqlite3message, and
    user message
  */
@@ -44,9 +44,21 @@ void throw_sqlite3_exception(JNIEnv* env, sqlite3* handle, const char* message);
 /* throw a SQLiteException for a given error code */
 void throw_sqlite3_exception_errcode(JNIEnv* env, int errcode, const char* message);
 
+/* throw a SQLiteDiskIOException for a failed system call, with the description of errnum */
+void throw_sqlite3_exception_errno(JNIEnv* env, int errnum, const char* message);
+
 void throw_sqlite3_exception(JNIEnv* env, int errcode,
         const char* sqlite3Message, const char* message);
 
+/* set the VM whose JNIEnv getJNIEnv returns, called once from JNI_OnLoad */
+void setJavaVM(JavaVM* vm);
+
+/* return the JNIEnv of the calling thread, which is cached per thread. Threads not
+   started by the VM, such as SQLite worker threads, are attached on first use and
+   detached when they exit. Returns NULL if the thread cannot be attached.
+ */
+JNIEnv* getJNIEnv();
+
 }
 
 #endif // _ANDROID_DATABASE_SQLITE_COMMON_H
@@ -18,18 +18,32 @@
 #define LOG_TAG "SQLiteConnection"
 
 #include <jni.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <ctype.h>
+#include <strings.h>
 
 #include "sqlite3.h"
 #include "JNIHelp.h"
 #include "ALog-priv.h"
 #include "android_database_SQLiteCommon.h"
 #include "CursorWindow.h"
+#include "StatementCache.h"
+#include "FunctionResultCache.h"
+#include "NativeFunctions.h"
+#include "LocalizedCollator.h"
+#include "MemoryGovernor.h"
+#include "Checkpointer.h"
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 // Set to 1 to use UTF16 storage for localized indexes.
 #define UTF16_STORAGE 0
@@ -50,7 +64,12 @@ namespace android {
  */
 static const int BUSY_TIMEOUT_MS = 2500;
 
-static JavaVM *gpJavaVM = 0;
+// The size the SQL scratch buffer of a connection is brought back to after a longer
+// statement.
+static const size_t SCRATCH_KEEP_BYTES = 16 * 1024;
+
+// Reported by functions called on a thread that cannot be attached to the VM.
+static const char* NO_JNI_ENV_ERROR = "Function called on a thread without a JNIEnv";
 
 static struct {
     jfieldID name;
@@ -62,13 +81,74 @@ static struct {
     jfieldID name;
     jfieldID numArgs;
     jfieldID flags;
-    jmethodID dispatchCallback;
+    jfieldID cacheSize;
+    jfieldID cacheStats;
+    jmethodID newInvocation;
 } gSQLiteFunctionClassInfo;
 
+static struct {
+    jmethodID dispatch;
+} gSQLiteFunctionInvocationClassInfo;
+
+static struct {
+    jfieldID name;
+    jfieldID numArgs;
+    jfieldID flags;
+    jfieldID window;
+    jmethodID newInvocation;
+} gSQLiteAggregateFunctionClassInfo;
+
+static struct {
+    jmethodID newAggregate;
+    jmethodID step;
+    jmethodID result;
+} gSQLiteAggregateFunctionInvocationClassInfo;
+
 static struct {
     jclass clazz;
 } gStringClassInfo;
 
+static struct {
+    jfieldID statementPtr;
+    jfieldID numParameters;
+    jfieldID type;
+    jfieldID readOnly;
+} gPreparedStatementClassInfo;
+
+// What a schema was deserialized from when SQLite reads it in place, which must be kept
+// until the schema is replaced or the connection is closed.
+struct DeserializedImage {
+    std::string schema;
+    // Global reference to the direct buffer holding the image, or NULL.
+    jobject buffer;
+    // Mapping of the file holding the image, or NULL.
+    void* mapping;
+    size_t length;
+};
+
+// Where the values of a result column are stored, so that large blobs can be left in
+// the database and referenced from the window instead.
+struct BlobColumnOrigin {
+    bool eligible;
+    std::string database;
+    std::string table;
+    std::string column;
+    // The result column holding the rowid of the same table.
+    int rowIdColumn;
+
+    BlobColumnOrigin() : eligible(false), rowIdColumn(-1) { }
+};
+
+// The origins of the result columns of a statement, resolved the first time one of its
+// blobs exceeds the lazy blob threshold and kept until the statement is recompiled.
+struct BlobColumnOrigins {
+    // The number of times the statement had been recompiled when they were resolved.
+    int reprepareCount;
+    std::vector<BlobColumnOrigin> columns;
+
+    BlobColumnOrigins() : reprepareCount(0) { }
+};
+
 struct SQLiteConnection {
     sqlite3* const db;
     const int openFlags;
@@ -77,10 +157,45 @@ struct SQLiteConnection {
 
     volatile bool canceled;
 
+    // Reusable buffer that SQL text is transcoded into before it is compiled.
+    std::string scratch;
+
+    // Statements kept prepared between executions, sized by the Java configuration.
+    StatementCache statementCache;
+
+    // The state of the memory governor last applied to the connection.
+    uint32_t memoryGeneration;
+
+    // Images of schemas deserialized without copying them.
+    std::vector<DeserializedImage> images;
+
+    // The background checkpointer whose WAL hook is installed, if any.
+    Checkpointer* checkpointer;
+
+    // The blob column origins of the statements read with lazy blobs, by statement. They
+    // are forgotten when the statement is finalized, as SQLite may reuse its address.
+    std::unordered_map<sqlite3_stmt*, BlobColumnOrigins> blobOrigins;
+
     SQLiteConnection(sqlite3* db, int openFlags, const std::string& path, const std::string& label) :
-        db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
+        db(db), openFlags(openFlags), path(path), label(label), canceled(false),
+        memoryGeneration(0), checkpointer(NULL) {
+        statementCache.setFinalizeListener(&forgetStatement, this);
+    }
+
+    // Finalizes a statement which is not held by the statement cache.
+    void finalize(sqlite3_stmt* statement) {
+        blobOrigins.erase(statement);
+        sqlite3_finalize(statement);
+    }
+
+    static void forgetStatement(void* data, sqlite3_stmt* statement) {
+        static_cast<SQLiteConnection*>(data)->blobOrigins.erase(statement);
+    }
 };
 
+extern size_t javaCharArrayUtf8Length(const jchar* v, jsize count);
+extern size_t javaCharArrayToUtf8(const jchar* v, jsize count, char* d);
+
 // Called each time a statement begins execution, when tracing is enabled.
 static void sqliteTraceCallback(void *data, const char *sql) {
     SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
@@ -101,33 +216,33 @@ static int sqliteProgressHandlerCallback(void* data) {
     return connection->canceled;
 }
 
-/*
-** This function is a collation sequence callback equivalent to the built-in
-** BINARY sequence. 
-**
-** Stock Android uses a modified version of sqlite3.c that calls out to a module
-** named "sqlite3_android" to add extra built-in collations and functions to
-** all database handles. Specifically, collation sequence "LOCALIZED". For now,
-** this module does not include sqlite3_android (since it is difficult to build
-** with the NDK only). Instead, this function is registered as "LOCALIZED" for all
-** new database handles. 
-*/
-static int coll_localized(
-  void *not_used,
-  int nKey1, const void *pKey1,
-  int nKey2, const void *pKey2
-){
-  int rc, n;
-  n = nKey1<nKey2 ? nKey1 : nKey2;
-  rc = memcmp(pKey1, pKey2, n);
-  if( rc==0 ){
-    rc = nKey1 - nKey2;
-  }
-  return rc;
+// Registers the groups of native functions named in the array. Throws and returns false
+// if a group does not exist or cannot be registered.
+static bool registerNativeFunctions(JNIEnv* env, sqlite3* db, jobjectArray groups) {
+    jsize count = env->GetArrayLength(groups);
+    for (jsize i = 0; i < count; i++) {
+        jstring groupStr = static_cast<jstring>(env->GetObjectArrayElement(groups, i));
+        const char* group = env->GetStringUTFChars(groupStr, NULL);
+        int err = register_native_functions(db, group);
+        if (err == SQLITE_NOTFOUND) {
+            char message[128];
+            snprintf(message, sizeof(message), "Unknown native functions '%s'", group);
+            jniThrowException(env, "java/lang/IllegalArgumentException", message);
+        } else if (err != SQLITE_OK) {
+            throw_sqlite3_exception(env, db, "Could not register native functions");
+        }
+        env->ReleaseStringUTFChars(groupStr, group);
+        env->DeleteLocalRef(groupStr);
+        if (err != SQLITE_OK) {
+            return false;
+        }
+    }
+    return true;
 }
 
 static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFlags,
-        jstring labelStr, jboolean enableTrace, jboolean enableProfile) {
+        jstring labelStr, jstring vfsNameStr, jboolean enableTrace, jboolean enableProfile,
+        jobjectArray nativeFunctions, jint lookasideSlotSize, jint lookasideSlotCount) {
 
     const char* pathChars = env->GetStringUTFChars(pathStr, NULL);
     std::string path(pathChars);
@@ -137,13 +252,36 @@ static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFla
     std::string label(labelChars);
     env->ReleaseStringUTFChars(labelStr, labelChars);
 
+    // A null VFS name selects the default VFS.
+    std::string vfsName;
+    if (vfsNameStr) {
+        const char* vfsNameChars = env->GetStringUTFChars(vfsNameStr, NULL);
+        vfsName = vfsNameChars;
+        env->ReleaseStringUTFChars(vfsNameStr, vfsNameChars);
+    }
+
     sqlite3* db;
-    int err = sqlite3_open_v2(path.c_str(), &db, openFlags, NULL);
+    int err = sqlite3_open_v2(path.c_str(), &db, openFlags,
+            vfsNameStr ? vfsName.c_str() : NULL);
     if (err != SQLITE_OK) {
         throw_sqlite3_exception_errcode(env, err, "Could not open database");
         return 0;
     }
-    err = sqlite3_create_collation(db, "localized", SQLITE_UTF8, 0, coll_localized);
+
+    // The lookaside can only be changed before the connection has used any of it.
+    if (lookasideSlotSize >= 0 && lookasideSlotCount >= 0) {
+        err = sqlite3_db_config(db, SQLITE_DBCONFIG_LOOKASIDE, NULL,
+                lookasideSlotSize, lookasideSlotCount);
+        if (err != SQLITE_OK) {
+            ALOGE("sqlite3_db_config(..., %d, %d) failed: %d", lookasideSlotSize,
+                    lookasideSlotCount, err);
+            throw_sqlite3_exception(env, db, "Could not configure the lookaside");
+            sqlite3_close(db);
+            return 0;
+        }
+    }
+    // Until the locale of the connection is set, LOCALIZED uses the root collation order.
+    err = LocalizedCollator::registerCollation(db, "");
     if (err != SQLITE_OK) {
         throw_sqlite3_exception_errcode(env, err, "Could not register collation");
         sqlite3_close(db);
@@ -165,6 +303,12 @@ static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFla
         return 0;
     }
 
+    // Register the requested built-in functions before the database is used.
+    if (!registerNativeFunctions(env, db, nativeFunctions)) {
+        sqlite3_close(db);
+        return 0;
+    }
+
     // Register custom Android functions.
 #if 0
     err = register_android_functions(db, UTF16_STORAGE);
@@ -190,11 +334,21 @@ static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFla
     return reinterpret_cast<jlong>(connection);
 }
 
+static void releaseImage(JNIEnv* env, const DeserializedImage& image) {
+    if (image.buffer) {
+        env->DeleteGlobalRef(image.buffer);
+    }
+    if (image.mapping) {
+        munmap(image.mapping, image.length);
+    }
+}
+
 static void nativeClose(JNIEnv* env, jclass clazz, jlong connectionPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
     if (connection) {
         ALOGV("Closing connection %p", connection->db);
+        connection->statementCache.clear();
         int err = sqlite3_close(connection->db);
         if (err != SQLITE_OK) {
             // This can happen if sub-objects aren't closed first.  Make sure the caller knows.
@@ -203,6 +357,13 @@ static void nativeClose(JNIEnv* env, jclass clazz, jlong connectionPtr) {
             return;
         }
 
+        // Images are only released once SQLite no longer reads them.
+        for (size_t i = 0; i < connection->images.size(); i++) {
+            releaseImage(env, connection->images[i]);
+        }
+        if (connection->checkpointer) {
+            connection->checkpointer->release();
+        }
         delete connection;
     }
 }
@@ -211,8 +372,11 @@ static void nativeClose(JNIEnv* env, jclass clazz, jlong connectionPtr) {
 static void sqliteCustomFunctionCallback(sqlite3_context *context,
         int argc, sqlite3_value **argv) {
 
-    JNIEnv* env = 0;
-    gpJavaVM->GetEnv((void**)&env, JNI_VERSION_1_4);
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        sqlite3_result_error(context, NO_JNI_ENV_ERROR, -1);
+        return;
+    }
 
     // Get the callback function object.
     // Create a new local reference to it in case the callback tries to do something
@@ -223,10 +387,9 @@ static void sqliteCustomFunctionCallback(sqlite3_context *context,
     jobjectArray argsArray = env->NewObjectArray(argc, gStringClassInfo.clazz, NULL);
     if (argsArray) {
         for (int i = 0; i < argc; i++) {
+            // NULL arguments are passed as null elements.
             const jchar* arg = static_cast<const jchar*>(sqlite3_value_text16(argv[i]));
-            if (!arg) {
-                ALOGW("NULL argument in custom_function_callback.  This should not happen.");
-            } else {
+            if (arg) {
                 size_t argLen = sqlite3_value_bytes16(argv[i]) / sizeof(jchar);
                 jstring argStr = env->NewString(arg, argLen);
                 if (!argStr) {
@@ -246,9 +409,14 @@ static void sqliteCustomFunctionCallback(sqlite3_context *context,
                 sqlite3_result_null(context);
             } else {
                 jstring str = static_cast<jstring>(result);
-                const char* chars = env->GetStringUTFChars(str, NULL);
-                sqlite3_result_text(context, chars, -1, SQLITE_TRANSIENT);
-                env->ReleaseStringUTFChars(str, chars);
+                jsize len = env->GetStringLength(str);
+                const jchar* chars = env->GetStringChars(str, NULL);
+                if (chars) {
+                    sqlite3_result_text16(context, chars, len * sizeof(jchar), SQLITE_TRANSIENT);
+                    env->ReleaseStringChars(str, chars);
+                } else {
+                    sqlite3_result_error_nomem(context);
+                }
             }
             env->DeleteLocalRef(result);
         }
@@ -265,34 +433,233 @@ error:
     }
 }
 
+// Layout of the buffer shared with SQLiteFunction.Invocation, in native byte order. A
+// header holding the result is followed by one slot per argument. Both store a field
+// type at offset 0 and, for numbers, the value at offset 8.
+static const size_t FUNCTION_HEADER_SIZE = 16;
+static const size_t FUNCTION_SLOT_SIZE = 16;
+static const size_t FUNCTION_VALUE_OFFSET = 8;
+
+// Result type left in the header when the result was set through a native call.
+static const int32_t FUNCTION_RESULT_SET = -1;
+
+// Number of argument slots allocated up front for functions taking any number of arguments.
+static const int FUNCTION_VARIADIC_SLOTS = 8;
+
+// State of a typed function registered on a connection.
+struct SQLiteFunctionContext {
+    // Global reference to the SQLiteFunction.Invocation that dispatches calls.
+    jobject invocation;
+    // Global reference to a direct ByteBuffer over values.
+    jobject buffer;
+    uint8_t* values;
+    int capacity;
+    bool busy;
+    // Results of a memoized function, NULL otherwise.
+    FunctionResultCache* cache;
+    // Global reference to the direct ByteBuffer holding the cache counters.
+    jobject cacheStats;
+
+    SQLiteFunctionContext() :
+            invocation(NULL), buffer(NULL), values(NULL), capacity(0), busy(false),
+            cache(NULL), cacheStats(NULL) { }
+};
+
+/* Allocates an argument buffer with the given number of slots.
+ * Returns a local reference to it, or NULL if out of memory. */
+static jobject newFunctionBuffer(JNIEnv* env, int slots, uint8_t** outValues) {
+    size_t size = FUNCTION_HEADER_SIZE + size_t(slots) * FUNCTION_SLOT_SIZE;
+    uint8_t* values = static_cast<uint8_t*>(malloc(size));
+    if (!values) {
+        return NULL;
+    }
+    jobject buffer = env->NewDirectByteBuffer(values, size);
+    if (!buffer) {
+        free(values);
+        return NULL;
+    }
+    *outValues = values;
+    return buffer;
+}
+
+static bool resizeFunctionBuffer(JNIEnv* env, SQLiteFunctionContext* function, int slots) {
+    uint8_t* values;
+    jobject buffer = newFunctionBuffer(env, slots, &values);
+    if (!buffer) {
+        return false;
+    }
+    if (function->buffer) {
+        env->DeleteGlobalRef(function->buffer);
+    }
+    free(function->values);
+    function->buffer = env->NewGlobalRef(buffer);
+    function->values = values;
+    function->capacity = slots;
+    env->DeleteLocalRef(buffer);
+    return true;
+}
+
+// Stores the type of every argument and the value of numeric ones into consecutive slots,
+// so that the callback can read them without calling back into native code or creating
+// strings.
+static void putFunctionArgs(uint8_t* slot, int argc, sqlite3_value** argv) {
+    for (int i = 0; i < argc; i++, slot += FUNCTION_SLOT_SIZE) {
+        int32_t type;
+        switch (sqlite3_value_type(argv[i])) {
+            case SQLITE_INTEGER: {
+                type = CursorWindow::FIELD_TYPE_INTEGER;
+                int64_t value = sqlite3_value_int64(argv[i]);
+                memcpy(slot + FUNCTION_VALUE_OFFSET, &value, sizeof(value));
+                break;
+            }
+            case SQLITE_FLOAT: {
+                type = CursorWindow::FIELD_TYPE_FLOAT;
+                double value = sqlite3_value_double(argv[i]);
+                memcpy(slot + FUNCTION_VALUE_OFFSET, &value, sizeof(value));
+                break;
+            }
+            case SQLITE_TEXT:
+                type = CursorWindow::FIELD_TYPE_STRING;
+                break;
+            case SQLITE_BLOB:
+                type = CursorWindow::FIELD_TYPE_BLOB;
+                break;
+            default:
+                type = CursorWindow::FIELD_TYPE_NULL;
+                break;
+        }
+        memcpy(slot, &type, sizeof(type));
+    }
+}
+
+// Sets the numeric or NULL result stored in the header, and caches it if a cache is given.
+static void setFunctionResult(sqlite3_context* context, const uint8_t* values,
+        FunctionResultCache* cache = NULL) {
+    int32_t type;
+    memcpy(&type, values, sizeof(type));
+    int64_t value;
+    memcpy(&value, values + FUNCTION_VALUE_OFFSET, sizeof(value));
+    switch (type) {
+        case CursorWindow::FIELD_TYPE_INTEGER:
+            sqlite3_result_int64(context, value);
+            if (cache) cache->put(SQLITE_INTEGER, value, NULL, 0);
+            break;
+        case CursorWindow::FIELD_TYPE_FLOAT: {
+            double number;
+            memcpy(&number, &value, sizeof(number));
+            sqlite3_result_double(context, number);
+            if (cache) cache->put(SQLITE_FLOAT, value, NULL, 0);
+            break;
+        }
+        case CursorWindow::FIELD_TYPE_NULL:
+            sqlite3_result_null(context);
+            if (cache) cache->put(SQLITE_NULL, 0, NULL, 0);
+            break;
+        default:
+            // Strings, blobs and errors are set by the callback through native calls.
+            break;
+    }
+}
+
+// Sets a string or blob result which a memoized function returned from dispatch, so
+// that it can be cached.
+static void setFunctionObjectResult(JNIEnv* env, sqlite3_context* context,
+        const uint8_t* values, jobject result, FunctionResultCache* cache) {
+    int32_t type;
+    memcpy(&type, values, sizeof(type));
+    if (type == CursorWindow::FIELD_TYPE_STRING) {
+        jstring str = static_cast<jstring>(result);
+        jsize len = env->GetStringLength(str);
+        const jchar* chars = env->GetStringChars(str, NULL);
+        if (!chars) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        sqlite3_result_text16(context, chars, len * sizeof(jchar), SQLITE_TRANSIENT);
+        if (cache) cache->put(SQLITE_TEXT, 0, chars, len * sizeof(jchar));
+        env->ReleaseStringChars(str, chars);
+    } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
+        jbyteArray array = static_cast<jbyteArray>(result);
+        jsize len = env->GetArrayLength(array);
+        void* bytes = env->GetPrimitiveArrayCritical(array, NULL);
+        if (!bytes) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        sqlite3_result_blob(context, bytes, len, SQLITE_TRANSIENT);
+        if (cache) cache->put(SQLITE_BLOB, 0, bytes, len);
+        env->ReleasePrimitiveArrayCritical(array, bytes, JNI_ABORT);
+    }
+}
+
 // Called each time a Function is evaluated.
 static void sqliteFunctionCallback(sqlite3_context *context,
                                    int argc, sqlite3_value **argv) {
 
-    JNIEnv* env = 0;
-    gpJavaVM->GetEnv((void**)&env, JNI_VERSION_1_4);
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        sqlite3_result_error(context, NO_JNI_ENV_ERROR, -1);
+        return;
+    }
 
-    // Get the callback function object.
-    // Create a new local reference to it in case the callback tries to do something
-    // dumb like unregister the function (thereby destroying the global ref) while it is running.
-    jobject functionObjGlobal = reinterpret_cast<jobject>(sqlite3_user_data(context));
-    jobject functionObj = env->NewLocalRef(functionObjGlobal);
+    SQLiteFunctionContext* function =
+            reinterpret_cast<SQLiteFunctionContext*>(sqlite3_user_data(context));
+
+    bool nested = function->busy;
+    // Recursive calls bypass the cache, whose key belongs to the outer call.
+    FunctionResultCache* cache = nested ? NULL : function->cache;
+    if (cache) {
+        if (!cache->setKey(argc, argv)) {
+            cache = NULL;
+        } else if (cache->lookup(context)) {
+            return;
+        }
+    }
 
-    jlong contextPtr = jlong(context);
-    jlong argsPtr = jlong(argv);
-    jint argsCount = jint(argc);
+    jobject buffer;
+    uint8_t* values;
+    if (nested) {
+        // The function ran a query that calls it again, so the shared buffer is in use.
+        buffer = newFunctionBuffer(env, argc, &values);
+    } else if (argc <= function->capacity || resizeFunctionBuffer(env, function, argc)) {
+        buffer = env->NewLocalRef(function->buffer);
+        values = function->values;
+    } else {
+        buffer = NULL;
+    }
+    if (!buffer) {
+        env->ExceptionClear();
+        sqlite3_result_error_nomem(context);
+        return;
+    }
 
-    env->CallVoidMethod(functionObj,
-            gSQLiteFunctionClassInfo.dispatchCallback,
-            contextPtr,
-            argsPtr,
-            argsCount
+    putFunctionArgs(values + FUNCTION_HEADER_SIZE, argc, argv);
+    memcpy(values, &FUNCTION_RESULT_SET, sizeof(FUNCTION_RESULT_SET));
+
+    function->busy = true;
+    // Memoized functions return string and blob results instead of setting them.
+    jobject result = env->CallObjectMethod(function->invocation,
+            gSQLiteFunctionInvocationClassInfo.dispatch,
+            jlong(context),
+            jlong(argv),
+            jint(argc),
+            buffer
     );
+    function->busy = nested;
+
     if (env->ExceptionCheck()) {
         sqlite3_result_error(context, "Custom function exception", -1);
+    } else if (result) {
+        setFunctionObjectResult(env, context, values, result, cache);
+    } else {
+        setFunctionResult(context, values, cache);
     }
 
-    env->DeleteLocalRef(functionObj);
+    env->DeleteLocalRef(result);
+    env->DeleteLocalRef(buffer);
+    if (nested) {
+        free(values);
+    }
 
     if (env->ExceptionCheck()) {
         ALOGE("An exception was thrown by custom SQLite function.");
@@ -301,14 +668,292 @@ static void sqliteFunctionCallback(sqlite3_context *context,
     }
 }
 
+// Number of rows whose arguments are collected before they are delivered to an aggregate.
+static const int AGGREGATE_BATCH_ROWS = 256;
+
+// Rows are delivered early once the copies of their text and blob arguments take this
+// many bytes.
+static const size_t AGGREGATE_BATCH_BYTES = 256 * 1024;
+
+// Number of rows an aggregate's buffer holds at first. It doubles until it holds a batch.
+static const int AGGREGATE_INITIAL_ROWS = 8;
+
+// State of one aggregate, kept in the memory SQLite allocates for it, which starts out
+// zeroed. Rows of the same kind are buffered until the batch is full, a row of the other
+// kind arrives or the value is needed.
+struct AggregateState {
+    // Global reference to the Java aggregate, NULL until rows are first delivered.
+    jobject aggregate;
+    // Argument slots in the FUNCTION_SLOT_SIZE layout, after a FUNCTION_HEADER_SIZE header.
+    uint8_t* values;
+    // Copies of the text and blob arguments of the buffered rows, NULL for other types.
+    sqlite3_value** copies;
+    int capacity;
+    int rows;
+    int argc;
+    bool inverse;
+    size_t bytes;
+};
+
+static void releaseAggregateCopies(AggregateState* state) {
+    int count = state->rows * state->argc;
+    for (int i = 0; i < count; i++) {
+        if (state->copies[i]) {
+            sqlite3_value_free(state->copies[i]);
+            state->copies[i] = NULL;
+        }
+    }
+    state->rows = 0;
+    state->bytes = 0;
+}
+
+static void reportAggregateException(JNIEnv* env, sqlite3_context* context) {
+    sqlite3_result_error(context, "Custom aggregate exception", -1);
+    ALOGE("An exception was thrown by custom SQLite aggregate.");
+    env->ExceptionClear();
+}
+
+static bool newAggregate(JNIEnv* env, sqlite3_context* context, AggregateState* state) {
+    jobject invocation = reinterpret_cast<jobject>(sqlite3_user_data(context));
+    jobject aggregate = env->CallObjectMethod(invocation,
+            gSQLiteAggregateFunctionInvocationClassInfo.newAggregate);
+    if (env->ExceptionCheck()) {
+        reportAggregateException(env, context);
+        return false;
+    }
+    state->aggregate = env->NewGlobalRef(aggregate);
+    env->DeleteLocalRef(aggregate);
+    return true;
+}
+
+// Delivers the buffered rows to the aggregate with a single call.
+static bool flushAggregateRows(JNIEnv* env, sqlite3_context* context, AggregateState* state) {
+    if (!state->rows) {
+        return true;
+    }
+    if (!state->aggregate && !newAggregate(env, context, state)) {
+        releaseAggregateCopies(state);
+        return false;
+    }
+
+    jobject invocation = reinterpret_cast<jobject>(sqlite3_user_data(context));
+    size_t size = FUNCTION_HEADER_SIZE + size_t(state->rows) * state->argc * FUNCTION_SLOT_SIZE;
+    jobject buffer = env->NewDirectByteBuffer(state->values, size);
+    if (buffer) {
+        env->CallVoidMethod(invocation, gSQLiteAggregateFunctionInvocationClassInfo.step,
+                state->aggregate,
+                jboolean(state->inverse),
+                buffer,
+                jlong(state->copies),
+                jint(state->argc),
+                jint(state->rows)
+        );
+        env->DeleteLocalRef(buffer);
+    }
+    releaseAggregateCopies(state);
+
+    if (!buffer || env->ExceptionCheck()) {
+        reportAggregateException(env, context);
+        return false;
+    }
+    return true;
+}
+
+static bool growAggregateState(AggregateState* state) {
+    int capacity = state->capacity ? state->capacity * 2 : AGGREGATE_INITIAL_ROWS;
+    size_t slots = size_t(capacity) * state->argc;
+    uint8_t* values = static_cast<uint8_t*>(
+            realloc(state->values, FUNCTION_HEADER_SIZE + slots * FUNCTION_SLOT_SIZE));
+    if (!values) {
+        return false;
+    }
+    state->values = values;
+    sqlite3_value** copies = static_cast<sqlite3_value**>(
+            realloc(state->copies, slots * sizeof(sqlite3_value*)));
+    if (!copies) {
+        return false;
+    }
+    state->copies = copies;
+    state->capacity = capacity;
+    return true;
+}
+
+static void bufferAggregateRow(sqlite3_context* context, int argc, sqlite3_value** argv,
+        bool inverse) {
+    AggregateState* state = static_cast<AggregateState*>(
+            sqlite3_aggregate_context(context, sizeof(AggregateState)));
+    if (!state) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        sqlite3_result_error(context, NO_JNI_ENV_ERROR, -1);
+        return;
+    }
+
+    if (state->rows && state->inverse != inverse
+            && !flushAggregateRows(env, context, state)) {
+        return;
+    }
+    if (!state->values) {
+        state->argc = argc;
+    }
+    if (state->rows == state->capacity && !growAggregateState(state)) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    state->inverse = inverse;
+    size_t first = size_t(state->rows) * argc;
+    putFunctionArgs(state->values + FUNCTION_HEADER_SIZE + first * FUNCTION_SLOT_SIZE,
+            argc, argv);
+    sqlite3_value** copies = state->copies + first;
+    for (int i = 0; i < argc; i++) {
+        int type = sqlite3_value_type(argv[i]);
+        if (type == SQLITE_TEXT || type == SQLITE_BLOB) {
+            // The values only live until this call returns.
+            copies[i] = sqlite3_value_dup(argv[i]);
+            if (!copies[i]) {
+                for (int j = 0; j < i; j++) {
+                    sqlite3_value_free(copies[j]);
+                }
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+            state->bytes += sqlite3_value_bytes(copies[i]);
+        } else {
+            copies[i] = NULL;
+        }
+    }
+    state->rows += 1;
+
+    if (state->rows >= AGGREGATE_BATCH_ROWS || state->bytes >= AGGREGATE_BATCH_BYTES) {
+        flushAggregateRows(env, context, state);
+    }
+}
+
+// Delivers the pending rows and asks the aggregate for its value. The final value is
+// requested with a fresh aggregate if no rows were seen.
+static void deliverAggregateResult(JNIEnv* env, sqlite3_context* context,
+        AggregateState* state, bool final) {
+    if (!flushAggregateRows(env, context, state)) {
+        return;
+    }
+    if (!state->aggregate && !newAggregate(env, context, state)) {
+        return;
+    }
+
+    uint8_t header[FUNCTION_HEADER_SIZE];
+    memcpy(header, &FUNCTION_RESULT_SET, sizeof(FUNCTION_RESULT_SET));
+    jobject buffer = env->NewDirectByteBuffer(header, sizeof(header));
+    if (!buffer) {
+        env->ExceptionClear();
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    jobject invocation = reinterpret_cast<jobject>(sqlite3_user_data(context));
+    env->CallVoidMethod(invocation, gSQLiteAggregateFunctionInvocationClassInfo.result,
+            state->aggregate,
+            jboolean(final),
+            jlong(context),
+            buffer
+    );
+    env->DeleteLocalRef(buffer);
+
+    if (env->ExceptionCheck()) {
+        reportAggregateException(env, context);
+    } else {
+        setFunctionResult(context, header);
+    }
+}
+
+// Called for each row added to an aggregate or window function.
+static void sqliteAggregateStep(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    bufferAggregateRow(context, argc, argv, false);
+}
+
+// Called for each row leaving the frame of a window function.
+static void sqliteAggregateInverse(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    bufferAggregateRow(context, argc, argv, true);
+}
+
+// Called when the current value of a window function is needed.
+static void sqliteAggregateValue(sqlite3_context* context) {
+    AggregateState* state = static_cast<AggregateState*>(
+            sqlite3_aggregate_context(context, sizeof(AggregateState)));
+    if (!state) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        sqlite3_result_error(context, NO_JNI_ENV_ERROR, -1);
+        return;
+    }
+    deliverAggregateResult(env, context, state, false);
+}
+
+// Called once per aggregate, also when the statement is reset before the last row.
+static void sqliteAggregateFinal(sqlite3_context* context) {
+    AggregateState empty;
+    memset(&empty, 0, sizeof(empty));
+    AggregateState* state = static_cast<AggregateState*>(sqlite3_aggregate_context(context, 0));
+    if (!state) {
+        // No rows were added.
+        state = &empty;
+    }
+
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        sqlite3_result_error(context, NO_JNI_ENV_ERROR, -1);
+    } else {
+        deliverAggregateResult(env, context, state, true);
+        if (state->aggregate) {
+            env->DeleteGlobalRef(state->aggregate);
+        }
+    }
+    releaseAggregateCopies(state);
+    free(state->values);
+    free(state->copies);
+}
+
 // Called when a custom function is destroyed.
 static void sqliteCustomFunctionDestructor(void* data) {
     jobject functionObjGlobal = reinterpret_cast<jobject>(data);
-    JNIEnv* env = 0;
-    gpJavaVM->GetEnv((void**)&env, JNI_VERSION_1_4);
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        ALOGE("Leaking custom function, the thread cannot be attached to the VM.");
+        return;
+    }
     env->DeleteGlobalRef(functionObjGlobal);
 }
 
+// Called when a Function is destroyed.
+static void sqliteFunctionDestructor(void* data) {
+    SQLiteFunctionContext* function = reinterpret_cast<SQLiteFunctionContext*>(data);
+    // The cache adds to the counters in cacheStats, so it goes first.
+    free(function->values);
+    delete function->cache;
+
+    JNIEnv* env = getJNIEnv();
+    if (!env) {
+        ALOGE("Leaking function references, the thread cannot be attached to the VM.");
+    } else {
+        env->DeleteGlobalRef(function->invocation);
+        if (function->buffer) {
+            env->DeleteGlobalRef(function->buffer);
+        }
+        if (function->cacheStats) {
+            env->DeleteGlobalRef(function->cacheStats);
+        }
+    }
+    delete function;
+}
+
 static void nativeRegisterCustomFunction(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jobject functionObj) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
@@ -320,6 +965,7 @@ static void nativeRegisterCustomFunction(JNIEnv* env, jclass clazz, jlong connec
     jobject functionObjGlobal = env->NewGlobalRef(functionObj);
 
     const char* name = env->GetStringUTFChars(nameStr, NULL);
+    // The destructor is also called if registering fails.
     int err = sqlite3_create_function_v2(connection->db, name, numArgs, SQLITE_UTF16,
             reinterpret_cast<void*>(functionObjGlobal),
             &sqliteCustomFunctionCallback, NULL, NULL, &sqliteCustomFunctionDestructor);
@@ -327,7 +973,42 @@ static void nativeRegisterCustomFunction(JNIEnv* env, jclass clazz, jlong connec
 
     if (err != SQLITE_OK) {
         ALOGE("sqlite3_create_function returned %d", err);
-        env->DeleteGlobalRef(functionObjGlobal);
+        throw_sqlite3_exception(env, connection->db);
+        return;
+    }
+}
+
+static void nativeRegisterAggregateFunction(JNIEnv *env, jclass clazz, jlong connectionPtr,
+        jobject functionObj) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    jstring nameStr = jstring(env->GetObjectField(
+            functionObj, gSQLiteAggregateFunctionClassInfo.name));
+    jint numArgs = env->GetIntField(functionObj, gSQLiteAggregateFunctionClassInfo.numArgs);
+    jint flags = env->GetIntField(functionObj, gSQLiteAggregateFunctionClassInfo.flags);
+    bool window = env->GetBooleanField(functionObj, gSQLiteAggregateFunctionClassInfo.window);
+
+    // The invocation holds the argument and result views used by the connection.
+    jobject invocation = env->CallObjectMethod(functionObj,
+            gSQLiteAggregateFunctionClassInfo.newInvocation);
+    if (env->ExceptionCheck()) {
+        return;
+    }
+    jobject invocationGlobal = env->NewGlobalRef(invocation);
+    env->DeleteLocalRef(invocation);
+
+    const char* name = env->GetStringUTFChars(nameStr, NULL);
+    // The destructor is also called if registering fails.
+    int err = sqlite3_create_window_function(connection->db, name, numArgs,
+            SQLITE_UTF16 | flags, reinterpret_cast<void*>(invocationGlobal),
+            &sqliteAggregateStep, &sqliteAggregateFinal,
+            window ? &sqliteAggregateValue : NULL,
+            window ? &sqliteAggregateInverse : NULL,
+            &sqliteCustomFunctionDestructor);
+    env->ReleaseStringUTFChars(nameStr, name);
+
+    if (err != SQLITE_OK) {
+        ALOGE("sqlite3_create_window_function returned %d", err);
         throw_sqlite3_exception(env, connection->db);
         return;
     }
@@ -341,19 +1022,51 @@ static void nativeRegisterFunction(JNIEnv *env, jclass clazz, jlong connectionPt
             functionObj, gSQLiteFunctionClassInfo.name));
     jint numArgs = env->GetIntField(functionObj, gSQLiteFunctionClassInfo.numArgs);
     jint flags = env->GetIntField(functionObj, gSQLiteFunctionClassInfo.flags);
+    jint cacheSize = env->GetIntField(functionObj, gSQLiteFunctionClassInfo.cacheSize);
 
-    jobject functionObjGlobal = env->NewGlobalRef(functionObj);
+    // Each connection gets its own invocation and argument buffer, so that functions
+    // shared by the connections of a pool can run concurrently.
+    jobject invocation = env->CallObjectMethod(functionObj,
+            gSQLiteFunctionClassInfo.newInvocation);
+    if (env->ExceptionCheck()) {
+        return;
+    }
+
+    SQLiteFunctionContext* function = new SQLiteFunctionContext();
+    function->invocation = env->NewGlobalRef(invocation);
+    env->DeleteLocalRef(invocation);
+    if (!resizeFunctionBuffer(env, function,
+            numArgs >= 0 ? numArgs : FUNCTION_VARIADIC_SLOTS)) {
+        env->ExceptionClear();
+        sqliteFunctionDestructor(function);
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate function buffer");
+        return;
+    }
+    if (cacheSize > 0) {
+        // Each connection has its own cache, the counters are summed in Java's buffer.
+        jobject stats = env->GetObjectField(functionObj, gSQLiteFunctionClassInfo.cacheStats);
+        int64_t* counters = static_cast<int64_t*>(env->GetDirectBufferAddress(stats));
+        if (!counters) {
+            env->DeleteLocalRef(stats);
+            sqliteFunctionDestructor(function);
+            throw_sqlite3_exception(env, "Function cache counters are not a direct buffer.");
+            return;
+        }
+        function->cacheStats = env->NewGlobalRef(stats);
+        function->cache = new FunctionResultCache(size_t(cacheSize), counters);
+        env->DeleteLocalRef(stats);
+    }
 
     const char* name = env->GetStringUTFChars(nameStr, NULL);
+    // The destructor is also called if registering fails.
     int err = sqlite3_create_function_v2(connection->db, name, numArgs,
                                          SQLITE_UTF16 | flags,
-                                         reinterpret_cast<void*>(functionObjGlobal),
-                                         &sqliteFunctionCallback, NULL, NULL, &sqliteCustomFunctionDestructor);
+                                         reinterpret_cast<void*>(function),
+                                         &sqliteFunctionCallback, NULL, NULL, &sqliteFunctionDestructor);
     env->ReleaseStringUTFChars(nameStr, name);
 
     if (err != SQLITE_OK) {
         ALOGE("sqlite3_create_function returned %d", err);
-        env->DeleteGlobalRef(functionObjGlobal);
         throw_sqlite3_exception(env, connection->db);
         return;
     }
@@ -362,47 +1075,149 @@ static void nativeRegisterFunction(JNIEnv *env, jclass clazz, jlong connectionPt
 static void nativeRegisterLocalizedCollators(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jstring localeStr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-#if 0
     const char* locale = env->GetStringUTFChars(localeStr, NULL);
 
-    int err = register_localized_collators(connection->db, locale, UTF16_STORAGE);
+    int err = LocalizedCollator::registerCollation(connection->db, locale);
     env->ReleaseStringUTFChars(localeStr, locale);
 
     if (err != SQLITE_OK) {
         throw_sqlite3_exception(env, connection->db);
     }
-#endif
 }
 
-static jlong nativePrepareStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+static jint nativeGetLocalizedCollatorVersion(JNIEnv* env, jclass clazz) {
+    return LocalizedCollator::VERSION;
+}
+
+static jlong nativePrepareStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring sqlString, jboolean persistent) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    // Transcode straight into the connection's scratch buffer so SQLite does not have
+    // to convert the statement from UTF-16 itself. Each UTF-16 unit needs at most
+    // 3 bytes of UTF-8.
+    jsize sqlLength = env->GetStringLength(sqlString);
+    connection->scratch.resize(size_t(sqlLength) * 3 + 1);
+    char* sqlUtf8 = &connection->scratch[0];
+    const jchar* sql = env->GetStringCritical(sqlString, NULL);
+    size_t sqlUtf8Length = javaCharArrayToUtf8(sql, sqlLength, sqlUtf8);
+    env->ReleaseStringCritical(sqlString, sql);
+    sqlUtf8[sqlUtf8Length] = '\0';
+
+    // Statements that will be cached are flagged persistent so SQLite allocates them
+    // from the heap and leaves the lookaside slots to short-lived objects.
+    sqlite3_stmt* statement;
+    int err = sqlite3_prepare_v3(connection->db,
+            sqlUtf8, int(sqlUtf8Length) + 1, persistent ? SQLITE_PREPARE_PERSISTENT : 0,
+            &statement, NULL);
+
+    // Do not keep the buffer of an unusually long statement for the life of the
+    // connection.
+    if (connection->scratch.capacity() > SCRATCH_KEEP_BYTES) {
+        std::string scratch;
+        scratch.reserve(SCRATCH_KEEP_BYTES);
+        connection->scratch.swap(scratch);
+    }
+
+    if (err != SQLITE_OK) {
+        // Error messages like 'near ")": syntax error' are not
+        // always helpful enough, so construct an error string that
+        // includes the query itself.
+        const char *query = env->GetStringUTFChars(sqlString, NULL);
+        char *message = (char*) malloc(strlen(query) + 50);
+        if (message) {
+            strcpy(message, ", while compiling: "); // less than 50 chars
+            strcat(message, query);
+        }
+        env->ReleaseStringUTFChars(sqlString, query);
+        throw_sqlite3_exception(env, connection->db, message);
+        free(message);
+        return 0;
+    }
+
+    ALOGV("Prepared statement %p on connection %p", statement, connection->db);
+    return reinterpret_cast<jlong>(statement);
+}
+
+static jboolean nativeAcquireCachedStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring sqlString, jobject statementObj) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    jsize sqlLength = env->GetStringLength(sqlString);
+    const jchar* sql = env->GetStringCritical(sqlString, NULL);
+    int type = 0;
+    sqlite3_stmt* statement = connection->statementCache.acquire(sql, sqlLength, &type);
+    env->ReleaseStringCritical(sqlString, sql);
+    if (!statement) {
+        return false;
+    }
+
+    env->SetLongField(statementObj, gPreparedStatementClassInfo.statementPtr,
+            reinterpret_cast<jlong>(statement));
+    env->SetIntField(statementObj, gPreparedStatementClassInfo.numParameters,
+            sqlite3_bind_parameter_count(statement));
+    env->SetIntField(statementObj, gPreparedStatementClassInfo.type, type);
+    env->SetBooleanField(statementObj, gPreparedStatementClassInfo.readOnly,
+            sqlite3_stmt_readonly(statement) != 0);
+    return true;
+}
+
+static jboolean nativeCacheStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring sqlString, jlong statementPtr, jint type) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+
+    jsize sqlLength = env->GetStringLength(sqlString);
+    const jchar* sql = env->GetStringCritical(sqlString, NULL);
+    bool cached = connection->statementCache.put(sql, sqlLength, statement, type);
+    env->ReleaseStringCritical(sqlString, sql);
+    return cached;
+}
+
+static void nativeReleaseCachedStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+
+    int err = sqlite3_reset(statement);
+    if (err == SQLITE_OK) {
+        err = sqlite3_clear_bindings(statement);
+    }
+    if (err != SQLITE_OK) {
+        // The statement could not be reset due to an error.  Remove it from the cache.
+        ALOGV("Could not reset statement %p, removing it from the cache", statement);
+        connection->statementCache.remove(statement);
+        connection->finalize(statement);
+    } else if (!connection->statementCache.release(statement)) {
+        connection->finalize(statement);
+    }
+}
+
+static jboolean nativeHasCachedStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jstring sqlString) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
     jsize sqlLength = env->GetStringLength(sqlString);
     const jchar* sql = env->GetStringCritical(sqlString, NULL);
-    sqlite3_stmt* statement;
-    int err = sqlite3_prepare16_v2(connection->db,
-            sql, sqlLength * sizeof(jchar), &statement, NULL);
+    bool cached = connection->statementCache.contains(sql, sqlLength);
     env->ReleaseStringCritical(sqlString, sql);
+    return cached;
+}
 
-    if (err != SQLITE_OK) {
-        // Error messages like 'near ")": syntax error' are not
-        // always helpful enough, so construct an error string that
-        // includes the query itself.
-        const char *query = env->GetStringUTFChars(sqlString, NULL);
-        char *message = (char*) malloc(strlen(query) + 50);
-        if (message) {
-            strcpy(message, ", while compiling: "); // less than 50 chars
-            strcat(message, query);
-        }
-        env->ReleaseStringUTFChars(sqlString, query);
-        throw_sqlite3_exception(env, connection->db, message);
-        free(message);
-        return 0;
-    }
+static void nativeResizeStatementCache(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jint size) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    connection->statementCache.resize(size > 0 ? size_t(size) : 0);
+}
 
-    ALOGV("Prepared statement %p on connection %p", statement, connection->db);
-    return reinterpret_cast<jlong>(statement);
+static void nativeGetStatementCacheStats(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jintArray statsArray) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    const StatementCache& cache = connection->statementCache;
+
+    // Order matches the STATEMENT_CACHE_* indices in SQLiteConnection.java.
+    jint stats[] = { cache.hits(), cache.misses(), cache.evictions(), cache.size() };
+    env->SetIntArrayRegion(statsArray, 0, NELEM(stats), stats);
 }
 
 static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
@@ -414,7 +1229,7 @@ static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jlong connectionP
     // whether any errors occurred while executing the statement.  The statement itself
     // is always finalized regardless.
     ALOGV("Finalized statement %p on connection %p", statement, connection->db);
-    sqlite3_finalize(statement);
+    connection->finalize(statement);
 }
 
 static jint nativeGetParameterCount(JNIEnv* env, jclass clazz, jlong connectionPtr,
@@ -495,11 +1310,24 @@ static void nativeBindString(JNIEnv* env, jclass clazz, jlong connectionPtr,
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
+    // Encode once into a buffer that SQLite takes ownership of, rather than binding
+    // UTF-16 with SQLITE_TRANSIENT (a copy) which is then transcoded again on use.
     jsize valueLength = env->GetStringLength(valueString);
     const jchar* value = env->GetStringCritical(valueString, NULL);
-    int err = sqlite3_bind_text16(statement, index, value, valueLength * sizeof(jchar),
-            SQLITE_TRANSIENT);
+    size_t utf8Length = javaCharArrayUtf8Length(value, valueLength);
+    char* utf8 = static_cast<char*>(sqlite3_malloc64(utf8Length + 1));
+    if (utf8) {
+        javaCharArrayToUtf8(value, valueLength, utf8);
+        utf8[utf8Length] = '\0';
+    }
     env->ReleaseStringCritical(valueString, value);
+    if (!utf8) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not allocate bind argument");
+        return;
+    }
+
+    // The destructor is invoked by SQLite even if binding fails.
+    int err = sqlite3_bind_text64(statement, index, utf8, utf8Length, sqlite3_free, SQLITE_UTF8);
     if (err != SQLITE_OK) {
         throw_sqlite3_exception(env, connection->db, NULL);
     }
@@ -519,15 +1347,31 @@ static void nativeBindBlob(JNIEnv* env, jclass clazz, jlong connectionPtr,
     }
 }
 
-static void nativeResetStatementAndClearBindings(JNIEnv* env, jclass clazz, jlong connectionPtr,
-        jlong statementPtr) {
+static void nativeBindBlobBuffer(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr, jint index, jobject buffer, jint offset, jint length) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
-    int err = sqlite3_reset(statement);
-    if (err == SQLITE_OK) {
-        err = sqlite3_clear_bindings(statement);
+    uint8_t* address = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+    if (!address) {
+        throw_sqlite3_exception(env, "Blob buffer is not a direct buffer.");
+        return;
+    }
+
+    // The buffer is referenced by the bind arguments until the statement is reset and its
+    // bindings are cleared, so SQLite can read the value in place rather than copying it.
+    int err = sqlite3_bind_blob(statement, index, address + offset, length, SQLITE_STATIC);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(env, connection->db, NULL);
     }
+}
+
+static void nativeBindZeroBlob(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr, jint index, jlong length) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+
+    int err = sqlite3_bind_zeroblob64(statement, index, length);
     if (err != SQLITE_OK) {
         throw_sqlite3_exception(env, connection->db, NULL);
     }
@@ -667,8 +1511,232 @@ enum CopyRowResult {
     CPR_ERROR,
 };
 
+struct LazyBlobContext {
+    SQLiteConnection* connection;
+    sqlite3_stmt* statement;
+    size_t threshold;
+    // The origins of the columns of the statement, once first needed.
+    const BlobColumnOrigins* origins;
+
+    LazyBlobContext() : connection(NULL), statement(NULL), threshold(0), origins(NULL) { }
+};
+
+// A view, with the SELECT it is defined as.
+struct ViewDefinition {
+    std::string name;
+    std::string select;
+};
+
+// Views are followed this deep into the views they read before giving up.
+static const int MAX_VIEW_DEPTH = 8;
+
+// Returns where the word next appears in the SQL from the given position, ignoring case,
+// other than as part of a longer identifier, or NULL if it does not.
+static const char* findWord(const char* sql, const char* from, const char* word) {
+    size_t length = strlen(word);
+    for (const char* p = from; *p; p++) {
+        if (p != sql && (isalnum((unsigned char) p[-1]) || p[-1] == '_')) {
+            continue;
+        }
+        if (!strncasecmp(p, word, length)
+                && !isalnum((unsigned char) p[length]) && p[length] != '_') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static bool containsWord(const char* sql, const char* word) {
+    return findWord(sql, sql, word) != NULL;
+}
+
+// Returns the number of times the SQL names a table or view, not counting the names
+// qualifying a column, as in "name.column".
+static int countNameReferences(const char* sql, const char* name) {
+    size_t length = strlen(name);
+    int count = 0;
+    for (const char* p = findWord(sql, sql, name); p; p = findWord(sql, p + length, name)) {
+        const char* next = p + length;
+        if (*next == '"' || *next == '`' || *next == ']' || *next == '\'') {
+            next++;
+        }
+        while (isspace((unsigned char) *next)) {
+            next++;
+        }
+        if (*next != '.') {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Reads the views of every attached database. Returns false if they could not be read.
+static bool readViews(sqlite3* db, std::vector<ViewDefinition>* views) {
+    sqlite3_stmt* databases = NULL;
+    if (sqlite3_prepare_v2(db, "PRAGMA database_list", -1, &databases, NULL) != SQLITE_OK) {
+        return false;
+    }
+    bool failed = false;
+    while (!failed && sqlite3_step(databases) == SQLITE_ROW) {
+        char* query = sqlite3_mprintf(
+                "SELECT name, sql FROM \"%w\".sqlite_master WHERE type = 'view'",
+                reinterpret_cast<const char*>(sqlite3_column_text(databases, 1)));
+        sqlite3_stmt* statement = NULL;
+        if (!query || sqlite3_prepare_v2(db, query, -1, &statement, NULL) != SQLITE_OK) {
+            failed = true;
+        }
+        while (!failed && sqlite3_step(statement) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+            const char* sql = reinterpret_cast<const char*>(sqlite3_column_text(statement, 1));
+            // Only what follows AS is kept, the CREATE VIEW before it names the view itself.
+            const char* as = sql ? findWord(sql, sql, "AS") : NULL;
+            if (name && as) {
+                views->push_back(ViewDefinition());
+                views->back().name = name;
+                views->back().select = as + 2;
+            }
+        }
+        sqlite3_finalize(statement);
+        sqlite3_free(query);
+    }
+    sqlite3_finalize(databases);
+    return !failed;
+}
+
+// Returns true if the SQL, or a view it may read directly or through other views, may be
+// a compound SELECT. The origin reported for the columns of a compound SELECT is that of
+// its first SELECT, which is wrong for the other rows.
+static bool mayReadCompoundSelect(const char* sql, const std::vector<ViewDefinition>& views,
+        int depth) {
+    if (containsWord(sql, "UNION") || containsWord(sql, "INTERSECT")
+            || containsWord(sql, "EXCEPT")) {
+        return true;
+    }
+    for (size_t i = 0; i < views.size(); i++) {
+        if (containsWord(sql, views[i].name.c_str())
+                && (depth >= MAX_VIEW_DEPTH
+                        || mayReadCompoundSelect(views[i].select.c_str(), views, depth + 1))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the number of times the SQL may read the table, directly or through views. A
+// table read more than once, as by a self-join, reports the same origin for the columns
+// of each of its reads, so a rowid column cannot be told to belong to the same row.
+static int countTableReferences(const char* sql, const char* table,
+        const std::vector<ViewDefinition>& views, int depth) {
+    // A common table expression may be read more than once under names of its own.
+    if (containsWord(sql, "WITH")) {
+        return 2;
+    }
+    int count = countNameReferences(sql, table);
+    for (size_t i = 0; i < views.size() && count < 2; i++) {
+        int references = countNameReferences(sql, views[i].name.c_str());
+        if (references > 0) {
+            if (depth >= MAX_VIEW_DEPTH) {
+                return 2;
+            }
+            count += references
+                    * countTableReferences(views[i].select.c_str(), table, views, depth + 1);
+        }
+    }
+    return count;
+}
+
+// Returns the name the rowid of the table is reported with as the origin of a column,
+// which is its INTEGER PRIMARY KEY alias if there is one. Returns an empty string for
+// WITHOUT ROWID tables, which fail to prepare.
+static std::string getRowIdName(sqlite3* db, const char* database, const char* table) {
+    std::string rowIdName;
+    char* sql = sqlite3_mprintf("SELECT rowid FROM \"%w\".\"%w\"", database, table);
+    sqlite3_stmt* statement = NULL;
+    if (sql && sqlite3_prepare_v2(db, sql, -1, &statement, NULL) == SQLITE_OK) {
+        const char* origin = sqlite3_column_origin_name(statement, 0);
+        if (origin) {
+            rowIdName = origin;
+        }
+    }
+    sqlite3_finalize(statement);
+    sqlite3_free(sql);
+    return rowIdName;
+}
+
+// Resolves the table, column and rowid column of each result column of the statement.
+// Only columns read straight from a rowid table which the statement reads once, and whose
+// rowid is also selected exactly once, are eligible.
+static void resolveBlobColumnOrigins(sqlite3* db, sqlite3_stmt* statement,
+        BlobColumnOrigins* origins) {
+    int numColumns = sqlite3_column_count(statement);
+    origins->reprepareCount = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_REPREPARE, 0);
+    origins->columns.assign(numColumns, BlobColumnOrigin());
+
+    const char* sql = sqlite3_sql(statement);
+    std::vector<ViewDefinition> views;
+    if (!sql || !readViews(db, &views) || mayReadCompoundSelect(sql, views, 0)) {
+        return;
+    }
+
+    for (int column = 0; column < numColumns; column++) {
+        const char* database = sqlite3_column_database_name(statement, column);
+        const char* table = sqlite3_column_table_name(statement, column);
+        const char* name = sqlite3_column_origin_name(statement, column);
+        if (!database || !table || !name
+                || countTableReferences(sql, table, views, 0) != 1) {
+            continue;
+        }
+        std::string rowIdName = getRowIdName(db, database, table);
+        if (rowIdName.empty()) {
+            continue;
+        }
+
+        int rowIdColumn = -1;
+        bool ambiguous = false;
+        for (int i = 0; i < numColumns && !ambiguous; i++) {
+            const char* otherDatabase = sqlite3_column_database_name(statement, i);
+            const char* otherTable = sqlite3_column_table_name(statement, i);
+            const char* otherName = sqlite3_column_origin_name(statement, i);
+            if (otherDatabase && otherTable && otherName
+                    && !strcmp(database, otherDatabase) && !strcmp(table, otherTable)
+                    && !sqlite3_stricmp(otherName, rowIdName.c_str())) {
+                ambiguous = rowIdColumn >= 0;
+                rowIdColumn = i;
+            }
+        }
+        if (rowIdColumn < 0 || ambiguous) {
+            continue;
+        }
+
+        BlobColumnOrigin& origin = origins->columns[column];
+        origin.database = database;
+        origin.table = table;
+        origin.column = name;
+        origin.rowIdColumn = rowIdColumn;
+        origin.eligible = true;
+    }
+}
+
+// Returns the origin of a result column whose blob exceeds the threshold, or NULL if it is
+// not eligible. The origins are resolved once per compilation of the statement.
+static const BlobColumnOrigin* getBlobColumnOrigin(LazyBlobContext* context, int column) {
+    if (!context->origins) {
+        SQLiteConnection* connection = context->connection;
+        sqlite3_stmt* statement = context->statement;
+        BlobColumnOrigins& origins = connection->blobOrigins[statement];
+        int reprepareCount = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_REPREPARE, 0);
+        if (origins.columns.empty() || origins.reprepareCount != reprepareCount) {
+            resolveBlobColumnOrigins(connection->db, statement, &origins);
+        }
+        context->origins = &origins;
+    }
+    const BlobColumnOrigin& origin = context->origins->columns[column];
+    return origin.eligible ? &origin : NULL;
+}
+
 static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
-        sqlite3_stmt* statement, int numColumns, int startPos, int addedRows) {
+        sqlite3_stmt* statement, int numColumns, int startPos, int addedRows,
+        LazyBlobContext* lazyBlobs) {
     // Allocate a new field directory for the row.
     status_t status = window->allocRow();
     if (status) {
@@ -722,8 +1790,26 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
             LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
         } else if (type == SQLITE_BLOB) {
             // BLOB data
-            const void* blob = sqlite3_column_blob(statement, i);
             size_t size = sqlite3_column_bytes(statement, i);
+            if (lazyBlobs && size > lazyBlobs->threshold) {
+                const BlobColumnOrigin* origin = getBlobColumnOrigin(lazyBlobs, i);
+                if (origin
+                        && sqlite3_column_type(statement, origin->rowIdColumn) == SQLITE_INTEGER) {
+                    int64_t rowId = sqlite3_column_int64(statement, origin->rowIdColumn);
+                    status = window->putBlobReference(addedRows, i, origin->database.c_str(),
+                            origin->table.c_str(), origin->column.c_str(), rowId, size);
+                    if (status) {
+                        LOG_WINDOW("Failed allocating blob reference at %d,%d, error=%d",
+                                startPos + addedRows, i, status);
+                        result = CPR_FULL;
+                        break;
+                    }
+                    LOG_WINDOW("%d,%d is Blob reference to rowid %lld with %u bytes",
+                            startPos + addedRows, i, rowId, size);
+                    continue;
+                }
+            }
+            const void* blob = sqlite3_column_blob(statement, i);
             status = window->putBlob(addedRows, i, blob, size);
             if (status) {
                 LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
@@ -762,7 +1848,7 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
 
 static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
         jlong connectionPtr, jlong statementPtr, jlong windowPtr,
-        jint startPos, jint requiredPos, jboolean countAllRows) {
+        jint startPos, jint requiredPos, jboolean countAllRows, jint lazyBlobThreshold) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
@@ -780,6 +1866,17 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
         return 0;
     }
 
+    // Blobs larger than the threshold are left in the database and referenced from the
+    // window, they are read through incremental blob I/O when the cursor asks for them.
+    LazyBlobContext lazyBlobContext;
+    LazyBlobContext* lazyBlobs = NULL;
+    if (lazyBlobThreshold > 0) {
+        lazyBlobContext.connection = connection;
+        lazyBlobContext.statement = statement;
+        lazyBlobContext.threshold = size_t(lazyBlobThreshold);
+        lazyBlobs = &lazyBlobContext;
+    }
+
     int retryCount = 0;
     int totalRows = 0;
     int addedRows = 0;
@@ -797,7 +1894,8 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
                 continue;
             }
 
-            CopyRowResult cpr = copyRow(env, window, statement, numColumns, startPos, addedRows);
+            CopyRowResult cpr = copyRow(env, window, statement, numColumns, startPos, addedRows,
+                    lazyBlobs);
             if (cpr == CPR_FULL && addedRows && startPos + addedRows <= requiredPos) {
                 // We filled the window before we got to the one row that we really wanted.
                 // Clear the window and start filling it again from here.
@@ -806,7 +1904,8 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
                 window->setNumColumns(numColumns);
                 startPos += addedRows;
                 addedRows = 0;
-                cpr = copyRow(env, window, statement, numColumns, startPos, addedRows);
+                cpr = copyRow(env, window, statement, numColumns, startPos, addedRows,
+                        lazyBlobs);
             }
 
             if (cpr == CPR_OK) {
@@ -851,15 +1950,36 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
     return result;
 }
 
-static jint nativeGetDbLookaside(JNIEnv* env, jobject clazz, jlong connectionPtr) {
+static jint nativeGetDbLookaside(JNIEnv* env, jobject clazz, jlong connectionPtr,
+        jintArray statsArray) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
     int cur = -1;
     int unused;
     sqlite3_db_status(connection->db, SQLITE_DBSTATUS_LOOKASIDE_USED, &cur, &unused, 0);
+
+    // The counters are reported as the highwater marks. Order matches the LOOKASIDE_*
+    // indices in SQLiteConnection.java.
+    static const int COUNTERS[] = {
+        SQLITE_DBSTATUS_LOOKASIDE_HIT,
+        SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE,
+        SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL,
+    };
+    jint stats[NELEM(COUNTERS)];
+    for (size_t i = 0; i < NELEM(COUNTERS); i++) {
+        int count = 0;
+        sqlite3_db_status(connection->db, COUNTERS[i], &unused, &count, 0);
+        stats[i] = count;
+    }
+    env->SetIntArrayRegion(statsArray, 0, NELEM(stats), stats);
     return cur;
 }
 
+static void nativeApplyMemoryPolicy(JNIEnv* env, jobject clazz, jlong connectionPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    MemoryGovernor::applyTo(connection->db, &connection->memoryGeneration);
+}
+
 static void nativeCancel(JNIEnv* env, jobject clazz, jlong connectionPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     connection->canceled = true;
@@ -886,6 +2006,12 @@ static jboolean nativeHasCodec(JNIEnv* env, jobject clazz){
 #endif
 }
 
+static void nativeRegisterNativeFunctions(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jobjectArray nativeFunctions) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    registerNativeFunctions(env, connection->db, nativeFunctions);
+}
+
 static void nativeLoadExtension(JNIEnv* env, jobject clazz,
                                 jlong connectionPtr, jstring file, jstring proc) {
     char* errorMessage;
@@ -913,10 +2039,397 @@ static void nativeLoadExtension(JNIEnv* env, jobject clazz,
     }
 }
 
+static jlong nativeOpenBlob(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring databaseStr, jstring tableStr, jstring columnStr, jlong rowId,
+        jboolean writable) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    const char* database = env->GetStringUTFChars(databaseStr, NULL);
+    const char* table = env->GetStringUTFChars(tableStr, NULL);
+    const char* column = env->GetStringUTFChars(columnStr, NULL);
+    sqlite3_blob* blob = NULL;
+    int err = sqlite3_blob_open(connection->db, database, table, column, rowId,
+            writable ? 1 : 0, &blob);
+    env->ReleaseStringUTFChars(columnStr, column);
+    env->ReleaseStringUTFChars(tableStr, table);
+    env->ReleaseStringUTFChars(databaseStr, database);
+
+    if (err != SQLITE_OK) {
+        // The handle is set to NULL on failure, nothing to close.
+        throw_sqlite3_exception(env, connection->db, "Could not open blob");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(blob);
+}
+
+// Writes all of data to fd. Returns false and throws if that fails.
+static bool writeFully(JNIEnv* env, int fd, const unsigned char* data, sqlite3_int64 size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size_t(size < INT32_MAX ? size : INT32_MAX));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_sqlite3_exception_errno(env, errno, "Could not write serialized database");
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* Returns the serialized image of a schema in data and size. In-memory databases are
+ * returned as they are; other databases are copied, and the copy must be freed with
+ * sqlite3_free when copied is set.
+ * If false is returned, an exception has been thrown to report the reason. */
+static bool serialize(JNIEnv* env, SQLiteConnection* connection, jstring schemaStr,
+        unsigned char** data, sqlite3_int64* size, bool* copied) {
+    const char* schema = env->GetStringUTFChars(schemaStr, NULL);
+    *size = -1;
+    *data = sqlite3_serialize(connection->db, schema, size, SQLITE_SERIALIZE_NOCOPY);
+    *copied = false;
+    if (!*data && *size > 0) {
+        *data = sqlite3_serialize(connection->db, schema, size, 0);
+        *copied = true;
+    }
+    env->ReleaseStringUTFChars(schemaStr, schema);
+
+    if (*size < 0) {
+        throw_sqlite3_exception(env, connection->db, "Could not serialize database");
+        return false;
+    }
+    if (!*data && *size > 0) {
+        throw_sqlite3_exception_errcode(env, SQLITE_NOMEM, "Could not serialize database");
+        return false;
+    }
+    return true;
+}
+
+static jbyteArray nativeSerialize(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring schemaStr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    unsigned char* data;
+    sqlite3_int64 size;
+    bool copied;
+    if (!serialize(env, connection, schemaStr, &data, &size, &copied)) {
+        return NULL;
+    }
+    jbyteArray array = NULL;
+    if (size > INT32_MAX) {
+        throw_sqlite3_exception_errcode(env, SQLITE_TOOBIG,
+                "Database is too large for an array");
+    } else {
+        array = env->NewByteArray(jsize(size));
+        if (array) {
+            env->SetByteArrayRegion(array, 0, jsize(size),
+                    reinterpret_cast<const jbyte*>(data));
+        }
+    }
+    if (copied) {
+        sqlite3_free(data);
+    }
+    return array;
+}
+
+static jlong nativeSerializeToFileDescriptor(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring schemaStr, jint fd) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    unsigned char* data;
+    sqlite3_int64 size;
+    bool copied;
+    if (!serialize(env, connection, schemaStr, &data, &size, &copied)) {
+        return 0;
+    }
+    bool written = writeFully(env, fd, data, size);
+    if (copied) {
+        sqlite3_free(data);
+    }
+    return written ? size : 0;
+}
+
+// Offsets of the file format versions for writing and reading in the database header,
+// which are 2 in WAL mode.
+static const int HEADER_WRITE_VERSION = 18;
+static const int HEADER_READ_VERSION = 19;
+
+static bool isWalImage(const unsigned char* data, sqlite3_int64 size) {
+    return size > HEADER_READ_VERSION && data[HEADER_WRITE_VERSION] == 2
+            && data[HEADER_READ_VERSION] == 2;
+}
+
+// In-memory databases cannot be in WAL mode, so images of databases in WAL mode, which
+// include the content of the WAL once serialized, are switched to rollback journals.
+static void clearWalMode(unsigned char* data, sqlite3_int64 size) {
+    if (isWalImage(data, size)) {
+        data[HEADER_WRITE_VERSION] = 1;
+        data[HEADER_READ_VERSION] = 1;
+    }
+}
+
+/* Replaces the schema with an image of size bytes at data. A read-only image is read in
+ * place, and image describes what holds it. A writable image must have been allocated
+ * with sqlite3_malloc64, and belongs to SQLite from then on, since it grows the image as
+ * the database grows.
+ * If false is returned, an exception has been thrown to report the reason. */
+static bool deserialize(JNIEnv* env, SQLiteConnection* connection, jstring schemaStr,
+        unsigned char* data, sqlite3_int64 size, bool readOnly, DeserializedImage& image) {
+    unsigned int flags;
+    if (readOnly) {
+        if (isWalImage(data, size)) {
+            throw_sqlite3_exception(env, "Cannot deserialize a database in WAL mode in place, "
+                    "deserialize a writable copy instead.");
+            return false;
+        }
+        flags = SQLITE_DESERIALIZE_READONLY;
+    } else {
+        clearWalMode(data, size);
+        flags = SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE;
+    }
+
+    const char* schema = env->GetStringUTFChars(schemaStr, NULL);
+    // A writable image is freed by SQLite even if this fails.
+    int err = sqlite3_deserialize(connection->db, schema, data, size, size, flags);
+    if (err != SQLITE_OK) {
+        env->ReleaseStringUTFChars(schemaStr, schema);
+        throw_sqlite3_exception(env, connection->db, "Could not deserialize database");
+        return false;
+    }
+
+    // The schema no longer reads what it was deserialized from before.
+    std::vector<DeserializedImage>& images = connection->images;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!strcasecmp(images[i].schema.c_str(), schema)) {
+            releaseImage(env, images[i]);
+            images.erase(images.begin() + i);
+            break;
+        }
+    }
+    if (readOnly) {
+        image.schema = schema;
+        images.push_back(image);
+    }
+    env->ReleaseStringUTFChars(schemaStr, schema);
+    return true;
+}
+
+static void nativeDeserialize(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring schemaStr, jobject buffer, jint offset, jint length, jboolean readOnly) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    unsigned char* address = static_cast<unsigned char*>(env->GetDirectBufferAddress(buffer));
+    if (!address) {
+        throw_sqlite3_exception(env, "Database buffer is not a direct buffer.");
+        return;
+    }
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (offset < 0 || length < 0 || jlong(offset) + length > capacity) {
+        throw_sqlite3_exception(env, "Database buffer range is out of bounds.");
+        return;
+    }
+
+    DeserializedImage image = DeserializedImage();
+    unsigned char* data;
+    if (readOnly) {
+        data = address + offset;
+        image.buffer = env->NewGlobalRef(buffer);
+    } else {
+        data = static_cast<unsigned char*>(sqlite3_malloc64(length > 0 ? length : 1));
+        if (!data) {
+            throw_sqlite3_exception_errcode(env, SQLITE_NOMEM,
+                    "Could not allocate database image");
+            return;
+        }
+        memcpy(data, address + offset, size_t(length));
+    }
+    if (!deserialize(env, connection, schemaStr, data, length, readOnly, image)) {
+        releaseImage(env, image);
+    }
+}
+
+static void nativeDeserializeFile(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring schemaStr, jstring pathStr, jboolean readOnly) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    const char* path = env->GetStringUTFChars(pathStr, NULL);
+    std::string walPath = std::string(path) + "-wal";
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    env->ReleaseStringUTFChars(pathStr, path);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        throw_sqlite3_exception_errno(env, errno, "Could not open database image");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    // Commits still in the WAL file are not in the database file, so the image would
+    // silently lack them.
+    struct stat walSt;
+    if (stat(walPath.c_str(), &walSt) == 0 && walSt.st_size > 0) {
+        throw_sqlite3_exception(env, "The database has commits in its WAL file, checkpoint "
+                "it with PRAGMA wal_checkpoint(TRUNCATE) before deserializing it.");
+        close(fd);
+        return;
+    }
+
+    // Read-only images are mapped, writable ones are read since SQLite needs a copy it
+    // can grow. The mapping is private so that the header of a database in WAL mode can
+    // be changed without copying more than its first page.
+    DeserializedImage image = DeserializedImage();
+    unsigned char* data = NULL;
+    sqlite3_int64 size = st.st_size;
+    if (readOnly && size > 0) {
+        void* mapping = mmap(NULL, size_t(size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            throw_sqlite3_exception_errno(env, errno, "Could not map database image");
+            close(fd);
+            return;
+        }
+        data = static_cast<unsigned char*>(mapping);
+        clearWalMode(data, size);
+        image.mapping = mapping;
+        image.length = size_t(size);
+    } else if (!readOnly) {
+        data = static_cast<unsigned char*>(sqlite3_malloc64(size > 0 ? size : 1));
+        if (!data) {
+            throw_sqlite3_exception_errcode(env, SQLITE_NOMEM,
+                    "Could not allocate database image");
+            close(fd);
+            return;
+        }
+        for (sqlite3_int64 done = 0; done < size;) {
+            ssize_t n = pread(fd, data + done, size_t(size - done), off_t(done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw_sqlite3_exception_errno(env, n < 0 ? errno : EIO,
+                        "Could not read database image");
+                sqlite3_free(data);
+                close(fd);
+                return;
+            }
+            done += n;
+        }
+    }
+    close(fd);
+
+    if (!deserialize(env, connection, schemaStr, data, size, readOnly, image)) {
+        releaseImage(env, image);
+    }
+}
+
+// Results of nativeBackupStep, which match the BACKUP_* constants in SQLiteConnection.java.
+enum {
+    BACKUP_MORE = 0,
+    BACKUP_DONE = 1,
+    BACKUP_BUSY = 2,
+};
+
+static jlong nativeBackupOpen(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong destinationPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    SQLiteConnection* destination = reinterpret_cast<SQLiteConnection*>(destinationPtr);
+
+    sqlite3_backup* backup = sqlite3_backup_init(destination->db, "main",
+            connection->db, "main");
+    if (!backup) {
+        // The error is reported by the destination connection.
+        throw_sqlite3_exception(env, destination->db, "Could not start backup");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(backup);
+}
+
+static jint nativeBackupStep(JNIEnv* env, jclass clazz, jlong backupPtr, jint pages,
+        jintArray progressArray) {
+    sqlite3_backup* backup = reinterpret_cast<sqlite3_backup*>(backupPtr);
+
+    int err = sqlite3_backup_step(backup, pages);
+    jint progress[2] = { sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup) };
+    env->SetIntArrayRegion(progressArray, 0, 2, progress);
+    switch (err) {
+        case SQLITE_OK:
+            return BACKUP_MORE;
+        case SQLITE_DONE:
+            return BACKUP_DONE;
+        case SQLITE_BUSY:
+        case SQLITE_LOCKED:
+            // Another connection holds a lock, the step can be tried again later.
+            return BACKUP_BUSY;
+        default:
+            throw_sqlite3_exception_errcode(env, err, "Could not back up database");
+            return BACKUP_MORE;
+    }
+}
+
+static void nativeBackupFinish(JNIEnv* env, jclass clazz, jlong backupPtr) {
+    sqlite3_backup* backup = reinterpret_cast<sqlite3_backup*>(backupPtr);
+
+    // The backup is released even if an error is returned, which is the last error of
+    // its steps.
+    int err = sqlite3_backup_finish(backup);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not finish backup");
+    }
+}
+
+static jlong nativeSnapshotGet(JNIEnv* env, jclass clazz, jlong connectionPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    // Opens a read transaction first if the transaction in progress has not read yet.
+    sqlite3_snapshot* snapshot = NULL;
+    int err = sqlite3_snapshot_get(connection->db, "main", &snapshot);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err,
+                "Could not get a snapshot; the database must be in WAL mode, outside of "
+                "a write transaction, and its WAL must hold a transaction");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(snapshot);
+}
+
+static void nativeSnapshotOpen(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong snapshotPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_snapshot* snapshot = reinterpret_cast<sqlite3_snapshot*>(snapshotPtr);
+
+    // SQLite no longer refers to the snapshot once its read transaction is open.
+    int err = sqlite3_snapshot_open(connection->db, "main", snapshot);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, err == SQLITE_ERROR_SNAPSHOT
+                ? "Could not open snapshot; the WAL has been reset since it was taken"
+                : "Could not open snapshot; it must be opened by a transaction that has "
+                "not read yet");
+    }
+}
+
+static jint nativeSnapshotCompare(JNIEnv* env, jclass clazz, jlong snapshotPtr,
+        jlong otherPtr) {
+    return sqlite3_snapshot_cmp(reinterpret_cast<sqlite3_snapshot*>(snapshotPtr),
+            reinterpret_cast<sqlite3_snapshot*>(otherPtr));
+}
+
+static void nativeSnapshotFree(JNIEnv* env, jclass clazz, jlong snapshotPtr) {
+    sqlite3_snapshot_free(reinterpret_cast<sqlite3_snapshot*>(snapshotPtr));
+}
+
+static void nativeAttachCheckpointer(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong checkpointerPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    Checkpointer* checkpointer = reinterpret_cast<Checkpointer*>(checkpointerPtr);
+
+    // The connection keeps the checkpointer until it is closed, since its WAL hook may
+    // run until then.
+    checkpointer->attach(connection->db);
+    connection->checkpointer = checkpointer;
+}
+
 static JNINativeMethod sMethods[] =
 {
     /* name, signature, funcPtr */
-    { "nativeOpen", "(Ljava/lang/String;ILjava/lang/String;ZZ)J",
+    { "nativeOpen",
+            "(Ljava/lang/String;ILjava/lang/String;Ljava/lang/String;ZZ[Ljava/lang/String;II)J",
             (void*)nativeOpen },
     { "nativeClose", "(J)V",
             (void*)nativeClose },
@@ -924,10 +2437,30 @@ static JNINativeMethod sMethods[] =
             (void*)nativeRegisterCustomFunction },
     { "nativeRegisterFunction", "(JLio/requery/android/database/sqlite/SQLiteFunction;)V",
             (void*)nativeRegisterFunction },
+    { "nativeRegisterAggregateFunction",
+            "(JLio/requery/android/database/sqlite/SQLiteAggregateFunction;)V",
+            (void*)nativeRegisterAggregateFunction },
+    { "nativeRegisterNativeFunctions", "(J[Ljava/lang/String;)V",
+            (void*)nativeRegisterNativeFunctions },
     { "nativeRegisterLocalizedCollators", "(JLjava/lang/String;)V",
             (void*)nativeRegisterLocalizedCollators },
-    { "nativePrepareStatement", "(JLjava/lang/String;)J",
+    { "nativeGetLocalizedCollatorVersion", "()I",
+            (void*)nativeGetLocalizedCollatorVersion },
+    { "nativePrepareStatement", "(JLjava/lang/String;Z)J",
             (void*)nativePrepareStatement },
+    { "nativeAcquireCachedStatement",
+            "(JLjava/lang/String;Lio/requery/android/database/sqlite/SQLiteConnection$PreparedStatement;)Z",
+            (void*)nativeAcquireCachedStatement },
+    { "nativeCacheStatement", "(JLjava/lang/String;JI)Z",
+            (void*)nativeCacheStatement },
+    { "nativeReleaseCachedStatement", "(JJ)V",
+            (void*)nativeReleaseCachedStatement },
+    { "nativeHasCachedStatement", "(JLjava/lang/String;)Z",
+            (void*)nativeHasCachedStatement },
+    { "nativeResizeStatementCache", "(JI)V",
+            (void*)nativeResizeStatementCache },
+    { "nativeGetStatementCacheStats", "(J[I)V",
+            (void*)nativeGetStatementCacheStats },
     { "nativeFinalizeStatement", "(JJ)V",
             (void*)nativeFinalizeStatement },
     { "nativeGetParameterCount", "(JJ)I",
@@ -948,8 +2481,10 @@ static JNINativeMethod sMethods[] =
             (void*)nativeBindString },
     { "nativeBindBlob", "(JJI[B)V",
             (void*)nativeBindBlob },
-    { "nativeResetStatementAndClearBindings", "(JJ)V",
-            (void*)nativeResetStatementAndClearBindings },
+    { "nativeBindBlobBuffer", "(JJILjava/nio/ByteBuffer;II)V",
+            (void*)nativeBindBlobBuffer },
+    { "nativeBindZeroBlob", "(JJIJ)V",
+            (void*)nativeBindZeroBlob },
     { "nativeExecute", "(JJ)V",
             (void*)nativeExecute },
     { "nativeExecuteForLong", "(JJ)J",
@@ -962,10 +2497,12 @@ static JNINativeMethod sMethods[] =
             (void*)nativeExecuteForChangedRowCount },
     { "nativeExecuteForLastInsertedRowId", "(JJ)J",
             (void*)nativeExecuteForLastInsertedRowId },
-    { "nativeExecuteForCursorWindow", "(JJJIIZ)J",
+    { "nativeExecuteForCursorWindow", "(JJJIIZI)J",
             (void*)nativeExecuteForCursorWindow },
-    { "nativeGetDbLookaside", "(J)I",
+    { "nativeGetDbLookaside", "(J[I)I",
             (void*)nativeGetDbLookaside },
+    { "nativeApplyMemoryPolicy", "(J)V",
+            (void*)nativeApplyMemoryPolicy },
     { "nativeCancel", "(J)V",
             (void*)nativeCancel },
     { "nativeResetCancel", "(JZ)V",
@@ -974,6 +2511,32 @@ static JNINativeMethod sMethods[] =
             (void*)nativeHasCodec },
     { "nativeLoadExtension", "(JLjava/lang/String;Ljava/lang/String;)V",
             (void*)nativeLoadExtension },
+    { "nativeOpenBlob", "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;JZ)J",
+            (void*)nativeOpenBlob },
+    { "nativeSerialize", "(JLjava/lang/String;)[B",
+            (void*)nativeSerialize },
+    { "nativeSerializeToFileDescriptor", "(JLjava/lang/String;I)J",
+            (void*)nativeSerializeToFileDescriptor },
+    { "nativeDeserialize", "(JLjava/lang/String;Ljava/nio/ByteBuffer;IIZ)V",
+            (void*)nativeDeserialize },
+    { "nativeDeserializeFile", "(JLjava/lang/String;Ljava/lang/String;Z)V",
+            (void*)nativeDeserializeFile },
+    { "nativeBackupOpen", "(JJ)J",
+            (void*)nativeBackupOpen },
+    { "nativeBackupStep", "(JI[I)I",
+            (void*)nativeBackupStep },
+    { "nativeBackupFinish", "(J)V",
+            (void*)nativeBackupFinish },
+    { "nativeAttachCheckpointer", "(JJ)V",
+            (void*)nativeAttachCheckpointer },
+    { "nativeSnapshotGet", "(J)J",
+            (void*)nativeSnapshotGet },
+    { "nativeSnapshotOpen", "(JJ)V",
+            (void*)nativeSnapshotOpen },
+    { "nativeSnapshotCompare", "(JJ)I",
+            (void*)nativeSnapshotCompare },
+    { "nativeSnapshotFree", "(J)V",
+            (void*)nativeSnapshotFree },
 };
 
 int register_android_database_SQLiteConnection(JNIEnv *env)
@@ -996,12 +2559,54 @@ int register_android_database_SQLiteConnection(JNIEnv *env)
             "numArgs", "I");
     GET_FIELD_ID(gSQLiteFunctionClassInfo.flags, clazz,
             "flags", "I");
-    GET_METHOD_ID(gSQLiteFunctionClassInfo.dispatchCallback,
-            clazz, "dispatchCallback", "(JJI)V");
+    GET_FIELD_ID(gSQLiteFunctionClassInfo.cacheSize, clazz,
+            "cacheSize", "I");
+    GET_FIELD_ID(gSQLiteFunctionClassInfo.cacheStats, clazz,
+            "cacheStats", "Ljava/nio/ByteBuffer;");
+    GET_METHOD_ID(gSQLiteFunctionClassInfo.newInvocation,
+            clazz, "newInvocation", "()Lio/requery/android/database/sqlite/SQLiteFunction$Invocation;");
+
+    FIND_CLASS(clazz, "io/requery/android/database/sqlite/SQLiteFunction$Invocation");
+
+    GET_METHOD_ID(gSQLiteFunctionInvocationClassInfo.dispatch,
+            clazz, "dispatch", "(JJILjava/nio/ByteBuffer;)Ljava/lang/Object;");
+
+    FIND_CLASS(clazz, "io/requery/android/database/sqlite/SQLiteAggregateFunction");
+
+    GET_FIELD_ID(gSQLiteAggregateFunctionClassInfo.name, clazz,
+            "name", "Ljava/lang/String;");
+    GET_FIELD_ID(gSQLiteAggregateFunctionClassInfo.numArgs, clazz,
+            "numArgs", "I");
+    GET_FIELD_ID(gSQLiteAggregateFunctionClassInfo.flags, clazz,
+            "flags", "I");
+    GET_FIELD_ID(gSQLiteAggregateFunctionClassInfo.window, clazz,
+            "window", "Z");
+    GET_METHOD_ID(gSQLiteAggregateFunctionClassInfo.newInvocation, clazz, "newInvocation",
+            "()Lio/requery/android/database/sqlite/SQLiteAggregateFunction$Invocation;");
+
+    FIND_CLASS(clazz, "io/requery/android/database/sqlite/SQLiteAggregateFunction$Invocation");
+
+    GET_METHOD_ID(gSQLiteAggregateFunctionInvocationClassInfo.newAggregate,
+            clazz, "newAggregate", "()Ljava/lang/Object;");
+    GET_METHOD_ID(gSQLiteAggregateFunctionInvocationClassInfo.step,
+            clazz, "step", "(Ljava/lang/Object;ZLjava/nio/ByteBuffer;JII)V");
+    GET_METHOD_ID(gSQLiteAggregateFunctionInvocationClassInfo.result,
+            clazz, "result", "(Ljava/lang/Object;ZJLjava/nio/ByteBuffer;)V");
 
     FIND_CLASS(clazz, "java/lang/String");
     gStringClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
 
+    FIND_CLASS(clazz, "io/requery/android/database/sqlite/SQLiteConnection$PreparedStatement");
+
+    GET_FIELD_ID(gPreparedStatementClassInfo.statementPtr, clazz,
+            "mStatementPtr", "J");
+    GET_FIELD_ID(gPreparedStatementClassInfo.numParameters, clazz,
+            "mNumParameters", "I");
+    GET_FIELD_ID(gPreparedStatementClassInfo.type, clazz,
+            "mType", "I");
+    GET_FIELD_ID(gPreparedStatementClassInfo.readOnly, clazz,
+            "mReadOnly", "Z");
+
     return jniRegisterNativeMethods(env,
         "io/requery/android/database/sqlite/SQLiteConnection",
         sMethods, NELEM(sMethods)
@@ -1011,6 +2616,9 @@ int register_android_database_SQLiteConnection(JNIEnv *env)
 extern int register_android_database_SQLiteGlobal(JNIEnv *env);
 extern int register_android_database_SQLiteDebug(JNIEnv *env);
 extern int register_android_database_SQLiteFunction(JNIEnv *env);
+extern int register_android_database_SQLiteBlob(JNIEnv *env);
+extern int register_android_database_SQLiteGroupCommit(JNIEnv *env);
+extern int register_android_database_SQLiteCheckpointer(JNIEnv *env);
 extern int register_android_database_CursorWindow(JNIEnv *env);
 
 } // namespace android
@@ -1018,14 +2626,17 @@ extern int register_android_database_CursorWindow(JNIEnv *env);
 extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
   JNIEnv *env = 0;
 
-  android::gpJavaVM = vm;
-  vm->GetEnv((void**)&env, JNI_VERSION_1_4);
+  android::setJavaVM(vm);
+  env = android::getJNIEnv();
 
   android::register_android_database_SQLiteConnection(env);
   android::register_android_database_SQLiteDebug(env);
   android::register_android_database_SQLiteGlobal(env);
   android::register_android_database_CursorWindow(env);
   android::register_android_database_SQLiteFunction(env);
+  android::register_android_database_SQLiteBlob(env);
+  android::register_android_database_SQLiteGroupCommit(env);
+  android::register_android_database_SQLiteCheckpointer(env);
 
   return JNI_VERSION_1_4;
 }
@@ -21,6 +21,7 @@
 #include "JNIHelp.h"
 #include "ALog-priv.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,8 +29,23 @@
 
 #include <sqlite3.h>
 
+#include "CompressedVfs.h"
+#include "IoStatsVfs.h"
+#include "IoUringVfs.h"
+#include "MemoryGovernor.h"
+#include "MmapVfs.h"
+#include "PoolAllocator.h"
+#include "ReadaheadVfs.h"
+
+#include <string>
+#include <vector>
+
 namespace android {
 
+static struct {
+    jclass clazz;
+} gStringClassInfo;
+
 static struct {
     jfieldID memoryUsed;
     jfieldID pageCacheOverflow;
@@ -52,6 +68,112 @@ static void nativeGetPagerStats(JNIEnv *env, jobject clazz, jobject statsObj)
     env->SetIntField(statsObj, gSQLiteDebugPagerStatsClassInfo.largestMemAlloc, largestMemAlloc);
 }
 
+static void nativeGetAllocatorStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the ALLOCATOR_* indices in SQLiteDebug.java.
+    int64_t stats[PoolAllocator::STAT_COUNT];
+    PoolAllocator::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, PoolAllocator::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static void nativeGetMemoryGovernorStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the MEMORY_* indices in SQLiteDebug.java.
+    int64_t stats[MemoryGovernor::STAT_COUNT];
+    MemoryGovernor::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, MemoryGovernor::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static void nativeGetMmapStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the MMAP_* indices in SQLiteDebug.java.
+    int64_t stats[MmapVfs::STAT_COUNT];
+    MmapVfs::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, MmapVfs::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static void nativeGetReadaheadStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the READAHEAD_* indices in SQLiteDebug.java.
+    int64_t stats[ReadaheadVfs::STAT_COUNT];
+    ReadaheadVfs::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, ReadaheadVfs::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static void nativeGetIoUringStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the IO_URING_* indices in SQLiteDebug.java.
+    int64_t stats[IoUringVfs::STAT_COUNT];
+    IoUringVfs::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, IoUringVfs::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static jboolean nativeEvictFileCache(JNIEnv *env, jobject clazz, jstring pathStr)
+{
+    const char* path = env->GetStringUTFChars(pathStr, NULL);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    env->ReleaseStringUTFChars(pathStr, path);
+    if (fd < 0) {
+        return false;
+    }
+    // Dirty pages are not evicted, so write them out first.
+    bool evicted = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+}
+
+static jobjectArray nativeGetIoStatsDatabases(JNIEnv *env, jobject clazz)
+{
+    std::vector<std::string> paths = IoStatsVfs::getDatabases();
+    jobjectArray array = env->NewObjectArray(jsize(paths.size()), gStringClassInfo.clazz, NULL);
+    if (!array) {
+        return NULL;
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        jstring path = env->NewStringUTF(paths[i].c_str());
+        if (!path) {
+            return NULL;
+        }
+        env->SetObjectArrayElement(array, jsize(i), path);
+        env->DeleteLocalRef(path);
+    }
+    return array;
+}
+
+static jboolean nativeGetIoStats(JNIEnv *env, jobject clazz, jstring pathStr,
+        jlongArray statsArray)
+{
+    // Order matches the IO_* indices in SQLiteDebug.java.
+    int64_t stats[IoStatsVfs::STAT_COUNT];
+    const char* path = env->GetStringUTFChars(pathStr, NULL);
+    bool found = IoStatsVfs::getStats(path, stats);
+    env->ReleaseStringUTFChars(pathStr, path);
+    if (found) {
+        env->SetLongArrayRegion(statsArray, 0, IoStatsVfs::STAT_COUNT,
+                reinterpret_cast<const jlong*>(stats));
+    }
+    return found;
+}
+
+static void nativeResetIoStats(JNIEnv *env, jobject clazz)
+{
+    IoStatsVfs::reset();
+}
+
+static void nativeGetCompressedVfsStats(JNIEnv *env, jobject clazz, jlongArray statsArray)
+{
+    // Order matches the COMPRESSED_* indices in SQLiteDebug.java.
+    int64_t stats[CompressedVfs::STAT_COUNT];
+    CompressedVfs::getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, CompressedVfs::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
 /*
  * JNI registration.
  */
@@ -60,11 +182,34 @@ static JNINativeMethod gMethods[] =
 {
     { "nativeGetPagerStats", "(Lio/requery/android/database/sqlite/SQLiteDebug$PagerStats;)V",
             (void*) nativeGetPagerStats },
+    { "nativeGetAllocatorStats", "([J)V",
+            (void*) nativeGetAllocatorStats },
+    { "nativeGetMemoryGovernorStats", "([J)V",
+            (void*) nativeGetMemoryGovernorStats },
+    { "nativeGetMmapStats", "([J)V",
+            (void*) nativeGetMmapStats },
+    { "nativeGetReadaheadStats", "([J)V",
+            (void*) nativeGetReadaheadStats },
+    { "nativeGetIoUringStats", "([J)V",
+            (void*) nativeGetIoUringStats },
+    { "nativeEvictFileCache", "(Ljava/lang/String;)Z",
+            (void*) nativeEvictFileCache },
+    { "nativeGetIoStatsDatabases", "()[Ljava/lang/String;",
+            (void*) nativeGetIoStatsDatabases },
+    { "nativeGetIoStats", "(Ljava/lang/String;[J)Z",
+            (void*) nativeGetIoStats },
+    { "nativeResetIoStats", "()V",
+            (void*) nativeResetIoStats },
+    { "nativeGetCompressedVfsStats", "([J)V",
+            (void*) nativeGetCompressedVfsStats },
 };
 
 int register_android_database_SQLiteDebug(JNIEnv *env)
 {
     jclass clazz;
+    FIND_CLASS(clazz, "java/lang/String");
+    gStringClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+
     FIND_CLASS(clazz, "io/requery/android/database/sqlite/SQLiteDebug$PagerStats");
 
     GET_FIELD_ID(gSQLiteDebugPagerStatsClassInfo.memoryUsed, clazz,
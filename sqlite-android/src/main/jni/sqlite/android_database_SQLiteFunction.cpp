@@ -105,6 +105,13 @@ static jint nativeGetArgInt(JNIEnv* env, jclass clazz, jlong argsPtr,
     return value ? sqlite3_value_int(value) : 0;
 }
 
+// Formats a double the way SQLite converts REAL values to text.
+static jstring nativeFormatDouble(JNIEnv* env, jclass clazz, jdouble value) {
+    char buffer[32];
+    sqlite3_snprintf(sizeof(buffer), buffer, "%!.15g", value);
+    return env->NewStringUTF(buffer);
+}
+
 /*
  * Setters
  */
@@ -138,15 +145,17 @@ static void nativeSetResultString(JNIEnv* env, jclass clazz,
         return;
     }
 
-    const char* chars = env->GetStringUTFChars(result, NULL);
+    // Modified UTF-8 would mangle supplementary characters and embedded NULs.
+    jsize len = env->GetStringLength(result);
+    const jchar* chars = env->GetStringChars(result, NULL);
     if (!chars) {
-        ALOGE("result value can't be transferred to UTFChars");
+        ALOGE("result value can't be transferred to chars");
         sqlite3_result_error_nomem(context);
         return;
     }
 
-    sqlite3_result_text(context, chars, -1, SQLITE_TRANSIENT);
-    env->ReleaseStringUTFChars(result, chars);
+    sqlite3_result_text16(context, chars, len * sizeof(jchar), SQLITE_TRANSIENT);
+    env->ReleaseStringChars(result, chars);
 }
 
 static void nativeSetResultLong(JNIEnv* env, jclass clazz,
@@ -205,6 +214,8 @@ static const JNINativeMethod sMethods[] =
             (void*)nativeGetArgDouble },
     { "nativeGetArgInt", "(JI)I",
             (void*)nativeGetArgInt },
+    { "nativeFormatDouble", "(D)Ljava/lang/String;",
+            (void*)nativeFormatDouble },
 
     { "nativeSetResultBlob", "(J[B)V",
             (void*)nativeSetResultBlob },
@@ -21,18 +21,26 @@
 #include <JNIHelp.h>
 #include "ALog-priv.h"
 
+#include <stdlib.h>
+
 #include <sqlite3.h>
 //#include <sqlite3_android.h>
 
 #include "android_database_SQLiteCommon.h"
+#include "CompressedVfs.h"
+#include "IoStatsVfs.h"
+#include "IoUringVfs.h"
+#include "MemoryGovernor.h"
+#include "MmapVfs.h"
+#include "PoolAllocator.h"
+#include "ReadaheadVfs.h"
+#include "ZipVfs.h"
 
 namespace android {
 
-// Limit heap to 8MB for now.  This is 4 times the maximum cursor window
-// size, as has been used by the original code in SQLiteDatabase for
-// a long time.
-static const int SOFT_HEAP_LIMIT = 8 * 1024 * 1024;
-
+// The page cache arena given to SQLITE_CONFIG_PAGECACHE, or NULL if pages are allocated
+// from the heap. It is only freed once SQLite has been shut down.
+static void* gPageCacheArena;
 
 // Called each time a message is logged.
 static void sqliteLogCallback(void* data, int iErrCode, const char* zMsg) {
@@ -49,6 +57,10 @@ static void sqliteLogCallback(void* data, int iErrCode, const char* zMsg) {
 // Sets the global SQLite configuration.
 // This must be called before any other SQLite functions are called.
 static void sqliteInitialize() {
+    // Route allocations through the pool allocator, which passes them to malloc until
+    // pooling is enabled but counts them either way.
+    PoolAllocator::install();
+
     // Enable multi-threaded mode.  In this mode, SQLite is safe to use by multiple
     // threads as long as no two threads use the same database connection at the same
     // time (which we guarantee in the SQLite database wrappers).
@@ -63,15 +75,111 @@ static void sqliteInitialize() {
 
     // The soft heap limit prevents the page cache allocations from growing
     // beyond the given limit, no matter what the max page cache sizes are
-    // set to. The limit does not, as of 3.5.0, affect any other allocations.
-    sqlite3_soft_heap_limit(SOFT_HEAP_LIMIT);
+    // set to. The pool allocator enforces it, and the memory governor lowers it
+    // under memory pressure.
+    MemoryGovernor::applyHeapLimits();
 
     // Initialize SQLite.
     sqlite3_initialize();
+
+    // Reads go through the io_uring VFS once it is enabled and through the readahead VFS
+    // on top of it, memory-mapped I/O through the budget of the mmap VFS on top of that,
+    // and all I/O through the counters of the I/O statistics VFS at the top. The
+    // compressed and ZIP VFSes are only used by the databases that ask for them.
+    IoUringVfs::install();
+    ReadaheadVfs::install();
+    MmapVfs::install();
+    IoStatsVfs::install();
+    CompressedVfs::install();
+    ZipVfs::install();
+}
+
+// Reconfigures the memory of SQLite, which requires shutting it down. This must only be
+// called while no database connections are open.
+static void nativeConfigureMemory(JNIEnv* env, jclass clazz, jint pageSize, jint pageCount,
+        jint lookasideSlotSize, jint lookasideSlotCount) {
+    int err = sqlite3_shutdown();
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not shut down SQLite");
+        return;
+    }
+
+    if (lookasideSlotSize >= 0 && lookasideSlotCount >= 0) {
+        err = sqlite3_config(SQLITE_CONFIG_LOOKASIDE, lookasideSlotSize, lookasideSlotCount);
+    }
+
+    // Each page cache slot holds a page and the header of the page cache.
+    void* arena = NULL;
+    int slotSize = 0;
+    if (err == SQLITE_OK && pageCount > 0) {
+        int headerSize = 0;
+        sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &headerSize);
+        slotSize = (pageSize + headerSize + 7) & ~7;
+        arena = malloc(size_t(slotSize) * size_t(pageCount));
+        if (!arena) {
+            err = SQLITE_NOMEM;
+        }
+    }
+    if (err == SQLITE_OK) {
+        err = sqlite3_config(SQLITE_CONFIG_PAGECACHE, arena, slotSize, arena ? pageCount : 0);
+    }
+    if (err == SQLITE_OK) {
+        // The previous arena is no longer used after the shut down.
+        free(gPageCacheArena);
+        gPageCacheArena = arena;
+    } else {
+        ALOGE("Could not configure SQLite memory: %d", err);
+        free(arena);
+    }
+
+    sqlite3_initialize();
+    IoUringVfs::install();
+    ReadaheadVfs::install();
+    MmapVfs::install();
+    IoStatsVfs::install();
+    CompressedVfs::install();
+    ZipVfs::install();
+
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception_errcode(env, err, "Could not configure SQLite memory");
+    }
+}
+
+static void nativeSetPoolAllocatorEnabled(JNIEnv* env, jclass clazz, jboolean enabled) {
+    PoolAllocator::setPooling(enabled);
 }
 
 static jint nativeReleaseMemory(JNIEnv* env, jclass clazz) {
-    return sqlite3_release_memory(SOFT_HEAP_LIMIT);
+    return MemoryGovernor::releaseMemory();
+}
+
+static void nativeSetMemoryPolicy(JNIEnv* env, jclass clazz, jlong softHeapLimit,
+        jlong hardHeapLimit, jint maxCacheSizeKiB, jint minCacheSizeKiB) {
+    MemoryGovernor::setPolicy(softHeapLimit, hardHeapLimit, maxCacheSizeKiB, minCacheSizeKiB);
+}
+
+static jint nativeOnMemoryPressure(JNIEnv* env, jclass clazz, jint level) {
+    return MemoryGovernor::onPressure(level);
+}
+
+static void nativeSetMmapBudget(JNIEnv* env, jclass clazz, jlong bytes) {
+    MmapVfs::setBudget(bytes);
+}
+
+static void nativeSetReadaheadSize(JNIEnv* env, jclass clazz, jint bytes) {
+    ReadaheadVfs::setReadaheadSize(bytes);
+}
+
+static jboolean nativeSetIoUringEnabled(JNIEnv* env, jclass clazz, jboolean enabled) {
+    return IoUringVfs::setEnabled(enabled);
+}
+
+static void nativeSetIoStatsEnabled(JNIEnv* env, jclass clazz, jboolean enabled) {
+    IoStatsVfs::setEnabled(enabled);
+}
+
+static void nativeSetCompressedCacheSize(JNIEnv* env, jclass clazz, jlong bytes) {
+    CompressedVfs::setCacheSize(bytes);
 }
 
 static JNINativeMethod sMethods[] =
@@ -79,6 +187,24 @@ static JNINativeMethod sMethods[] =
     /* name, signature, funcPtr */
     { "nativeReleaseMemory", "()I",
             (void*)nativeReleaseMemory },
+    { "nativeConfigureMemory", "(IIII)V",
+            (void*)nativeConfigureMemory },
+    { "nativeSetPoolAllocatorEnabled", "(Z)V",
+            (void*)nativeSetPoolAllocatorEnabled },
+    { "nativeSetMemoryPolicy", "(JJII)V",
+            (void*)nativeSetMemoryPolicy },
+    { "nativeOnMemoryPressure", "(I)I",
+            (void*)nativeOnMemoryPressure },
+    { "nativeSetMmapBudget", "(J)V",
+            (void*)nativeSetMmapBudget },
+    { "nativeSetReadaheadSize", "(I)V",
+            (void*)nativeSetReadaheadSize },
+    { "nativeSetIoUringEnabled", "(Z)Z",
+            (void*)nativeSetIoUringEnabled },
+    { "nativeSetIoStatsEnabled", "(Z)V",
+            (void*)nativeSetIoStatsEnabled },
+    { "nativeSetCompressedCacheSize", "(J)V",
+            (void*)nativeSetCompressedCacheSize },
 };
 
 int register_android_database_SQLiteGlobal(JNIEnv *env)
@@ -0,0 +1,180 @@
+#define LOG_TAG "SQLiteGroupCommit"
+
+#include <jni.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+#include "JNIHelp.h"
+#include "ALog-priv.h"
+#include "android_database_SQLiteCommon.h"
+#include "GroupCommitter.h"
+
+#include <string>
+
+namespace android {
+
+static struct {
+    jclass clazz;
+    jmethodID longValue;
+} gLongClassInfo;
+
+static struct {
+    jclass clazz;
+    jmethodID doubleValue;
+} gDoubleClassInfo;
+
+static struct {
+    jclass clazz;
+} gStringClassInfo;
+
+static struct {
+    jclass clazz;
+} gByteArrayClassInfo;
+
+static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jstring vfsNameStr,
+        jstring syncModeStr, jboolean foreignKeys, jstring localeStr, jint maxBatchSize,
+        jlong maxLatencyMicros) {
+    const char* path = env->GetStringUTFChars(pathStr, NULL);
+    const char* vfsName = vfsNameStr ? env->GetStringUTFChars(vfsNameStr, NULL) : NULL;
+    const char* syncMode = env->GetStringUTFChars(syncModeStr, NULL);
+    const char* locale = env->GetStringUTFChars(localeStr, NULL);
+    int err;
+    std::string message;
+    GroupCommitter* committer = GroupCommitter::open(path, vfsName, syncMode, foreignKeys,
+            locale, maxBatchSize, maxLatencyMicros, &err, &message);
+    env->ReleaseStringUTFChars(localeStr, locale);
+    env->ReleaseStringUTFChars(syncModeStr, syncMode);
+    if (vfsName) {
+        env->ReleaseStringUTFChars(vfsNameStr, vfsName);
+    }
+    env->ReleaseStringUTFChars(pathStr, path);
+
+    if (!committer) {
+        throw_sqlite3_exception(env, err, message.c_str(), "Could not open group commit");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(committer);
+}
+
+static void nativeClose(JNIEnv* env, jclass clazz, jlong committerPtr) {
+    GroupCommitter* committer = reinterpret_cast<GroupCommitter*>(committerPtr);
+    committer->close();
+}
+
+static void nativeDestroy(JNIEnv* env, jclass clazz, jlong committerPtr) {
+    GroupCommitter* committer = reinterpret_cast<GroupCommitter*>(committerPtr);
+    delete committer;
+}
+
+static void copyChars(JNIEnv* env, jstring str, std::string& out) {
+    const jchar* chars = env->GetStringChars(str, NULL);
+    out.assign(reinterpret_cast<const char*>(chars), env->GetStringLength(str) * sizeof(jchar));
+    env->ReleaseStringChars(str, chars);
+}
+
+/* Copies the arguments, which SQLiteGroupCommit has converted to Long, Double, String or
+ * byte[]. */
+static bool copyArgs(JNIEnv* env, jobjectArray argsArray,
+        std::vector<GroupCommitter::Value>& args) {
+    jsize count = argsArray ? env->GetArrayLength(argsArray) : 0;
+    args.resize(count);
+    for (jsize i = 0; i < count; i++) {
+        GroupCommitter::Value& value = args[i];
+        jobject arg = env->GetObjectArrayElement(argsArray, i);
+        if (!arg) {
+            value.type = SQLITE_NULL;
+        } else if (env->IsInstanceOf(arg, gLongClassInfo.clazz)) {
+            value.type = SQLITE_INTEGER;
+            value.integer = env->CallLongMethod(arg, gLongClassInfo.longValue);
+        } else if (env->IsInstanceOf(arg, gDoubleClassInfo.clazz)) {
+            value.type = SQLITE_FLOAT;
+            value.real = env->CallDoubleMethod(arg, gDoubleClassInfo.doubleValue);
+        } else if (env->IsInstanceOf(arg, gStringClassInfo.clazz)) {
+            value.type = SQLITE_TEXT;
+            copyChars(env, jstring(arg), value.bytes);
+        } else if (env->IsInstanceOf(arg, gByteArrayClassInfo.clazz)) {
+            jbyteArray bytes = jbyteArray(arg);
+            value.type = SQLITE_BLOB;
+            value.bytes.resize(env->GetArrayLength(bytes));
+            env->GetByteArrayRegion(bytes, 0, jsize(value.bytes.size()),
+                    reinterpret_cast<jbyte*>(&value.bytes[0]));
+        } else {
+            env->DeleteLocalRef(arg);
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                    "Unsupported argument type");
+            return false;
+        }
+        env->DeleteLocalRef(arg);
+    }
+    return true;
+}
+
+static void nativeExecute(JNIEnv* env, jclass clazz, jlong committerPtr, jstring sqlString,
+        jobjectArray argsArray, jlongArray resultArray) {
+    GroupCommitter* committer = reinterpret_cast<GroupCommitter*>(committerPtr);
+
+    GroupCommitter::Operation operation;
+    copyChars(env, sqlString, operation.sql);
+    if (!copyArgs(env, argsArray, operation.args)) {
+        return;
+    }
+
+    int err = committer->execute(&operation);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(env, err, operation.message.c_str(), NULL);
+        return;
+    }
+    // Order matches the RESULT_* indices in SQLiteGroupCommit.java.
+    jlong result[2] = { operation.changes, operation.lastInsertRowId };
+    env->SetLongArrayRegion(resultArray, 0, 2, result);
+}
+
+static void nativeGetStats(JNIEnv* env, jclass clazz, jlong committerPtr,
+        jlongArray statsArray) {
+    GroupCommitter* committer = reinterpret_cast<GroupCommitter*>(committerPtr);
+
+    // Order matches the STAT_* indices in SQLiteGroupCommit.java.
+    int64_t stats[GroupCommitter::STAT_COUNT];
+    committer->getStats(stats);
+    env->SetLongArrayRegion(statsArray, 0, GroupCommitter::STAT_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
+static JNINativeMethod sMethods[] =
+{
+    /* name, signature, funcPtr */
+    { "nativeOpen",
+            "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZLjava/lang/String;IJ)J",
+            (void*)nativeOpen },
+    { "nativeClose", "(J)V",
+            (void*)nativeClose },
+    { "nativeDestroy", "(J)V",
+            (void*)nativeDestroy },
+    { "nativeExecute", "(JLjava/lang/String;[Ljava/lang/Object;[J)V",
+            (void*)nativeExecute },
+    { "nativeGetStats", "(J[J)V",
+            (void*)nativeGetStats },
+};
+
+int register_android_database_SQLiteGroupCommit(JNIEnv* env)
+{
+    jclass clazz;
+    FIND_CLASS(clazz, "java/lang/Long");
+    gLongClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+    GET_METHOD_ID(gLongClassInfo.longValue, clazz, "longValue", "()J");
+
+    FIND_CLASS(clazz, "java/lang/Double");
+    gDoubleClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+    GET_METHOD_ID(gDoubleClassInfo.doubleValue, clazz, "doubleValue", "()D");
+
+    FIND_CLASS(clazz, "java/lang/String");
+    gStringClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+
+    FIND_CLASS(clazz, "[B");
+    gByteArrayClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
+
+    return jniRegisterNativeMethods(env,
+        "io/requery/android/database/sqlite/SQLiteGroupCommit", sMethods, NELEM(sMethods));
+}
+
+} // namespace android